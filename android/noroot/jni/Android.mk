@@ -41,12 +41,17 @@ LOCAL_SRC_FILES = \
 		  liblisp/lisp_messages.c        \
 		  liblisp/lisp_message_fields.c  \
 		  lib/cksum.c                    \
+		  lib/crc32c.c                   \
+		  lib/epoch.c                    \
+		  lib/fwd_gen.c                  \
+		  lib/fwd_pub.c                  \
 		  lib/generic_list.c             \
 		  lib/hmac.c                     \
 		  lib/iface_locators.c           \
 		  lib/int_table.c                \
 		  lib/lbuf.c                     \
 		  lib/lisp_site.c                \
+		  lib/lpm.c                      \
 		  lib/oor_log.c                  \
 		  lib/mapping_db.c               \
 		  lib/map_cache_entry.c          \
@@ -54,6 +59,8 @@ LOCAL_SRC_FILES = \
 		  lib/mem_util.c	    	     \
           lib/nonces_table.c             \
           lib/packets.c                  \
+		  lib/pcache.c                   \
+		  lib/pendq.c                    \
           lib/pointers_table.c           \
 		  lib/prefixes.c                 \
 		  lib/routing_tables_lib.c       \
@@ -20,8 +20,10 @@ config/oor_config_confuse.c    \
 		  control/control-data-plane/tun/cdp_tun.c           \
 		  data-plane/data-plane.c        \
 		  data-plane/encapsulations/vxlan-gpe.c              \
+		  data-plane/pkt_mmap/pkt_mmap.c \
 		  data-plane/tun/tun.c           \
 		  data-plane/tun/tun_input.c     \
+		  data-plane/tun/tun_offload.c   \
 		  data-plane/tun/tun_output.c    \
 		  elibs/mbedtls/md.c             \
 		  elibs/mbedtls/sha1.c           \
@@ -41,12 +43,17 @@ config/oor_config_confuse.c    \
 		  liblisp/lisp_messages.c        \
 		  liblisp/lisp_message_fields.c  \
 		  lib/cksum.c                    \
+		  lib/crc32c.c                   \
+		  lib/epoch.c                    \
+		  lib/fwd_gen.c                  \
+		  lib/fwd_pub.c                  \
 		  lib/generic_list.c             \
 		  lib/hmac.c                     \
 		  lib/iface_locators.c           \
 		  lib/int_table.c                \
 		  lib/lbuf.c                     \
 		  lib/lisp_site.c                \
+		  lib/lpm.c                      \
 		  lib/oor_log.c                  \
 		  lib/mapping_db.c               \
 		  lib/map_cache_entry.c          \
@@ -54,6 +61,8 @@ config/oor_config_confuse.c    \
           lib/mem_util.c	    	     \
           lib/nonces_table.c             \
           lib/packets.c                  \
+		  lib/pcache.c                   \
+		  lib/pendq.c                    \
           lib/pointers_table.c           \
 		  lib/prefixes.c                 \
 		  lib/routing_tables_lib.c       \
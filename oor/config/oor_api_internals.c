@@ -941,6 +941,8 @@ oor_api_xtr_petrs_create(oor_api_connection_t *conn, oor_api_msg_hdr_t *hdr,
 
     xtr->fwd_policy->updated_map_cache_inf(xtr->fwd_policy_dev_parm,xtr->petrs);
 
+    fwd_gen_bump(xtr->petrs->gen_idx);
+
     OOR_LOG(LDBG_1, "OOR_API: List of Proxy ETRs successfully created");
     OOR_LOG(LDBG_1, "************************* Proxy ETRs List ****************************");
     mapping_to_char(mcache_entry_mapping(xtr->petrs));
@@ -983,6 +985,83 @@ oor_api_xtr_petrs_delete(oor_api_connection_t *conn, oor_api_msg_hdr_t *hdr,
     return (GOOD);
 }
 
+/*
+ * Reply with the size of the map cache, its limits and the bytes of each
+ * entry as XML:
+ *   <map-cache entries="" bytes="" max-entries="" max-bytes="" evictions=""
+ *       first="" [next=""]>
+ *     <entry eid="" type="" active="" bytes=""/>
+ *   </map-cache>
+ * The reply is limited to MAX_API_PKT_LEN. The request may contain the index
+ * (uint32_t) of the first entry to list. When not all the entries fit, next
+ * is the index of the first one not listed
+ */
+int
+oor_api_xtr_mapcache_read(oor_api_connection_t *conn, oor_api_msg_hdr_t *hdr,
+        uint8_t *data)
+{
+    lisp_xtr_t *xtr;
+    map_cache_db_t *mcdb;
+    mcache_entry_t *mce;
+    oor_api_msg_hdr_t res_hdr;
+    uint8_t *result_msg, *ptr;
+    char *entries, head[256], entry[256];
+    uint32_t first = 0, idx = 0, next = 0;
+    int len, entries_len = 0, max_len;
+    void *it;
+
+    OOR_LOG(LDBG_2, "OOR_API: Reading map cache");
+
+    xtr = CONTAINER_OF(ctrl_dev, lisp_xtr_t, super);
+    mcdb = xtr->map_cache;
+    if (hdr->datalen >= sizeof(uint32_t)){
+        memcpy(&first, data, sizeof(uint32_t));
+    }
+
+    /* Room left for the entries after the header and the map-cache tags */
+    max_len = MAX_API_PKT_LEN - sizeof(oor_api_msg_hdr_t) - sizeof(head) - 16;
+    entries = xzalloc(MAX_API_PKT_LEN);
+    mcache_foreach_entry(mcdb, it) {
+        mce = (mcache_entry_t *)it;
+        if (idx++ < first || next){
+            continue;
+        }
+        len = snprintf(entry, sizeof(entry),
+                "<entry eid=\"%s\" type=\"%s\" active=\"%s\" bytes=\"%u\"/>",
+                lisp_addr_to_char(mapping_eid(mcache_entry_mapping(mce))),
+                mce->how_learned == MCE_STATIC ? "static" : "dynamic",
+                mce->active == ACTIVE ? "yes" : "no", mce->bytes);
+        if (len >= (int)sizeof(entry) || entries_len + len > max_len){
+            next = idx - 1;
+            continue;
+        }
+        memcpy(entries + entries_len, entry, len);
+        entries_len += len;
+    } mcache_foreach_end;
+
+    len = snprintf(head, sizeof(head), "<map-cache entries=\"%u\" bytes=\"%lu\" "
+            "max-entries=\"%u\" max-bytes=\"%lu\" evictions=\"%llu\" first=\"%u\"",
+            mcdb->entries, (unsigned long)mcdb->bytes, mcdb->max_entries,
+            (unsigned long)mcdb->max_bytes, (unsigned long long)mcdb->evictions, first);
+    if (next){
+        len += snprintf(head + len, sizeof(head) - len, " next=\"%u\"", next);
+    }
+    len += snprintf(head + len, sizeof(head) - len, ">");
+
+    oor_api_fill_hdr(&res_hdr, hdr->device, hdr->target, hdr->operation,
+            OOR_API_TYPE_RESULT, len + entries_len + strlen("</map-cache>"));
+    result_msg = xzalloc(sizeof(oor_api_msg_hdr_t) + res_hdr.datalen + 1);
+    ptr = oor_api_hdr_push(result_msg, &res_hdr);
+    memcpy(ptr, head, len);
+    memcpy(ptr + len, entries, entries_len);
+    memcpy(ptr + len + entries_len, "</map-cache>", strlen("</map-cache>"));
+    oor_api_send(conn, result_msg, sizeof(oor_api_msg_hdr_t) + res_hdr.datalen,
+            OOR_API_NOFLAGS);
+
+    free(entries);
+    return (GOOD);
+}
+
 
 int
 (*oor_api_get_proc_func(oor_api_msg_hdr_t* hdr))(oor_api_connection_t *,
@@ -1063,6 +1142,17 @@ int
                 break;
             }
             break;
+        case OOR_API_TRGT_MAPCACHE:
+            switch (operation){
+            case OOR_API_OPR_READ:
+                OOR_LOG(LDBG_2, "OOR_API call = (Device: xTR | Target: Map cache | Operation: Read)");
+                process_func = oor_api_xtr_mapcache_read;
+                break;
+            default:
+                OOR_LOG(LWRN, "OOR_API call = (Device: xTR | Target: Map cache | Operation: Unsupported)");
+                break;
+            }
+            break;
         default:
         	OOR_LOG(LWRN, "OOR_API call = (Device: xTR | Target: Unsupported)");
             break;
@@ -1089,6 +1179,17 @@ int
                 break;
             }
             break;
+        case OOR_API_TRGT_MAPCACHE:
+            switch (operation){
+            case OOR_API_OPR_READ:
+                OOR_LOG(LDBG_2, "OOR_API call = (Device: RTR | Target: Map cache | Operation: Read)");
+                process_func = oor_api_xtr_mapcache_read;
+                break;
+            default:
+                OOR_LOG(LWRN, "OOR_API call = (Device: RTR | Target: Map cache | Operation: Unsupported)");
+                break;
+            }
+            break;
         default:
             OOR_LOG(LWRN, "OOR_API call = (Device: RTR | Target: Unsupported)");
             break;
@@ -343,9 +343,11 @@ parse_database_mapping(cfg_t *cfg, lisp_xtr_t *xtr, shash_t *lcaf_ht)
 int
 configure_tunnel_router(cfg_t *cfg, lisp_xtr_t *xtr, shash_t *lcaf_ht)
 {
-    int i,n,ret;
+    int i,n,ret,max_mem;
     char *map_resolver;
     char *encap;
+    char *input_mode;
+    char *backend;
     mapping_t *mapping;
 
     /* FWD POLICY STRUCTURES */
@@ -367,6 +369,173 @@ configure_tunnel_router(cfg_t *cfg, lisp_xtr_t *xtr, shash_t *lcaf_ht)
     ret = cfg_getint(cfg, "map-request-retries");
     xtr->map_request_retries = (ret != 0) ? ret : DEFAULT_MAP_REQUEST_RETRIES;
 
+    /* MAP CACHE REFRESH */
+    ret = cfg_getint(cfg, "map-cache-refresh-lead");
+    if (ret < 0){
+        OOR_LOG(LWRN, "Configuration file: map-cache-refresh-lead can't be negative. "
+                "Using %d", DEFAULT_MCACHE_REFRESH_LEAD);
+        ret = DEFAULT_MCACHE_REFRESH_LEAD;
+    }
+    xtr->mcache_refresh_lead = ret;
+    ret = cfg_getint(cfg, "map-cache-refresh-min-packets");
+    if (ret < 0){
+        OOR_LOG(LWRN, "Configuration file: map-cache-refresh-min-packets can't be "
+                "negative. Using %d", DEFAULT_MCACHE_REFRESH_MIN_PKTS);
+        ret = DEFAULT_MCACHE_REFRESH_MIN_PKTS;
+    }
+    xtr->mcache_refresh_min_pkts = ret;
+
+    /* MAP CACHE SIZE */
+    ret = cfg_getint(cfg, "map-cache-max-entries");
+    max_mem = cfg_getint(cfg, "map-cache-max-memory");
+    if (ret < 0 || max_mem < 0){
+        OOR_LOG(LWRN, "Configuration file: map-cache-max-entries and "
+                "map-cache-max-memory can't be negative. Not limiting the map cache");
+        ret = max_mem = 0;
+    }
+    mcache_set_limits(xtr->map_cache, ret, (size_t)max_mem * 1024);
+    if (cfg_getbool(cfg, "map-cache-multibit")){
+        mcache_set_lpm(xtr->map_cache, MDB_LPM_MULTIBIT);
+    }
+
+    /* DATA PLANE BACKEND */
+    if ((backend = cfg_getstr(cfg, "data-backend")) != NULL) {
+        if (strcmp(backend, "tun") == 0) {
+            data_plane_conf.type = DATA_PLANE_TUN;
+        }else if (strcmp(backend, "packet-mmap") == 0){
+            data_plane_conf.type = DATA_PLANE_PACKET_MMAP;
+        }else{
+            OOR_LOG(LERR, "Unknown data plane backend: %s",backend);
+            return (BAD);
+        }
+        data_plane_select();
+    }
+
+    /* DATA PLANE BATCHING */
+    ret = cfg_getint(cfg, "data-rx-batch-size");
+    if (ret < 0 || ret > SOCK_MAX_BATCH){
+        OOR_LOG(LWRN, "Configuration file: data-rx-batch-size should be between "
+                "1 and %d. Using %d", SOCK_MAX_BATCH, DEFAULT_DATA_RX_BATCH);
+        ret = 0;
+    }
+    data_plane_conf.rx_batch_size = (ret != 0) ? ret : DEFAULT_DATA_RX_BATCH;
+    ret = cfg_getint(cfg, "data-tx-batch-size");
+    if (ret < 0 || ret > SOCK_MAX_BATCH){
+        OOR_LOG(LWRN, "Configuration file: data-tx-batch-size should be between "
+                "1 and %d. Using %d", SOCK_MAX_BATCH, DEFAULT_DATA_TX_BATCH);
+        ret = 0;
+    }
+    data_plane_conf.tx_batch_size = (ret != 0) ? ret : DEFAULT_DATA_TX_BATCH;
+
+    /* DATA PLANE THREADS */
+    ret = cfg_getint(cfg, "data-tun-queues");
+    if (ret < 0 || ret > MAX_TUN_QUEUES){
+        OOR_LOG(LWRN, "Configuration file: data-tun-queues should be between "
+                "1 and %d. Using 1", MAX_TUN_QUEUES);
+        ret = 0;
+    }
+    data_plane_conf.tun_queues = (ret != 0) ? ret : 1;
+
+    /* DATA INPUT SOCKETS */
+    if ((input_mode = cfg_getstr(cfg, "data-input-socket")) != NULL) {
+        if (strcmp(input_mode, "raw") == 0) {
+            data_plane_conf.input_mode = DATA_INPUT_RAW;
+        }else if (strcmp(input_mode, "filtered-raw") == 0){
+            data_plane_conf.input_mode = DATA_INPUT_FILTERED_RAW;
+        }else if (strcmp(input_mode, "datagram") == 0){
+            data_plane_conf.input_mode = DATA_INPUT_DATAGRAM;
+        }else{
+            OOR_LOG(LERR, "Unknown data input socket type: %s",input_mode);
+            return (BAD);
+        }
+    }
+
+    ret = cfg_getint(cfg, "data-rx-workers");
+    if (ret < 0 || ret > MAX_RX_WORKERS){
+        OOR_LOG(LWRN, "Configuration file: data-rx-workers should be between "
+                "0 and %d. Using 0", MAX_RX_WORKERS);
+        ret = 0;
+    }
+    data_plane_conf.rx_workers = ret;
+    data_plane_conf.rx_steering = cfg_getbool(cfg, "data-rx-steering") ? TRUE : FALSE;
+
+    /* DATA PLANE OFFLOAD */
+    data_plane_conf.offload = cfg_getbool(cfg, "data-offload") ? TRUE : FALSE;
+
+    /* OUTER UDP SOURCE PORTS */
+    n = cfg_getint(cfg, "data-src-port-min");
+    ret = cfg_getint(cfg, "data-src-port-max");
+    if (n != 0 || ret != 0){
+        if (n < 1 || ret > 65535 || n > ret){
+            OOR_LOG(LWRN, "Configuration file: Wrong data source port range "
+                    "%d-%d. Using %d-%d", n, ret, DEFAULT_DATA_SRC_PORT_MIN,
+                    DEFAULT_DATA_SRC_PORT_MAX);
+        }else{
+            data_plane_conf.src_port_min = n;
+            data_plane_conf.src_port_max = ret;
+        }
+    }
+
+    /* FLOW TABLE */
+    ret = cfg_getint(cfg, "data-flow-table-size");
+    if (ret < 0 || ret > MAX_FLOW_TABLE_SIZE){
+        OOR_LOG(LWRN, "Configuration file: data-flow-table-size should be between "
+                "1 and %d. Using %d", MAX_FLOW_TABLE_SIZE, DEFAULT_FLOW_TABLE_SIZE);
+        ret = 0;
+    }
+    data_plane_conf.flow_table_size = (ret != 0) ? ret : DEFAULT_FLOW_TABLE_SIZE;
+    ret = cfg_getint(cfg, "data-flow-idle-timeout");
+    if (ret < 0){
+        OOR_LOG(LWRN, "Configuration file: data-flow-idle-timeout should be "
+                "positive. Using %d", DEFAULT_FLOW_IDLE_TIMEOUT);
+        ret = 0;
+    }
+    data_plane_conf.flow_idle_timeout = (ret != 0) ? ret : DEFAULT_FLOW_IDLE_TIMEOUT;
+    ret = cfg_getint(cfg, "data-prefix-cache-size");
+    if (ret < 0 || ret > MAX_PREFIX_CACHE_SIZE){
+        OOR_LOG(LWRN, "Configuration file: data-prefix-cache-size should be between "
+                "1 and %d. Using %d", MAX_PREFIX_CACHE_SIZE, DEFAULT_PREFIX_CACHE_SIZE);
+        ret = 0;
+    }
+    data_plane_conf.prefix_cache_size = (ret != 0) ? ret : DEFAULT_PREFIX_CACHE_SIZE;
+
+    /* PACKETS WAITING FOR A MAPPING */
+    ret = cfg_getint(cfg, "data-pending-pkts");
+    if (ret < 0){
+        OOR_LOG(LWRN, "Configuration file: data-pending-pkts should be positive "
+                "or 0. Using %d", DEFAULT_PENDING_PKTS);
+        ret = DEFAULT_PENDING_PKTS;
+    }
+    data_plane_conf.pending_pkts = ret;
+    ret = cfg_getint(cfg, "data-pending-bytes");
+    if (ret < 0){
+        OOR_LOG(LWRN, "Configuration file: data-pending-bytes should be "
+                "positive. Using %d", DEFAULT_PENDING_BYTES);
+        ret = 0;
+    }
+    data_plane_conf.pending_bytes = (ret != 0) ? ret : DEFAULT_PENDING_BYTES;
+    ret = cfg_getint(cfg, "data-pending-max-pkts");
+    if (ret < 0){
+        OOR_LOG(LWRN, "Configuration file: data-pending-max-pkts should be "
+                "positive. Using %d", DEFAULT_PENDING_MAX_PKTS);
+        ret = 0;
+    }
+    data_plane_conf.pending_max_pkts = (ret != 0) ? ret : DEFAULT_PENDING_MAX_PKTS;
+    ret = cfg_getint(cfg, "data-pending-max-bytes");
+    if (ret < 0){
+        OOR_LOG(LWRN, "Configuration file: data-pending-max-bytes should be "
+                "positive. Using %d", DEFAULT_PENDING_MAX_BYTES);
+        ret = 0;
+    }
+    data_plane_conf.pending_max_bytes = (ret != 0) ? ret : DEFAULT_PENDING_MAX_BYTES;
+    ret = cfg_getint(cfg, "data-pending-timeout");
+    if (ret < 0){
+        OOR_LOG(LWRN, "Configuration file: data-pending-timeout should be "
+                "positive. Using %d", DEFAULT_PENDING_TIMEOUT);
+        ret = 0;
+    }
+    data_plane_conf.pending_timeout = (ret != 0) ? ret : DEFAULT_PENDING_TIMEOUT;
+
 
     /* RLOC PROBING CONFIG */
     cfg_t *dm = cfg_getnsec(cfg, "rloc-probing", 0);
@@ -861,6 +1030,29 @@ handle_config_file()
             CFG_STR("encapsulation",        0,                      CFGF_NONE),
             CFG_SEC("rloc-probing",         rloc_probing_opts,      CFGF_MULTI),
             CFG_INT("map-request-retries",  0, CFGF_NONE),
+            CFG_INT("map-cache-refresh-lead", DEFAULT_MCACHE_REFRESH_LEAD, CFGF_NONE),
+            CFG_INT("map-cache-refresh-min-packets", DEFAULT_MCACHE_REFRESH_MIN_PKTS, CFGF_NONE),
+            CFG_INT("map-cache-max-entries",        0, CFGF_NONE),
+            CFG_INT("map-cache-max-memory",         0, CFGF_NONE),
+            CFG_BOOL("map-cache-multibit",          cfg_false, CFGF_NONE),
+            CFG_INT("data-rx-batch-size",   0, CFGF_NONE),
+            CFG_INT("data-tx-batch-size",   0, CFGF_NONE),
+            CFG_INT("data-tun-queues",      0, CFGF_NONE),
+            CFG_STR("data-backend",         0, CFGF_NONE),
+            CFG_STR("data-input-socket",    0, CFGF_NONE),
+            CFG_INT("data-rx-workers",      0, CFGF_NONE),
+            CFG_BOOL("data-rx-steering",    cfg_false, CFGF_NONE),
+            CFG_BOOL("data-offload",        cfg_false, CFGF_NONE),
+            CFG_INT("data-src-port-min",    0, CFGF_NONE),
+            CFG_INT("data-src-port-max",    0, CFGF_NONE),
+            CFG_INT("data-flow-table-size", 0, CFGF_NONE),
+            CFG_INT("data-flow-idle-timeout", 0, CFGF_NONE),
+            CFG_INT("data-prefix-cache-size", 0, CFGF_NONE),
+            CFG_INT("data-pending-pkts",    DEFAULT_PENDING_PKTS, CFGF_NONE),
+            CFG_INT("data-pending-bytes",   0, CFGF_NONE),
+            CFG_INT("data-pending-max-pkts", 0, CFGF_NONE),
+            CFG_INT("data-pending-max-bytes", 0, CFGF_NONE),
+            CFG_INT("data-pending-timeout", 0, CFGF_NONE),
             CFG_INT("control-port",         0, CFGF_NONE),
             CFG_INT("debug",                0, CFGF_NONE),
             CFG_STR("log-file",             0, CFGF_NONE),
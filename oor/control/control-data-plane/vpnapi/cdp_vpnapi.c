@@ -365,7 +365,8 @@ vpnapi_control_dp_reset_socket(vpnapi_ctr_dplane_data_t * data, int fd, int afi)
         return (BAD);
     }
 
-    sockmstr_register_read_listener(smaster,old_sock->recv_cb,old_sock->arg,new_fd);
+    sock_set_priority(sockmstr_register_read_listener(smaster,old_sock->recv_cb,
+            old_sock->arg,new_fd), old_sock->priority);
     sockmstr_unregister_read_listenedr(smaster,old_sock);
     /* Protect the socket from loops in the system*/
     oor_jni_protect_socket(new_fd);
@@ -190,6 +190,28 @@ lsite_entry_update_expiration_timer(lisp_ms_t *ms, lisp_reg_site_t *rsite)
             MS_SITE_EXPIRATION);
 }
 
+/* Largest prefix containing the EID that doesn't overlap with the configured
+ * sites nor with the registered ones. The negative Map-Reply for the EID
+ * covers it, so that the requester doesn't ask again for other addresses of
+ * the same range */
+static lisp_addr_t *
+ms_negative_eid(lisp_ms_t *ms, lisp_addr_t *eid)
+{
+    lisp_addr_t *neg_eid;
+    uint8_t plen, reg_plen;
+
+    plen = mdb_uncovered_plen(ms->lisp_sites_db, eid);
+    reg_plen = mdb_uncovered_plen(ms->reg_sites_db, eid);
+    if (reg_plen > plen){
+        plen = reg_plen;
+    }
+    neg_eid = lisp_addr_clone(eid);
+    lisp_addr_set_plen(neg_eid, plen);
+    pref_conv_to_netw_pref(neg_eid);
+
+    return (neg_eid);
+}
+
 static int
 ms_recv_map_request(lisp_ms_t *ms, lbuf_t *buf, uconn_t *uc)
 {
@@ -206,6 +228,7 @@ ms_recv_map_request(lisp_ms_t *ms, lbuf_t *buf, uconn_t *uc)
     lbuf_t  b;
     lisp_site_prefix_t *    site            = NULL;
     lisp_reg_site_t *       rsite           = NULL;
+    lisp_addr_t *   neg_eid     = NULL;
     uint8_t act_flag;
 
     /* local copy of the buf that can be modified */
@@ -248,21 +271,23 @@ ms_recv_map_request(lisp_ms_t *ms, lbuf_t *buf, uconn_t *uc)
         rsite = mdb_lookup_entry(ms->reg_sites_db, deid);
         /* Static entries will have null site and not null rsite */
         if (!site && !rsite) {
-            /* send negative map-reply with TTL 15 min */
-
+            /* send negative map-reply with TTL 15 min for the whole range
+             * of addresses without EIDs containing the requested one */
+            neg_eid = ms_negative_eid(ms, deid);
             if (lisp_addr_is_iid(deid)){
                 act_flag = ACT_NO_ACTION;
             }else{
                 act_flag = ACT_NATIVE_FWD;
             }
-            mrep = lisp_msg_neg_mrep_create(deid, 15, act_flag,A_AUTHORITATIVE,
+            mrep = lisp_msg_neg_mrep_create(neg_eid, 15, act_flag,A_AUTHORITATIVE,
                     MREQ_NONCE(mreq_hdr));
             OOR_LOG(LDBG_1,"The requested EID %s doesn't belong to this Map Server",
                     lisp_addr_to_char(deid));
             OOR_LOG(LDBG_2, "%s, EID: %s, NEGATIVE", lisp_msg_hdr_to_char(mrep),
-                    lisp_addr_to_char(deid));
+                    lisp_addr_to_char(neg_eid));
             send_msg(&ms->super, mrep, uc);
             lisp_msg_destroy(mrep);
+            lisp_addr_del(neg_eid);
             lisp_addr_del(deid);
 
             continue;
@@ -645,8 +670,8 @@ ms_ctrl_construct(oor_ctrl_dev_t *dev)
 {
     lisp_ms_t *ms = lisp_ms_cast(dev);
 
-    ms->reg_sites_db = mdb_new();
-    ms->lisp_sites_db = mdb_new();
+    ms->reg_sites_db = mdb_new(MDB_LPM_PATRICIA);
+    ms->lisp_sites_db = mdb_new(MDB_LPM_PATRICIA);
 
     if (!ms->reg_sites_db || !ms->lisp_sites_db) {
         return(BAD);
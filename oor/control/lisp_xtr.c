@@ -25,6 +25,8 @@
 #include "../lib/oor_log.h"
 #include "../lib/timers_utils.h"
 #include "../lib/util.h"
+#include "../data-plane/data-plane.h"
+#include "../oor_external.h"
 #include "lisp_xtr.h"
 
 static int mc_entry_expiration_timer_cb(oor_timer_t *t);
@@ -32,6 +34,8 @@ static void mc_entry_start_expiration_timer(lisp_xtr_t *, mcache_entry_t *);
 static int handle_locator_probe_reply(lisp_xtr_t *, mcache_entry_t *, lisp_addr_t *);
 static int update_mcache_entry(lisp_xtr_t *, mapping_t *);
 static int tr_recv_map_reply(lisp_xtr_t *, lbuf_t *, uconn_t *);
+static void tr_flush_pending(lisp_addr_t *eid, uint8_t send);
+static void tr_mcache_make_room(lisp_xtr_t *xtr, size_t bytes);
 static int tr_reply_to_smr(lisp_xtr_t *xtr, lisp_addr_t *src_eid, lisp_addr_t *req_eid);
 static int tr_recv_map_request(lisp_xtr_t *, lbuf_t *, uconn_t *);
 static int tr_recv_map_notify(lisp_xtr_t *, lbuf_t *);
@@ -71,6 +75,9 @@ static void proxy_etrs_dump(lisp_xtr_t *, int log_level);
 
 static fwd_info_t *tr_get_forwarding_entry(oor_ctrl_dev_t *,
         packet_tuple_t *);
+static fwd_prefix_t *tr_get_fwd_prefix(lisp_xtr_t *xtr,
+        map_local_entry_t *map_loc_e, mcache_entry_t *dst_mce,
+        mcache_entry_t *mce, uint32_t iid);
 
 glist_t *get_local_locators_with_address(local_map_db_t *local_db, lisp_addr_t *addr);
 map_local_entry_t *get_map_loc_ent_containing_loct_ptr(local_map_db_t *local_db,
@@ -127,18 +134,138 @@ mc_entry_expiration_timer_cb(oor_timer_t *timer)
     return(GOOD);
 }
 
+/* Seconds before the expiration of the entry to check if it is in use, or 0
+ * if it is not refreshed */
+static int
+mc_entry_refresh_lead(lisp_xtr_t *xtr, mcache_entry_t *mce)
+{
+    int ttl = mapping_ttl(mcache_entry_mapping(mce))*60;
+
+    if (xtr->mcache_refresh_lead <= 0 || mce->how_learned != MCE_DYNAMIC
+            || mce->active == NOT_ACTIVE || ttl < 2){
+        return (0);
+    }
+    /* Short lived entries are checked in the middle of their validity */
+    return (xtr->mcache_refresh_lead < ttl / 2 ? xtr->mcache_refresh_lead : ttl / 2);
+}
+
+/* Retries of the Map-Request refreshing an entry. If there is no reply, the
+ * entry expires as usual */
+static int
+mc_entry_refresh_map_request_cb(oor_timer_t *timer)
+{
+    timer_map_req_argument *timer_arg = (timer_map_req_argument *)oor_timer_cb_argument(timer);
+    nonces_list_t *nonces_list = oor_timer_nonces(timer);
+    lisp_xtr_t *xtr = oor_timer_owner(timer);
+    mcache_entry_t *mce = timer_arg->mce;
+    uint64_t nonce;
+    int retries = nonces_list_size(nonces_list);
+    int timeout;
+
+    if (retries - 1 < xtr->map_request_retries) {
+        nonce = nonce_new();
+        htable_nonces_insert(nonces_ht, nonce, nonces_list);
+        timeout = OOR_INITIAL_MRQ_TIMEOUT << retries;
+        oor_timer_start(timer, timeout < OOR_MAX_MRQ_TIMEOUT ? timeout : OOR_MAX_MRQ_TIMEOUT);
+        if (build_and_send_encap_map_request(xtr, timer_arg->src_eid, mce, nonce) != GOOD){
+            return (BAD);
+        }
+        xtr->mreq_stats.refreshes++;
+        return (GOOD);
+    }
+
+    OOR_LOG(LDBG_1, "No Map-Reply refreshing EID %s after %d retries. The entry "
+            "will expire", lisp_addr_to_char(mapping_eid(mcache_entry_mapping(mce))),
+            retries - 1);
+    mce->refreshing = FALSE;
+    stop_timer_from_obj(mce, timer, ptrs_to_timers_ht, nonces_ht);
+    return (BAD);
+}
+
+/* Request again the mapping of an entry in use. The entry is still used
+ * until the reply restarts its validity */
+static void
+mc_entry_refresh(lisp_xtr_t *xtr, mcache_entry_t *mce)
+{
+    lisp_addr_t *eid = mapping_eid(mcache_entry_mapping(mce));
+    lisp_addr_t *src_eid = mce->requester;
+    timer_map_req_argument *timer_arg;
+    oor_timer_t *timer;
+
+    if (!src_eid){
+        src_eid = local_map_db_get_main_eid(xtr->local_mdb, lisp_addr_ip_afi(eid));
+    }
+    if (!src_eid){
+        OOR_LOG(LDBG_1, "Couldn't refresh EID %s: No source EID available",
+                lisp_addr_to_char(eid));
+        return;
+    }
+    mce->refreshing = TRUE;
+
+    timer_arg = timer_map_req_arg_new_init(mce, src_eid);
+    timer = oor_timer_with_nonce_new(MAP_REQUEST_RETRY_TIMER, xtr,
+            mc_entry_refresh_map_request_cb, timer_arg,
+            (oor_timer_del_cb_arg_fn)timer_map_req_arg_free);
+    htable_ptrs_timers_add(ptrs_to_timers_ht, mce, timer);
+
+    mc_entry_refresh_map_request_cb(timer);
+}
+
+/* Called some time before an entry expires. If the data plane has used it
+ * enough during its validity, its mapping is requested again. The timer is
+ * then restarted to expire the entry if no reply arrives */
+static int
+mc_entry_refresh_timer_cb(oor_timer_t *timer)
+{
+    mcache_entry_t *mce = oor_timer_cb_argument(timer);
+    lisp_xtr_t *xtr = oor_timer_owner(timer);
+    lisp_addr_t *eid = mapping_eid(mcache_entry_mapping(mce));
+    uint32_t used = fwd_gen_uses(mce->gen_idx) - mce->uses;
+
+    /* Without the previous refresh, the packets since then would have
+     * started with a miss */
+    if (mce->refreshed && used > 0){
+        xtr->mreq_stats.misses_avoided++;
+    }
+    mce->refreshed = FALSE;
+
+    oor_timer_init(timer, xtr, mc_entry_expiration_timer_cb, mce, NULL, NULL);
+    oor_timer_start(timer, mc_entry_refresh_lead(xtr, mce));
+
+    if (used < (uint32_t)xtr->mcache_refresh_min_pkts){
+        OOR_LOG(LDBG_2, "Map cache entry of EID %s not in use (%u packets). "
+                "Letting it expire", lisp_addr_to_char(eid), used);
+        return (GOOD);
+    }
+    OOR_LOG(LDBG_1, "Map cache entry of EID %s about to expire still in use "
+            "(%u packets). Refreshing it", lisp_addr_to_char(eid), used);
+    mc_entry_refresh(xtr, mce);
+
+    return (GOOD);
+}
+
 static void
 mc_entry_start_expiration_timer(lisp_xtr_t *xtr, mcache_entry_t *mce)
 {
     /* Expiration cache timer */
     oor_timer_t *timer;
+    int ttl = mapping_ttl(mcache_entry_mapping(mce))*60;
+    int lead = mc_entry_refresh_lead(xtr, mce);
+
+    /* The new validity period replaces the previous one */
+    stop_timers_of_type_from_obj(mce, EXPIRE_MAP_CACHE_TIMER, ptrs_to_timers_ht, nonces_ht);
+    mce->uses = fwd_gen_uses(mce->gen_idx);
 
     timer = oor_timer_create(EXPIRE_MAP_CACHE_TIMER);
-    oor_timer_init(timer,xtr,mc_entry_expiration_timer_cb,mce,NULL,NULL);
+    if (lead > 0){
+        oor_timer_init(timer,xtr,mc_entry_refresh_timer_cb,mce,NULL,NULL);
+        oor_timer_start(timer, ttl - lead);
+    }else{
+        oor_timer_init(timer,xtr,mc_entry_expiration_timer_cb,mce,NULL,NULL);
+        oor_timer_start(timer, ttl);
+    }
     htable_ptrs_timers_add(ptrs_to_timers_ht, mce, timer);
 
-    oor_timer_start(timer, mapping_ttl(mcache_entry_mapping(mce))*60);
-
     OOR_LOG(LDBG_1,"The map cache entry of EID %s will expire in %d minutes.",
             lisp_addr_to_char(mapping_eid(mcache_entry_mapping(mce))),
             mapping_ttl(mcache_entry_mapping(mce)));
@@ -177,6 +304,7 @@ handle_locator_probe_reply(lisp_xtr_t *xtr, mcache_entry_t *mce,
 
         /* [re]Calculate forwarding info if status changed*/
         xtr->fwd_policy->updated_map_cache_inf(xtr->fwd_policy_dev_parm,mce);
+        fwd_gen_bump(mce->gen_idx);
     }
 
     /* Reprogramming timers of rloc probing */
@@ -210,9 +338,18 @@ update_mcache_entry(lisp_xtr_t *xtr, mapping_t *recv_map)
 
     /* DISCARD all locator state */
     mapping_update_locators(map, mapping_locators_lists(recv_map));
+    mapping_set_ttl(map, mapping_ttl(recv_map));
+
+    if (mce->refreshing){
+        mce->refreshing = FALSE;
+        mce->refreshed = TRUE;
+        xtr->mreq_stats.refreshed++;
+    }
 
     /* Update forwarding info */
     xtr->fwd_policy->updated_map_cache_inf(xtr->fwd_policy_dev_parm,mce);
+    fwd_gen_bump(mce->gen_idx);
+    mcache_entry_updated(xtr->map_cache, mce);
 
     /* Reprogramming timers */
     mc_entry_start_expiration_timer(xtr, mce);
@@ -223,6 +360,16 @@ update_mcache_entry(lisp_xtr_t *xtr, mapping_t *recv_map)
     return (GOOD);
 }
 
+/* Packets kept by the data plane while the mapping of the EID was requested
+ * are forwarded (send TRUE) or dropped */
+static void
+tr_flush_pending(lisp_addr_t *eid, uint8_t send)
+{
+    if (data_plane && data_plane->datap_flush_pending){
+        data_plane->datap_flush_pending(eid, send);
+    }
+}
+
 static int
 tr_recv_map_reply(lisp_xtr_t *xtr, lbuf_t *buf, uconn_t *udp_con)
 {
@@ -231,10 +378,11 @@ tr_recv_map_reply(lisp_xtr_t *xtr, lbuf_t *buf, uconn_t *udp_con)
     lisp_addr_t *probed_addr;
     mapping_t *m, *aux_m;
     lbuf_t b;
-    mcache_entry_t *mce;
+    mcache_entry_t *mce, *aux_mce;
     nonces_list_t *nonces_lst;
     oor_timer_t *timer;
     timer_map_req_argument *t_mr_arg;
+    lisp_addr_t *req_eid = NULL, *src_eid = NULL;
     int records,active_entry,i;
 
     /* local copy */
@@ -260,6 +408,13 @@ tr_recv_map_reply(lisp_xtr_t *xtr, lbuf_t *buf, uconn_t *udp_con)
         active_entry = mcache_entry_active(mce);
         if (!active_entry){
             records = MREP_REC_COUNT(mrep_hdr);
+            /* The packets to the requested EID are sent once the mapping is
+             * installed */
+            req_eid = lisp_addr_clone(mapping_eid(mcache_entry_mapping(mce)));
+            /* Used to refresh the mapping */
+            if (t_mr_arg->src_eid){
+                src_eid = lisp_addr_clone(t_mr_arg->src_eid);
+            }
             /* delete placeholder/dummy mapping inorder to install the new one */
             tr_mcache_remove_entry(xtr, mce);
             /* Timers are removed during the process of deleting the mce*/
@@ -284,8 +439,23 @@ tr_recv_map_reply(lisp_xtr_t *xtr, lbuf_t *buf, uconn_t *udp_con)
 
             /* Mapping is NOT ACTIVE */
             if (!active_entry) {
-                /* DO NOT free mapping in this case */
-                tr_mcache_add_mapping(xtr, m);
+                /* A prefix covering several requested EIDs, like the one of
+                 * a negative reply, may have been installed already by the
+                 * reply to another request */
+                aux_mce = mcache_lookup_exact(xtr->map_cache, mapping_eid(m));
+                if (!aux_mce){
+                    /* DO NOT free mapping in this case */
+                    if (tr_mcache_add_mapping(xtr, m) == GOOD && src_eid){
+                        aux_mce = mcache_lookup_exact(xtr->map_cache, mapping_eid(m));
+                        aux_mce->requester = lisp_addr_clone(src_eid);
+                        mcache_entry_updated(xtr->map_cache, aux_mce);
+                    }
+                }else{
+                    if (mcache_entry_active(aux_mce)){
+                        update_mcache_entry(xtr, m);
+                    }
+                    mapping_del(m);
+                }
                 /* Mapping is ACTIVE */
             } else {
                 /* the reply might be for an active mapping (SMR)*/
@@ -295,6 +465,11 @@ tr_recv_map_reply(lisp_xtr_t *xtr, lbuf_t *buf, uconn_t *udp_con)
 
             mcache_dump_db(xtr->map_cache, LDBG_3);
         }
+        if (req_eid){
+            tr_flush_pending(req_eid, TRUE);
+            lisp_addr_del(req_eid);
+            lisp_addr_del(src_eid);
+        }
     }else{
         if (MREP_REC_COUNT(mrep_hdr) >1){
             OOR_LOG(LDBG_1,"Received Map Reply Probe with multiple records. Only first one will be processed");
@@ -344,6 +519,8 @@ tr_recv_map_reply(lisp_xtr_t *xtr, lbuf_t *buf, uconn_t *udp_con)
 err:
     locator_del(probed);
     mapping_del(m);
+    lisp_addr_del(req_eid);
+    lisp_addr_del(src_eid);
     return(BAD);
 }
 
@@ -361,6 +538,8 @@ tr_reply_to_smr(lisp_xtr_t *xtr, lisp_addr_t *src_eid, lisp_addr_t *req_eid)
                 "doesn't exist in cache", lisp_addr_to_char(req_eid));
         return(BAD);
     }
+    /* The mapping is going to change. Stop using the cached forwarding info */
+    fwd_gen_bump(mce->gen_idx);
 
     /* Creat timer responsible of retries */
     timer_arg = timer_map_req_arg_new_init(mce,src_eid);
@@ -589,6 +768,7 @@ tr_update_nat_info(lisp_xtr_t *xtr, map_local_entry_t *mle, locator_t *loct,
 
     /* Update forwarding info of the local entry*/
     xtr->fwd_policy->updated_map_loc_inf(xtr->fwd_policy_dev_parm,mle);
+    fwd_gen_bump(mle->gen_idx);
 
     /* Update forwarding info of rtrs */
     tr_update_fwd_info_rtrs(xtr);
@@ -624,6 +804,7 @@ tr_update_fwd_info_rtrs(lisp_xtr_t *xtr)
 
     /* Update forwarding info of rtrs */
     xtr->fwd_policy->updated_map_cache_inf(xtr->fwd_policy_dev_parm,xtr->rtrs);
+    fwd_gen_bump(xtr->rtrs->gen_idx);
 }
 
 glist_t *
@@ -714,6 +895,8 @@ handle_merge_semantics(lisp_xtr_t *xtr, mapping_t *rec_map)
 
         /* Update forward info*/
         xtr->fwd_policy->updated_map_cache_inf(xtr->fwd_policy_dev_parm,mce);
+        fwd_gen_bump(mce->gen_idx);
+        mcache_entry_updated(xtr->map_cache, mce);
 
         program_mce_rloc_probing(xtr, mce);
 
@@ -811,16 +994,33 @@ tr_recv_map_notify(lisp_xtr_t *xtr, lbuf_t *buf)
 }
 
 
+/* Resolve the mapping of an EID without map cache entry or with a NOT ACTIVE
+ * one. Only one Map-Request is in flight for each requested EID. The misses of
+ * the EIDs it covers are attached to it and wait for its reply or its
+ * retransmissions */
 int
 handle_map_cache_miss(lisp_xtr_t *xtr, lisp_addr_t *requested_eid,
         lisp_addr_t *src_eid)
 {
-    mcache_entry_t *mce = mcache_entry_new();
+    mcache_entry_t *mce;
     mapping_t *m = NULL;
     oor_timer_t *timer;
     timer_map_req_argument *timer_arg;
+    mreq_in_flight_t *mreq;
 
+    mreq = mdb_lookup_entry(xtr->mreqs_in_flight, requested_eid);
+    if (mreq){
+        mreq->attached++;
+        xtr->mreq_stats.suppressed++;
+        OOR_LOG(LDBG_2, "Already sent Map-Request for %s. Waiting for reply!",
+                lisp_addr_to_char(requested_eid));
+        return (GOOD);
+    }
+
+    OOR_LOG(LDBG_1, "No map cache for EID %s. Sending Map-Request!",
+            lisp_addr_to_char(requested_eid));
     /* Install temporary, NOT active, mapping in map_cache */
+    mce = mcache_entry_new();
     m = mapping_new_init(requested_eid);
     mcache_entry_init(mce, m);
     /* Precalculate routing information */
@@ -832,12 +1032,19 @@ handle_map_cache_miss(lisp_xtr_t *xtr, lisp_addr_t *requested_eid,
         return(BAD);
     }
 
+    tr_mcache_make_room(xtr, mcache_entry_mem_size(mce));
     if (mcache_add_entry(xtr->map_cache, requested_eid, mce) != GOOD) {
         OOR_LOG(LWRN, "Couln't install temporary map cache entry for %s!",
                 lisp_addr_to_char(requested_eid));
         mcache_entry_del(mce);
         return(BAD);
     }
+    mreq = xzalloc(sizeof(mreq_in_flight_t));
+    mreq->mce = mce;
+    if (mdb_add_entry(xtr->mreqs_in_flight, requested_eid, mreq) != GOOD){
+        free(mreq);
+    }
+
     timer_arg = timer_map_req_arg_new_init(mce,src_eid);
     timer = oor_timer_with_nonce_new(MAP_REQUEST_RETRY_TIMER,xtr,send_map_request_retry_cb,
             timer_arg,(oor_timer_del_cb_arg_fn)timer_map_req_arg_free);
@@ -1125,6 +1332,7 @@ send_map_request_retry_cb(oor_timer_t *timer)
     uint64_t nonce;
     lisp_addr_t *deid;
     int retries = nonces_list_size(nonces_list);
+    int timeout;
 
     deid = mapping_eid (mcache_entry_mapping(timer_arg->mce));
     if (retries - 1 < xtr->map_request_retries) {
@@ -1132,17 +1340,25 @@ send_map_request_retry_cb(oor_timer_t *timer)
         if (retries > 0) {
             OOR_LOG(LDBG_1, "Retransmitting Map Request for EID: %s (%d retries)",
                     lisp_addr_to_char(deid), retries);
+            xtr->mreq_stats.retransmitted++;
         }
+        /* The nonce is kept even if the Map-Request couldn't be sent, so the
+         * retries run out and the entry is removed */
         nonce = nonce_new();
+        htable_nonces_insert(nonces_ht, nonce, nonces_list);
+        /* Exponential backoff shared by all the misses attached */
+        timeout = OOR_INITIAL_MRQ_TIMEOUT << retries;
+        oor_timer_start(timer, timeout < OOR_MAX_MRQ_TIMEOUT ? timeout : OOR_MAX_MRQ_TIMEOUT);
         if (build_and_send_encap_map_request(xtr, timer_arg->src_eid, timer_arg->mce, nonce) != GOOD){
             return (BAD);
         }
-        htable_nonces_insert(nonces_ht, nonce, nonces_list);
-        oor_timer_start(timer, OOR_INITIAL_MRQ_TIMEOUT);
+        xtr->mreq_stats.issued++;
         return (GOOD);
     } else {
         OOR_LOG(LDBG_1, "No Map-Reply for EID %s after %d retries. Aborting!",
                 lisp_addr_to_char(deid), retries -1 );
+        xtr->mreq_stats.failed++;
+        tr_flush_pending(deid, FALSE);
         /* When removing mce, all timers associated to it are canceled */
         tr_mcache_remove_entry(xtr,timer_arg->mce);
 
@@ -1689,6 +1905,8 @@ rloc_probing_cb(oor_timer_t *timer)
             }
 
             xtr->fwd_policy->updated_map_cache_inf(xtr->fwd_policy_dev_parm,mce);
+
+            fwd_gen_bump(mce->gen_idx);
         }
 
         /* Reprogram time for next probe interval */
@@ -1803,6 +2021,7 @@ tr_mcache_add_mapping(lisp_xtr_t *xtr, mapping_t *m)
         return(BAD);
     }
 
+    tr_mcache_make_room(xtr, mcache_entry_mem_size(mce));
     if (mcache_add_entry(xtr->map_cache, mapping_eid(m), mce) != GOOD) {
         OOR_LOG(LDBG_1, "tr_mcache_add_mapping: Couldn't add map cache entry %s to data base!. Discarding it.",
                 lisp_addr_to_char(mapping_eid(m)));
@@ -1857,7 +2076,17 @@ tr_mcache_remove_entry(lisp_xtr_t *xtr, mcache_entry_t *mce)
 {
     void *data = NULL;
     lisp_addr_t *eid = mapping_eid(mcache_entry_mapping(mce));
-
+    mreq_in_flight_t *mreq;
+
+    /* The resolution of the EID has finished */
+    if (mce->active == NOT_ACTIVE){
+        mreq = mdb_remove_entry(xtr->mreqs_in_flight, eid);
+        if (mreq){
+            OOR_LOG(LDBG_2, "Map-Request for %s finished. %u misses were attached to it",
+                    lisp_addr_to_char(eid), mreq->attached);
+            free(mreq);
+        }
+    }
     data = mcache_remove_entry(xtr->map_cache, eid);
     mcache_entry_del(data);
     mcache_dump_db(xtr->map_cache, LDBG_3);
@@ -1865,6 +2094,33 @@ tr_mcache_remove_entry(lisp_xtr_t *xtr, mcache_entry_t *mce)
     return (GOOD);
 }
 
+/* Evict dynamic entries until there is room in the map cache for a new one
+ * of the given bytes. The packets waiting for the mapping of an evicted NOT
+ * ACTIVE entry are dropped. Called before adding the new entry, which is
+ * never the one evicted */
+static void
+tr_mcache_make_room(lisp_xtr_t *xtr, size_t bytes)
+{
+    mcache_entry_t *mce;
+    lisp_addr_t *eid;
+
+    while (mcache_is_full(xtr->map_cache, bytes)){
+        mce = mcache_clock_victim(xtr->map_cache);
+        if (!mce){
+            return;
+        }
+        eid = mapping_eid(mcache_entry_mapping(mce));
+        OOR_LOG(LDBG_1, "Map cache full (%u entries, %lu bytes). Evicting entry of EID %s",
+                xtr->map_cache->entries, (unsigned long)xtr->map_cache->bytes,
+                lisp_addr_to_char(eid));
+        if (mce->active == NOT_ACTIVE){
+            tr_flush_pending(eid, FALSE);
+        }
+        tr_mcache_remove_entry(xtr, mce);
+        xtr->map_cache->evictions++;
+    }
+}
+
 
 mapping_t *
 tr_mcache_lookup_mapping(lisp_xtr_t *xtr, lisp_addr_t *laddr)
@@ -1929,10 +2185,12 @@ xtr_if_link_update(oor_ctrl_dev_t *dev, char *iface_name, uint8_t status)
     glist_for_each_entry(it_m, if_loct->map_loc_entries){
         map_loc_e = (map_local_entry_t *)glist_entry_data(it_m);
         xtr->fwd_policy->updated_map_loc_inf(xtr->fwd_policy_dev_parm,map_loc_e);
+        fwd_gen_bump(map_loc_e->gen_idx);
     }
 
     if (xtr->super.mode == RTR_MODE && xtr->all_locs_map) {
         xtr->fwd_policy->updated_map_loc_inf(xtr->fwd_policy_dev_parm,xtr->all_locs_map);
+        fwd_gen_bump(xtr->all_locs_map->gen_idx);
     }
 
     xtr_iface_event_signaling(xtr, if_loct);
@@ -2007,6 +2265,7 @@ xtr_if_addr_update(oor_ctrl_dev_t *dev, char *iface_name, lisp_addr_t *old_addr,
             mapping_activate_locator(mapping,locator,new_addr);
             /* Recalculate forwarding info of the mappings with activated locators */
             xtr->fwd_policy->updated_map_loc_inf(xtr->fwd_policy_dev_parm,map_loc_e);
+            fwd_gen_bump(map_loc_e->gen_idx);
 
         }else{
             locator_clone_addr(locator,new_addr);
@@ -2036,6 +2295,7 @@ xtr_if_addr_update(oor_ctrl_dev_t *dev, char *iface_name, lisp_addr_t *old_addr,
 
     if (xtr->super.mode == RTR_MODE && xtr->all_locs_map) {
         xtr->fwd_policy->updated_map_loc_inf(xtr->fwd_policy_dev_parm,xtr->all_locs_map);
+        fwd_gen_bump(xtr->all_locs_map->gen_idx);
     }
 
     xtr_iface_event_signaling(xtr, if_loct);
@@ -2214,14 +2474,17 @@ xtr_ctrl_construct(oor_ctrl_dev_t *dev)
     /* set up databases */
     xtr->local_mdb = local_map_db_new();
     xtr->map_cache = mcache_new();
+    xtr->mreqs_in_flight = mdb_new(MDB_LPM_PATRICIA);
     xtr->map_servers = glist_new_managed((glist_del_fct)map_server_elt_del);
     xtr->map_resolvers = glist_new_managed((glist_del_fct)lisp_addr_del);
     xtr->pitrs = glist_new_managed((glist_del_fct)lisp_addr_del);
     xtr->petrs = mcache_entry_new();
     xtr->rtrs = mcache_entry_new();
     xtr->iface_locators_table = shash_new_managed((free_value_fn_t)iface_locators_del);
+    xtr->mcache_refresh_lead = DEFAULT_MCACHE_REFRESH_LEAD;
+    xtr->mcache_refresh_min_pkts = DEFAULT_MCACHE_REFRESH_MIN_PKTS;
 
-    if (!xtr->local_mdb || !xtr->map_cache || !xtr->map_servers ||
+    if (!xtr->local_mdb || !xtr->map_cache || !xtr->mreqs_in_flight || !xtr->map_servers ||
             !xtr->map_resolvers || !xtr->pitrs || !xtr->petrs ||
             !xtr->rtrs || !xtr->iface_locators_table) {
         return(BAD);
@@ -2254,7 +2517,22 @@ xtr_ctrl_destruct(oor_ctrl_dev_t *dev)
         xtr->fwd_policy->del_dev_policy_inf(xtr->fwd_policy_dev_parm);
     }
 
+    OOR_LOG(LDBG_1, "Map-Requests: %llu sent (%llu retransmissions), %llu "
+            "misses attached to a Map-Request in flight, %llu misses not resolved",
+            (unsigned long long)xtr->mreq_stats.issued,
+            (unsigned long long)xtr->mreq_stats.retransmitted,
+            (unsigned long long)xtr->mreq_stats.suppressed,
+            (unsigned long long)xtr->mreq_stats.failed);
+    OOR_LOG(LDBG_1, "Map cache refresh: %llu Map-Requests sent, %llu entries "
+            "refreshed before expiring, %llu misses avoided",
+            (unsigned long long)xtr->mreq_stats.refreshes,
+            (unsigned long long)xtr->mreq_stats.refreshed,
+            (unsigned long long)xtr->mreq_stats.misses_avoided);
+    OOR_LOG(LDBG_1, "Map cache: %u entries, %lu bytes, %llu entries evicted",
+            xtr->map_cache->entries, (unsigned long)xtr->map_cache->bytes,
+            (unsigned long long)xtr->map_cache->evictions);
     shash_destroy(xtr->iface_locators_table);
+    mdb_del(xtr->mreqs_in_flight, free);
     mcache_del(xtr->map_cache);
     mcache_entry_del(xtr->petrs);
     mcache_entry_del(xtr->rtrs);
@@ -2309,6 +2587,7 @@ xtr_run(lisp_xtr_t *xtr)
         oor_timer_sleep(2);
     } else {
         xtr->fwd_policy->updated_map_cache_inf(xtr->fwd_policy_dev_parm,xtr->petrs);
+        fwd_gen_bump(xtr->petrs->gen_idx);
     }
 
     /* Check configured parameters when NAT-T activated. */
@@ -2389,6 +2668,7 @@ xtr_run(lisp_xtr_t *xtr)
          * the local rlocs are not set. For this reason should be calculated again. It can not be removed
          * from the conf file process -> In future could appear fwd_map_info parameters*/
         xtr->fwd_policy->updated_map_loc_inf(xtr->fwd_policy_dev_parm,map_loc_e);
+        fwd_gen_bump(map_loc_e->gen_idx);
 
     } local_map_db_foreach_end;
 
@@ -2431,6 +2711,7 @@ rtr_run(lisp_xtr_t *xtr)
         mapping = map_local_entry_mapping(xtr->all_locs_map);
         OOR_LOG(LINF, "Active interfaces status");
         xtr->fwd_policy->updated_map_loc_inf(xtr->fwd_policy_dev_parm,xtr->all_locs_map);
+        fwd_gen_bump(xtr->all_locs_map->gen_idx);
         OOR_LOG(LINF, "%s", mapping_to_char(mapping));
     }
 }
@@ -2545,22 +2826,54 @@ map_servers_dump(lisp_xtr_t *xtr, int log_level)
 //    }
 //
 
+/* Send a Map-Request for the destination of the flow, or attach it to the one
+ * in flight. Only the first packet of a miss needs the EIDs as addresses */
+static void
+tr_fwd_entry_miss(lisp_xtr_t *xtr, packet_tuple_t *tuple)
+{
+    mreq_in_flight_t *mreq;
+    lisp_addr_t *src_eid, *dst_eid;
+    int iidmlen;
+
+    mreq = mdb_lookup_key(xtr->mreqs_in_flight, tuple->iid,
+            lisp_addr_ip_afi(&tuple->dst_addr),
+            ip_addr_get_addr(lisp_addr_ip(&tuple->dst_addr)));
+    if (mreq){
+        mreq->attached++;
+        xtr->mreq_stats.suppressed++;
+        return;
+    }
+
+    if (tuple->iid > 0){
+        iidmlen = (lisp_addr_ip_afi(&tuple->src_addr) == AF_INET) ? 32: 128;
+        src_eid = lisp_addr_new_init_iid(tuple->iid, &tuple->src_addr, iidmlen);
+        dst_eid = lisp_addr_new_init_iid(tuple->iid, &tuple->dst_addr, iidmlen);
+    }else{
+        src_eid = lisp_addr_clone(&tuple->src_addr);
+        dst_eid = lisp_addr_clone(&tuple->dst_addr);
+    }
+    handle_map_cache_miss(xtr, dst_eid, src_eid);
+    lisp_addr_del(src_eid);
+    lisp_addr_del(dst_eid);
+}
+
 static fwd_info_t *
 tr_get_fwd_entry(lisp_xtr_t *xtr, packet_tuple_t *tuple)
 {
     fwd_info_t  *fwd_info;
-    mcache_entry_t *mce = NULL;
+    mcache_entry_t *mce = NULL, *neg_mce = NULL;
     map_local_entry_t *map_loc_e = NULL;
     mapping_t *dmap = NULL;
     lisp_addr_t *eid;
-    lisp_addr_t *src_eid, *dst_eid;
-    int iidmlen;
 
     fwd_info = fwd_info_new();
     if(fwd_info == NULL){
         OOR_LOG(LWRN, "tr_get_fwd_entry: Couldn't allocate memory for fwd_info_t");
         return (NULL);
     }
+    /* Record the state used to obtain the forwarding info. It remains valid
+     * in the data plane while this state doesn't change */
+    fwd_gen_deps_add(&fwd_info->deps, FWD_GEN_LOCAL);
 
     if (xtr->super.mode == xTR_MODE || xtr->super.mode == MN_MODE) {
         /* lookup local mapping for source EID */
@@ -2580,61 +2893,38 @@ tr_get_fwd_entry(lisp_xtr_t *xtr, packet_tuple_t *tuple)
         /* When RTR, iid is obtained from the desencapsulated packet */
         map_loc_e = xtr->all_locs_map;
     }
-    if (tuple->iid > 0){
-        iidmlen = (lisp_addr_ip_afi(&tuple->src_addr) == AF_INET) ? 32: 128;
-        src_eid = lisp_addr_new_init_iid(tuple->iid, &tuple->src_addr, iidmlen);
-        dst_eid = lisp_addr_new_init_iid(tuple->iid, &tuple->dst_addr, iidmlen);
-    }else{
-        src_eid = lisp_addr_clone(&tuple->src_addr);
-        dst_eid = lisp_addr_clone(&tuple->dst_addr);
+    if (map_loc_e){
+        fwd_gen_deps_add(&fwd_info->deps, map_loc_e->gen_idx);
     }
-
     if (xtr->nat_aware){
         mce = xtr->rtrs;
     }else{
-        mce = mcache_lookup(xtr->map_cache, dst_eid);
+        mce = mcache_lookup_key(xtr->map_cache, tuple->iid,
+                lisp_addr_ip_afi(&tuple->dst_addr),
+                ip_addr_get_addr(lisp_addr_ip(&tuple->dst_addr)));
     }
-    if (!mce) {
-        /* No map cache entry, initiate map cache miss process */
-        fwd_info->temporal = TRUE;
-        OOR_LOG(LDBG_1, "No map cache for EID %s. Sending Map-Request!",
-                lisp_addr_to_char(dst_eid));
-        handle_map_cache_miss(xtr, dst_eid, src_eid);
-        /* If the EID is not from a iid net, try to fordward to the PeTR */
-        if (lisp_addr_is_iid(dst_eid) == FALSE){
-            if (mcache_has_locators(xtr->petrs) == FALSE){
-                OOR_LOG(LDBG_3, "Trying to forward to PETR but none found ...");
-                lisp_addr_del(src_eid);
-                lisp_addr_del(dst_eid);
-                return (fwd_info);
-            }
-            OOR_LOG(LDBG_3, "Forwarding packet to PeTR");
-            fwd_info->neg_map_reply_act = ACT_NATIVE_FWD;
-            mce = xtr->petrs;
-        }else{
-            lisp_addr_del(src_eid);
-            lisp_addr_del(dst_eid);
-            fwd_info->neg_map_reply_act = ACT_NO_ACTION;
-            return (fwd_info);
-        }
-    } else if (mce->active == NOT_ACTIVE) {
+    if (mce){
+        fwd_gen_deps_add(&fwd_info->deps, mce->gen_idx);
+    }else{
+        fwd_gen_deps_add(&fwd_info->deps, FWD_GEN_MCACHE);
+    }
+    /* The PeTRs are used when there is no mapping */
+    fwd_gen_deps_add(&fwd_info->deps, xtr->petrs->gen_idx);
+    if (!mce || mce->active == NOT_ACTIVE) {
+        /* No map cache entry or waiting for the reply, initiate map cache
+         * miss process or attach to the Map-Request in flight */
         fwd_info->temporal = TRUE;
-        OOR_LOG(LDBG_2, "Already sent Map-Request for %s. Waiting for reply!",
-                lisp_addr_to_char(dst_eid));
+        tr_fwd_entry_miss(xtr, tuple);
         /* If the EID is not from a iid net, try to fordward to the PeTR */
-        if (lisp_addr_is_iid(dst_eid) == FALSE){
+        if (tuple->iid == 0){
             if (mcache_has_locators(xtr->petrs) == FALSE){
                 OOR_LOG(LDBG_3, "Trying to forward to PETR but none found ...");
-                lisp_addr_del(src_eid);
-                lisp_addr_del(dst_eid);
                 return (fwd_info);
             }
             OOR_LOG(LDBG_3, "Forwarding packet to PeTR");
             fwd_info->neg_map_reply_act = ACT_NATIVE_FWD;
             mce = xtr->petrs;
         }else{
-            lisp_addr_del(src_eid);
-            lisp_addr_del(dst_eid);
             fwd_info->neg_map_reply_act = ACT_NO_ACTION;
             return (fwd_info);
         }
@@ -2643,34 +2933,27 @@ tr_get_fwd_entry(lisp_xtr_t *xtr, packet_tuple_t *tuple)
     dmap = mcache_entry_mapping(mce);
     if (mapping_locator_count(dmap) == 0) {
         OOR_LOG(LDBG_3, "Destination %s has a NEGATIVE mapping!",
-                lisp_addr_to_char(dst_eid));
+                lisp_addr_to_char(&tuple->dst_addr));
         switch (mapping_action(dmap)){
         case ACT_NO_ACTION:
-            lisp_addr_del(src_eid);
-            lisp_addr_del(dst_eid);
             fwd_info->neg_map_reply_act = ACT_NO_ACTION;
             return (fwd_info);
         case ACT_NATIVE_FWD:
             if (mcache_has_locators(xtr->petrs) == FALSE){
                 OOR_LOG(LDBG_3, "Trying to forward to PETR but none found ...");
-                lisp_addr_del(src_eid);
-                lisp_addr_del(dst_eid);
                 return (fwd_info);
             }
             OOR_LOG(LDBG_3, "Forwarding packet to PeTR");
             fwd_info->neg_map_reply_act = ACT_NATIVE_FWD;
+            neg_mce = mce;
             mce = xtr->petrs;
             break;
         case ACT_SEND_MREQ:
             // TODO: To be implemented. Now drop paquet
             OOR_LOG(LDBG_2, "Received a packet of an entry with ACT send map req. Drop packet");
-            lisp_addr_del(src_eid);
-            lisp_addr_del(dst_eid);
             fwd_info->neg_map_reply_act = ACT_NO_ACTION;
             return (fwd_info);
         case ACT_DROP:
-            lisp_addr_del(src_eid);
-            lisp_addr_del(dst_eid);
             fwd_info->neg_map_reply_act = ACT_DROP;
             return (fwd_info);
         }
@@ -2683,12 +2966,20 @@ tr_get_fwd_entry(lisp_xtr_t *xtr, packet_tuple_t *tuple)
             mcache_entry_routing_info(mce),
             tuple, fwd_info);
 
+    /* Let the data plane reuse the result for the rest of flows between the
+     * prefixes. The flows to the prefix of a negative entry all go to the
+     * PeTRs */
+    if (fwd_info->fwd_info && (mce != xtr->petrs || neg_mce) && !xtr->nat_aware
+            && (xtr->super.mode == xTR_MODE || xtr->super.mode == MN_MODE)){
+        fwd_info->prefix = tr_get_fwd_prefix(xtr, map_loc_e,
+                neg_mce ? neg_mce : mce, mce, tuple->iid);
+    }
 
     /* Problems obtaining fwd entry */
     if (!fwd_info->fwd_info){
         /* If we didn't try to send to a PeTR, try now */
         if (mce != xtr->petrs){
-            if (lisp_addr_is_iid(dst_eid) == FALSE){
+            if (tuple->iid == 0){
                 if (mcache_has_locators(xtr->petrs) == TRUE){
                     OOR_LOG(LDBG_3, "Forwarding packet to PeTR");
                     mce = xtr->petrs;
@@ -2715,12 +3006,52 @@ tr_get_fwd_entry(lisp_xtr_t *xtr, packet_tuple_t *tuple)
     }
     /* Assign encapsulated that should be used */
     fwd_info->encap = xtr->encap_type;
-    lisp_addr_del(src_eid);
-    lisp_addr_del(dst_eid);
     return (fwd_info);
 }
 
 
+/* Get the state needed to forward any flow from the prefix of the local
+ * mapping to the prefix of the map cache entry dst_mce, through the locators
+ * of mce (dst_mce itself or the PeTRs). It is not valid when there are more
+ * specific prefixes, as some of the flows would match them instead */
+static fwd_prefix_t *
+tr_get_fwd_prefix(lisp_xtr_t *xtr, map_local_entry_t *map_loc_e,
+        mcache_entry_t *dst_mce, mcache_entry_t *mce, uint32_t iid)
+{
+    fwd_prefix_t *prefix;
+    lisp_addr_t *src_eid, *dst_eid;
+    lisp_addr_t *src_pref, *dst_pref;
+
+    if (!xtr->fwd_policy->policy_get_fwd_prefix){
+        return (NULL);
+    }
+    src_eid = map_local_entry_eid(map_loc_e);
+    dst_eid = mapping_eid(mcache_entry_mapping(dst_mce));
+    src_pref = lisp_addr_get_ip_pref_addr(src_eid);
+    dst_pref = lisp_addr_get_ip_pref_addr(dst_eid);
+    if (!src_pref || !dst_pref
+            || local_map_db_has_more_specific(xtr->local_mdb, src_eid)
+            || mcache_has_more_specific(xtr->map_cache, dst_eid)){
+        return (NULL);
+    }
+
+    prefix = fwd_prefix_new();
+    if (!prefix){
+        return (NULL);
+    }
+    if (xtr->fwd_policy->policy_get_fwd_prefix(xtr->fwd_policy_dev_parm,
+            map_local_entry_fwd_info(map_loc_e), mcache_entry_routing_info(mce),
+            prefix) != GOOD){
+        fwd_prefix_del(prefix);
+        return (NULL);
+    }
+    lisp_addr_copy(&prefix->src_pref, src_pref);
+    lisp_addr_copy(&prefix->dst_pref, dst_pref);
+    prefix->iid = iid;
+
+    return (prefix);
+}
+
 static fwd_info_t *
 tr_get_forwarding_entry(oor_ctrl_dev_t *dev, packet_tuple_t *tuple)
 {
@@ -39,6 +39,34 @@ typedef enum {
     AFTER_DRAFT_VER_4
 }nat_version;
 
+/* Map-Request in flight to resolve a map cache miss. Later misses of EIDs
+ * covered by the requested one are attached to it instead of sending their
+ * own Map-Request */
+typedef struct mreq_in_flight {
+    /* NOT ACTIVE entry installed in the map cache for the requested EID */
+    mcache_entry_t *mce;
+    uint32_t attached;
+} mreq_in_flight_t;
+
+typedef struct mreq_stats {
+    /* Map-Requests sent to resolve map cache misses, including the
+     * retransmissions */
+    uint64_t issued;
+    uint64_t retransmitted;
+    /* Misses attached to a Map-Request already in flight */
+    uint64_t suppressed;
+    /* Misses not resolved after all the retransmissions */
+    uint64_t failed;
+    /* Map-Requests sent to refresh entries in use before they expire,
+     * including the retransmissions */
+    uint64_t refreshes;
+    /* Entries whose mapping was refreshed before expiring */
+    uint64_t refreshed;
+    /* Refreshed entries used after their previous mapping expired. Each one
+     * would have been a miss */
+    uint64_t misses_avoided;
+} mreq_stats_t;
+
 typedef struct lisp_xtr {
     oor_ctrl_dev_t super; /* base "class" */
 
@@ -51,6 +79,11 @@ typedef struct lisp_xtr {
     int (*add_mapping_to_local_map_db)(mapping_t *mapping);
 
     int map_request_retries;
+    /* Entries forwarding at least mcache_refresh_min_pkts packets during
+     * their validity are requested again mcache_refresh_lead seconds before
+     * expiring. 0 seconds to let them expire */
+    int mcache_refresh_lead;
+    int mcache_refresh_min_pkts;
     int probe_interval;
     int probe_retries;
     int probe_retries_interval;
@@ -61,6 +94,9 @@ typedef struct lisp_xtr {
     /* DATABASES */
     map_cache_db_t *map_cache;
     local_map_db_t *local_mdb;
+    /* Map-Requests in flight by requested EID <mreq_in_flight_t *> */
+    mdb_t *mreqs_in_flight;
+    mreq_stats_t mreq_stats;
 
     /* FWD POLICY */
     fwd_policy_class *fwd_policy;
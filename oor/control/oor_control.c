@@ -25,6 +25,7 @@
 #include "../data-plane/data-plane.h"
 #include "../lib/oor_log.h"
 #include "../lib/routing_tables_lib.h"
+#include "../lib/fwd_gen.h"
 #include "../lib/mem_util.h"
 
 
@@ -153,6 +154,8 @@ ctrl_if_addr_update(oor_ctrl_t *ctrl,iface_t *iface, lisp_addr_t *old_addr,
      * be passed to ctrl_dev */
     ctrl_dev_if_addr_update(dev, iface->iface_name, old_addr,new_addr, iface_status(iface));
     set_rlocs(ctrl);
+    /* The flows could use other interfaces or addresses */
+    fwd_gen_bump(FWD_GEN_LOCAL);
 }
 
 void
@@ -166,6 +169,7 @@ ctrl_if_link_update(oor_ctrl_t *ctrl, iface_t *iface, int old_iface_index,
     ctrl->control_data_plane->control_dp_update_link(ctrl, iface, old_iface_index, new_iface_index, status);
     ctrl_dev_if_link_update(dev, iface->iface_name, iface_status(iface));
     set_rlocs(ctrl);
+    fwd_gen_bump(FWD_GEN_LOCAL);
 }
 
 
@@ -179,6 +183,7 @@ ctrl_route_update(oor_ctrl_t *ctrl, int command, iface_t *iface,lisp_addr_t *src
     ctrl->control_data_plane->control_dp_updated_route(ctrl, command, iface, src, dst_pref, gateway);
     ctrl_dev_route_update(dev, command, iface->iface_name, src, dst_pref, gateway);
     set_rlocs(ctrl);
+    fwd_gen_bump(FWD_GEN_LOCAL);
 }
 
 lisp_addr_t *
@@ -33,7 +33,7 @@ local_map_db_new()
         return(NULL);
     }
 
-    db->db = mdb_new();
+    db->db = mdb_new(MDB_LPM_PATRICIA);
     if (!db->db) {
         OOR_LOG(LCRIT, "Could allocate local map database ");
         return(NULL);
@@ -61,6 +61,7 @@ local_map_db_add_entry(local_map_db_t *lmdb, map_local_entry_t *map_loc_e)
                 lisp_addr_to_char(map_local_entry_eid(map_loc_e)));
         return(BAD);
     }
+    fwd_gen_bump(FWD_GEN_LOCAL);
     return(GOOD);
 }
 
@@ -70,6 +71,7 @@ local_map_db_lookup_eid(local_map_db_t *lmdb, lisp_addr_t *eid, uint8_t check_ii
 	map_local_entry_t *map_loc_e = NULL;
 	uint32_t iid = 0;
 	lisp_addr_t *ip_pref_eid, *db_eid;
+	ip_addr_t *ip;
 
 
 	if (lisp_addr_is_lcaf(eid)){
@@ -83,7 +85,15 @@ local_map_db_lookup_eid(local_map_db_t *lmdb, lisp_addr_t *eid, uint8_t check_ii
 	    ip_pref_eid = eid;
 	}
 
-	map_loc_e = (map_local_entry_t *)mdb_lookup_entry(lmdb->db, ip_pref_eid);
+	ip = ip_pref_eid ? lisp_addr_ip_get_addr(ip_pref_eid) : NULL;
+	if (!ip){
+	    OOR_LOG(LDBG_2, "local_map_db_lookup_eid: EID %s is not an IP address or prefix",
+	            lisp_addr_to_char(eid));
+	    return (NULL);
+	}
+	/* The local EIDs of all the IIDs are in the tables without IID */
+	map_loc_e = (map_local_entry_t *)mdb_lookup_key(lmdb->db, 0, ip_addr_afi(ip),
+	        ip_addr_get_addr(ip));
     if (!map_loc_e) {
         OOR_LOG(LDBG_3, "Couldn't find mapping for EID %s in local mappings database",
                 lisp_addr_to_char(eid));
@@ -142,12 +152,27 @@ local_map_db_lookup_eid_exact(local_map_db_t *lmdb, lisp_addr_t *eid)
     return (map_loc_e);
 }
 
+/* Check if there are local prefixes more specific than the one of eid */
+uint8_t
+local_map_db_has_more_specific(local_map_db_t *lmdb, lisp_addr_t *eid)
+{
+    lisp_addr_t *ip_pref;
+
+    ip_pref = lisp_addr_get_ip_pref_addr(eid);
+    if (!ip_pref){
+        return (TRUE);
+    }
+    return (mdb_has_more_specific(lmdb->db, ip_pref));
+}
+
 void
 local_map_db_del_entry(local_map_db_t *lmdb, lisp_addr_t *eid)
 {
 	map_local_entry_t *map_loc_e = NULL;
 	map_loc_e = (map_local_entry_t *)mdb_remove_entry(lmdb->db, eid);
     if (map_loc_e != NULL) {
+        fwd_gen_bump(map_loc_e->gen_idx);
+        fwd_gen_bump(FWD_GEN_LOCAL);
     	map_local_entry_del(map_loc_e);
     }
 }
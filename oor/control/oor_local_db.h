@@ -38,6 +38,7 @@ int local_map_db_add_entry(local_map_db_t *, map_local_entry_t *);
 void local_map_db_del_entry(local_map_db_t *, lisp_addr_t *);
 map_local_entry_t *local_map_db_lookup_eid(local_map_db_t *, lisp_addr_t *, uint8_t);
 map_local_entry_t *local_map_db_lookup_eid_exact(local_map_db_t *, lisp_addr_t *);
+uint8_t local_map_db_has_more_specific(local_map_db_t *, lisp_addr_t *);
 
 
 lisp_addr_t *local_map_db_get_main_eid(local_map_db_t *, int );
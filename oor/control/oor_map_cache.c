@@ -31,11 +31,13 @@ mcache_new()
         return(NULL);
     }
 
-    mcdb->db = mdb_new();
+    /* The multibit tables can be enabled with mcache_set_lpm */
+    mcdb->db = mdb_new(MDB_LPM_PATRICIA);
     if (!mcdb->db) {
         OOR_LOG(LCRIT, "Could create map cache db ");
         return(NULL);
     }
+    mcdb->clock = glist_new();
 
     return(mcdb);
 }
@@ -44,20 +46,147 @@ void
 mcache_del(map_cache_db_t *mcdb)
 {
     mdb_del(mcdb->db, (mdb_del_fct)mcache_entry_del);
+    glist_destroy(mcdb->clock);
     free(mcdb);
 }
 
+void
+mcache_set_limits(map_cache_db_t *mcdb, uint32_t max_entries, size_t max_bytes)
+{
+    mcdb->max_entries = max_entries;
+    mcdb->max_bytes = max_bytes;
+}
+
+/* Select the engine of the lookups of the map cache, which is looked up for
+ * each packet without a cached flow. The multibit tables are faster but take
+ * more memory and make the removals and the short prefixes slower. It can
+ * only be changed while the map cache is empty */
+int
+mcache_set_lpm(map_cache_db_t *mcdb, mdb_lpm_e lpm)
+{
+    mdb_t *db;
+
+    if (mdb_n_entries(mcdb->db) != 0){
+        OOR_LOG(LWRN, "mcache_set_lpm: The map cache is not empty. Lookup "
+                "engine not changed");
+        return (BAD);
+    }
+    db = mdb_new(lpm);
+    if (!db){
+        return (BAD);
+    }
+    mdb_del(mcdb->db, (mdb_del_fct)mcache_entry_del);
+    mcdb->db = db;
+
+    return (GOOD);
+}
+
 
 int
 mcache_add_entry(map_cache_db_t *mcdb, lisp_addr_t *key, mcache_entry_t *mce)
 {
-    return(mdb_add_entry(mcdb->db, key, mce));
+    mcache_entry_t *covering;
+
+    /* The flows forwarded with a less specific entry could now match the
+     * new one */
+    covering = mdb_lookup_entry(mcdb->db, key);
+    if (covering){
+        fwd_gen_bump(covering->gen_idx);
+    }
+    fwd_gen_bump(FWD_GEN_MCACHE);
+    if (mdb_add_entry(mcdb->db, key, mce) != GOOD){
+        return(BAD);
+    }
+
+    mce->bytes = mcache_entry_mem_size(mce);
+    mcdb->entries++;
+    mcdb->bytes += mce->bytes;
+    if (mce->how_learned == MCE_DYNAMIC){
+        glist_add_tail(mce, mcdb->clock);
+        mce->clock_it = glist_last(mcdb->clock);
+        mce->clock_ref = TRUE;
+        mce->clock_uses = fwd_gen_uses(mce->gen_idx);
+    }
+    return(GOOD);
 }
 
 void *
 mcache_remove_entry(map_cache_db_t *mcdb, lisp_addr_t *key)
 {
-    return(mdb_remove_entry(mcdb->db, key));
+    mcache_entry_t *mce;
+
+    mce = mdb_remove_entry(mcdb->db, key);
+    if (mce){
+        fwd_gen_bump(mce->gen_idx);
+        fwd_gen_bump(FWD_GEN_MCACHE);
+        mcdb->entries--;
+        mcdb->bytes -= mce->bytes;
+        if (mce->clock_it){
+            if (mcdb->hand == mce->clock_it){
+                mcdb->hand = glist_next(mce->clock_it);
+            }
+            glist_remove(mce->clock_it, mcdb->clock);
+            mce->clock_it = NULL;
+        }
+    }
+    return(mce);
+}
+
+/* The mapping or the routing info of the entry have changed. Account its
+ * new size */
+void
+mcache_entry_updated(map_cache_db_t *mcdb, mcache_entry_t *mce)
+{
+    size_t bytes = mcache_entry_mem_size(mce);
+
+    mcdb->bytes = mcdb->bytes - mce->bytes + bytes;
+    mce->bytes = bytes;
+}
+
+/* Check if there is no room for another entry of the given bytes */
+uint8_t
+mcache_is_full(map_cache_db_t *mcdb, size_t bytes)
+{
+    if (mcdb->max_entries && mcdb->entries >= mcdb->max_entries){
+        return (TRUE);
+    }
+    if (mcdb->max_bytes && mcdb->bytes + bytes > mcdb->max_bytes){
+        return (TRUE);
+    }
+    return (FALSE);
+}
+
+/*
+ * Select the dynamic entry to evict, or NULL if there is none. The hand
+ * skips the entries with the second chance, or whose usage counter changed
+ * since it last passed, and removes their chance. After two turns all the
+ * entries in use have lost it, and the last one checked is selected anyway.
+ * The entry is not removed: the hand moves past it
+ */
+mcache_entry_t *
+mcache_clock_victim(map_cache_db_t *mcdb)
+{
+    mcache_entry_t *mce = NULL;
+    uint32_t uses;
+    int i;
+
+    if (glist_size(mcdb->clock) == 0){
+        return (NULL);
+    }
+    for (i = 0; i < 2 * glist_size(mcdb->clock) + 1; i++){
+        if (!mcdb->hand || mcdb->hand == glist_head(mcdb->clock)){
+            mcdb->hand = glist_first(mcdb->clock);
+        }
+        mce = (mcache_entry_t *)glist_entry_data(mcdb->hand);
+        mcdb->hand = glist_next(mcdb->hand);
+        uses = fwd_gen_uses(mce->gen_idx);
+        if (!mce->clock_ref && uses == mce->clock_uses){
+            break;
+        }
+        mce->clock_ref = FALSE;
+        mce->clock_uses = uses;
+    }
+    return (mce);
 }
 
 
@@ -71,6 +200,16 @@ mcache_lookup(map_cache_db_t *mcdb, lisp_addr_t *laddr)
     return(mdb_lookup_entry(mcdb->db, laddr));
 }
 
+/*
+ * Look up the address addr, in network byte order, of the IID iid (0 for the
+ * EIDs without IID). It doesn't allocate memory
+ */
+mcache_entry_t *
+mcache_lookup_key(map_cache_db_t *mcdb, uint32_t iid, int afi, void *addr)
+{
+    return(mdb_lookup_key(mcdb->db, iid, afi, addr));
+}
+
 /*
  * Find an exact match for a prefix/prefixlen if possible
  */
@@ -80,6 +219,15 @@ mcache_lookup_exact(map_cache_db_t *mcdb, lisp_addr_t *laddr)
     return(mdb_lookup_entry_exact(mcdb->db, laddr));
 }
 
+/*
+ * Check if the map cache has prefixes more specific than laddr
+ */
+uint8_t
+mcache_has_more_specific(map_cache_db_t *mcdb, lisp_addr_t *laddr)
+{
+    return(mdb_has_more_specific(mcdb->db, laddr));
+}
+
 
 void mcache_dump_db(map_cache_db_t *mcdb, int log_level)
 {
@@ -25,12 +25,31 @@
 #include "../lib/mapping_db.h"
 #include "../liblisp/liblisp.h"
 
+/*
+ * The map cache can be bounded by a number of entries and of bytes. When an
+ * entry doesn't fit, the dynamic entries are evicted with the CLOCK
+ * (second-chance) policy: the hand goes round the entries skipping, and
+ * clearing, the ones used by the data plane or added since it last passed.
+ * The static entries are never evicted.
+ */
 typedef struct map_cache_db {
     mdb_t *db;
+    /* Limits of the map cache, 0 for unlimited */
+    uint32_t max_entries;
+    size_t max_bytes;
+    uint32_t entries;
+    size_t bytes;
+    /* CLOCK of the dynamic entries <mcache_entry_t *> and its hand, the next
+     * entry checked */
+    glist_t *clock;
+    glist_entry_t *hand;
+    uint64_t evictions;
 } map_cache_db_t;
 
 map_cache_db_t *mcache_new();
 void mcache_del(map_cache_db_t *mcdb);
+void mcache_set_limits(map_cache_db_t *mcdb, uint32_t max_entries, size_t max_bytes);
+int mcache_set_lpm(map_cache_db_t *mcdb, mdb_lpm_e lpm);
 
 
 int mcache_add_entry(map_cache_db_t *, lisp_addr_t *key, mcache_entry_t *entry);
@@ -38,6 +57,11 @@ void *mcache_remove_entry(map_cache_db_t *, lisp_addr_t *key);
 void map_cache_del_entry(map_cache_db_t *, lisp_addr_t *laddr);
 mcache_entry_t *mcache_lookup_exact(map_cache_db_t *, lisp_addr_t *addr);
 mcache_entry_t *mcache_lookup(map_cache_db_t *, lisp_addr_t *addr);
+mcache_entry_t *mcache_lookup_key(map_cache_db_t *, uint32_t iid, int afi, void *addr);
+uint8_t mcache_has_more_specific(map_cache_db_t *, lisp_addr_t *addr);
+void mcache_entry_updated(map_cache_db_t *, mcache_entry_t *entry);
+uint8_t mcache_is_full(map_cache_db_t *, size_t bytes);
+mcache_entry_t *mcache_clock_victim(map_cache_db_t *);
 
 void mcache_dump_db(map_cache_db_t *, int log_level);
 
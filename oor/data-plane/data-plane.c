@@ -21,12 +21,40 @@
 #include "data-plane.h"
 
 data_plane_struct_t *data_plane = NULL;
+data_plane_conf_t data_plane_conf = {
+        .type = DATA_PLANE_TUN,
+        .rx_batch_size = DEFAULT_DATA_RX_BATCH,
+        .tx_batch_size = DEFAULT_DATA_TX_BATCH,
+        .tun_queues = 1,
+        .input_mode = DATA_INPUT_FILTERED_RAW,
+        .rx_workers = 0,
+        .rx_steering = FALSE,
+        .offload = FALSE,
+        .src_port_min = DEFAULT_DATA_SRC_PORT_MIN,
+        .src_port_max = DEFAULT_DATA_SRC_PORT_MAX,
+        .flow_table_size = DEFAULT_FLOW_TABLE_SIZE,
+        .flow_idle_timeout = DEFAULT_FLOW_IDLE_TIMEOUT,
+        .prefix_cache_size = DEFAULT_PREFIX_CACHE_SIZE,
+        .pending_pkts = DEFAULT_PENDING_PKTS,
+        .pending_bytes = DEFAULT_PENDING_BYTES,
+        .pending_max_pkts = DEFAULT_PENDING_MAX_PKTS,
+        .pending_max_bytes = DEFAULT_PENDING_MAX_BYTES,
+        .pending_timeout = DEFAULT_PENDING_TIMEOUT
+};
 
 void data_plane_select()
 {
 #ifdef VPNAPI
     data_plane = &dplane_vpnapi;
 #else
-    data_plane = &dplane_tun;
+    switch (data_plane_conf.type){
+    case DATA_PLANE_PACKET_MMAP:
+        data_plane = &dplane_pkt_mmap;
+        break;
+    case DATA_PLANE_TUN:
+    default:
+        data_plane = &dplane_tun;
+        break;
+    }
 #endif
 }
@@ -24,6 +24,93 @@
 typedef struct iface iface_t;
 typedef struct sock sock_t;
 
+#define DEFAULT_DATA_RX_BATCH   32
+#define DEFAULT_DATA_TX_BATCH   32
+#define MAX_TUN_QUEUES          64
+#define MAX_RX_WORKERS          64
+/* Default range of the outer UDP source ports of encapsulated packets */
+#define DEFAULT_DATA_SRC_PORT_MIN   49152
+#define DEFAULT_DATA_SRC_PORT_MAX   65535
+#define DEFAULT_FLOW_TABLE_SIZE     10000
+#define MAX_FLOW_TABLE_SIZE         (1 << 24)
+#define DEFAULT_FLOW_IDLE_TIMEOUT   60
+#define DEFAULT_PREFIX_CACHE_SIZE   4096
+#define MAX_PREFIX_CACHE_SIZE       (1 << 20)
+/* Packets kept while the mapping of their destination is requested */
+#define DEFAULT_PENDING_PKTS        16
+#define DEFAULT_PENDING_BYTES       32768
+#define DEFAULT_PENDING_MAX_PKTS    1024
+#define DEFAULT_PENDING_MAX_BYTES   (1 << 20)
+#define DEFAULT_PENDING_TIMEOUT     8
+
+/* Backend used to exchange the packets with the kernel */
+typedef enum {
+    /* Tun for the EID side and sockets for the RLOC side */
+    DATA_PLANE_TUN,
+    /* Tun for the EID side and memory mapped packet rings in the RLOC
+     * interfaces */
+    DATA_PLANE_PACKET_MMAP
+} data_plane_type_e;
+
+/* Type of the sockets used to receive encapsulated packets */
+typedef enum {
+    /* Raw UDP socket. All the UDP packets arriving to the host reach
+     * user space */
+    DATA_INPUT_RAW,
+    /* Raw UDP socket with a kernel filter on the data port */
+    DATA_INPUT_FILTERED_RAW,
+    /* UDP socket bound to the data port. Only the UDP payload is received */
+    DATA_INPUT_DATAGRAM
+} data_input_mode_e;
+
+/* Tunable parameters of the data plane. They are filled while parsing the
+ * configuration file, before the data plane is initialized */
+typedef struct data_plane_conf_ {
+    /* Backend selected by data_plane_select */
+    data_plane_type_e type;
+    /* Max number of packets read from a data input socket per wakeup */
+    int rx_batch_size;
+    /* Max number of packets read from the tun and sent per output socket
+     * with a single system call */
+    int tx_batch_size;
+    /* Number of queues of the tun. Each one is served by its own thread */
+    int tun_queues;
+    /* Type of the sockets used to receive encapsulated packets */
+    data_input_mode_e input_mode;
+    /* Number of threads receiving and decapsulating packets, each one with
+     * its own datagram socket bound to the data port. 0 to use the main
+     * thread */
+    int rx_workers;
+    /* Steer the packets to the input workers by outer UDP source port */
+    uint8_t rx_steering;
+    /* Exchange GSO super-packets with the kernel (tun with virtio headers,
+     * UDP_SEGMENT and UDP_GRO) instead of MTU sized packets */
+    uint8_t offload;
+    /* The outer UDP source port of an encapsulated packet is selected from
+     * this range with the hash of its inner flow */
+    uint16_t src_port_min;
+    uint16_t src_port_max;
+    /* Max number of flows of each AFI in the flow table of each output
+     * thread */
+    int flow_table_size;
+    /* Time without packets after which a flow can be removed from the flow
+     * table (s) */
+    int flow_idle_timeout;
+    /* Max number of pairs of local and remote prefixes in the prefix cache
+     * of each output thread */
+    int prefix_cache_size;
+    /* Max number of packets and bytes kept per destination, and in total,
+     * while the mapping of the destination is requested. 0 packets to drop
+     * them as before */
+    int pending_pkts;
+    int pending_bytes;
+    int pending_max_pkts;
+    int pending_max_bytes;
+    /* Time after which the kept packets are dropped if the mapping has not
+     * been obtained (s) */
+    int pending_timeout;
+} data_plane_conf_t;
+
 /* functions to manipulate routing */
 typedef struct data_plane_struct {
     int (*datap_init)(oor_dev_type_e dev_type, oor_encap_t encap_type,  ...);
@@ -38,14 +125,20 @@ typedef struct data_plane_struct {
             lisp_addr_t *dst_pref, lisp_addr_t *gw);
     int (*datap_updated_addr)(iface_t *iface,lisp_addr_t *old_addr,lisp_addr_t *new_addr);
     int (*datap_update_link)(iface_t *iface, int old_iface_index, int new_iface_index, int status);
+    /* Forward (send TRUE) or drop the packets kept while the mapping of
+     * the EID was requested */
+    void (*datap_flush_pending)(lisp_addr_t *eid, uint8_t send);
 
     void *datap_data;
 } data_plane_struct_t;
 
 void data_plane_select();
 
+extern data_plane_conf_t data_plane_conf;
+
 extern data_plane_struct_t dplane_tun;
 extern data_plane_struct_t dplane_vpnapi;
+extern data_plane_struct_t dplane_pkt_mmap;
 
 
 #endif /* DATA_PLANE_H_ */
@@ -0,0 +1,653 @@
+/*
+ *
+ * Copyright (C) 2011, 2015 Cisco Systems, Inc.
+ * Copyright (C) 2015 CBA research group, Technical University of Catalonia.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <net/ethernet.h>
+#include <net/if_arp.h>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+
+#include "pkt_mmap.h"
+#include "../tun/tun.h"
+#include "../tun/tun_input.h"
+#include "../tun/tun_output.h"
+#include "../../iface_list.h"
+#include "../../oor_external.h"
+#include "../../lib/fwd_gen.h"
+#include "../../lib/mem_util.h"
+#include "../../lib/oor_log.h"
+#include "../../lib/routing_tables_lib.h"
+#include "../../lib/sockets-util.h"
+
+/* Offset of the packet in a frame of the TX ring */
+#define PKT_MMAP_TX_DATA_OFF    TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+#define PKT_MMAP_TX_FRAMES      (PKT_MMAP_TX_BLOCKS * \
+        (PKT_MMAP_TX_BLOCK_SIZE / PKT_MMAP_TX_FRAME_SIZE))
+
+/* Packet socket of an RLOC interface with its rings */
+typedef struct pkt_mmap_link_ {
+    char *ifname;
+    int ifindex;
+    sock_t *sl;
+    uint8_t mac[ETH_ALEN];
+    /* The RX ring is followed by the TX ring in the same mapping */
+    uint8_t *map;
+    size_t map_len;
+    uint8_t *rx_ring;
+    uint8_t *tx_ring;
+    /* Next block of the RX ring to be read and next frame of the TX ring
+     * to be filled */
+    int rx_block;
+    int tx_frame;
+    int tx_pending;
+    /* Counters */
+    uint64_t rx_pkts;
+    uint64_t rx_blocks;
+    uint64_t tx_pkts;
+    uint64_t tx_batches;
+    uint64_t tx_full;
+} pkt_mmap_link_t;
+
+/* Link layer path used to send the packets from a source RLOC to a
+ * destination RLOC. It is resolved once and shared by all the forwarding
+ * entries with the same RLOCs */
+typedef struct pkt_mmap_path_ {
+    lisp_addr_t srloc;
+    lisp_addr_t drloc;
+    pkt_mmap_link_t *link;
+    struct ether_header eth;
+} pkt_mmap_path_t;
+
+static pkt_mmap_link_t links[PKT_MMAP_MAX_LINKS];
+static int links_num = 0;
+static glist_t *paths = NULL;
+/* UDP sockets bound to the data port that discard the packets delivered to
+ * them. The packets have already been read from the rings */
+static int sink_socks[2] = {ERR_SOCKET, ERR_SOCKET};
+static int data_port = LISP_DATA_PORT;
+static uint8_t rtr = FALSE;
+static uint8_t initialized = FALSE;
+/* Buffers where the packets are copied in RTR mode to have headroom for the
+ * new outer headers */
+static uint8_t *rtr_mem = NULL;
+static int rtr_slots = 0;
+
+static int pkt_mmap_configure_data_plane(oor_dev_type_e dev_type,
+        oor_encap_t encap_type, ...);
+static void pkt_mmap_uninit_data_plane();
+static int pkt_mmap_add_datap_iface_addr(iface_t *iface, int afi);
+static int pkt_mmap_updated_route(int command, iface_t *iface,
+        lisp_addr_t *src_pref, lisp_addr_t *dst_pref, lisp_addr_t *gateway);
+static int pkt_mmap_updated_link(iface_t *iface, int old_iface_index,
+        int new_iface_index, int status);
+static int pkt_mmap_process_input_packet(sock_t *sl);
+static pkt_mmap_link_t *pkt_mmap_link_open(char *ifname, int ifindex);
+static void pkt_mmap_link_close(pkt_mmap_link_t *link);
+static void pkt_mmap_link_flush(pkt_mmap_link_t *link);
+static void pkt_mmap_invalidate_paths();
+
+data_plane_struct_t dplane_pkt_mmap = {
+        .datap_init = pkt_mmap_configure_data_plane,
+        .datap_uninit = pkt_mmap_uninit_data_plane,
+        .datap_add_iface_addr = pkt_mmap_add_datap_iface_addr,
+        .datap_add_eid_prefix = tun_add_eid_prefix,
+        .datap_remove_eid_prefix = tun_remove_eid_prefix,
+        .datap_input_packet = pkt_mmap_process_input_packet,
+        .datap_rtr_input_packet = pkt_mmap_process_input_packet,
+        .datap_output_packet = tun_output_recv,
+        .datap_updated_route = pkt_mmap_updated_route,
+        .datap_updated_addr = tun_updated_addr,
+        .datap_update_link = pkt_mmap_updated_link,
+        .datap_flush_pending = tun_output_flush_pending,
+        .datap_data = NULL
+};
+
+
+/* Open a socket bound to the data port that discards the packets */
+static int
+pkt_mmap_open_sink(int afi)
+{
+    int sock;
+
+    sock = open_data_datagram_input_socket(afi, data_port);
+    if (sock == ERR_SOCKET){
+        OOR_LOG(LERR, "pkt_mmap_open_sink: Couldn't bind the data port %d",
+                data_port);
+        return (ERR_SOCKET);
+    }
+    if (socket_attach_drop_filter(sock) != GOOD){
+        close(sock);
+        return (ERR_SOCKET);
+    }
+    return (sock);
+}
+
+static int
+pkt_mmap_configure_data_plane(oor_dev_type_e dev_type, oor_encap_t encap_type, ...)
+{
+    glist_entry_t *iface_it;
+    iface_t *iface;
+
+    /* The tun, the routing and the output sockets, used when a packet can
+     * not be sent through a ring, are the ones of the tun backend */
+    if (tun_configure_data_plane(dev_type, encap_type) != GOOD){
+        return (BAD);
+    }
+    dplane_pkt_mmap.datap_data = dplane_tun.datap_data;
+
+    data_port = encap_type == ENCP_VXLAN_GPE ? VXLAN_GPE_DATA_PORT : LISP_DATA_PORT;
+    rtr = dev_type == RTR_MODE;
+    if (rtr){
+        rtr_slots = data_plane_conf.rx_batch_size;
+        rtr_mem = xmalloc(rtr_slots * MAX_IP_PKT_LEN);
+        if (!rtr_mem){
+            return (BAD);
+        }
+    }
+
+    /* The data port should be bound. Otherwise the kernel answers the
+     * encapsulated packets with ICMP port unreachable messages */
+    if (default_rloc_afi != AF_INET6){
+        sink_socks[0] = pkt_mmap_open_sink(AF_INET);
+        if (sink_socks[0] == ERR_SOCKET){
+            return (BAD);
+        }
+    }
+    if (default_rloc_afi != AF_INET){
+        sink_socks[1] = pkt_mmap_open_sink(AF_INET6);
+        if (sink_socks[1] == ERR_SOCKET){
+            return (BAD);
+        }
+    }
+
+    paths = glist_new_managed((glist_del_fct)free);
+    initialized = TRUE;
+
+    glist_for_each_entry(iface_it, interface_list){
+        iface = (iface_t *)glist_entry_data(iface_it);
+        if (iface_status(iface) == UP){
+            pkt_mmap_link_open(iface->iface_name, iface->iface_index);
+        }
+    }
+
+    OOR_LOG(LINF, "Data plane: Using memory mapped packet rings in %d "
+            "interfaces", links_num);
+
+    return (GOOD);
+}
+
+static void
+pkt_mmap_uninit_data_plane()
+{
+    int i;
+
+    /* Packets pending in the TX rings are sent by the tun output */
+    tun_uninit_data_plane();
+    if (!initialized){
+        return;
+    }
+    for (i = 0; i < links_num; i++){
+        pkt_mmap_link_close(&links[i]);
+    }
+    links_num = 0;
+    for (i = 0; i < 2; i++){
+        if (sink_socks[i] != ERR_SOCKET){
+            close(sink_socks[i]);
+            sink_socks[i] = ERR_SOCKET;
+        }
+    }
+    glist_destroy(paths);
+    paths = NULL;
+    free(rtr_mem);
+    rtr_mem = NULL;
+    initialized = FALSE;
+}
+
+static int
+pkt_mmap_add_datap_iface_addr(iface_t *iface, int afi)
+{
+    int ret;
+
+    ret = tun_add_datap_iface_addr(iface, afi);
+    /* Interfaces configured before the data plane are processed when it
+     * is initialized */
+    if (initialized && iface_status(iface) == UP){
+        pkt_mmap_link_open(iface->iface_name, iface->iface_index);
+    }
+    return (ret);
+}
+
+static int
+pkt_mmap_updated_route(int command, iface_t *iface, lisp_addr_t *src_pref,
+        lisp_addr_t *dst_pref, lisp_addr_t *gateway)
+{
+    /* Next hops are resolved again by the new forwarding entries */
+    pkt_mmap_invalidate_paths();
+    return (tun_updated_route(command, iface, src_pref, dst_pref, gateway));
+}
+
+static int
+pkt_mmap_updated_link(iface_t *iface, int old_iface_index, int new_iface_index,
+        int status)
+{
+    int i;
+
+    for (i = 0; i < links_num; i++){
+        if (links[i].ifindex == old_iface_index && links[i].sl){
+            pkt_mmap_link_close(&links[i]);
+        }
+    }
+    pkt_mmap_invalidate_paths();
+    if (status == UP){
+        pkt_mmap_link_open(iface->iface_name, new_iface_index);
+    }
+
+    return (tun_updated_link(iface, old_iface_index, new_iface_index, status));
+}
+
+/* Kernel filter of the RX rings. Only the UDP packets addressed to this host
+ * with the data port as destination are placed in the ring. Fragments are
+ * discarded */
+static int
+pkt_mmap_attach_filter(int sock, uint16_t port)
+{
+    struct sock_filter filter[] = {
+        /*  0 */ BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE),
+        /*  1 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   PACKET_HOST, 0, 18),
+        /*  2 */ BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, SKF_AD_OFF + SKF_AD_PROTOCOL),
+        /*  3 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   ETH_P_IP, 0, 10),
+        /* IPv4 */
+        /*  4 */ BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, SKF_NET_OFF + 9),
+        /*  5 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   IPPROTO_UDP, 0, 14),
+        /*  6 */ BPF_STMT(BPF_LD  | BPF_H   | BPF_ABS, SKF_NET_OFF + 6),
+        /*  7 */ BPF_JUMP(BPF_JMP | BPF_JSET| BPF_K,   0x3fff, 12, 0),
+        /*  8 */ BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, SKF_NET_OFF),
+        /*  9 */ BPF_STMT(BPF_ALU | BPF_AND | BPF_K,   0x0f),
+        /* 10 */ BPF_STMT(BPF_ALU | BPF_LSH | BPF_K,   2),
+        /* 11 */ BPF_STMT(BPF_MISC| BPF_TAX,           0),
+        /* 12 */ BPF_STMT(BPF_LD  | BPF_H   | BPF_IND, SKF_NET_OFF + 2),
+        /* 13 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   port, 5, 6),
+        /* IPv6. Extension headers are not expected */
+        /* 14 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   ETH_P_IPV6, 0, 5),
+        /* 15 */ BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, SKF_NET_OFF + 6),
+        /* 16 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   IPPROTO_UDP, 0, 3),
+        /* 17 */ BPF_STMT(BPF_LD  | BPF_H   | BPF_ABS, SKF_NET_OFF + 42),
+        /* 18 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   port, 0, 1),
+        /* 19 */ BPF_STMT(BPF_RET | BPF_K,             0x40000),
+        /* 20 */ BPF_STMT(BPF_RET | BPF_K,             0),
+    };
+    struct sock_fprog prog;
+
+    prog.len = sizeof(filter) / sizeof(struct sock_filter);
+    prog.filter = filter;
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        OOR_LOG(LERR, "pkt_mmap_attach_filter: setsockopt SO_ATTACH_FILTER: %s",
+                strerror(errno));
+        return (BAD);
+    }
+    return (GOOD);
+}
+
+/* Create the packet socket of an Ethernet interface and map its rings */
+static pkt_mmap_link_t *
+pkt_mmap_link_open(char *ifname, int ifindex)
+{
+    pkt_mmap_link_t *link = NULL;
+    struct tpacket_req3 rx_req, tx_req;
+    struct sockaddr_ll sll;
+    struct ifreq ifr;
+    int version = TPACKET_V3, loss = 1;
+    int sock, i;
+
+    for (i = 0; i < links_num; i++){
+        if (links[i].sl && links[i].ifindex == ifindex){
+            return (&links[i]);
+        }
+        if (!links[i].sl && !link){
+            link = &links[i];
+        }
+    }
+    if (!link){
+        if (links_num == PKT_MMAP_MAX_LINKS){
+            OOR_LOG(LWRN, "pkt_mmap_link_open: Too many interfaces. %s uses "
+                    "sockets", ifname);
+            return (NULL);
+        }
+        link = &links[links_num];
+    }
+    memset(link, 0, sizeof(pkt_mmap_link_t));
+
+    /* No packet is received until the socket is bound with a protocol */
+    sock = socket(AF_PACKET, SOCK_RAW, 0);
+    if (sock < 0){
+        OOR_LOG(LERR, "pkt_mmap_link_open: socket: %s", strerror(errno));
+        return (NULL);
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (ioctl(sock, SIOCGIFHWADDR, &ifr) < 0
+            || ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER){
+        OOR_LOG(LDBG_1, "pkt_mmap_link_open: %s is not an Ethernet interface. "
+                "It uses sockets", ifname);
+        close(sock);
+        return (NULL);
+    }
+    memcpy(link->mac, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+
+    memset(&rx_req, 0, sizeof(rx_req));
+    rx_req.tp_block_size = PKT_MMAP_RX_BLOCK_SIZE;
+    rx_req.tp_block_nr = PKT_MMAP_RX_BLOCKS;
+    rx_req.tp_frame_size = PKT_MMAP_RX_FRAME_SIZE;
+    rx_req.tp_frame_nr = PKT_MMAP_RX_BLOCKS
+            * (PKT_MMAP_RX_BLOCK_SIZE / PKT_MMAP_RX_FRAME_SIZE);
+    rx_req.tp_retire_blk_tov = PKT_MMAP_RX_BLOCK_TOV;
+    memset(&tx_req, 0, sizeof(tx_req));
+    tx_req.tp_block_size = PKT_MMAP_TX_BLOCK_SIZE;
+    tx_req.tp_block_nr = PKT_MMAP_TX_BLOCKS;
+    tx_req.tp_frame_size = PKT_MMAP_TX_FRAME_SIZE;
+    tx_req.tp_frame_nr = PKT_MMAP_TX_FRAMES;
+
+    /* With PACKET_LOSS, malformed frames of the TX ring are skipped instead
+     * of blocking the ring */
+    if (setsockopt(sock, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0
+            || setsockopt(sock, SOL_PACKET, PACKET_LOSS, &loss, sizeof(loss)) < 0
+            || pkt_mmap_attach_filter(sock, data_port) != GOOD
+            || setsockopt(sock, SOL_PACKET, PACKET_RX_RING, &rx_req, sizeof(rx_req)) < 0
+            || setsockopt(sock, SOL_PACKET, PACKET_TX_RING, &tx_req, sizeof(tx_req)) < 0){
+        OOR_LOG(LERR, "pkt_mmap_link_open: Couldn't set up the rings of %s: %s",
+                ifname, strerror(errno));
+        close(sock);
+        return (NULL);
+    }
+
+    link->map_len = (size_t)PKT_MMAP_RX_BLOCK_SIZE * PKT_MMAP_RX_BLOCKS
+            + (size_t)PKT_MMAP_TX_BLOCK_SIZE * PKT_MMAP_TX_BLOCKS;
+    link->map = mmap(NULL, link->map_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+            sock, 0);
+    if (link->map == MAP_FAILED){
+        OOR_LOG(LERR, "pkt_mmap_link_open: mmap: %s", strerror(errno));
+        close(sock);
+        return (NULL);
+    }
+    link->rx_ring = link->map;
+    link->tx_ring = link->map + (size_t)PKT_MMAP_RX_BLOCK_SIZE * PKT_MMAP_RX_BLOCKS;
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = ifindex;
+    if (bind(sock, (struct sockaddr *)&sll, sizeof(sll)) < 0){
+        OOR_LOG(LERR, "pkt_mmap_link_open: bind to %s: %s", ifname,
+                strerror(errno));
+        munmap(link->map, link->map_len);
+        close(sock);
+        return (NULL);
+    }
+
+    link->ifname = strdup(ifname);
+    link->ifindex = ifindex;
+    link->sl = sockmstr_register_read_listener(smaster,
+            pkt_mmap_process_input_packet, link, sock);
+    sock_set_priority(link->sl, SOCK_PRIO_LOW);
+    if (link == &links[links_num]){
+        links_num++;
+    }
+
+    OOR_LOG(LDBG_1, "pkt_mmap_link_open: Packet rings ready in %s", ifname);
+
+    return (link);
+}
+
+static void
+pkt_mmap_link_close(pkt_mmap_link_t *link)
+{
+    struct tpacket_stats_v3 stats;
+    socklen_t len = sizeof(stats);
+
+    if (!link->sl){
+        return;
+    }
+    pkt_mmap_link_flush(link);
+
+    memset(&stats, 0, sizeof(stats));
+    getsockopt(link->sl->fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len);
+    OOR_LOG(LDBG_1, "Data plane rings (%s): %llu packets received in %llu "
+            "blocks, %u dropped by the kernel. %llu packets sent in %llu batches, "
+            "%llu sent through sockets with the TX ring full", link->ifname,
+            (unsigned long long)link->rx_pkts, (unsigned long long)link->rx_blocks,
+            stats.tp_drops, (unsigned long long)link->tx_pkts,
+            (unsigned long long)link->tx_batches, (unsigned long long)link->tx_full);
+
+    munmap(link->map, link->map_len);
+    /* The socket is closed by the socket master */
+    sockmstr_unregister_read_listenedr(smaster, link->sl);
+    link->sl = NULL;
+    free(link->ifname);
+    link->ifname = NULL;
+}
+
+/* Read all the blocks of the RX ring filled by the kernel */
+static int
+pkt_mmap_process_input_packet(sock_t *sl)
+{
+    pkt_mmap_link_t *link = (pkt_mmap_link_t *)sl->arg;
+    struct tpacket_block_desc *bd;
+    struct tpacket3_hdr *hdr;
+    lbuf_t b;
+    uint8_t *pkt;
+    int nblocks, npkts, i, len, slot = 0;
+
+    for (nblocks = 0; nblocks < PKT_MMAP_RX_BLOCKS; nblocks++){
+        bd = (struct tpacket_block_desc *)(link->rx_ring
+                + (size_t)link->rx_block * PKT_MMAP_RX_BLOCK_SIZE);
+        if (!(bd->hdr.bh1.block_status & TP_STATUS_USER)){
+            break;
+        }
+        npkts = bd->hdr.bh1.num_pkts;
+        hdr = (struct tpacket3_hdr *)((uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt);
+        for (i = 0; i < npkts; i++){
+            pkt = (uint8_t *)hdr + hdr->tp_net;
+            len = hdr->tp_snaplen - (hdr->tp_net - hdr->tp_mac);
+            if (!rtr){
+                /* The packet is written to the tun from the ring */
+                lbuf_use_stack(&b, pkt, len);
+                lbuf_set_size(&b, len);
+                tun_input_ring_pkt(&b, FALSE);
+            }else if (len <= MAX_IP_PKT_LEN - LBUF_STACK_OFFSET){
+                /* The re-encapsulated packets point to the buffers until
+                 * they are sent */
+                if (slot == rtr_slots){
+                    tun_output_flush();
+                    slot = 0;
+                }
+                lbuf_use_stack(&b, rtr_mem + slot * MAX_IP_PKT_LEN, MAX_IP_PKT_LEN);
+                lbuf_reserve(&b, LBUF_STACK_OFFSET);
+                lbuf_put(&b, pkt, len);
+                tun_input_ring_pkt(&b, TRUE);
+                slot++;
+            }
+            hdr = (struct tpacket3_hdr *)((uint8_t *)hdr + hdr->tp_next_offset);
+        }
+        link->rx_pkts += npkts;
+        link->rx_blocks++;
+
+        /* Give the block back to the kernel once all its packets have been
+         * read */
+        __sync_synchronize();
+        bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+        link->rx_block = (link->rx_block + 1) % PKT_MMAP_RX_BLOCKS;
+    }
+
+    if (rtr){
+        tun_output_flush();
+    }
+
+    return (nblocks > 0 ? GOOD : BAD);
+}
+
+/* Get the link layer path from srloc to drloc. NULL when the destination is
+ * not reached through an interface with rings or its next hop has not been
+ * resolved yet by the kernel. In this case the packets are sent through the
+ * sockets of the tun backend */
+void *
+pkt_mmap_get_tx_path(lisp_addr_t *srloc, lisp_addr_t *drloc)
+{
+    glist_entry_t *path_it;
+    pkt_mmap_path_t *path;
+    pkt_mmap_link_t *link = NULL;
+    lisp_addr_t gw;
+    int oif, i;
+
+    if (!initialized || links_num == 0){
+        return (NULL);
+    }
+
+    glist_for_each_entry(path_it, paths){
+        path = (pkt_mmap_path_t *)glist_entry_data(path_it);
+        if (lisp_addr_cmp(&path->drloc, drloc) == 0
+                && lisp_addr_cmp(&path->srloc, srloc) == 0){
+            return (path);
+        }
+    }
+
+    if (get_route_to(drloc, srloc, &oif, &gw) != GOOD){
+        return (NULL);
+    }
+    for (i = 0; i < links_num; i++){
+        if (links[i].sl && links[i].ifindex == oif){
+            link = &links[i];
+            break;
+        }
+    }
+    if (!link){
+        return (NULL);
+    }
+
+    path = xzalloc(sizeof(pkt_mmap_path_t));
+    if (!path){
+        return (NULL);
+    }
+    if (get_neighbour_lladdr(oif, lisp_addr_is_no_addr(&gw) ? drloc : &gw,
+            path->eth.ether_dhost, ETH_ALEN) != GOOD){
+        OOR_LOG(LDBG_2, "pkt_mmap_get_tx_path: Next hop to %s not resolved yet",
+                lisp_addr_to_char(drloc));
+        free(path);
+        return (NULL);
+    }
+    memcpy(path->eth.ether_shost, link->mac, ETH_ALEN);
+    path->eth.ether_type = htons(lisp_addr_ip_afi(drloc) == AF_INET ?
+            ETHERTYPE_IP : ETHERTYPE_IPV6);
+    lisp_addr_copy(&path->srloc, srloc);
+    lisp_addr_copy(&path->drloc, drloc);
+    path->link = link;
+    glist_add(path, paths);
+
+    OOR_LOG(LDBG_2, "pkt_mmap_get_tx_path: %s -> %s through %s",
+            lisp_addr_to_char(srloc), lisp_addr_to_char(drloc), link->ifname);
+
+    return (path);
+}
+
+/* The links of the paths may be closed or their next hop changed. The paths
+ * are freed and the forwarding entries that point to them are invalidated,
+ * so that new paths are resolved by the next packets */
+static void
+pkt_mmap_invalidate_paths()
+{
+    if (!paths || glist_size(paths) == 0){
+        return;
+    }
+    /* Pending frames may belong to a link that is being closed */
+    pkt_mmap_flush();
+    glist_remove_all(paths);
+    fwd_gen_bump(FWD_GEN_LOCAL);
+}
+
+/* Copy an encapsulated packet to the TX ring of the link of the path. It is
+ * sent with the next flush. Returns BAD when it should be sent through a
+ * socket */
+int
+pkt_mmap_queue(void *tx_path, lbuf_t *b)
+{
+    pkt_mmap_path_t *path = (pkt_mmap_path_t *)tx_path;
+    pkt_mmap_link_t *link = path->link;
+    struct tpacket3_hdr *hdr;
+    uint8_t *data;
+    int len = lbuf_size(b) + sizeof(struct ether_header);
+
+    if (!link || len > PKT_MMAP_TX_FRAME_SIZE - PKT_MMAP_TX_DATA_OFF){
+        return (BAD);
+    }
+
+    hdr = (struct tpacket3_hdr *)(link->tx_ring
+            + (size_t)link->tx_frame * PKT_MMAP_TX_FRAME_SIZE);
+    if (hdr->tp_status != TP_STATUS_AVAILABLE){
+        /* The ring is full. Send the pending frames and check again */
+        pkt_mmap_link_flush(link);
+        if (hdr->tp_status != TP_STATUS_AVAILABLE){
+            link->tx_full++;
+            return (BAD);
+        }
+    }
+
+    data = (uint8_t *)hdr + PKT_MMAP_TX_DATA_OFF;
+    memcpy(data, &path->eth, sizeof(struct ether_header));
+    memcpy(data + sizeof(struct ether_header), lbuf_data(b), lbuf_size(b));
+    hdr->tp_len = len;
+    hdr->tp_next_offset = 0;
+    __sync_synchronize();
+    hdr->tp_status = TP_STATUS_SEND_REQUEST;
+
+    link->tx_frame = (link->tx_frame + 1) % PKT_MMAP_TX_FRAMES;
+    link->tx_pending++;
+
+    return (GOOD);
+}
+
+static void
+pkt_mmap_link_flush(pkt_mmap_link_t *link)
+{
+    if (link->tx_pending == 0){
+        return;
+    }
+    if (sendto(link->sl->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0
+            && errno != EAGAIN && errno != ENOBUFS){
+        OOR_LOG(LDBG_2, "pkt_mmap_link_flush: %s: %s", link->ifname,
+                strerror(errno));
+    }
+    link->tx_pkts += link->tx_pending;
+    link->tx_batches++;
+    link->tx_pending = 0;
+}
+
+/* Send the packets queued in the TX rings */
+void
+pkt_mmap_flush()
+{
+    int i;
+
+    for (i = 0; i < links_num; i++){
+        if (links[i].sl){
+            pkt_mmap_link_flush(&links[i]);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+/*
+ *
+ * Copyright (C) 2011, 2015 Cisco Systems, Inc.
+ * Copyright (C) 2015 CBA research group, Technical University of Catalonia.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef PKT_MMAP_H_
+#define PKT_MMAP_H_
+
+#include "../data-plane.h"
+#include "../../lib/lbuf.h"
+
+/*
+ * Data plane backend that exchanges the encapsulated packets with the RLOC
+ * interfaces through memory mapped packet rings (PACKET_MMAP). Each interface
+ * has an AF_PACKET socket with a TPACKET_V3 RX ring, where the kernel places
+ * the received packets in blocks, and a TX ring where the encapsulated packets
+ * are written and sent together with a single system call. The EID side is
+ * the same tun of the tun backend.
+ */
+
+/* RX ring: blocks of packets handed to user space when full or when
+ * PKT_MMAP_RX_BLOCK_TOV ms have passed since the first packet */
+#define PKT_MMAP_RX_BLOCK_SIZE  (1 << 18)
+#define PKT_MMAP_RX_BLOCKS      8
+#define PKT_MMAP_RX_BLOCK_TOV   1
+/* Frames of the RX ring, large enough for any received packet. With
+ * TPACKET_V3 the packets are stored back to back in the blocks, so the frame
+ * size doesn't waste space of the ring */
+#define PKT_MMAP_RX_FRAME_SIZE  (1 << 16)
+/* TX ring: one encapsulated packet, with its Ethernet header, per frame */
+#define PKT_MMAP_TX_BLOCK_SIZE  (1 << 16)
+#define PKT_MMAP_TX_BLOCKS      16
+#define PKT_MMAP_TX_FRAME_SIZE  2048
+/* Max number of interfaces with rings */
+#define PKT_MMAP_MAX_LINKS      16
+
+void *pkt_mmap_get_tx_path(lisp_addr_t *srloc, lisp_addr_t *drloc);
+int pkt_mmap_queue(void *tx_path, lbuf_t *b);
+void pkt_mmap_flush();
+
+extern data_plane_struct_t dplane_pkt_mmap;
+
+#endif /* PKT_MMAP_H_ */
@@ -25,22 +25,21 @@
 #include "tun.h"
 #include "tun_input.h"
 #include "tun_output.h"
+#include "tun_offload.h"
 #include "../data-plane.h"
 #include "../../oor_external.h"
 #include "../../lib/oor_log.h"
 #include "../../lib/routing_tables_lib.h"
 
 
-int tun_configure_data_plane(oor_dev_type_e dev_type, oor_encap_t encap_type, ...);
-void tun_uninit_data_plane();
-int tun_add_datap_iface_addr(iface_t *iface,int afi);
-int tun_add_eid_prefix(oor_dev_type_e dev_type, lisp_addr_t *eid_prefix);
-int tun_remove_eid_prefix(oor_dev_type_e dev_type, lisp_addr_t *eid_prefix);
-
 int configure_routing_to_tun_router(int afi);
 //int configure_routing_to_tun_mn(lisp_addr_t *eid_addr);
 int remove_routing_to_tun_mn(lisp_addr_t *eid_addr);
 int create_tun();
+static int tun_open_queues(struct ifreq *ifr, int num);
+static int tun_open_data_input_socket(int afi, int data_port, uint8_t shared);
+static int tun_start_input_workers(int data_port);
+static void tun_close_queues();
 int configure_routing_to_tun_mn(lisp_addr_t *eid_addr);
 int tun_bring_up_iface();
 int tun_add_eid_to_iface(lisp_addr_t *addr);
@@ -49,10 +48,6 @@ int set_tun_default_route_v4();
 int del_tun_default_route_v4();
 int set_tun_default_route_v6();
 int del_tun_default_route_v6();
-int tun_updated_route (int command, iface_t *iface, lisp_addr_t *src_pref,
-        lisp_addr_t *dst_pref, lisp_addr_t *gateway);
-int tun_updated_addr(iface_t *iface,lisp_addr_t *old_addr,lisp_addr_t *new_addr);
-int tun_updated_link(iface_t *iface, int old_iface_index, int new_iface_index, int status);
 void tun_process_new_gateway(iface_t *iface,lisp_addr_t *gateway);
 void tun_process_rm_gateway(iface_t *iface,lisp_addr_t *gateway);
 
@@ -60,6 +55,11 @@ void tun_set_default_output_ifaces();
 void tun_iface_remove_routing_rules(iface_t *iface);
 
 
+/* Descriptors of the queues of a multi-queue tun. The first one is
+ * tun_receive_fd */
+static int *tun_queue_fds = NULL;
+static int tun_queues_num = 0;
+
 data_plane_struct_t dplane_tun = {
         .datap_init = tun_configure_data_plane,
         .datap_uninit = tun_uninit_data_plane,
@@ -72,6 +72,7 @@ data_plane_struct_t dplane_tun = {
         .datap_updated_route = tun_updated_route,
         .datap_updated_addr = tun_updated_addr,
         .datap_update_link = tun_updated_link,
+        .datap_flush_pending = tun_output_flush_pending,
         .datap_data = NULL
 };
 
@@ -95,7 +96,6 @@ tun_configure_data_plane(oor_dev_type_e dev_type, oor_encap_t encap_type, ...)
 
     switch (dev_type){
     case MN_MODE:
-        sockmstr_register_read_listener(smaster, tun_output_recv, NULL,tun_receive_fd);
         cb_func = tun_process_input_packet;
         break;
     case xTR_MODE:
@@ -103,7 +103,6 @@ tun_configure_data_plane(oor_dev_type_e dev_type, oor_encap_t encap_type, ...)
         /* Rules created for EID will redirect traffic to this table*/
         configure_routing_to_tun_router(AF_INET);
         configure_routing_to_tun_router(AF_INET6);
-        sockmstr_register_read_listener(smaster, tun_output_recv, NULL,tun_receive_fd);
         cb_func = tun_process_input_packet;
         break;
     case RTR_MODE:
@@ -124,22 +123,60 @@ tun_configure_data_plane(oor_dev_type_e dev_type, oor_encap_t encap_type, ...)
         return (BAD);
     }
 
-    /* Generate receive sockets for data port (4341) */
-    if (default_rloc_afi != AF_INET6) {
-        ipv4_data_input_fd = open_data_raw_input_socket(AF_INET, data_port);
-        sockmstr_register_read_listener(smaster, cb_func, NULL,
-                ipv4_data_input_fd);
+    if (data_plane_conf.offload && data_plane_conf.input_mode != DATA_INPUT_DATAGRAM){
+        OOR_LOG(LINF, "UDP GRO is only used with datagram data input sockets");
+    }
+    if (tun_input_init(data_plane_conf.rx_batch_size, data_plane_conf.input_mode,
+            data_port, data_plane_conf.offload) != GOOD){
+        return (BAD);
     }
 
-    if (default_rloc_afi != AF_INET) {
-        ipv6_data_input_fd = open_data_raw_input_socket(AF_INET6, data_port);
-        sockmstr_register_read_listener(smaster, cb_func, NULL,
-                ipv6_data_input_fd);
+    /* Encapsulated packets are received by the main thread or, when
+     * configured, by several workers sharing the data port */
+    if (data_plane_conf.type == DATA_PLANE_PACKET_MMAP){
+        /* Packets are read from the rings of the RLOC interfaces */
+    }else if (data_plane_conf.rx_workers > 0 && dev_type != RTR_MODE
+            && data_plane_conf.input_mode == DATA_INPUT_DATAGRAM){
+        if (tun_start_input_workers(data_port) != GOOD){
+            return (BAD);
+        }
+    }else{
+        if (data_plane_conf.rx_workers > 0){
+            OOR_LOG(LWRN, "Data input workers require datagram input sockets "
+                    "and are not used by RTRs. Receiving in the main thread");
+        }
+        /* Generate receive sockets for data port (4341) */
+        if (default_rloc_afi != AF_INET6) {
+            ipv4_data_input_fd = tun_open_data_input_socket(AF_INET, data_port, FALSE);
+            sock_set_priority(sockmstr_register_read_listener(smaster, cb_func, NULL,
+                    ipv4_data_input_fd), SOCK_PRIO_LOW);
+        }
+
+        if (default_rloc_afi != AF_INET) {
+            ipv6_data_input_fd = tun_open_data_input_socket(AF_INET6, data_port, FALSE);
+            sock_set_priority(sockmstr_register_read_listener(smaster, cb_func, NULL,
+                    ipv6_data_input_fd), SOCK_PRIO_LOW);
+        }
     }
     data = xmalloc(sizeof(tun_dplane_data_t));
     data->encap_type = encap_type;
     dplane_tun.datap_data = (void *)data;
-    tun_output_init();
+    if (tun_output_init(data_plane_conf.tx_batch_size) != GOOD){
+        return (BAD);
+    }
+
+    /* Packets to be encapsulated are read from the tun by the main thread or,
+     * with a multi-queue tun, by one worker thread per queue */
+    if (dev_type == MN_MODE || dev_type == xTR_MODE){
+        if (tun_queues_num > 1){
+            if (tun_output_start_workers(tun_queue_fds, tun_queues_num) != GOOD){
+                return (BAD);
+            }
+        }else{
+            sock_set_priority(sockmstr_register_read_listener(smaster,
+                    tun_output_recv, NULL,tun_receive_fd), SOCK_PRIO_LOW);
+        }
+    }
 
     /* Select the default rlocs for output data packets and output control
      * packets */
@@ -149,6 +186,95 @@ tun_configure_data_plane(oor_dev_type_e dev_type, oor_encap_t encap_type, ...)
 
 }
 
+/* Open the socket used to receive encapsulated packets according to the
+ * configured input mode. Shared sockets are datagram sockets in the same
+ * SO_REUSEPORT group */
+static int
+tun_open_data_input_socket(int afi, int data_port, uint8_t shared)
+{
+    int sock;
+
+    if (shared){
+        sock = open_data_datagram_input_socket_shared(afi, data_port);
+        if (sock != ERR_SOCKET && data_plane_conf.offload){
+            socket_enable_udp_gro(sock);
+        }
+        return (sock);
+    }
+
+    switch (data_plane_conf.input_mode){
+    case DATA_INPUT_DATAGRAM:
+        sock = open_data_datagram_input_socket(afi, data_port);
+        /* Consecutive packets of a flow are received together */
+        if (sock != ERR_SOCKET && data_plane_conf.offload
+                && socket_enable_udp_gro(sock) != GOOD){
+            OOR_LOG(LWRN, "Couldn't enable UDP GRO in the data input socket");
+        }
+        return (sock);
+    case DATA_INPUT_FILTERED_RAW:
+        sock = open_data_raw_input_socket(afi, data_port);
+        if (sock != ERR_SOCKET
+                && socket_attach_udp_port_filter(sock, afi, data_port) != GOOD){
+            OOR_LOG(LWRN, "Couldn't filter the data input socket in the kernel. "
+                    "All UDP packets will be processed");
+        }
+        return (sock);
+    case DATA_INPUT_RAW:
+    default:
+        return (open_data_raw_input_socket(afi, data_port));
+    }
+}
+
+/* Open one socket per address family and worker, all of them bound to the
+ * data port, and start the input workers. Worker i writes to tun queue
+ * i % number of queues */
+static int
+tun_start_input_workers(int data_port)
+{
+    int afis[2], socks[MAX_RX_WORKERS * 2];
+    int num = data_plane_conf.rx_workers;
+    int afis_num = 0, i, j, ret;
+
+    if (default_rloc_afi != AF_INET6) {
+        afis[afis_num++] = AF_INET;
+    }
+    if (default_rloc_afi != AF_INET) {
+        afis[afis_num++] = AF_INET6;
+    }
+
+    for (i = 0; i < num; i++){
+        for (j = 0; j < afis_num; j++){
+            socks[i * afis_num + j] = tun_open_data_input_socket(afis[j],
+                    data_port, TRUE);
+            if (socks[i * afis_num + j] == ERR_SOCKET){
+                OOR_LOG(LERR, "Couldn't open the data input socket of worker %d", i);
+                goto err;
+            }
+        }
+    }
+
+    /* The steering program is shared by all the sockets of the group */
+    if (data_plane_conf.rx_steering){
+        for (j = 0; j < afis_num; j++){
+            socket_attach_reuseport_steering(socks[j], afis[j], num);
+        }
+    }
+
+    ret = tun_input_start_workers(num, socks, afis_num, tun_queue_fds,
+            tun_queues_num);
+    if (ret != GOOD){
+        OOR_LOG(LERR, "Couldn't start the data input workers");
+    }
+    /* The sockets are closed by the workers, also on error */
+    return (ret);
+
+err:
+    for (i = i * afis_num + j - 1; i >= 0; i--){
+        close(socks[i]);
+    }
+    return (BAD);
+}
+
 void
 tun_uninit_data_plane()
 {
@@ -164,6 +290,8 @@ tun_uninit_data_plane()
         }
 
         tun_output_uninit();
+        tun_input_uninit();
+        tun_close_queues();
         free(data);
     }
 }
@@ -294,6 +422,13 @@ create_tun()
     int flags = IFF_TUN | IFF_NO_PI; // Create a tunnel without persistence
     char *clonedev = CLONEDEV;
 
+    if (data_plane_conf.tun_queues > 1){
+        flags |= IFF_MULTI_QUEUE;
+    }
+    if (data_plane_conf.offload){
+        flags |= IFF_VNET_HDR;
+    }
+
 
     /* Arguments taken by the function:
      *
@@ -323,6 +458,30 @@ create_tun()
         return(BAD);
     }
 
+    /* With IFF_VNET_HDR the kernel may hand us TCP super-packets. The
+     * offload settings are shared by all the queues */
+    if (data_plane_conf.offload && tun_offload_tun_init(tun_receive_fd) != GOOD){
+        /* The virtio header can't be removed from an existing tun */
+        OOR_LOG(LWRN, "TUN/TAP: Offload not available. Creating the tunnel "
+                "interface without virtio header");
+        close(tun_receive_fd);
+        ifr.ifr_flags = flags & ~IFF_VNET_HDR;
+        if ((tun_receive_fd = open(clonedev, O_RDWR)) < 0
+                || ioctl(tun_receive_fd, TUNSETIFF, (void *) &ifr) < 0) {
+            OOR_LOG(LCRIT, "TUN/TAP: Failed to create tunnel interface, errno: %d.", errno);
+            if (tun_receive_fd >= 0){
+                close(tun_receive_fd);
+            }
+            return(BAD);
+        }
+    }
+
+    /* Attach the rest of queues before ifr is reused by the next ioctls */
+    if (tun_open_queues(&ifr, data_plane_conf.tun_queues) != GOOD){
+        close(tun_receive_fd);
+        return (BAD);
+    }
+
     // get the ifindex for the tun/tap
     tmpsocket = socket(AF_INET, SOCK_DGRAM, 0); // Dummy socket for the ioctl, type/details unimportant
     if ((err = ioctl(tmpsocket, SIOCGIFINDEX, (void *)&ifr)) < 0) {
@@ -348,6 +507,12 @@ create_tun()
 
     close(tmpsocket);
 
+    /* Packets are read from the tun in batches until no more are available */
+    if (fcntl(tun_receive_fd, F_SETFL, fcntl(tun_receive_fd, F_GETFL) | O_NONBLOCK) < 0){
+        OOR_LOG(LWRN, "TUN/TAP: unable to set tun descriptor as non blocking: %s",
+                strerror(errno));
+    }
+
     tun_receive_buf = (uint8_t *)malloc(TUN_RECEIVE_SIZE);
 
     if (tun_receive_buf == NULL){
@@ -366,6 +531,63 @@ create_tun()
     return (tun_receive_fd);
 }
 
+/* Open the remaining queues of a multi-queue tun. The first one has already
+ * been opened by create_tun */
+static int
+tun_open_queues(struct ifreq *ifr, int num)
+{
+    int i, fd;
+
+    if (num < 1){
+        num = 1;
+    }
+    tun_queue_fds = xzalloc(num * sizeof(int));
+    if (tun_queue_fds == NULL){
+        return (BAD);
+    }
+    tun_queue_fds[0] = tun_receive_fd;
+    tun_queues_num = 1;
+
+    for (i = 1; i < num; i++){
+        if ((fd = open(CLONEDEV, O_RDWR)) < 0) {
+            OOR_LOG(LCRIT, "TUN/TAP: Failed to open clone device for queue %d", i);
+            return (BAD);
+        }
+        if (ioctl(fd, TUNSETIFF, (void *)ifr) < 0) {
+            close(fd);
+            OOR_LOG(LCRIT, "TUN/TAP: Failed to attach queue %d to the tunnel "
+                    "interface: %s", i, strerror(errno));
+            return (BAD);
+        }
+        if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0){
+            OOR_LOG(LWRN, "TUN/TAP: unable to set queue %d as non blocking: %s",
+                    i, strerror(errno));
+        }
+        tun_queue_fds[i] = fd;
+        tun_queues_num++;
+    }
+
+    if (tun_queues_num > 1){
+        OOR_LOG(LDBG_1, "TUN/TAP: Opened %d queues", tun_queues_num);
+    }
+
+    return (GOOD);
+}
+
+static void
+tun_close_queues()
+{
+    int i;
+
+    /* The first queue is tun_receive_fd */
+    for (i = 1; i < tun_queues_num; i++){
+        close(tun_queue_fds[i]);
+    }
+    free(tun_queue_fds);
+    tun_queue_fds = NULL;
+    tun_queues_num = 0;
+}
+
 /*
 * For mobile node mode, we create two /1 routes covering the full IP addresses space to route all traffic
 * generated by the node to the lispTun0 interface
@@ -87,6 +87,18 @@ typedef struct tun_dplane_data_{
 
 extern data_plane_struct_t dplane_tun;
 
+/* Functions of the tun backend reused by other backends that also use the
+ * tun for the EID side */
+int tun_configure_data_plane(oor_dev_type_e dev_type, oor_encap_t encap_type, ...);
+void tun_uninit_data_plane();
+int tun_add_datap_iface_addr(iface_t *iface,int afi);
+int tun_add_eid_prefix(oor_dev_type_e dev_type, lisp_addr_t *eid_prefix);
+int tun_remove_eid_prefix(oor_dev_type_e dev_type, lisp_addr_t *eid_prefix);
+int tun_updated_route (int command, iface_t *iface, lisp_addr_t *src_pref,
+        lisp_addr_t *dst_pref, lisp_addr_t *gateway);
+int tun_updated_addr(iface_t *iface,lisp_addr_t *old_addr,lisp_addr_t *new_addr);
+int tun_updated_link(iface_t *iface, int old_iface_index, int new_iface_index, int status);
+
 
 #endif /* TUN_H_ */
 
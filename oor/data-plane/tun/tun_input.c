@@ -17,55 +17,374 @@
  *
  */
 
+/* Define _GNU_SOURCE in order to pin the workers to CPUs */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
 #include <string.h>
 #include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 
 #include "tun.h"
 #include "tun_input.h"
 #include "tun_output.h"
+#include "tun_offload.h"
 #include "../../lib/packets.h"
 #include "../../lib/mem_util.h"
 #include "../../liblisp/liblisp.h"
 #include "../../lib/oor_log.h"
 
-/* static buffer to receive packets */
-static uint8_t pkt_recv_buf[MAX_IP_PKT_LEN+1];
-static lbuf_t pkt_buf;
+/* Max number of data input sockets drained by a worker (IPv4 and IPv6) */
+#define TUN_IN_MAX_SOCKS        2
+/* Time a worker waits for packets before checking if it should stop (ms) */
+#define TUN_IN_POLL_TIMEOUT     100
 
-int
-tun_read_and_decap_pkt(int sock, lbuf_t *b, uint32_t *iid)
+/* State used to receive and decapsulate data packets. The main thread and
+ * each one of the input workers owns one */
+typedef struct tun_in_ctx_ {
+    /* Ring of preallocated buffers where batches of data packets are
+     * received */
+    uint8_t *ring_mem;
+    lbuf_t ring[SOCK_MAX_BATCH];
+    lbuf_t *ring_ptr[SOCK_MAX_BATCH];
+    int ring_afi[SOCK_MAX_BATCH];
+    uint8_t ring_ttl[SOCK_MAX_BATCH];
+    uint8_t ring_tos[SOCK_MAX_BATCH];
+    uint16_t ring_seg_size[SOCK_MAX_BATCH];
+    int batch_size;
+    int slot_size;
+    /* With UDP GRO, the datagrams coalesced by the kernel are copied here
+     * one by one before being re-encapsulated by the RTR */
+    uint8_t *gro_seg_mem;
+    /* Tun queue where decapsulated packets are written */
+    int tun_fd;
+    /* Sockets drained by a worker */
+    int socks[TUN_IN_MAX_SOCKS];
+    int socks_num;
+    /* Input counters. rx_pkts / rx_batches is the average batch size */
+    uint64_t rx_pkts;
+    uint64_t rx_batches;
+    /* Worker thread */
+    pthread_t thread;
+    int cpu;
+    volatile uint8_t running;
+} tun_in_ctx_t;
+
+static tun_in_ctx_t main_ctx;
+static tun_in_ctx_t *workers = NULL;
+static int workers_num = 0;
+
+/* Type of the data input sockets and their port */
+static data_input_mode_e rx_mode = DATA_INPUT_RAW;
+static int rx_port = LISP_DATA_PORT;
+static uint8_t rx_gro = FALSE;
+
+static int tun_input_recv_batch(tun_in_ctx_t *ctx, int sock, uint8_t reserve);
+static int tun_decap_pkt(lbuf_t *b, int afi, uint8_t ttl, uint8_t tos,
+        uint32_t *iid);
+static int tun_decap_payload(lbuf_t *b, int port, uint8_t ttl, uint8_t tos,
+        uint32_t *iid);
+static void tun_rtr_forward_decap(lbuf_t *b, uint32_t iid);
+static void tun_input_process_batch(tun_in_ctx_t *ctx, int npkts);
+
+static int
+tun_in_ctx_init(tun_in_ctx_t *ctx, int batch_size, int tun_fd)
 {
-    uint8_t ttl = 0, tos = 0;
-    int afi;
-    struct udphdr *udph;
-    lisp_data_hdr_t *lisph;
-    vxlan_gpe_hdr_t *vxlanh;
-    int port;
+    int i;
 
-    if (sock_data_recv(sock, b, &afi, &ttl, &tos) != GOOD) {
-        return(BAD);
+    memset(ctx, 0, sizeof(tun_in_ctx_t));
+    if (batch_size < 1){
+        batch_size = 1;
+    }else if (batch_size > SOCK_MAX_BATCH){
+        batch_size = SOCK_MAX_BATCH;
     }
 
-    if (afi == AF_INET){
-        /* With input RAW UDP sockets in IPv4, we get the whole external
-         * IPv4 packet */
-        lbuf_reset_ip(b);
-        pkt_pull_ip(b);
-        lbuf_reset_udp(b);
+    /* UDP GRO is only available with datagram sockets. Each read may return
+     * up to 64KB of coalesced datagrams */
+    if (rx_gro){
+        ctx->slot_size = TUN_GSO_RECEIVE_SIZE;
+        ctx->gro_seg_mem = xmalloc(TUN_GSO_MAX_SEGS * TUN_GSO_SEG_SIZE);
+        if (!ctx->gro_seg_mem){
+            return (BAD);
+        }
     }else{
-        /* With input RAW UDP sockets in IPv6, we get the whole external
-         * UDP packet */
-        lbuf_reset_udp(b);
+        ctx->slot_size = MAX_IP_PKT_LEN;
     }
 
-    udph = pkt_pull_udp(b);
-    if (ntohs(udplen(udph)) < 16){//8 udp header + 8 lisp header
-        return (ERR_NOT_ENCAP);
+    ctx->ring_mem = xmalloc(batch_size * ctx->slot_size);
+    if (!ctx->ring_mem){
+        free(ctx->gro_seg_mem);
+        return (BAD);
+    }
+    for (i = 0; i < batch_size; i++){
+        ctx->ring_ptr[i] = &ctx->ring[i];
+    }
+    ctx->batch_size = batch_size;
+    ctx->tun_fd = tun_fd;
+
+    return (GOOD);
+}
+
+static void
+tun_in_ctx_uninit(tun_in_ctx_t *ctx)
+{
+    free(ctx->ring_mem);
+    ctx->ring_mem = NULL;
+    free(ctx->gro_seg_mem);
+    ctx->gro_seg_mem = NULL;
+}
+
+int
+tun_input_init(int batch_size, data_input_mode_e mode, int data_port,
+        uint8_t offload)
+{
+    rx_mode = mode;
+    rx_port = data_port;
+    rx_gro = offload && mode == DATA_INPUT_DATAGRAM;
+
+    if (tun_in_ctx_init(&main_ctx, batch_size, tun_receive_fd) != GOOD){
+        return (BAD);
+    }
+
+    OOR_LOG(LDBG_1, "Data input: Reading up to %d packets per wakeup",
+            main_ctx.batch_size);
+
+    return (GOOD);
+}
+
+void
+tun_input_uninit()
+{
+    tun_input_stop_workers();
+    tun_input_log_stats();
+    tun_in_ctx_uninit(&main_ctx);
+}
+
+void
+tun_input_log_stats()
+{
+    uint64_t rx_pkts = main_ctx.rx_pkts;
+    uint64_t rx_batches = main_ctx.rx_batches;
+    int i;
+
+    for (i = 0; i < workers_num; i++){
+        rx_pkts += workers[i].rx_pkts;
+        rx_batches += workers[i].rx_batches;
+    }
+    OOR_LOG(LDBG_1, "Data input: %llu packets received in %llu batches. "
+            "Average batch size: %.2f", (unsigned long long)rx_pkts,
+            (unsigned long long)rx_batches,
+            rx_batches ? (double)rx_pkts / rx_batches : 0);
+}
+
+static void tun_input_pin_to_cpu(int cpu);
+
+static void *
+tun_input_worker(void *arg)
+{
+    tun_in_ctx_t *ctx = (tun_in_ctx_t *)arg;
+    struct pollfd pfds[TUN_IN_MAX_SOCKS];
+    int i, npkts;
+
+    tun_input_pin_to_cpu(ctx->cpu);
+    for (i = 0; i < ctx->socks_num; i++){
+        pfds[i].fd = ctx->socks[i];
+        pfds[i].events = POLLIN;
+    }
+
+    while (ctx->running){
+        if (poll(pfds, ctx->socks_num, TUN_IN_POLL_TIMEOUT) <= 0){
+            continue;
+        }
+        for (i = 0; i < ctx->socks_num; i++){
+            if (!(pfds[i].revents & POLLIN)){
+                continue;
+            }
+            npkts = tun_input_recv_batch(ctx, pfds[i].fd, FALSE);
+            tun_input_process_batch(ctx, npkts);
+        }
+    }
+
+    return (NULL);
+}
+
+/* Pin the calling thread to a CPU */
+static void
+tun_input_pin_to_cpu(int cpu)
+{
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus) != 0){
+        OOR_LOG(LDBG_1, "tun_input_pin_to_cpu: Couldn't pin worker to CPU %d", cpu);
+    }
+}
+
+/* Start num input workers. Worker i drains the socks_per_worker sockets
+ * starting at socks[i * socks_per_worker], all of them bound to the data port
+ * with SO_REUSEPORT, and writes the decapsulated packets to the tun queue
+ * tun_fds[i % tun_fds_num]. Workers are pinned to consecutive CPUs */
+int
+tun_input_start_workers(int num, int *socks, int socks_per_worker,
+        int *tun_fds, int tun_fds_num)
+{
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int i, j;
+
+    if (ncpus < 1){
+        ncpus = 1;
+    }
+    workers = xzalloc(num * sizeof(tun_in_ctx_t));
+    if (!workers || socks_per_worker > TUN_IN_MAX_SOCKS){
+        for (j = 0; j < num * socks_per_worker; j++){
+            close(socks[j]);
+        }
+        free(workers);
+        workers = NULL;
+        return (BAD);
+    }
+
+    for (i = 0; i < num; i++){
+        if (tun_in_ctx_init(&workers[i], main_ctx.batch_size,
+                tun_fds[i % tun_fds_num]) != GOOD){
+            break;
+        }
+        for (j = 0; j < socks_per_worker; j++){
+            workers[i].socks[j] = socks[i * socks_per_worker + j];
+        }
+        workers[i].socks_num = socks_per_worker;
+        workers[i].cpu = i % ncpus;
+        workers[i].running = TRUE;
+        if (pthread_create(&workers[i].thread, NULL, tun_input_worker,
+                &workers[i]) != 0){
+            OOR_LOG(LERR, "tun_input_start_workers: Couldn't create worker %d: %s",
+                    i, strerror(errno));
+            tun_in_ctx_uninit(&workers[i]);
+            break;
+        }
+        workers_num++;
+    }
+
+    if (workers_num != num){
+        /* Sockets of the workers not started are still ours */
+        for (j = workers_num * socks_per_worker; j < num * socks_per_worker; j++){
+            close(socks[j]);
+        }
+        tun_input_stop_workers();
+        return (BAD);
+    }
+
+    OOR_LOG(LINF, "Data input: Started %d workers", workers_num);
+
+    return (GOOD);
+}
+
+void
+tun_input_stop_workers()
+{
+    int i, j;
+
+    for (i = 0; i < workers_num; i++){
+        workers[i].running = FALSE;
+    }
+    for (i = 0; i < workers_num; i++){
+        pthread_join(workers[i].thread, NULL);
+        OOR_LOG(LDBG_1, "Data input worker %d: %llu packets received",
+                i, (unsigned long long)workers[i].rx_pkts);
+        /* Keep the global counters */
+        main_ctx.rx_pkts += workers[i].rx_pkts;
+        main_ctx.rx_batches += workers[i].rx_batches;
+        for (j = 0; j < workers[i].socks_num; j++){
+            close(workers[i].socks[j]);
+        }
+        tun_in_ctx_uninit(&workers[i]);
+    }
+    free(workers);
+    workers = NULL;
+    workers_num = 0;
+}
+
+/* Read into the ring all the packets queued in the socket, up to the
+ * configured batch size. Returns the number of packets read */
+static int
+tun_input_recv_batch(tun_in_ctx_t *ctx, int sock, uint8_t reserve)
+{
+    int i, npkts;
+
+    for (i = 0; i < ctx->batch_size; i++){
+        lbuf_use_stack(&ctx->ring[i], ctx->ring_mem + i * ctx->slot_size,
+                ctx->slot_size);
+        if (reserve){
+            /* Reserve space in case the received packet was IPv6. In this
+             * case the IPv6 header is not provided */
+            lbuf_reserve(&ctx->ring[i], LBUF_STACK_OFFSET);
+        }
+    }
+
+    npkts = sock_data_recv_batch(sock, ctx->ring_ptr, ctx->ring_afi,
+            ctx->ring_ttl, ctx->ring_tos, ctx->ring_seg_size, ctx->batch_size);
+    if (npkts <= 0){
+        return (0);
+    }
+
+    ctx->rx_pkts += npkts;
+    ctx->rx_batches++;
+
+    return (npkts);
+}
+
+static int
+tun_decap_pkt(lbuf_t *b, int afi, uint8_t ttl, uint8_t tos, uint32_t *iid)
+{
+    struct udphdr *udph;
+    int port;
+
+    if (rx_mode == DATA_INPUT_DATAGRAM){
+        /* Datagram sockets bound to the data port only provide the UDP
+         * payload */
+        if (lbuf_size(b) < 8){ // 8-> At least LISP header size
+            return (ERR_NOT_ENCAP);
+        }
+        port = rx_port;
+    }else{
+        if (afi == AF_INET){
+            /* With input RAW UDP sockets in IPv4, we get the whole external
+             * IPv4 packet */
+            lbuf_reset_ip(b);
+            pkt_pull_ip(b);
+            lbuf_reset_udp(b);
+        }else{
+            /* With input RAW UDP sockets in IPv6, we get the whole external
+             * UDP packet */
+            lbuf_reset_udp(b);
+        }
+
+        udph = pkt_pull_udp(b);
+        if (ntohs(udplen(udph)) < 16){//8 udp header + 8 lisp header
+            return (ERR_NOT_ENCAP);
+        }
+        port = ntohs(udpdport(udph));
     }
 
-    /* FILTER UDP: with input RAW UDP sockets, we receive all UDP packets,
-     * we only want LISP data ones */
-    switch (ntohs(udpdport(udph))){
+    return (tun_decap_payload(b, port, ttl, tos, iid));
+}
+
+/* Remove the LISP or VXLAN-GPE header of a packet received on port and
+ * prepare the inner packet to be written to the tun */
+static int
+tun_decap_payload(lbuf_t *b, int port, uint8_t ttl, uint8_t tos, uint32_t *iid)
+{
+    lisp_data_hdr_t *lisph;
+    vxlan_gpe_hdr_t *vxlanh;
+
+    /* FILTER UDP: with input RAW UDP sockets without kernel filter, we
+     * receive all UDP packets, we only want LISP data ones */
+    switch (port){
     case LISP_DATA_PORT:
         lisph = lisp_data_pull_hdr(b);
         if (LDHDR_LSB_BIT(lisph)){
@@ -73,8 +392,6 @@ tun_read_and_decap_pkt(int sock, lbuf_t *b, uint32_t *iid)
         }else{
             *iid = 0;
         }
-
-        port = LISP_DATA_PORT;
         break;
     case VXLAN_GPE_DATA_PORT:
 
@@ -82,7 +399,6 @@ tun_read_and_decap_pkt(int sock, lbuf_t *b, uint32_t *iid)
         if (VXLAN_HDR_VNI_BIT(vxlanh)){
             *iid = vxlan_gpe_hdr_get_vni(vxlanh);
         }
-        port = VXLAN_GPE_DATA_PORT;
         break;
     default:
         return (ERR_NOT_ENCAP);
@@ -101,47 +417,213 @@ tun_read_and_decap_pkt(int sock, lbuf_t *b, uint32_t *iid)
     return(GOOD);
 }
 
-int
-tun_process_input_packet(sock_t *sl)
+/* Point seg to the next datagram coalesced by UDP GRO in b, starting at
+ * offset. Returns FALSE when there are no more datagrams */
+static int
+tun_input_gro_next(lbuf_t *b, uint16_t seg_size, int *offset, lbuf_t *seg)
+{
+    int len = lbuf_size(b) - *offset;
+
+    if (len <= 0){
+        return (FALSE);
+    }
+    if (len > seg_size){
+        len = seg_size;
+    }
+    lbuf_use_stack(seg, (uint8_t *)lbuf_data(b) + *offset, len);
+    lbuf_set_size(seg, len);
+    *offset += len;
+
+    return (TRUE);
+}
+
+static void
+tun_input_deliver(tun_in_ctx_t *ctx, lbuf_t *b, int afi, uint8_t ttl,
+        uint8_t tos)
 {
     uint32_t iid;
-    lbuf_use_stack(&pkt_buf, &pkt_recv_buf, MAX_IP_PKT_LEN);
 
-    if (tun_read_and_decap_pkt(sl->fd, &pkt_buf, &iid) != GOOD) {
-        return (BAD);
+    if (tun_decap_pkt(b, afi, ttl, tos, &iid) != GOOD) {
+        return;
     }
 
     /* XXX Destination packet should be checked it belongs to this xTR */
-    if ((write(tun_receive_fd, lbuf_l3(&pkt_buf), lbuf_size(&pkt_buf))) < 0) {
+    if ((tun_write(ctx->tun_fd, lbuf_l3(b), lbuf_size(b))) < 0) {
         OOR_LOG(LDBG_2, "lisp_input: write error: %s\n ", strerror(errno));
     }
+}
 
-    return (GOOD);
+/* Decapsulate the packets of the ring and write them to the tun */
+static void
+tun_input_process_batch(tun_in_ctx_t *ctx, int npkts)
+{
+    lbuf_t seg;
+    int i, offset;
+
+    for (i = 0; i < npkts; i++){
+        if (ctx->ring_seg_size[i] == 0){
+            tun_input_deliver(ctx, &ctx->ring[i], ctx->ring_afi[i],
+                    ctx->ring_ttl[i], ctx->ring_tos[i]);
+            continue;
+        }
+        offset = 0;
+        while (tun_input_gro_next(&ctx->ring[i], ctx->ring_seg_size[i], &offset,
+                &seg)){
+            tun_input_deliver(ctx, &seg, ctx->ring_afi[i], ctx->ring_ttl[i],
+                    ctx->ring_tos[i]);
+        }
+    }
 }
 
 int
-tun_rtr_process_input_packet(struct sock *sl)
+tun_process_input_packet(sock_t *sl)
 {
-    packet_tuple_t tpl;
-    lbuf_use_stack(&pkt_buf, &pkt_recv_buf, MAX_IP_PKT_LEN);
-    /* Reserve space in case the received packet was IPv6. In this case the IPv6 header is
-     * not provided */
-    lbuf_reserve(&pkt_buf,LBUF_STACK_OFFSET);
+    int npkts;
 
-    if (tun_read_and_decap_pkt(sl->fd, &pkt_buf, &(tpl.iid)) != GOOD) {
+    npkts = tun_input_recv_batch(&main_ctx, sl->fd, FALSE);
+    if (npkts == 0){
         return (BAD);
     }
+    tun_input_process_batch(&main_ctx, npkts);
+
+    return (GOOD);
+}
+
+static void
+tun_rtr_input_forward(lbuf_t *b, int afi, uint8_t ttl, uint8_t tos)
+{
+    uint32_t iid;
+
+    if (tun_decap_pkt(b, afi, ttl, tos, &iid) != GOOD) {
+        return;
+    }
+    tun_rtr_forward_decap(b, iid);
+}
+
+/* Re-encapsulate a decapsulated packet. The buffer should have enough
+ * headroom for the new outer headers */
+static void
+tun_rtr_forward_decap(lbuf_t *b, uint32_t iid)
+{
+    packet_tuple_t tpl;
+
+    tpl.iid = iid;
 
     OOR_LOG(LDBG_3, "Forwarding packet to OUPUT for re-encapsulation");
 
-    lbuf_point_to_l3(&pkt_buf);
-    lbuf_reset_ip(&pkt_buf);
+    lbuf_point_to_l3(b);
+    lbuf_reset_ip(b);
+
+    if (pkt_parse_5_tuple(b, &tpl) != GOOD) {
+        return;
+    }
+    tun_output(b, &tpl);
+}
+
+/* Re-encapsulate the datagrams coalesced by UDP GRO in b. Each one is copied
+ * to a buffer with headroom for the new outer headers */
+static void
+tun_rtr_input_forward_gro(lbuf_t *b, int afi, uint8_t ttl, uint8_t tos,
+        uint16_t seg_size)
+{
+    lbuf_t view, seg;
+    int offset = 0, nsegs = 0;
+
+    if (seg_size > TUN_GSO_SEG_SIZE - LBUF_STACK_OFFSET){
+        OOR_LOG(LDBG_2, "tun_rtr_input_forward_gro: Segment too big (%d)", seg_size);
+        return;
+    }
+
+    while (tun_input_gro_next(b, seg_size, &offset, &view)){
+        if (nsegs == TUN_GSO_MAX_SEGS){
+            tun_output_flush();
+            nsegs = 0;
+        }
+        lbuf_use_stack(&seg, main_ctx.gro_seg_mem + nsegs * TUN_GSO_SEG_SIZE,
+                TUN_GSO_SEG_SIZE);
+        lbuf_reserve(&seg, LBUF_STACK_OFFSET);
+        lbuf_put(&seg, lbuf_data(&view), lbuf_size(&view));
+        tun_rtr_input_forward(&seg, afi, ttl, tos);
+        nsegs++;
+    }
+
+    /* Send the re-encapsulated packets before reusing the segment buffers */
+    tun_output_flush();
+}
+
+int
+tun_rtr_process_input_packet(struct sock *sl)
+{
+    tun_in_ctx_t *ctx = &main_ctx;
+    int i, npkts;
 
-    if (pkt_parse_5_tuple(&pkt_buf, &tpl) != GOOD) {
+    npkts = tun_input_recv_batch(ctx, sl->fd, TRUE);
+    if (npkts == 0){
         return (BAD);
     }
-    tun_output(&pkt_buf, &tpl);
+
+    for (i = 0; i < npkts; i++){
+        if (ctx->ring_seg_size[i] == 0){
+            tun_rtr_input_forward(&ctx->ring[i], ctx->ring_afi[i],
+                    ctx->ring_ttl[i], ctx->ring_tos[i]);
+        }else{
+            tun_rtr_input_forward_gro(&ctx->ring[i], ctx->ring_afi[i],
+                    ctx->ring_ttl[i], ctx->ring_tos[i], ctx->ring_seg_size[i]);
+        }
+    }
+
+    /* Send the re-encapsulated packets before reusing the ring */
+    tun_output_flush();
 
     return(GOOD);
 }
 
+/* Process an encapsulated packet read from a packet ring. Its data starts at
+ * the outer IP header for both address families and may include the padding
+ * of the link layer. It is decapsulated and written to the tun or, in RTR
+ * mode, re-encapsulated. In this case the caller should flush the output */
+int
+tun_input_ring_pkt(lbuf_t *b, uint8_t rtr)
+{
+    struct iphdr *iph = lbuf_data(b);
+    struct udphdr *udph;
+    uint32_t iid;
+    int ttl, tos, ip_len;
+
+    if (lbuf_size(b) < sizeof(struct iphdr)
+            || ip_hdr_ttl_and_tos(iph, &ttl, &tos) != GOOD){
+        return (BAD);
+    }
+    if (iph->version == 4){
+        ip_len = ntohs(iph->tot_len);
+    }else{
+        ip_len = ntohs(((struct ip6_hdr *)iph)->ip6_plen) + sizeof(struct ip6_hdr);
+    }
+    if (ip_len > lbuf_size(b)){
+        return (BAD);
+    }
+    lbuf_set_size(b, ip_len);
+
+    lbuf_reset_ip(b);
+    if (!pkt_pull_ip(b) || lbuf_size(b) < 16){ //8 udp header + 8 lisp header
+        return (ERR_NOT_ENCAP);
+    }
+    lbuf_reset_udp(b);
+    udph = pkt_pull_udp(b);
+    if (tun_decap_payload(b, ntohs(udpdport(udph)), ttl, tos, &iid) != GOOD){
+        return (ERR_NOT_ENCAP);
+    }
+    main_ctx.rx_pkts++;
+
+    if (rtr){
+        tun_rtr_forward_decap(b, iid);
+        return (GOOD);
+    }
+
+    if ((tun_write(main_ctx.tun_fd, lbuf_l3(b), lbuf_size(b))) < 0) {
+        OOR_LOG(LDBG_2, "lisp_input: write error: %s\n ", strerror(errno));
+        return (BAD);
+    }
+
+    return (GOOD);
+}
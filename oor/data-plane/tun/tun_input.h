@@ -30,8 +30,17 @@
 #include "../../defs.h"
 #include "../../lib/sockets.h"
 #include "../../lib/cksum.h"
+#include "../data-plane.h"
 
+int tun_input_init(int batch_size, data_input_mode_e mode, int data_port,
+        uint8_t offload);
+void tun_input_uninit();
+void tun_input_log_stats();
+int tun_input_start_workers(int num, int *socks, int socks_per_worker,
+        int *tun_fds, int tun_fds_num);
+void tun_input_stop_workers();
 int tun_process_input_packet(struct sock *sl);
 int tun_rtr_process_input_packet(struct sock *sl);
+int tun_input_ring_pkt(lbuf_t *b, uint8_t rtr);
 
 #endif /*TUN_IFACE_LIST_H_*/
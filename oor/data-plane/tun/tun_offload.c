@@ -0,0 +1,243 @@
+/*
+ *
+ * Copyright (C) 2011, 2015 Cisco Systems, Inc.
+ * Copyright (C) 2015 CBA research group, Technical University of Catalonia.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+
+#include "tun_offload.h"
+#include "../../lib/cksum.h"
+#include "../../lib/oor_log.h"
+
+/* TCP flags that must only appear in the first or last segment of a super
+ * packet */
+#define TCP_FLAGS_OFFSET    13
+#define TCP_FLAG_FIN        0x01
+#define TCP_FLAG_PSH        0x08
+#define TCP_FLAG_CWR        0x80
+
+/* Set once the tun has been created with IFF_VNET_HDR. From then on, every
+ * packet read from or written to the tun carries a virtio_net_hdr */
+static uint8_t tun_vnet_hdr = FALSE;
+
+/* Configure a tun created with IFF_VNET_HDR to hand us TCP super-packets
+ * (TSO) with partial checksums. On error the tun must be recreated without
+ * IFF_VNET_HDR */
+int
+tun_offload_tun_init(int fd)
+{
+    int hdr_len = TUN_VNET_HDR_LEN;
+    unsigned int offload = TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6 | TUN_F_TSO_ECN;
+
+    tun_vnet_hdr = FALSE;
+
+    if (ioctl(fd, TUNSETVNETHDRSZ, &hdr_len) < 0){
+        OOR_LOG(LERR, "TUN/TAP: unable to set the virtio header size: %s",
+                strerror(errno));
+        return (BAD);
+    }
+    if (ioctl(fd, TUNSETOFFLOAD, offload) < 0){
+        OOR_LOG(LWRN, "TUN/TAP: unable to enable TCP segmentation offload: %s",
+                strerror(errno));
+        return (BAD);
+    }
+    tun_vnet_hdr = TRUE;
+    OOR_LOG(LDBG_1, "TUN/TAP: TCP segmentation offload enabled");
+
+    return (GOOD);
+}
+
+uint8_t
+tun_offload_enabled()
+{
+    return (tun_vnet_hdr);
+}
+
+/* Write an IP packet to the tun, preceded by an empty virtio header when
+ * required */
+int
+tun_write(int fd, void *pkt, int len)
+{
+    struct virtio_net_hdr vnet_hdr;
+    struct iovec iov[2];
+
+    if (!tun_vnet_hdr){
+        return (write(fd, pkt, len));
+    }
+
+    memset(&vnet_hdr, 0, sizeof(struct virtio_net_hdr));
+    iov[0].iov_base = &vnet_hdr;
+    iov[0].iov_len = TUN_VNET_HDR_LEN;
+    iov[1].iov_base = pkt;
+    iov[1].iov_len = len;
+
+    return (writev(fd, iov, 2));
+}
+
+/* Remove the virtio header of a packet read from the tun. For super-packets
+ * gso_size is the size of the payload of each segment, otherwise it is 0 and
+ * the transport checksum, if left to us, is completed */
+int
+tun_offload_pull_vnet_hdr(lbuf_t *b, uint16_t *gso_size)
+{
+    struct virtio_net_hdr vnet_hdr;
+    uint16_t *csum;
+    uint8_t *pkt;
+    int size;
+
+    if (lbuf_size(b) < TUN_VNET_HDR_LEN){
+        return (BAD);
+    }
+    memcpy(&vnet_hdr, lbuf_data(b), TUN_VNET_HDR_LEN);
+    lbuf_pull(b, TUN_VNET_HDR_LEN);
+
+    switch (vnet_hdr.gso_type & ~VIRTIO_NET_HDR_GSO_ECN){
+    case VIRTIO_NET_HDR_GSO_NONE:
+        *gso_size = 0;
+        break;
+    case VIRTIO_NET_HDR_GSO_TCPV4:
+    case VIRTIO_NET_HDR_GSO_TCPV6:
+        /* The checksum of each segment is calculated when segmenting */
+        *gso_size = vnet_hdr.gso_size;
+        return (GOOD);
+    default:
+        OOR_LOG(LDBG_2, "tun_offload_pull_vnet_hdr: Unsupported GSO type %d",
+                vnet_hdr.gso_type);
+        return (BAD);
+    }
+
+    if (vnet_hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM){
+        pkt = lbuf_data(b);
+        size = lbuf_size(b);
+        if (vnet_hdr.csum_start + vnet_hdr.csum_offset + 2 > size){
+            return (BAD);
+        }
+        /* The checksum field already holds the sum of the pseudo-header */
+        csum = (uint16_t *)(pkt + vnet_hdr.csum_start + vnet_hdr.csum_offset);
+        *csum = ip_checksum((uint16_t *)(pkt + vnet_hdr.csum_start),
+                size - vnet_hdr.csum_start);
+        if (*csum == 0 && vnet_hdr.csum_offset == offsetof(struct udphdr, check)){
+            *csum = 0xffff;
+        }
+    }
+
+    return (GOOD);
+}
+
+/* Update the IP and TCP headers of segment i out of nsegs of a super-packet */
+static void
+tun_offload_fix_segment(uint8_t *pkt, int afi, int ip_hlen, int size,
+        uint32_t seq, uint16_t i, int nsegs)
+{
+    struct iphdr *iph;
+    struct ip6_hdr *ip6h;
+    struct tcphdr *tcph = (struct tcphdr *)(pkt + ip_hlen);
+    uint8_t *flags = (uint8_t *)tcph + TCP_FLAGS_OFFSET;
+
+    if (afi == AF_INET){
+        iph = (struct iphdr *)pkt;
+        iph->tot_len = htons(size);
+        iph->id = htons(ntohs(iph->id) + i);
+        iph->check = 0;
+        iph->check = ip_checksum((uint16_t *)iph, ip_hlen);
+    }else{
+        ip6h = (struct ip6_hdr *)pkt;
+        ip6h->ip6_plen = htons(size - ip_hlen);
+    }
+
+    tcph->seq = htonl(seq);
+    if (i != nsegs - 1){
+        *flags &= ~(TCP_FLAG_FIN | TCP_FLAG_PSH);
+    }
+    if (i != 0){
+        *flags &= ~TCP_FLAG_CWR;
+    }
+    tcph->check = 0;
+    tcph->check = tcp_checksum(tcph, size - ip_hlen, pkt, afi);
+}
+
+/* Split a TCP super-packet into segments of gso_size bytes of payload, each
+ * one with its own copy of the IP and TCP headers. Segment i is stored in
+ * segs[i], which uses TUN_GSO_SEG_SIZE bytes of seg_mem with LBUF_STACK_OFFSET
+ * bytes of headroom for the encapsulation headers.
+ * Returns the number of segments or BAD */
+int
+tun_offload_segment(lbuf_t *b, uint16_t gso_size, lbuf_t *segs,
+        uint8_t *seg_mem, int max_segs)
+{
+    uint8_t *pkt = lbuf_data(b);
+    uint8_t *seg;
+    int size = lbuf_size(b);
+    int afi, proto, ip_hlen, hlen, payload_len, len, nsegs, i;
+    uint32_t seq;
+
+    if (size < sizeof(struct ip6_hdr)){
+        return (BAD);
+    }
+    switch (((struct iphdr *)pkt)->version){
+    case IPVERSION:
+        afi = AF_INET;
+        ip_hlen = ((struct iphdr *)pkt)->ihl * 4;
+        proto = ((struct iphdr *)pkt)->protocol;
+        break;
+    case 6:
+        /* IPv6 extension headers are not supported */
+        afi = AF_INET6;
+        ip_hlen = sizeof(struct ip6_hdr);
+        proto = ((struct ip6_hdr *)pkt)->ip6_nxt;
+        break;
+    default:
+        return (BAD);
+    }
+    if (proto != IPPROTO_TCP || size < ip_hlen + sizeof(struct tcphdr)){
+        return (BAD);
+    }
+
+    hlen = ip_hlen + ((struct tcphdr *)(pkt + ip_hlen))->doff * 4;
+    payload_len = size - hlen;
+    if (gso_size == 0 || payload_len <= 0
+            || hlen + gso_size > TUN_GSO_SEG_SIZE - LBUF_STACK_OFFSET){
+        return (BAD);
+    }
+    nsegs = (payload_len + gso_size - 1) / gso_size;
+    if (nsegs > max_segs){
+        OOR_LOG(LDBG_2, "tun_offload_segment: Too many segments (%d)", nsegs);
+        return (BAD);
+    }
+
+    seq = ntohl(((struct tcphdr *)(pkt + ip_hlen))->seq);
+    for (i = 0; i < nsegs; i++){
+        len = payload_len - i * gso_size;
+        if (len > gso_size){
+            len = gso_size;
+        }
+        lbuf_use_stack(&segs[i], seg_mem + i * TUN_GSO_SEG_SIZE, TUN_GSO_SEG_SIZE);
+        lbuf_reserve(&segs[i], LBUF_STACK_OFFSET);
+        seg = lbuf_put(&segs[i], pkt, hlen);
+        lbuf_put(&segs[i], pkt + hlen + i * gso_size, len);
+        tun_offload_fix_segment(seg, afi, ip_hlen, hlen + len,
+                seq + i * gso_size, i, nsegs);
+        lbuf_reset_ip(&segs[i]);
+    }
+
+    return (nsegs);
+}
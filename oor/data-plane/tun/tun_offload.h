@@ -0,0 +1,43 @@
+/*
+ *
+ * Copyright (C) 2011, 2015 Cisco Systems, Inc.
+ * Copyright (C) 2015 CBA research group, Technical University of Catalonia.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef TUN_OFFLOAD_H_
+#define TUN_OFFLOAD_H_
+
+#include <linux/virtio_net.h>
+#include "tun.h"
+#include "../../lib/lbuf.h"
+
+/* Header prepended by the kernel to the packets of a tun with IFF_VNET_HDR */
+#define TUN_VNET_HDR_LEN        sizeof(struct virtio_net_hdr)
+/* Size of the buffers where GSO super-packets are read from the tun */
+#define TUN_GSO_RECEIVE_SIZE    (65536 + LBUF_STACK_OFFSET)
+/* Max number of segments a super-packet can be split into */
+#define TUN_GSO_MAX_SEGS        128
+/* Size of the buffers where each segment is built */
+#define TUN_GSO_SEG_SIZE        TUN_RECEIVE_SIZE
+
+int tun_offload_tun_init(int fd);
+uint8_t tun_offload_enabled();
+int tun_write(int fd, void *pkt, int len);
+int tun_offload_pull_vnet_hdr(lbuf_t *b, uint16_t *gso_size);
+int tun_offload_segment(lbuf_t *b, uint16_t gso_size, lbuf_t *segs,
+        uint8_t *seg_mem, int max_segs);
+
+#endif /* TUN_OFFLOAD_H_ */
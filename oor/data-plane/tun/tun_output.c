@@ -19,41 +19,490 @@
 
 
 #include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "tun_output.h"
 #include "tun.h"
+#include "tun_offload.h"
 #include "../encapsulations/vxlan-gpe.h"
+#include "../pkt_mmap/pkt_mmap.h"
 #include "../../fwd_policies/fwd_policy.h"
 #include "../../liblisp/liblisp.h"
 #include "../../lib/packets.h"
 #include "../../lib/sockets.h"
 #include "../../control/oor_control.h"
+#include "../../lib/epoch.h"
+#include "../../lib/fwd_pub.h"
+#include "../../lib/mem_util.h"
+#include "../../lib/pcache.h"
+#include "../../lib/pendq.h"
 #include "../../lib/ttable.h"
 #include "../../lib/oor_log.h"
 #include "../../lib/sockets-util.h"
+#include "../data-plane.h"
 
 
-/* static buffer to receive packets */
-static uint8_t pkt_recv_buf[TUN_RECEIVE_SIZE];
-static lbuf_t pkt_buf;
-ttable_t ttable;
+/* Max number of output sockets with packets pending to be sent */
+#define TUN_MAX_TX_QUEUES   16
+/* Max number of output sockets owned by a worker */
+#define TUN_MAX_OUT_SOCKS   16
+/* Number of sockets used to send segmented datagrams kept by a context */
+#define TUN_GSO_SOCKS       64
+/* Time a worker waits for packets before checking if it should stop (ms) */
+#define TUN_WORKER_POLL_TIMEOUT 100
+
+typedef struct tun_out_sock_ {
+    lisp_addr_t addr;
+    int sock;
+} tun_out_sock_t;
+
+/* Socket bound to a source RLOC and outer UDP source port. Port 0 if not in
+ * use */
+typedef struct tun_gso_sock_ {
+    lisp_addr_t addr;
+    uint16_t port;
+    int sock;
+} tun_gso_sock_t;
+
+/* State used to encapsulate the packets read from a tun queue. The main
+ * thread and each one of the workers owns one, so they can work in parallel
+ * without sharing buffers, flows or sockets */
+typedef struct tun_out_ctx_ {
+    int fd;
+    /* Ring of preallocated buffers where batches of packets are read */
+    uint8_t *ring_mem;
+    lbuf_t ring[SOCK_MAX_BATCH];
+    int batch_size;
+    int slot_size;
+    /* Segments of the last super-packet read from the tun (offload mode) */
+    uint8_t *gso_seg_mem;
+    lbuf_t gso_segs[TUN_GSO_MAX_SEGS];
+    /* UDP sockets bound to the source RLOCs and source ports of the flows,
+     * used to send segmented datagrams (offload mode). Indexed by port */
+    tun_gso_sock_t gso_socks[TUN_GSO_SOCKS];
+    /* Encapsulated packets pending to be sent, one queue per output socket.
+     * The queues point to the buffers of the packets, so they are flushed
+     * before the buffers are reused */
+    sock_txq_t tx_queues[TUN_MAX_TX_QUEUES];
+    int tx_queues_num;
+    ttable_t ttable;
+    /* Forwarding info of the prefixes, used to forward new flows without
+     * requesting it to the control plane */
+    pcache_t pcache;
+    /* Id of the worker in the epoch domain of the readers of the published
+     * prefixes. Negative if it doesn't read them without locking */
+    int epoch_id;
+    /* The control plane is locked by the context */
+    uint8_t ctrl_locked;
+    /* Sockets owned by the context. Only used by workers. The main thread
+     * uses the sockets of the interfaces */
+    tun_out_sock_t out_socks[TUN_MAX_OUT_SOCKS];
+    int out_socks_num;
+    uint8_t own_sockets;
+    /* Output counters */
+    uint64_t tx_pkts;
+    uint64_t tx_batches;
+    uint64_t gso_pkts;
+    /* New flows forwarded with the published prefixes */
+    uint64_t pub_hits;
+    /* Worker thread */
+    pthread_t thread;
+    volatile uint8_t running;
+} tun_out_ctx_t;
+
+static tun_out_ctx_t main_ctx;
+static tun_out_ctx_t *workers = NULL;
+static int workers_num = 0;
+/* Packets of all the contexts waiting for the mapping of their destination */
+static pendq_t pending;
+/* Prefixes obtained from the control plane by any of the contexts. Read
+ * without locking by the workers */
+static fwd_pub_t published;
+static epoch_t readers;
 
 
 static int tun_output_multicast(lbuf_t *b, packet_tuple_t *tuple);
-static int tun_output_unicast(lbuf_t *b, packet_tuple_t *tuple);
+static int tun_output_unicast(tun_out_ctx_t *ctx, lbuf_t *b, packet_tuple_t *tuple);
+static int tun_output_ctx(tun_out_ctx_t *ctx, lbuf_t *b, packet_tuple_t *tpl);
 static int tun_forward_native(lbuf_t *b, lisp_addr_t *dst);
 static inline int is_lisp_packet(packet_tuple_t *tpl);
+static int tun_output_queue(tun_out_ctx_t *ctx, int sock, lbuf_t *b, ip_addr_t *dst);
+static void tun_output_ctx_flush(tun_out_ctx_t *ctx);
+static int tun_output_read_batch(tun_out_ctx_t *ctx);
+static int tun_output_gso(tun_out_ctx_t *ctx, lbuf_t *b, packet_tuple_t *tpl,
+        uint16_t gso_size);
 
-void
-tun_output_init()
+static int
+tun_out_ctx_init(tun_out_ctx_t *ctx, int fd, int batch_size, uint8_t own_sockets)
+{
+    memset(ctx, 0, sizeof(tun_out_ctx_t));
+    if (batch_size < 1){
+        batch_size = 1;
+    }else if (batch_size > SOCK_MAX_BATCH){
+        batch_size = SOCK_MAX_BATCH;
+    }
+
+    /* With offload, the kernel may hand us super-packets of up to 64KB */
+    if (tun_offload_enabled()){
+        ctx->slot_size = TUN_GSO_RECEIVE_SIZE;
+        ctx->gso_seg_mem = xmalloc(TUN_GSO_MAX_SEGS * TUN_GSO_SEG_SIZE);
+        if (!ctx->gso_seg_mem){
+            return (BAD);
+        }
+    }else{
+        ctx->slot_size = TUN_RECEIVE_SIZE;
+    }
+
+    ctx->ring_mem = xmalloc(batch_size * ctx->slot_size);
+    if (!ctx->ring_mem){
+        free(ctx->gso_seg_mem);
+        return (BAD);
+    }
+    ctx->fd = fd;
+    ctx->batch_size = batch_size;
+    ctx->own_sockets = own_sockets;
+    /* The main thread only runs with the control plane locked */
+    ctx->ctrl_locked = !own_sockets;
+    ctx->epoch_id = ERR_EXIST;
+    ttable_init_sized(&ctx->ttable, data_plane_conf.flow_table_size,
+            data_plane_conf.flow_idle_timeout);
+    pcache_init(&ctx->pcache, data_plane_conf.prefix_cache_size);
+
+    return (GOOD);
+}
+
+static void
+tun_out_ctx_uninit(tun_out_ctx_t *ctx)
 {
-    ttable_init(&ttable);
+    int i;
+
+    tun_output_ctx_flush(ctx);
+    ttable_uninit(&ctx->ttable);
+    pcache_uninit(&ctx->pcache);
+    for (i = 0; i < ctx->out_socks_num; i++){
+        close(ctx->out_socks[i].sock);
+    }
+    ctx->out_socks_num = 0;
+    for (i = 0; i < TUN_GSO_SOCKS; i++){
+        if (ctx->gso_socks[i].port != 0){
+            close(ctx->gso_socks[i].sock);
+            ctx->gso_socks[i].port = 0;
+        }
+    }
+    free(ctx->ring_mem);
+    ctx->ring_mem = NULL;
+    free(ctx->gso_seg_mem);
+    ctx->gso_seg_mem = NULL;
+}
+
+int
+tun_output_init(int batch_size)
+{
+    pendq_init(&pending, data_plane_conf.pending_pkts,
+            data_plane_conf.pending_bytes, data_plane_conf.pending_max_pkts,
+            data_plane_conf.pending_max_bytes, data_plane_conf.pending_timeout);
+    epoch_init(&readers);
+    fwd_pub_init(&published, data_plane_conf.prefix_cache_size, &readers);
+    return (tun_out_ctx_init(&main_ctx, tun_receive_fd, batch_size, FALSE));
 }
 
 void
 tun_output_uninit()
 {
-    ttable_uninit(&ttable);
+    tun_output_stop_workers();
+    tun_output_log_stats();
+    tun_out_ctx_uninit(&main_ctx);
+    pendq_uninit(&pending);
+    fwd_pub_uninit(&published);
+    epoch_uninit(&readers);
+}
+
+void
+tun_output_log_stats()
+{
+    uint64_t tx_pkts = main_ctx.tx_pkts;
+    uint64_t tx_batches = main_ctx.tx_batches;
+    uint64_t gso_pkts = main_ctx.gso_pkts;
+    ttable_stats_t flow_stats = main_ctx.ttable.stats;
+    uint32_t flows = ttable_size(&main_ctx.ttable);
+    uint32_t capacity = ttable_capacity(&main_ctx.ttable);
+    pcache_stats_t pref_stats = main_ctx.pcache.stats;
+    uint32_t prefixes = pcache_size(&main_ctx.pcache);
+    uint64_t pub_hits = main_ctx.pub_hits;
+    pendq_stats_t pend_stats;
+    uint32_t pend_pkts;
+    int i;
+
+    for (i = 0; i < workers_num; i++){
+        tx_pkts += workers[i].tx_pkts;
+        tx_batches += workers[i].tx_batches;
+        gso_pkts += workers[i].gso_pkts;
+        ttable_stats_add(&flow_stats, &workers[i].ttable.stats);
+        flows += ttable_size(&workers[i].ttable);
+        capacity += ttable_capacity(&workers[i].ttable);
+        pcache_stats_add(&pref_stats, &workers[i].pcache.stats);
+        prefixes += pcache_size(&workers[i].pcache);
+        pub_hits += workers[i].pub_hits;
+    }
+    OOR_LOG(LDBG_1, "Data output: %llu encapsulated packets sent in %llu batches. "
+            "Average batch size: %.2f", (unsigned long long)tx_pkts,
+            (unsigned long long)tx_batches,
+            tx_batches ? (double)tx_pkts / tx_batches : 0);
+    if (tun_offload_enabled()){
+        OOR_LOG(LDBG_1, "Data output: %llu super-packets read from the tun",
+                (unsigned long long)gso_pkts);
+    }
+    OOR_LOG(LDBG_1, "Data output: Flow tables with %u flows of %u. %llu flows "
+            "inserted, %llu evicted, %llu idle or invalid removed, %llu "
+            "invalidated on lookup", flows, capacity,
+            (unsigned long long)flow_stats.inserts,
+            (unsigned long long)flow_stats.evictions,
+            (unsigned long long)flow_stats.expirations,
+            (unsigned long long)flow_stats.invalidations);
+    OOR_LOG(LDBG_1, "Data output: Prefix caches with %u prefixes. %llu new "
+            "flows found and %llu not found, %llu prefixes inserted, %llu "
+            "invalidated, %llu flushes", prefixes,
+            (unsigned long long)pref_stats.hits,
+            (unsigned long long)pref_stats.misses,
+            (unsigned long long)pref_stats.inserts,
+            (unsigned long long)pref_stats.invalidations,
+            (unsigned long long)pref_stats.flushes);
+    OOR_LOG(LDBG_1, "Data output: %u published prefixes. %llu new flows found "
+            "in them, %llu prefixes published, %llu invalidated, %llu flushes, "
+            "%u waiting to be freed", fwd_pub_size(&published),
+            (unsigned long long)pub_hits,
+            (unsigned long long)published.stats.inserts,
+            (unsigned long long)published.stats.invalidations,
+            (unsigned long long)published.stats.flushes,
+            epoch_pending(&readers));
+    pendq_get_stats(&pending, &pend_stats, &pend_pkts);
+    OOR_LOG(LDBG_1, "Data output: %u packets waiting for a mapping. %llu kept, "
+            "%llu forwarded once resolved, %llu dropped with the queue full, "
+            "%llu dropped unresolved", pend_pkts,
+            (unsigned long long)pend_stats.queued,
+            (unsigned long long)pend_stats.released,
+            (unsigned long long)pend_stats.drops_full,
+            (unsigned long long)pend_stats.drops_expired);
+}
+
+/* Get the socket of the worker bound to the source RLOC. It is created
+ * the first time it is requested */
+static int *
+tun_out_ctx_get_socket(tun_out_ctx_t *ctx, lisp_addr_t *srloc)
+{
+    tun_out_sock_t *out_sock;
+    int i, afi, sock;
+
+    for (i = 0; i < ctx->out_socks_num; i++){
+        if (lisp_addr_cmp(&ctx->out_socks[i].addr, srloc) == 0){
+            return (&ctx->out_socks[i].sock);
+        }
+    }
+
+    /* The sockets of the interfaces belong to the control plane */
+    if (ctx->out_socks_num == TUN_MAX_OUT_SOCKS){
+        return (ctx->ctrl_locked ? get_out_socket_ptr_from_address(srloc) : NULL);
+    }
+
+    afi = lisp_addr_ip_afi(srloc);
+    sock = open_ip_raw_socket(afi);
+    if (sock == ERR_SOCKET){
+        return (ctx->ctrl_locked ? get_out_socket_ptr_from_address(srloc) : NULL);
+    }
+    bind_socket(sock, afi, srloc, 0);
+
+    out_sock = &ctx->out_socks[ctx->out_socks_num];
+    lisp_addr_copy(&out_sock->addr, srloc);
+    out_sock->sock = sock;
+    ctx->out_socks_num++;
+
+    return (&out_sock->sock);
+}
+
+/* Get the UDP socket bound to the source RLOC and source port used to send
+ * the segmented datagrams of a flow. Each port has a slot, whose socket is
+ * replaced when a flow with a different RLOC or port that maps to it is sent.
+ * The sockets are in a SO_REUSEPORT group so that all the contexts can bind
+ * the same port */
+static int
+tun_out_ctx_get_gso_socket(tun_out_ctx_t *ctx, lisp_addr_t *srloc,
+        uint16_t port)
+{
+    tun_gso_sock_t *gso_sock = &ctx->gso_socks[port % TUN_GSO_SOCKS];
+    int afi, sock;
+
+    if (gso_sock->port == port && lisp_addr_cmp(&gso_sock->addr, srloc) == 0){
+        return (gso_sock->sock);
+    }
+
+    afi = lisp_addr_ip_afi(srloc);
+    sock = open_udp_datagram_socket(afi);
+    if (sock == ERR_SOCKET){
+        return (ERR_SOCKET);
+    }
+    if (socket_set_reuseport(sock) != GOOD
+            || bind_socket(sock, afi, srloc, port) != GOOD){
+        OOR_LOG(LDBG_2, "tun_out_ctx_get_gso_socket: Unable to bind %s:%d",
+                lisp_addr_to_char(srloc), port);
+        close(sock);
+        return (ERR_SOCKET);
+    }
+
+    if (gso_sock->port != 0){
+        close(gso_sock->sock);
+    }
+    lisp_addr_copy(&gso_sock->addr, srloc);
+    gso_sock->port = port;
+    gso_sock->sock = sock;
+
+    return (sock);
+}
+
+/* Queue an encapsulated packet to be sent through sock */
+static int
+tun_output_queue(tun_out_ctx_t *ctx, int sock, lbuf_t *b, ip_addr_t *dst)
+{
+    sock_txq_t *txq;
+    int i;
+
+    for (i = 0; i < ctx->tx_queues_num; i++){
+        if (ctx->tx_queues[i].fd == sock){
+            return (sock_txq_add(&ctx->tx_queues[i], lbuf_data(b), lbuf_size(b), dst));
+        }
+    }
+
+    if (ctx->tx_queues_num == TUN_MAX_TX_QUEUES){
+        return (send_raw_packet(sock, lbuf_data(b), lbuf_size(b), dst));
+    }
+
+    txq = &ctx->tx_queues[ctx->tx_queues_num];
+    sock_txq_init(txq, sock, ctx->batch_size);
+    ctx->tx_queues_num++;
+
+    return (sock_txq_add(txq, lbuf_data(b), lbuf_size(b), dst));
+}
+
+/* Send all the packets queued during the processing of the last batch */
+static void
+tun_output_ctx_flush(tun_out_ctx_t *ctx)
+{
+    int i;
+
+    for (i = 0; i < ctx->tx_queues_num; i++){
+        sock_txq_flush(&ctx->tx_queues[i]);
+        ctx->tx_pkts += ctx->tx_queues[i].sent_pkts;
+        ctx->tx_batches += ctx->tx_queues[i].sent_batches;
+    }
+    ctx->tx_queues_num = 0;
+    /* The packet rings of the interfaces are only used by the main thread */
+    if (!ctx->own_sockets){
+        pkt_mmap_flush();
+    }
+}
+
+void
+tun_output_flush()
+{
+    tun_output_ctx_flush(&main_ctx);
+}
+
+static void *
+tun_output_worker(void *arg)
+{
+    tun_out_ctx_t *ctx = (tun_out_ctx_t *)arg;
+    struct pollfd pfd;
+    int ret;
+
+    pfd.fd = ctx->fd;
+    pfd.events = POLLIN;
+    ctx->epoch_id = epoch_register(&readers);
+
+    while (ctx->running){
+        /* The published prefixes are only read while processing a batch, so
+         * the worker doesn't delay their reclamation while it waits */
+        if (ctx->epoch_id >= 0){
+            epoch_offline(&readers, ctx->epoch_id);
+        }
+        ret = poll(&pfd, 1, TUN_WORKER_POLL_TIMEOUT);
+        if (ctx->epoch_id >= 0){
+            epoch_online(&readers, ctx->epoch_id);
+        }
+        if (ret <= 0){
+            continue;
+        }
+        tun_output_read_batch(ctx);
+    }
+
+    if (ctx->epoch_id >= 0){
+        epoch_unregister(&readers, ctx->epoch_id);
+        ctx->epoch_id = ERR_EXIST;
+    }
+
+    return (NULL);
+}
+
+/* Start one worker thread per tun queue. Each worker reads, encapsulates and
+ * sends the packets of its queue */
+int
+tun_output_start_workers(int *queue_fds, int num)
+{
+    int i;
+
+    workers = xzalloc(num * sizeof(tun_out_ctx_t));
+    if (!workers){
+        return (BAD);
+    }
+
+    for (i = 0; i < num; i++){
+        if (tun_out_ctx_init(&workers[i], queue_fds[i], main_ctx.batch_size, TRUE) != GOOD){
+            break;
+        }
+        workers[i].running = TRUE;
+        if (pthread_create(&workers[i].thread, NULL, tun_output_worker, &workers[i]) != 0){
+            OOR_LOG(LERR, "tun_output_start_workers: Couldn't create worker %d: %s",
+                    i, strerror(errno));
+            tun_out_ctx_uninit(&workers[i]);
+            break;
+        }
+        workers_num++;
+    }
+
+    if (workers_num != num){
+        tun_output_stop_workers();
+        return (BAD);
+    }
+
+    OOR_LOG(LINF, "Data output: Started %d workers", workers_num);
+
+    return (GOOD);
+}
+
+void
+tun_output_stop_workers()
+{
+    int i;
+
+    for (i = 0; i < workers_num; i++){
+        workers[i].running = FALSE;
+    }
+    for (i = 0; i < workers_num; i++){
+        pthread_join(workers[i].thread, NULL);
+        OOR_LOG(LDBG_1, "Data output worker %d: %llu encapsulated packets sent",
+                i, (unsigned long long)workers[i].tx_pkts);
+        /* Keep the global counters */
+        main_ctx.tx_pkts += workers[i].tx_pkts;
+        main_ctx.tx_batches += workers[i].tx_batches;
+        main_ctx.gso_pkts += workers[i].gso_pkts;
+        ttable_stats_add(&main_ctx.ttable.stats, &workers[i].ttable.stats);
+        pcache_stats_add(&main_ctx.pcache.stats, &workers[i].pcache.stats);
+        main_ctx.pub_hits += workers[i].pub_hits;
+        tun_out_ctx_uninit(&workers[i]);
+    }
+    free(workers);
+    workers = NULL;
+    workers_num = 0;
 }
 
 static int
@@ -177,34 +626,170 @@ tun_output_multicast(lbuf_t *b, packet_tuple_t *tuple)
     return (GOOD);
 }
 
+/* Select the outer UDP source port of a flow from the configured range
+ * using the hash of its inner 5-tuple */
+static uint16_t
+tun_output_flow_src_port(packet_tuple_t *tuple)
+{
+    return (pkt_tuple_src_port(tuple, data_plane_conf.src_port_min,
+            data_plane_conf.src_port_max));
+}
+
+/* Build the outer headers used to encapsulate the packets of a forwarding
+ * entry */
+static void
+tun_output_build_hdr_tmpl(fwd_info_t *fi, fwd_entry_t *fe)
+{
+    uint8_t mem[sizeof(fe->tmpl.hdr)];
+    lbuf_t b;
+    int port;
+
+    memset(mem, 0, sizeof(mem));
+    lbuf_use_stack(&b, mem, sizeof(mem));
+    lbuf_reserve(&b, sizeof(mem));
+
+    switch (fi->encap){
+    case ENCP_LISP:
+        lisp_data_push_hdr(&b, fe->iid);
+        port = LISP_DATA_PORT;
+        break;
+    case ENCP_VXLAN_GPE:
+        vxlan_gpe_data_push_hdr(&b, fe->iid,
+                lisp_addr_ip_afi(fe->srloc) == AF_INET ? NP_IPv4 : NP_IPv6);
+        port = VXLAN_GPE_DATA_PORT;
+        break;
+    default:
+        return;
+    }
+    /* The source port is added to each packet */
+    if (pkt_push_udp_and_ip(&b, 0, port, lisp_addr_ip(fe->srloc),
+            lisp_addr_ip(fe->drloc)) != GOOD){
+        return;
+    }
+    pkt_hdr_tmpl_init(&fe->tmpl, &b);
+}
+
+/* Complete a forwarding info obtained from the control plane with the state
+ * of the data plane used to send its packets. Workers may call it without
+ * the control plane locked, then it fails if the state of the context is
+ * not enough */
 static int
-tun_output_unicast(lbuf_t *b, packet_tuple_t *tuple)
+tun_output_fwd_info_init(void *arg, fwd_info_t *fi)
 {
-    fwd_info_t *fi;
-    fwd_entry_t *fe;
+    tun_out_ctx_t *ctx = (tun_out_ctx_t *)arg;
+    fwd_entry_t *fe = fi->fwd_info;
+
+    if (!fe || !fe->srloc || !fe->drloc){
+        return (GOOD);
+    }
+    if (ctx->own_sockets){
+        fe->out_sock = tun_out_ctx_get_socket(ctx, fe->srloc);
+    }else{
+        fe->out_sock = get_out_socket_ptr_from_address(fe->srloc);
+    }
+    if (!fe->out_sock){
+        return (BAD);
+    }
+    tun_output_build_hdr_tmpl(fi, fe);
+    if (!ctx->own_sockets){
+        fe->tx_path = pkt_mmap_get_tx_path(fe->srloc, fe->drloc);
+    }
+    return (GOOD);
+}
+
+/* Get the forwarding information of the flow of the packet. On a miss of the
+ * flow table it is obtained from the prefix cache or, if not there, requested
+ * to the control plane */
+static fwd_info_t *
+tun_output_fwd_info(tun_out_ctx_t *ctx, packet_tuple_t *tuple)
+{
+    fwd_info_t *fi, *pfi = NULL;
+    pcache_entry_t *pe;
     uint32_t iid = tuple->iid;
 
     /* XXX Since OOR doesn't support same local prefixes with different IIDs when
      * operating as a XTR or MN, we use IID = 0 to calculate the hash of the ttable.
      * The actual IID to be used on the encapsulation processed is already stored
-     * in the forwarding entry, which is obtained on a ttable miss.*/
+     * in the forwarding entry, which is obtained on a ttable miss.
+     * Same remote prefixes in different IIDs are supported: the map cache
+     * is looked up with the IID of the local prefix, and the prefix caches
+     * match the local prefix too.*/
 
-    fi = ttable_lookup(&ttable, tuple);
-    if (!fi) {
-        fi = (fwd_info_t *)ctrl_get_forwarding_info(tuple);
-        if (fi == NULL){
-            return (BAD);
-        }
-        fe = fi->fwd_info;
-        if (fe && fe->srloc && fe->drloc)  {
-            fe->out_sock = get_out_socket_ptr_from_address(fe->srloc);
+    fi = ttable_lookup(&ctx->ttable, tuple);
+    if (fi){
+        return (fi);
+    }
+    fi = pcache_lookup(&ctx->pcache, tuple);
+    if (fi){
+        ttable_insert(&ctx->ttable, tuple, fwd_info_ref(fi));
+        return (fi);
+    }
+
+    /* Prefixes obtained by any context. The main one reads them with the
+     * control plane locked */
+    if (ctx->epoch_id >= 0 || ctx->ctrl_locked){
+        fi = fwd_pub_lookup(&published, tuple);
+        if (fi){
+            pe = pcache_insert(&ctx->pcache, fi, tun_output_fwd_info_init, ctx);
+            pfi = pe ? pcache_entry_fwd_info(pe, tuple) : NULL;
+            fwd_info_del(fi,(fwd_info_data_del)fwd_entry_del);
+            if (pfi){
+                ctx->pub_hits++;
+                fi = fwd_info_ref(pfi);
+                ttable_insert(&ctx->ttable, tuple, fi);
+                return (fi);
+            }
         }
-        tuple->iid = iid;
-        ttable_insert(&ttable, pkt_tuple_clone(tuple), fi);
-    }else{
-        fe = fi->fwd_info;
     }
 
+    /* Workers access the control plane in mutual exclusion with the
+     * main thread */
+    if (ctx->own_sockets){
+        sockmstr_lock(smaster);
+        ctx->ctrl_locked = TRUE;
+    }
+    fi = (fwd_info_t *)ctrl_get_forwarding_info(tuple);
+    if (fi && fi->prefix){
+        /* The rest of flows of the prefixes will be found in the cache, and
+         * by the other contexts in the published ones. This one uses the
+         * cached forwarding info too */
+        fwd_pub_insert(&published, fi);
+        pe = pcache_insert(&ctx->pcache, fi, tun_output_fwd_info_init, ctx);
+        pfi = pe ? pcache_entry_fwd_info(pe, tuple) : NULL;
+    }
+    if (pfi){
+        fwd_info_del(fi,(fwd_info_data_del)fwd_entry_del);
+        fi = fwd_info_ref(pfi);
+    }else if (fi && tun_output_fwd_info_init(ctx, fi) != GOOD){
+        fwd_entry_del(fi->fwd_info);
+        fi->fwd_info = NULL;
+    }
+    if (ctx->own_sockets){
+        ctx->ctrl_locked = FALSE;
+        sockmstr_unlock(smaster);
+    }
+    if (fi == NULL){
+        return (NULL);
+    }
+    tuple->iid = iid;
+    ttable_insert(&ctx->ttable, tuple, fi);
+
+    return (fi);
+}
+
+static int
+tun_output_unicast(tun_out_ctx_t *ctx, lbuf_t *b, packet_tuple_t *tuple)
+{
+    fwd_info_t *fi;
+    fwd_entry_t *fe;
+    uint16_t src_port;
+
+    fi = tun_output_fwd_info(ctx, tuple);
+    if (!fi){
+        return (BAD);
+    }
+    fe = fi->fwd_info;
+
     /* Packets with no/negative map cache entry AND no PETR
      * OR packets with missing src or dst RLOCs*/
     if (!fe || !fe->srloc || !fe->drloc) {
@@ -212,6 +797,13 @@ tun_output_unicast(lbuf_t *b, packet_tuple_t *tuple)
         case ACT_NO_ACTION:
         case ACT_SEND_MREQ:
         case ACT_DROP:
+            /* The mapping is being requested. Keep the packet until then */
+            if (fi->temporal && pendq_enabled(&pending) && pendq_add(&pending,
+                    lisp_addr_ip(&tuple->dst_addr), b) == GOOD){
+                OOR_LOG(LDBG_3, "tun_output_unicast: Packet kept until the "
+                        "mapping of %s is obtained", lisp_addr_to_char(&tuple->dst_addr));
+                return (GOOD);
+            }
             OOR_LOG(LDBG_3, "tun_output_unicast: Packet dropped");
             return (GOOD);
         case ACT_NATIVE_FWD:
@@ -223,23 +815,31 @@ tun_output_unicast(lbuf_t *b, packet_tuple_t *tuple)
             lisp_addr_to_char(fe->srloc),
             lisp_addr_to_char(fe->drloc));
 
-    switch (fi->encap){
-    case ENCP_LISP:
-        lisp_data_encap(b, LISP_DATA_PORT, LISP_DATA_PORT, fe->srloc, fe->drloc, fe->iid);
-        break;
-    case ENCP_VXLAN_GPE:
-        vxlan_gpe_data_encap(b, VXLAN_GPE_DATA_PORT, VXLAN_GPE_DATA_PORT, fe->srloc, fe->drloc, fe->iid);
-        break;
+    /* The forwarding info may be shared with other flows */
+    src_port = tun_output_flow_src_port(tuple);
+    if (fe->tmpl.len){
+        pkt_push_hdr_tmpl(b, &fe->tmpl, src_port);
+    }else{
+        switch (fi->encap){
+        case ENCP_LISP:
+            lisp_data_encap(b, src_port, LISP_DATA_PORT, fe->srloc, fe->drloc, fe->iid);
+            break;
+        case ENCP_VXLAN_GPE:
+            vxlan_gpe_data_encap(b, src_port, VXLAN_GPE_DATA_PORT, fe->srloc, fe->drloc, fe->iid);
+            break;
+        }
     }
 
+    if (fe->tx_path && !ctx->own_sockets && pkt_mmap_queue(fe->tx_path, b) == GOOD){
+        return (GOOD);
+    }
 
-    return(send_raw_packet(*(fe->out_sock), lbuf_data(b), lbuf_size(b),
-               lisp_addr_ip(fe->drloc)));
+    return(tun_output_queue(ctx, *(fe->out_sock), b, lisp_addr_ip(fe->drloc)));
 
 }
 
-int
-tun_output(lbuf_t *b, packet_tuple_t *tpl)
+static int
+tun_output_ctx(tun_out_ctx_t *ctx, lbuf_t *b, packet_tuple_t *tpl)
 {
     OOR_LOG(LDBG_3,"OUTPUT: Received EID %s -> %s, Proto: %d, Port: %d -> %d ",
             lisp_addr_to_char(&tpl->src_addr), lisp_addr_to_char(&tpl->dst_addr),
@@ -253,28 +853,203 @@ tun_output(lbuf_t *b, packet_tuple_t *tpl)
     if (ip_addr_is_multicast(lisp_addr_ip(&tpl->dst_addr))) {
         tun_output_multicast(b, tpl);
     } else {
-        tun_output_unicast(b, tpl);
+        tun_output_unicast(ctx, b, tpl);
     }
     return(GOOD);
 }
 
 int
-tun_output_recv(sock_t *sl)
+tun_output(lbuf_t *b, packet_tuple_t *tpl)
 {
+    return (tun_output_ctx(&main_ctx, b, tpl));
+}
+
+/* Called by the control plane, from the main thread, when the mapping of the
+ * EID has been obtained (send TRUE) or it has given up. The packets kept are
+ * forwarded as if they had just been read from the tun. If the mapping of
+ * their destination is still missing, they are kept again */
+void
+tun_output_flush_pending(lisp_addr_t *eid, uint8_t send)
+{
+    pendq_pkt_t *pkts, *pkt;
     packet_tuple_t tpl;
 
-    lbuf_use_stack(&pkt_buf, &pkt_recv_buf, TUN_RECEIVE_SIZE);
-    lbuf_reserve(&pkt_buf, LBUF_STACK_OFFSET);
+    if (!send){
+        pendq_drop(&pending, eid);
+        return;
+    }
+    pkts = pendq_take(&pending, eid);
+    if (!pkts){
+        return;
+    }
+    for (pkt = pkts; pkt != NULL; pkt = pkt->next){
+        tpl.iid = 0;
+        if (pkt_parse_5_tuple(pkt->b, &tpl) != GOOD){
+            continue;
+        }
+        tun_output_ctx(&main_ctx, pkt->b, &tpl);
+    }
+    /* The queued packets point to the buffers */
+    tun_output_ctx_flush(&main_ctx);
+    pendq_pkts_del(pkts);
+}
 
-    if (sock_recv(sl->fd, &pkt_buf) != GOOD) {
-        OOR_LOG(LWRN, "OUTPUT: Error while reading from tun!");
-        return (BAD);
+/* Encapsulate the segments of a super-packet and send them to the destination
+ * RLOC as segmented UDP datagrams. The outer IP and UDP headers are added by
+ * the kernel */
+static int
+tun_output_send_segments(tun_out_ctx_t *ctx, int sock, fwd_info_t *fi,
+        int nsegs)
+{
+    struct iovec iov[UDP_MAX_SEGMENTS];
+    fwd_entry_t *fe = fi->fwd_info;
+    lbuf_t *seg;
+    int ttl = 0, tos = 0, port, max_segs, first, i, n;
+
+    ip_hdr_ttl_and_tos(lbuf_data(&ctx->gso_segs[0]), &ttl, &tos);
+
+    for (i = 0; i < nsegs; i++){
+        seg = &ctx->gso_segs[i];
+        switch (fi->encap){
+        case ENCP_LISP:
+            lisp_data_push_hdr(seg, fe->iid);
+            break;
+        case ENCP_VXLAN_GPE:
+            vxlan_gpe_data_push_hdr(seg, fe->iid,
+                    lisp_addr_ip_afi(fe->srloc) == AF_INET ? NP_IPv4 : NP_IPv6);
+            break;
+        }
     }
-    lbuf_reset_ip(&pkt_buf);
-    if (pkt_parse_5_tuple(&pkt_buf, &tpl) != GOOD) {
+    port = fi->encap == ENCP_VXLAN_GPE ? VXLAN_GPE_DATA_PORT : LISP_DATA_PORT;
+
+    OOR_LOG(LDBG_3,"OUTPUT: Sending %d encapsulated segments: RLOC %s -> %s\n",
+            nsegs, lisp_addr_to_char(fe->srloc), lisp_addr_to_char(fe->drloc));
+
+    /* All the segments but the last one have the same size. A single send
+     * can not exceed the maximum size of an UDP datagram */
+    max_segs = 65000 / lbuf_size(&ctx->gso_segs[0]);
+    if (max_segs > UDP_MAX_SEGMENTS){
+        max_segs = UDP_MAX_SEGMENTS;
+    }
+    for (first = 0; first < nsegs; first += n){
+        n = nsegs - first < max_segs ? nsegs - first : max_segs;
+        for (i = 0; i < n; i++){
+            iov[i].iov_base = lbuf_data(&ctx->gso_segs[first + i]);
+            iov[i].iov_len = lbuf_size(&ctx->gso_segs[first + i]);
+        }
+        if (send_segmented_datagram(sock, iov, n, lbuf_size(&ctx->gso_segs[first]),
+                lisp_addr_ip(fe->drloc), port, ttl, tos) != GOOD){
+            OOR_LOG(LDBG_2, "tun_output_send_segments: Failed to send %d "
+                    "segments to %s", nsegs - first, lisp_addr_to_char(fe->drloc));
+            return (BAD);
+        }
+        ctx->tx_pkts += n;
+        ctx->tx_batches++;
+    }
+
+    return (GOOD);
+}
+
+/* Process a TCP super-packet read from the tun. It is split into segments
+ * that are sent with a single system call when the flow is encapsulated to an
+ * unicast RLOC. Otherwise they follow the normal output path.
+ * The segmentation is done here because each segment needs its own TCP header
+ * and checksum, which the kernel can't compute for a payload it only sees as
+ * UDP data. The outer IP and UDP headers are built by the kernel (UDP_SEGMENT),
+ * so the outer header templates don't apply, and the packet mmap rings are not
+ * used as they bypass the UDP stack that splits the datagrams */
+static int
+tun_output_gso(tun_out_ctx_t *ctx, lbuf_t *b, packet_tuple_t *tpl,
+        uint16_t gso_size)
+{
+    fwd_info_t *fi;
+    fwd_entry_t *fe = NULL;
+    int i, nsegs, sock = ERR_SOCKET;
+
+    nsegs = tun_offload_segment(b, gso_size, ctx->gso_segs, ctx->gso_seg_mem,
+            TUN_GSO_MAX_SEGS);
+    if (nsegs <= 0){
+        OOR_LOG(LDBG_2, "tun_output_gso: Unable to segment packet. Discarded");
         return (BAD);
     }
-    tpl.iid = 0;
-    tun_output(&pkt_buf, &tpl);
+    ctx->gso_pkts++;
+
+    if (!ip_addr_is_multicast(lisp_addr_ip(&tpl->dst_addr))){
+        fi = tun_output_fwd_info(ctx, tpl);
+        fe = fi ? fi->fwd_info : NULL;
+        if (fe && fe->srloc && fe->drloc){
+            sock = tun_out_ctx_get_gso_socket(ctx, fe->srloc,
+                    tun_output_flow_src_port(tpl));
+        }
+        if (sock != ERR_SOCKET){
+            /* Earlier packets of the flow may still be queued */
+            tun_output_ctx_flush(ctx);
+            return (tun_output_send_segments(ctx, sock, fi, nsegs));
+        }
+    }
+
+    for (i = 0; i < nsegs; i++){
+        tun_output_ctx(ctx, &ctx->gso_segs[i], tpl);
+    }
+    /* The segment buffers are reused by the next super-packet */
+    tun_output_ctx_flush(ctx);
+
     return (GOOD);
 }
+
+/* Read all the packets available in the tun queue up to the batch size. They
+ * are encapsulated and queued, and sent together at the end */
+static int
+tun_output_read_batch(tun_out_ctx_t *ctx)
+{
+    packet_tuple_t tpl;
+    lbuf_t *b;
+    uint16_t gso_size = 0;
+    int i, nread;
+
+    for (i = 0; i < ctx->batch_size; i++){
+        b = &ctx->ring[i];
+        lbuf_use_stack(b, ctx->ring_mem + i * ctx->slot_size, ctx->slot_size);
+        if (tun_offload_enabled()){
+            /* Keep the IP header at the usual offset once the virtio header
+             * is removed */
+            lbuf_reserve(b, LBUF_STACK_OFFSET - TUN_VNET_HDR_LEN);
+        }else{
+            lbuf_reserve(b, LBUF_STACK_OFFSET);
+        }
+
+        nread = read(ctx->fd, lbuf_data(b), lbuf_tailroom(b));
+        if (nread <= 0) {
+            if (nread == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)){
+                OOR_LOG(LWRN, "OUTPUT: Error while reading from tun!");
+            }
+            break;
+        }
+        lbuf_set_size(b, lbuf_size(b) + nread);
+
+        if (tun_offload_enabled() && tun_offload_pull_vnet_hdr(b, &gso_size) != GOOD){
+            continue;
+        }
+
+        lbuf_reset_ip(b);
+        tpl.iid = 0;
+        if (pkt_parse_5_tuple(b, &tpl) != GOOD) {
+            continue;
+        }
+        if (gso_size){
+            tun_output_gso(ctx, b, &tpl, gso_size);
+        }else{
+            tun_output_ctx(ctx, b, &tpl);
+        }
+    }
+
+    tun_output_ctx_flush(ctx);
+
+    return (i > 0 ? GOOD : BAD);
+}
+
+int
+tun_output_recv(sock_t *sl)
+{
+    return (tun_output_read_batch(&main_ctx));
+}
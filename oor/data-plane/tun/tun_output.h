@@ -36,7 +36,12 @@
 
 int tun_output_recv(sock_t *sl);
 int tun_output(lbuf_t *, packet_tuple_t *);
-void tun_output_init();
+int tun_output_init(int batch_size);
 void tun_output_uninit();
+void tun_output_flush();
+void tun_output_flush_pending(lisp_addr_t *eid, uint8_t send);
+int tun_output_start_workers(int *queue_fds, int num);
+void tun_output_stop_workers();
+void tun_output_log_stats();
 
 #endif /*TUN_OUTPUT_H_*/
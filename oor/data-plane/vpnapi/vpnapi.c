@@ -54,6 +54,7 @@ data_plane_struct_t dplane_vpnapi = {
         .datap_updated_route = vpnapi_updated_route,
         .datap_updated_addr = vpnapi_updated_addr,
         .datap_update_link = vpnapi_update_link,
+        .datap_flush_pending = vpnapi_output_flush_pending,
         .datap_data = NULL
 };
 
@@ -78,7 +79,8 @@ vpnapi_configure_data_plane(oor_dev_type_e dev_type, oor_encap_t encap_type,...)
     va_end(ap);
 
     data->tun_socket =tun_fd;
-    sockmstr_register_read_listener(smaster, vpnapi_output_recv, NULL,tun_fd);
+    sock_set_priority(sockmstr_register_read_listener(smaster, vpnapi_output_recv,
+            NULL,tun_fd), SOCK_PRIO_LOW);
 
     switch (dev_type){
     case MN_MODE:
@@ -104,7 +106,8 @@ vpnapi_configure_data_plane(oor_dev_type_e dev_type, oor_encap_t encap_type,...)
 
     if (default_rloc_afi != AF_INET6){
         data->ipv4_data_socket = open_data_datagram_input_socket(AF_INET, data_port);
-        sockmstr_register_read_listener(smaster, cb_func, NULL,data->ipv4_data_socket);
+        sock_set_priority(sockmstr_register_read_listener(smaster, cb_func, NULL,
+                data->ipv4_data_socket), SOCK_PRIO_LOW);
         oor_jni_protect_socket(data->ipv4_data_socket);
     }else {
         data->ipv4_data_socket = ERR_SOCKET;
@@ -112,7 +115,8 @@ vpnapi_configure_data_plane(oor_dev_type_e dev_type, oor_encap_t encap_type,...)
 
     if (default_rloc_afi != AF_INET){
         data->ipv6_data_socket = open_data_datagram_input_socket(AF_INET6, data_port);
-        sockmstr_register_read_listener(smaster, cb_func, NULL,data->ipv6_data_socket);
+        sock_set_priority(sockmstr_register_read_listener(smaster, cb_func, NULL,
+                data->ipv6_data_socket), SOCK_PRIO_LOW);
         oor_jni_protect_socket(data->ipv6_data_socket);
     }else {
         data->ipv6_data_socket = ERR_SOCKET;
@@ -329,7 +333,8 @@ vpnapi_reset_socket(int fd, int afi)
     default:
         return (BAD);
     }
-    sockmstr_register_read_listener(smaster,old_sock->recv_cb,old_sock->arg,new_fd);
+    sock_set_priority(sockmstr_register_read_listener(smaster,old_sock->recv_cb,
+            old_sock->arg,new_fd), old_sock->priority);
     sockmstr_unregister_read_listenedr(smaster,old_sock);
     /* Protect the socket from loops in the system*/
     oor_jni_protect_socket(new_fd);
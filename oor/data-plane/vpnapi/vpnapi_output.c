@@ -26,6 +26,8 @@
 #include "../../lib/packets.h"
 #include "../../lib/sockets.h"
 #include "../../control/oor_control.h"
+#include "../../lib/pcache.h"
+#include "../../lib/pendq.h"
 #include "../../lib/ttable.h"
 #include "../../lib/oor_log.h"
 #include "../../lib/sockets-util.h"
@@ -35,6 +37,9 @@
 static uint8_t pkt_recv_buf[VPNAPI_RECEIVE_SIZE];
 static lbuf_t pkt_buf;
 ttable_t ttable;
+pcache_t pcache;
+/* Packets waiting for the mapping of their destination */
+pendq_t pending;
 
 static int vpnapi_output_unicast(lbuf_t *b, packet_tuple_t *tuple);
 static int vpnapi_forward_native(lbuf_t *b, lisp_addr_t *dst);
@@ -42,13 +47,20 @@ static int vpnapi_forward_native(lbuf_t *b, lisp_addr_t *dst);
 void
 vpnapi_output_init()
 {
-    ttable_init(&ttable);
+    ttable_init_sized(&ttable, data_plane_conf.flow_table_size,
+            data_plane_conf.flow_idle_timeout);
+    pcache_init(&pcache, data_plane_conf.prefix_cache_size);
+    pendq_init(&pending, data_plane_conf.pending_pkts,
+            data_plane_conf.pending_bytes, data_plane_conf.pending_max_pkts,
+            data_plane_conf.pending_max_bytes, data_plane_conf.pending_timeout);
 }
 
 void
 vpnapi_output_uninit()
 {
     ttable_uninit(&ttable);
+    pcache_uninit(&pcache);
+    pendq_uninit(&pending);
 }
 
 static int
@@ -80,43 +92,72 @@ is_lisp_packet(packet_tuple_t *tpl)
     return (TRUE);
 }
 
+/* Select the socket used to send the packets of a forwarding info obtained
+ * from the control plane */
+static int
+vpnapi_output_fwd_info_init(void *arg, fwd_info_t *fi)
+{
+    fwd_entry_t *fe = fi->fwd_info;
+
+    if (!fe || !fe->srloc || !fe->drloc){
+        return (GOOD);
+    }
+    switch (lisp_addr_ip_afi(fe->srloc)){
+    case AF_INET:
+        fe->out_sock = &(((vpnapi_data_t *)dplane_vpnapi.datap_data)->ipv4_data_socket);
+        break;
+    case AF_INET6:
+        fe->out_sock = &(((vpnapi_data_t *)dplane_vpnapi.datap_data)->ipv6_data_socket);
+        break;
+    default:
+        OOR_LOG(LDBG_3,"OUTPUT: No output socket for afi %d", lisp_addr_ip_afi(fe->srloc));
+        return(BAD);
+    }
+    return (GOOD);
+}
+
 static int
 vpnapi_output_unicast(lbuf_t *b, packet_tuple_t *tuple)
 {
-    fwd_info_t *fi;
+    fwd_info_t *fi, *pfi = NULL;
     fwd_entry_t *fe;
+    pcache_entry_t *pe;
     uint32_t iid = tuple->iid;
 
     /* XXX Since OOR doesn't support same local prefixes with different IIDs when
      * operating as a XTR or MN, we use IID = 0 to calculate the hash of the ttable.
      * The actual IID to be used on the encapsulation processed is already stored
-     * in the forwarding entry, which is obtained on a ttable miss.*/
+     * in the forwarding entry, which is obtained on a ttable miss.
+     * Same remote prefixes in different IIDs are supported: the map cache
+     * is looked up with the IID of the local prefix, and the prefix caches
+     * match the local prefix too.*/
 
     fi = ttable_lookup(&ttable, tuple);
     if (!fi) {
-        fi = ctrl_get_forwarding_info(tuple);
-        if (!fi){
-            return (BAD);
-        }
-        fe = fi->fwd_info;
-        if (fe && fe->srloc && fe->drloc)  {
-            switch (lisp_addr_ip_afi(fe->srloc)){
-            case AF_INET:
-                fe->out_sock = &(((vpnapi_data_t *)dplane_vpnapi.datap_data)->ipv4_data_socket);
-                break;
-            case AF_INET6:
-                fe->out_sock = &(((vpnapi_data_t *)dplane_vpnapi.datap_data)->ipv6_data_socket);
-                break;
-            default:
-                OOR_LOG(LDBG_3,"OUTPUT: No output socket for afi %d", lisp_addr_ip_afi(fe->srloc));
+        fi = pcache_lookup(&pcache, tuple);
+        if (fi){
+            fwd_info_ref(fi);
+        }else{
+            fi = ctrl_get_forwarding_info(tuple);
+            if (!fi){
+                return (BAD);
+            }
+            if (fi->prefix){
+                pe = pcache_insert(&pcache, fi, vpnapi_output_fwd_info_init, NULL);
+                pfi = pe ? pcache_entry_fwd_info(pe, tuple) : NULL;
+            }
+            if (pfi){
+                fwd_info_del(fi,(fwd_info_data_del)fwd_entry_del);
+                fi = fwd_info_ref(pfi);
+            }else if (vpnapi_output_fwd_info_init(NULL, fi) != GOOD){
+                fwd_info_del(fi,(fwd_info_data_del)fwd_entry_del);
                 return(BAD);
             }
         }
         tuple->iid = iid;
-        ttable_insert(&ttable, pkt_tuple_clone(tuple), fi);
-    }else{
-        fe = fi->fwd_info;
+        ttable_insert(&ttable, tuple, fi);
     }
+    fe = fi->fwd_info;
 
     /* Packets with no/negative map cache entry AND no PETR
      * OR packets with missing src or dst RLOCs*/
@@ -126,6 +167,13 @@ vpnapi_output_unicast(lbuf_t *b, packet_tuple_t *tuple)
         case ACT_SEND_MREQ:
         case ACT_NATIVE_FWD:
         case ACT_DROP:
+            /* The mapping is being requested. Keep the packet until then */
+            if (fi->temporal && pendq_enabled(&pending) && pendq_add(&pending,
+                    lisp_addr_ip(&tuple->dst_addr), b) == GOOD){
+                OOR_LOG(LDBG_3,"OUTPUT: Packet kept until the mapping of %s is obtained",
+                        lisp_addr_to_char(&tuple->dst_addr));
+                return (GOOD);
+            }
             OOR_LOG(LDBG_3,"OUTPUT: Packet with non lisp destination. No PeTRs compatibles to be used. Discarding packet");
             return (GOOD);
         }
@@ -160,6 +208,30 @@ vpnapi_output(lbuf_t *b, packet_tuple_t *tpl)
     return(GOOD);
 }
 
+/* Called by the control plane when the mapping of the EID has been obtained
+ * (send TRUE) or it has given up. The packets kept are forwarded as if they had
+ * just been read from the tun */
+void
+vpnapi_output_flush_pending(lisp_addr_t *eid, uint8_t send)
+{
+    pendq_pkt_t *pkts, *pkt;
+    packet_tuple_t tpl;
+
+    if (!send){
+        pendq_drop(&pending, eid);
+        return;
+    }
+    pkts = pendq_take(&pending, eid);
+    for (pkt = pkts; pkt != NULL; pkt = pkt->next){
+        tpl.iid = 0;
+        if (pkt_parse_5_tuple(pkt->b, &tpl) != GOOD){
+            continue;
+        }
+        vpnapi_output(pkt->b, &tpl);
+    }
+    pendq_pkts_del(pkts);
+}
+
 int
 vpnapi_output_recv(struct sock *sl)
 {
@@ -173,10 +245,10 @@ vpnapi_output_recv(struct sock *sl)
     }
     lbuf_reset_ip(&pkt_buf);
 
+    tpl.iid = 0;
     if (pkt_parse_5_tuple(&pkt_buf, &tpl) != GOOD) {
         return (BAD);
     }
-    tpl.iid = 0;
     vpnapi_output(&pkt_buf, &tpl);
     return (GOOD);
 }
@@ -27,6 +27,7 @@
 void vpnapi_output_init();
 void vpnapi_output_uninit();
 int vpnapi_output(lbuf_t *b, packet_tuple_t *tpl);
+void vpnapi_output_flush_pending(lisp_addr_t *eid, uint8_t send);
 int vpnapi_output_recv(struct sock *sl);
 int vpnapi_send_ctrl_msg(lbuf_t *buf, uconn_t *udp_conn);
 
@@ -69,6 +69,8 @@ typedef struct htable_nonces_ htable_nonces_t;
 
 
 #define DEFAULT_MAP_REQUEST_RETRIES             3
+#define DEFAULT_MCACHE_REFRESH_LEAD             60  /* Seconds before expiring to request again the map cache entries in use */
+#define DEFAULT_MCACHE_REFRESH_MIN_PKTS         16  /* Packets forwarded during the validity of an entry to consider it in use */
 
 #define MAP_REGISTER_INTERVAL                   60
 #define MS_SITE_EXPIRATION                      180
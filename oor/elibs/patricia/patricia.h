@@ -89,6 +89,7 @@ void Clear_Patricia (patricia_tree_t *patricia, void_fn_t func);
 void Destroy_Patricia (patricia_tree_t *patricia, void_fn_t func);
 void patricia_process (patricia_tree_t *patricia, void_fn_t func);
 prefix_t *New_Prefix(int family, void *dest, int bitlen);
+prefix_t *New_Prefix2(int family, void *dest, int bitlen, prefix_t *prefix);
 void Deref_Prefix (prefix_t * prefix);
 /* { from demo.c */
 
@@ -33,8 +33,13 @@ int mce_balancing_locators_vecs_new_init(void *dev_parm, mcache_entry_t *mce,
         routing_info_del_fct del_fct);
 static void *balancing_locators_vecs_new_init(void *dev_parm, mapping_t *map, uint8_t is_mce);
 void balancing_locators_vecs_del(void * bal_vec);
+static size_t balancing_locators_vecs_size(void *bal_vec);
 void fb_get_fw_entry(void *fwd_dev_parm, void *src_map_parm,
         void *dst_map_parm, packet_tuple_t *tuple, fwd_info_t *fwd_info);
+int fb_get_fwd_prefix(void *fwd_dev_parm, void *src_map_parm,
+        void *dst_map_parm, fwd_prefix_t *prefix);
+static int fb_select_src_vec(balancing_locators_vecs *src_blv,
+        balancing_locators_vecs *dst_blv, locator_t ***src_loc_vec, int *src_vec_len);
 static locator_t **set_balancing_vector(locator_t **, int, int, int *);
 static int select_best_priority_locators(glist_t *, locator_t **, uint8_t);
 static inline void get_hcf_locators_weight(locator_t **, int *, int *);
@@ -61,6 +66,7 @@ fwd_policy_class  fwd_policy_flow_balancing = {
         .updated_map_loc_inf = mle_balancing_vectors_calculate,
         .updated_map_cache_inf = mce_balancing_vectors_calculate,
         .policy_get_fwd_info = fb_get_fw_entry,
+        .policy_get_fwd_prefix = fb_get_fwd_prefix,
         .get_fwd_ip_addr = fb_addr_get_fwd_ip_addr
 };
 
@@ -131,7 +137,7 @@ mce_balancing_locators_vecs_new_init(void *dev_parm, mcache_entry_t *mce, routin
     if (!routing_inf){
         return (BAD);
     }
-    mcache_entry_set_routing_info(mce, routing_inf, del_fct);
+    mcache_entry_set_routing_info(mce, routing_inf, del_fct, balancing_locators_vecs_size);
     return (GOOD);
 }
 
@@ -161,6 +167,22 @@ balancing_locators_vecs_del(void * bal_vec)
     free((balancing_locators_vecs *)bal_vec);
 }
 
+/* Heap memory used by the balancing vectors. The vector of IPv4 and IPv6
+ * locators may be one of the others */
+static size_t
+balancing_locators_vecs_size(void *bal_vec)
+{
+    balancing_locators_vecs *blv = (balancing_locators_vecs *)bal_vec;
+    size_t size = sizeof(balancing_locators_vecs);
+
+    size += (blv->v4_locators_vec_length + blv->v6_locators_vec_length) * sizeof(locator_t *);
+    if (blv->balancing_locators_vec != blv->v4_balancing_locators_vec
+            && blv->balancing_locators_vec != blv->v6_balancing_locators_vec){
+        size += blv->locators_vec_length * sizeof(locator_t *);
+    }
+    return (size);
+}
+
 /* Initialize to 0 balancing_locators_vecs */
 static void
 balancing_locators_vecs_reset(balancing_locators_vecs *blv)
@@ -499,7 +521,7 @@ fb_locators_classify_in_4_6(mapping_t *mapping, glist_t *loc_loct_addr,
     lisp_addr_t *addr;
     lisp_addr_t *ip_addr;
 
-    if (glist_size(mapping->locators_lists) == 0){
+    if (glist_size(mapping_locators_lists(mapping)) == 0){
         OOR_LOG(LDBG_3,"locators_classify_in_4_6: No locators to classify for mapping with eid %s",
                 lisp_addr_to_char(mapping_eid(mapping)));
         return;
@@ -522,6 +544,29 @@ fb_locators_classify_in_4_6(mapping_t *mapping, glist_t *loc_loct_addr,
 
 /*************************** Forward Select Function *************************/
 
+/* Select the vector of source locators compatible with the destination ones */
+static int
+fb_select_src_vec(balancing_locators_vecs *src_blv,
+        balancing_locators_vecs *dst_blv, locator_t ***src_loc_vec, int *src_vec_len)
+{
+    if (src_blv->balancing_locators_vec != NULL
+            && dst_blv->balancing_locators_vec != NULL) {
+        *src_loc_vec = src_blv->balancing_locators_vec;
+        *src_vec_len = src_blv->locators_vec_length;
+    } else if (src_blv->v6_balancing_locators_vec != NULL
+            && dst_blv->v6_balancing_locators_vec != NULL) {
+        *src_loc_vec = src_blv->v6_balancing_locators_vec;
+        *src_vec_len = src_blv->v6_locators_vec_length;
+    } else if (src_blv->v4_balancing_locators_vec != NULL
+            && dst_blv->v4_balancing_locators_vec != NULL) {
+        *src_loc_vec = src_blv->v4_balancing_locators_vec;
+        *src_vec_len = src_blv->v4_locators_vec_length;
+    } else {
+        return (BAD);
+    }
+    return (GOOD);
+}
+
 /* Select the source and destination RLOC according to the priority and weight.
  * The destination RLOC is selected according to the AFI of the selected source
  * RLOC */
@@ -548,19 +593,7 @@ fb_get_fw_entry(void *fwd_dev_parm, void *src_map_parm, void *dst_map_parm,
     lisp_addr_t * dst_ip_addr;
     int afi;
 
-    if (src_blv->balancing_locators_vec != NULL
-            && dst_blv->balancing_locators_vec != NULL) {
-        src_loc_vec = src_blv->balancing_locators_vec;
-        src_vec_len = src_blv->locators_vec_length;
-    } else if (src_blv->v6_balancing_locators_vec != NULL
-            && dst_blv->v6_balancing_locators_vec != NULL) {
-        src_loc_vec = src_blv->v6_balancing_locators_vec;
-        src_vec_len = src_blv->v6_locators_vec_length;
-    } else if (src_blv->v4_balancing_locators_vec != NULL
-            && dst_blv->v4_balancing_locators_vec != NULL) {
-        src_loc_vec = src_blv->v4_balancing_locators_vec;
-        src_vec_len = src_blv->v4_locators_vec_length;
-    } else {
+    if (fb_select_src_vec(src_blv, dst_blv, &src_loc_vec, &src_vec_len) != GOOD) {
         if (src_blv->v4_balancing_locators_vec == NULL
                 && src_blv->v6_balancing_locators_vec == NULL) {
             OOR_LOG(LDBG_3, "fb_get_fw_entry: No SRC locators "
@@ -576,7 +609,7 @@ fb_get_fw_entry(void *fwd_dev_parm, void *src_map_parm, void *dst_map_parm,
         return;
     }
 
-    hash = pkt_tuple_hash(tuple);
+    hash = tuple->hash;
     if (hash == 0) {
         OOR_LOG(LDBG_1, "fb_get_fw_entry: Couldn't get the hash of the tuple "
                 "to select the rloc. Using the default rloc");
@@ -627,3 +660,88 @@ fb_get_fw_entry(void *fwd_dev_parm, void *src_map_parm, void *dst_map_parm,
 
     return;
 }
+
+/* Position in locs of the IP address used to forward with the locator. It is
+ * added if it is not already there */
+static int
+fb_prefix_loct_pos(lisp_addr_t *locs, int *locs_num, locator_t *loct,
+        glist_t *loc_loct)
+{
+    lisp_addr_t *addr;
+    int i;
+
+    addr = fb_addr_get_fwd_ip_addr(locator_addr(loct), loc_loct);
+    if (addr == NULL){
+        return (ERR_NO_EXIST);
+    }
+    for (i = 0; i < *locs_num; i++){
+        if (lisp_addr_cmp(&locs[i], addr) == 0){
+            return (i);
+        }
+    }
+    if (*locs_num == FWD_PREFIX_MAX_LOCS){
+        return (ERR_NO_EXIST);
+    }
+    lisp_addr_copy(&locs[*locs_num], addr);
+    return ((*locs_num)++);
+}
+
+static int
+fb_prefix_vec(uint8_t *vec, int *vec_len, lisp_addr_t *locs, int *locs_num,
+        locator_t **loc_vec, int loc_vec_len, glist_t *loc_loct)
+{
+    int i, pos;
+
+    if (loc_vec == NULL){
+        *vec_len = 0;
+        return (GOOD);
+    }
+    if (loc_vec_len > FWD_PREFIX_MAX_VEC){
+        return (BAD);
+    }
+    for (i = 0; i < loc_vec_len; i++){
+        pos = fb_prefix_loct_pos(locs, locs_num, loc_vec[i], loc_loct);
+        if (pos < 0){
+            return (BAD);
+        }
+        vec[i] = pos;
+    }
+    *vec_len = loc_vec_len;
+    return (GOOD);
+}
+
+/* Translate the balancing vectors of a local mapping and a map cache entry to
+ * the vectors of positions of prefix. Selecting the RLOCs of a flow with them
+ * gives the same result than fb_get_fw_entry */
+int
+fb_get_fwd_prefix(void *fwd_dev_parm, void *src_map_parm, void *dst_map_parm,
+        fwd_prefix_t *prefix)
+{
+    fb_dev_parm * dev_parm = (fb_dev_parm *)fwd_dev_parm;
+    balancing_locators_vecs * src_blv = (balancing_locators_vecs *)src_map_parm;
+    balancing_locators_vecs * dst_blv = (balancing_locators_vecs *)dst_map_parm;
+    locator_t ** src_loc_vec;
+    int src_vec_len;
+
+    if (fb_select_src_vec(src_blv, dst_blv, &src_loc_vec, &src_vec_len) != GOOD
+            || src_vec_len == 0) {
+        return (BAD);
+    }
+    prefix->src_locs_num = 0;
+    prefix->dst_locs_num = 0;
+    if (fb_prefix_vec(prefix->src_vec, &prefix->src_vec_len, prefix->src_locs,
+            &prefix->src_locs_num, src_loc_vec, src_vec_len,
+            dev_parm->loc_loct) != GOOD
+            || fb_prefix_vec(prefix->dst_v4_vec, &prefix->dst_v4_vec_len,
+                    prefix->dst_locs, &prefix->dst_locs_num,
+                    dst_blv->v4_balancing_locators_vec,
+                    dst_blv->v4_locators_vec_length, dev_parm->loc_loct) != GOOD
+            || fb_prefix_vec(prefix->dst_v6_vec, &prefix->dst_v6_vec_len,
+                    prefix->dst_locs, &prefix->dst_locs_num,
+                    dst_blv->v6_balancing_locators_vec,
+                    dst_blv->v6_locators_vec_length, dev_parm->loc_loct) != GOOD) {
+        return (BAD);
+    }
+
+    return (GOOD);
+}
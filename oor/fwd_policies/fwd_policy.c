@@ -93,12 +93,45 @@ policy_loct_parm_del(fwd_policy_loct_parm *pol_loct)
 fwd_info_t *
 fwd_info_new()
 {
-    return (xzalloc(sizeof(fwd_info_t)));
+    fwd_info_t *fwd_info;
+
+    fwd_info = xzalloc(sizeof(fwd_info_t));
+    if (fwd_info){
+        fwd_info->refs = 1;
+    }
+    return (fwd_info);
 }
 
+/* Release a reference to the forwarding info. It is freed with the last one */
 void
 fwd_info_del(fwd_info_t * fwd_info,fwd_info_data_del del_fn)
 {
+    if (fwd_info->refs > 1){
+        fwd_info->refs--;
+        return;
+    }
     del_fn(fwd_info->fwd_info);
+    fwd_prefix_del(fwd_info->prefix);
     free(fwd_info);
 }
+
+/* Get a new reference to the forwarding info. Not thread safe: only the data
+ * plane thread owning it can share it */
+fwd_info_t *
+fwd_info_ref(fwd_info_t *fwd_info)
+{
+    fwd_info->refs++;
+    return (fwd_info);
+}
+
+fwd_prefix_t *
+fwd_prefix_new()
+{
+    return (xzalloc(sizeof(fwd_prefix_t)));
+}
+
+void
+fwd_prefix_del(fwd_prefix_t *prefix)
+{
+    free(prefix);
+}
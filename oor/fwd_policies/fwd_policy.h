@@ -22,6 +22,7 @@
 
 #include "../lib/map_cache_entry.h"
 #include "../lib/map_local_entry.h"
+#include "../lib/fwd_gen.h"
 
 typedef struct packet_tuple packet_tuple_t;
 
@@ -56,11 +57,53 @@ typedef struct fwd_policy_loct_parm_t{
 	shash_t 		*paramiters;
 } fwd_policy_loct_parm;
 
+/* Max number of different RLOCs and max length of the vectors of a
+ * fwd_prefix_t */
+#define FWD_PREFIX_MAX_LOCS     8
+#define FWD_PREFIX_MAX_VEC      256
+
+/*
+ * Forwarding state shared by all the flows from a local EID prefix to a map
+ * cache EID prefix. The RLOCs of a flow are selected with the hash of its
+ * tuple: the source RLOC is the position hash % src_vec_len of src_vec, and the
+ * destination one is taken in the same way from the vector of the AFI of the
+ * source RLOC. The vectors contain positions of src_locs and dst_locs.
+ */
+typedef struct fwd_prefix_{
+    /* IP prefixes. The IID is not part of them */
+    lisp_addr_t src_pref;
+    lisp_addr_t dst_pref;
+    uint32_t iid;
+    lisp_addr_t src_locs[FWD_PREFIX_MAX_LOCS];
+    lisp_addr_t dst_locs[FWD_PREFIX_MAX_LOCS];
+    int src_locs_num;
+    int dst_locs_num;
+    uint8_t src_vec[FWD_PREFIX_MAX_VEC];
+    uint8_t dst_v4_vec[FWD_PREFIX_MAX_VEC];
+    uint8_t dst_v6_vec[FWD_PREFIX_MAX_VEC];
+    int src_vec_len;
+    int dst_v4_vec_len;
+    int dst_v6_vec_len;
+}fwd_prefix_t;
+
 typedef struct fwd_info_{
     void *fwd_info;
     uint8_t temporal;
     lisp_action_e neg_map_reply_act;
     oor_encap_t encap;
+    /* Generations of the state used to obtain the forwarding info */
+    fwd_gen_deps_t deps;
+    /* Prefix level state the forwarding info was obtained from. Only filled
+     * by the control plane when it is valid for any flow between the
+     * prefixes */
+    fwd_prefix_t *prefix;
+    /* Number of holders of the forwarding info. It may be shared by several
+     * flows of the same data plane thread */
+    uint32_t refs;
+    /* Packets forwarded not yet added to the usage of deps */
+    uint32_t pkts;
+    /* fwd_use_epoch when they were last added */
+    uint32_t use_epoch;
 }fwd_info_t;
 
 
@@ -77,6 +120,10 @@ typedef struct fwd_policy_class {
     int (*updated_map_cache_inf)(void *dev_parm, mcache_entry_t *mce);
     void (*policy_get_fwd_info)(void *dev_parm, void *src_map_parm, void *dst_map_parm,
             packet_tuple_t *tuple, fwd_info_t *fdw_info);
+    /* Fill the RLOCs and vectors of prefix. Returns BAD if they can't be
+     * represented with a fwd_prefix_t */
+    int (*policy_get_fwd_prefix)(void *dev_parm, void *src_map_parm, void *dst_map_parm,
+            fwd_prefix_t *prefix);
     lisp_addr_t *(*get_fwd_ip_addr)(lisp_addr_t *addr, glist_t *locl_rlocs_addr);
 } fwd_policy_class;
 
@@ -93,5 +140,8 @@ void fwd_policy_loct_parm_del(fwd_policy_loct_parm *pol_loct);
 fwd_policy_class *fwd_policy_class_find(char *lib);
 fwd_info_t *fwd_info_new();
 void fwd_info_del(fwd_info_t * fwd_info,fwd_info_data_del del_fn);
+fwd_info_t *fwd_info_ref(fwd_info_t *fwd_info);
+fwd_prefix_t *fwd_prefix_new();
+void fwd_prefix_del(fwd_prefix_t *prefix);
 
 #endif /* ROUTING_POLICY_H_ */
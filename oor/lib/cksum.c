@@ -47,6 +47,32 @@ ip_checksum(uint16_t *buffer, int size)
     return ((uint16_t) (~cksum));
 }
 
+uint32_t
+cksum_add(const void *buffer, int size, uint32_t sum)
+{
+    const uint16_t *buf = buffer;
+
+    while (size > 1) {
+        sum += *buf++;
+        size -= sizeof(uint16_t);
+    }
+
+    if (size) {
+        sum += htons((*(const uint8_t *) buf) << 8);
+    }
+
+    return (sum);
+}
+
+uint16_t
+cksum_fold(uint32_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+
+    return ((uint16_t) sum);
+}
+
 /*
  *
  *  Calculate the IPv4 UDP checksum (calculated with the whole packet).
@@ -170,3 +196,48 @@ udp_checksum(struct udphdr *udph, int udp_len, void *iphdr, int afi)
     }
 }
 
+/*
+ *  tcp_checksum
+ *
+ *  Calculate the IPv4 or IPv6 TCP checksum (pseudo-header, header and
+ *  payload) */
+uint16_t
+tcp_checksum(void *tcph, int tcp_len, void *iphdr, int afi)
+{
+    uint16_t *buf;
+    uint32_t sum = 0;
+    int len;
+
+    /* Source and destination addresses of the pseudo-header */
+    switch (afi) {
+    case AF_INET:
+        buf = (uint16_t *)&((struct ip *)iphdr)->ip_src;
+        len = 2 * sizeof(struct in_addr);
+        break;
+    case AF_INET6:
+        buf = (uint16_t *)&((struct ip6_hdr *)iphdr)->ip6_src;
+        len = 2 * sizeof(struct in6_addr);
+        break;
+    default:
+        OOR_LOG(LDBG_2, "tcp_checksum: Unknown AFI");
+        return (~0);
+    }
+    for (; len > 1; len -= 2) {
+        sum += *buf++;
+    }
+    sum += htons(IPPROTO_TCP);
+    sum += htons(tcp_len);
+
+    buf = tcph;
+    for (len = tcp_len; len > 1; len -= 2) {
+        sum += *buf++;
+    }
+    if (len) {
+        sum += htons((*(const uint8_t *) buf) << 8);
+    }
+
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+
+    return ((uint16_t) (~sum));
+}
@@ -26,8 +26,16 @@
 
 uint16_t ip_checksum(uint16_t *buffer, int size);
 
+/* One's complement sum of a buffer added to sum, and folding of the result
+ * to 16 bits. Used to update checksums incrementally */
+uint32_t cksum_add(const void *buffer, int size, uint32_t sum);
+uint16_t cksum_fold(uint32_t sum);
+
 /* Calculate the IPv4 or IPv6 UDP checksum */
 uint16_t udp_checksum(struct udphdr *udph, int udp_len, void *iphdr, int afi);
 
+/* Calculate the IPv4 or IPv6 TCP checksum. The checksum field must be 0 */
+uint16_t tcp_checksum(void *tcph, int tcp_len, void *iphdr, int afi);
+
 
 #endif /* CKSUM_H_ */
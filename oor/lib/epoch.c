@@ -0,0 +1,170 @@
+/*
+ *
+ * Copyright (C) 2011, 2015 Cisco Systems, Inc.
+ * Copyright (C) 2015 CBA research group, Technical University of Catalonia.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <string.h>
+
+#include "epoch.h"
+#include "mem_util.h"
+#include "oor_log.h"
+
+
+void
+epoch_init(epoch_t *ep)
+{
+    memset(ep, 0, sizeof(epoch_t));
+    ep->global = EPOCH_OFFLINE + 1;
+    pthread_mutex_init(&ep->lock, NULL);
+}
+
+/* Free all the retired objects. No reader should be online */
+void
+epoch_uninit(epoch_t *ep)
+{
+    epoch_retired_t *r;
+
+    while (ep->head){
+        r = ep->head;
+        ep->head = r->next;
+        r->del_fct(r->obj);
+        free(r);
+    }
+    ep->tail = NULL;
+    ep->retired = 0;
+    pthread_mutex_destroy(&ep->lock);
+}
+
+/* Register the calling thread as a reader. It starts online. Returns its id
+ * or ERR_EXIST if there are no free slots */
+int
+epoch_register(epoch_t *ep)
+{
+    int id;
+
+    pthread_mutex_lock(&ep->lock);
+    for (id = 0; id < EPOCH_MAX_THREADS; id++){
+        if (!ep->threads[id].used){
+            ep->threads[id].used = TRUE;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ep->lock);
+    if (id == EPOCH_MAX_THREADS){
+        OOR_LOG(LERR, "epoch_register: More than %d reader threads",
+                EPOCH_MAX_THREADS);
+        return (ERR_EXIST);
+    }
+    epoch_online(ep, id);
+
+    return (id);
+}
+
+void
+epoch_unregister(epoch_t *ep, int id)
+{
+    epoch_offline(ep, id);
+    pthread_mutex_lock(&ep->lock);
+    ep->threads[id].used = FALSE;
+    pthread_mutex_unlock(&ep->lock);
+}
+
+/* Free obj with del_fct when no reader can be using it. It must be already
+ * unreachable from the shared state */
+void
+epoch_retire(epoch_t *ep, void *obj, epoch_del_fct del_fct)
+{
+    epoch_retired_t *r;
+
+    r = xmalloc(sizeof(epoch_retired_t));
+    r->next = NULL;
+    r->obj = obj;
+    r->del_fct = del_fct;
+
+    pthread_mutex_lock(&ep->lock);
+    /* Readers that see the new epoch in a quiescent state can't see obj */
+    r->epoch = __atomic_fetch_add(&ep->global, 1, __ATOMIC_SEQ_CST);
+    if (ep->tail){
+        ep->tail->next = r;
+    }else{
+        ep->head = r;
+    }
+    ep->tail = r;
+    ep->retired++;
+    pthread_mutex_unlock(&ep->lock);
+}
+
+/* Free the retired objects not used by any reader. Returns the number of
+ * objects freed */
+uint32_t
+epoch_reclaim(epoch_t *ep)
+{
+    epoch_retired_t *r, *done = NULL;
+    uint64_t min = UINT64_MAX, epoch;
+    uint32_t freed = 0;
+    int id;
+
+    /* Order the loads of the epochs of the readers after the changes of
+     * the shared state. See epoch_online */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (id = 0; id < EPOCH_MAX_THREADS; id++){
+        epoch = __atomic_load_n(&ep->threads[id].epoch, __ATOMIC_ACQUIRE);
+        if (epoch != EPOCH_OFFLINE && epoch < min){
+            min = epoch;
+        }
+    }
+
+    pthread_mutex_lock(&ep->lock);
+    if (ep->head && ep->head->epoch < min){
+        done = ep->head;
+        r = done;
+        freed++;
+        while (r->next && r->next->epoch < min){
+            r = r->next;
+            freed++;
+        }
+        ep->head = r->next;
+        r->next = NULL;
+        if (!ep->head){
+            ep->tail = NULL;
+        }
+        ep->retired -= freed;
+    }
+    pthread_mutex_unlock(&ep->lock);
+
+    while (done){
+        r = done;
+        done = r->next;
+        r->del_fct(r->obj);
+        free(r);
+    }
+
+    return (freed);
+}
+
+/* Number of retired objects not freed yet */
+uint32_t
+epoch_pending(epoch_t *ep)
+{
+    uint32_t retired;
+
+    pthread_mutex_lock(&ep->lock);
+    retired = ep->retired;
+    pthread_mutex_unlock(&ep->lock);
+
+    return (retired);
+}
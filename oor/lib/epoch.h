@@ -0,0 +1,111 @@
+/*
+ *
+ * Copyright (C) 2011, 2015 Cisco Systems, Inc.
+ * Copyright (C) 2015 CBA research group, Technical University of Catalonia.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef EPOCH_H_
+#define EPOCH_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+/* Max number of reader threads of a domain */
+#define EPOCH_MAX_THREADS   64
+
+/* Epoch of a thread that is not reading shared state */
+#define EPOCH_OFFLINE       0
+
+typedef void (*epoch_del_fct)(void *);
+
+/* Per thread state, in its own cache line so that the readers don't write
+ * to the lines of the others */
+typedef struct epoch_thread {
+    /* Global epoch seen by the thread the last time it held no references,
+     * or EPOCH_OFFLINE */
+    volatile uint64_t epoch;
+    uint8_t used;
+    uint8_t pad[64 - sizeof(uint64_t) - sizeof(uint8_t)];
+} epoch_thread_t;
+
+/* Object unlinked from the shared state, waiting for the readers */
+typedef struct epoch_retired {
+    struct epoch_retired *next;
+    uint64_t epoch;
+    void *obj;
+    epoch_del_fct del_fct;
+} epoch_retired_t;
+
+/*
+ * Deferred reclamation of the memory of state shared with reader threads that
+ * access it without locks (quiescent state based reclamation).
+ *
+ * Readers register with the domain and report a quiescent state, a point
+ * where they hold no references to the shared state, regularly (e.g. after
+ * processing a batch of packets). Threads blocked for a long time should go
+ * offline instead. Writers unlink objects from the shared state, publishing
+ * the changes with release stores, and retire them. A retired object is freed
+ * once all the online readers have reported a quiescent state after it was
+ * retired, so no reader can still be using it.
+ *
+ * Writers are serialized by the caller. Retire and reclaim can be called by
+ * any thread that is not in the middle of a read.
+ */
+typedef struct epoch {
+    volatile uint64_t global;
+    epoch_thread_t threads[EPOCH_MAX_THREADS];
+    /* Protects the registration of threads and the list of retired objects */
+    pthread_mutex_t lock;
+    /* Retired objects, from the oldest one */
+    epoch_retired_t *head;
+    epoch_retired_t *tail;
+    uint32_t retired;
+} epoch_t;
+
+void epoch_init(epoch_t *ep);
+void epoch_uninit(epoch_t *ep);
+int epoch_register(epoch_t *ep);
+void epoch_unregister(epoch_t *ep, int id);
+void epoch_retire(epoch_t *ep, void *obj, epoch_del_fct del_fct);
+uint32_t epoch_reclaim(epoch_t *ep);
+uint32_t epoch_pending(epoch_t *ep);
+
+/* The reader holds no references to the shared state obtained before */
+static inline void
+epoch_quiescent(epoch_t *ep, int id)
+{
+    __atomic_store_n(&ep->threads[id].epoch,
+            __atomic_load_n(&ep->global, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+/* The reader won't access the shared state until it goes online again */
+static inline void
+epoch_offline(epoch_t *ep, int id)
+{
+    __atomic_store_n(&ep->threads[id].epoch, EPOCH_OFFLINE, __ATOMIC_RELEASE);
+}
+
+/* The reader may access the shared state again. The reads can't be done
+ * before the writers see it online */
+static inline void
+epoch_online(epoch_t *ep, int id)
+{
+    __atomic_store_n(&ep->threads[id].epoch,
+            __atomic_load_n(&ep->global, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+#endif /* EPOCH_H_ */
@@ -0,0 +1,68 @@
+/*
+ *
+ * Copyright (C) 2011, 2015 Cisco Systems, Inc.
+ * Copyright (C) 2015 CBA research group, Technical University of Catalonia.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "fwd_gen.h"
+#include "oor_log.h"
+
+volatile uint32_t fwd_gens[FWD_GEN_SIZE];
+volatile uint32_t fwd_uses[FWD_GEN_SIZE];
+volatile uint32_t fwd_use_epoch = 0;
+static uint32_t fwd_gen_next_idx = FWD_GEN_RESERVED;
+
+
+/* Get the counter of a new map cache entry or local mapping */
+uint32_t
+fwd_gen_new_idx()
+{
+    uint32_t idx = fwd_gen_next_idx;
+
+    if (++fwd_gen_next_idx == FWD_GEN_SIZE){
+        fwd_gen_next_idx = FWD_GEN_RESERVED;
+    }
+    return (idx);
+}
+
+void
+fwd_gen_bump(uint32_t idx)
+{
+    __atomic_add_fetch(&fwd_gens[idx], 1, __ATOMIC_RELEASE);
+}
+
+void
+fwd_gen_deps_add(fwd_gen_deps_t *deps, uint32_t idx)
+{
+    int i;
+
+    for (i = 0; i < deps->num; i++){
+        if (deps->idx[i] == idx){
+            return;
+        }
+    }
+    if (deps->num == FWD_GEN_MAX_DEPS){
+        /* Shouldn't happen. Record an old generation so the forwarding
+         * info is never considered current */
+        OOR_LOG(LDBG_1, "fwd_gen_deps_add: Too many dependencies");
+        deps->idx[0] = FWD_GEN_MCACHE;
+        deps->gen[0] = fwd_gens[FWD_GEN_MCACHE] - 1;
+        return;
+    }
+    deps->idx[deps->num] = idx;
+    deps->gen[deps->num] = fwd_gens[idx];
+    deps->num++;
+}
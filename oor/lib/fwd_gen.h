@@ -0,0 +1,115 @@
+/*
+ *
+ * Copyright (C) 2011, 2015 Cisco Systems, Inc.
+ * Copyright (C) 2015 CBA research group, Technical University of Catalonia.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef FWD_GEN_H_
+#define FWD_GEN_H_
+
+#include <stdint.h>
+
+/*
+ * Generation counters of the control plane state used to obtain the
+ * forwarding info of a flow. The forwarding info cached by the data plane
+ * records the counters it depends on and remains valid while they don't
+ * change. The control plane bumps a counter when the associated state
+ * changes, invalidating lazily all the flows depending on it.
+ *
+ * Each map cache entry and local mapping gets its own counter. When there
+ * are more entries than counters, they are shared and a change invalidates
+ * also the flows of the other entries.
+ */
+#define FWD_GEN_SIZE            16384
+
+/* Counters not associated to an entry */
+/* Map cache entries added or removed */
+#define FWD_GEN_MCACHE          0
+/* Interfaces, addresses, routes and local mappings added or removed */
+#define FWD_GEN_LOCAL           1
+#define FWD_GEN_RESERVED        2
+
+/* Max number of counters the forwarding info of a flow can depend on */
+#define FWD_GEN_MAX_DEPS        4
+
+/* Packets of a flow table entry added at once to the usage of its state */
+#define FWD_USE_BATCH           16
+
+typedef struct fwd_gen_deps {
+    uint16_t idx[FWD_GEN_MAX_DEPS];
+    uint32_t gen[FWD_GEN_MAX_DEPS];
+    uint8_t num;
+} fwd_gen_deps_t;
+
+/* Only modified by the control plane. Read by the data plane threads with
+ * atomic loads */
+extern volatile uint32_t fwd_gens[FWD_GEN_SIZE];
+/* Packets forwarded with the state of each counter, added by the data plane
+ * threads in batches of up to FWD_USE_BATCH. The control plane uses the
+ * difference between two readings to know if the state is still in use */
+extern volatile uint32_t fwd_uses[FWD_GEN_SIZE];
+/* Incremented by each reading of the usage. The data plane threads add the
+ * packets of a batch without waiting for it to be complete when it changes,
+ * so that a packet forwarded after a reading is seen by the next one */
+extern volatile uint32_t fwd_use_epoch;
+
+uint32_t fwd_gen_new_idx();
+void fwd_gen_bump(uint32_t idx);
+void fwd_gen_deps_add(fwd_gen_deps_t *deps, uint32_t idx);
+
+/* Check if the counters recorded in deps are still the current ones */
+static inline int
+fwd_gen_deps_current(fwd_gen_deps_t *deps)
+{
+    int i;
+
+    for (i = 0; i < deps->num; i++){
+        if (__atomic_load_n(&fwd_gens[deps->idx[i]], __ATOMIC_ACQUIRE) != deps->gen[i]){
+            return (0);
+        }
+    }
+    return (1);
+}
+
+/* Account pkts packets forwarded with the state recorded in deps */
+static inline void
+fwd_gen_deps_use(fwd_gen_deps_t *deps, uint32_t pkts)
+{
+    int i;
+
+    for (i = 0; i < deps->num; i++){
+        if (deps->idx[i] >= FWD_GEN_RESERVED){
+            __atomic_add_fetch(&fwd_uses[deps->idx[i]], pkts, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static inline uint32_t
+fwd_gen_use_epoch()
+{
+    return (__atomic_load_n(&fwd_use_epoch, __ATOMIC_RELAXED));
+}
+
+/* Read the usage of a counter */
+static inline uint32_t
+fwd_gen_uses(uint32_t idx)
+{
+    __atomic_add_fetch(&fwd_use_epoch, 1, __ATOMIC_RELAXED);
+    return (__atomic_load_n(&fwd_uses[idx], __ATOMIC_RELAXED));
+}
+
+
+#endif /* FWD_GEN_H_ */
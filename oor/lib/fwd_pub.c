@@ -0,0 +1,292 @@
+/*
+ *
+ * Copyright (C) 2011, 2015 Cisco Systems, Inc.
+ * Copyright (C) 2015 CBA research group, Technical University of Catalonia.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <string.h>
+
+#include "fwd_pub.h"
+#include "mem_util.h"
+#include "oor_log.h"
+#include "../liblisp/liblisp.h"
+
+/* Default maximum number of published prefixes */
+#define MAX_SIZE 4096
+
+
+static inline fwd_pub_map_t *
+fwd_pub_map(fwd_pub_t *pub, int afi)
+{
+    switch (afi){
+    case AF_INET:
+        return (&pub->v4);
+    case AF_INET6:
+        return (&pub->v6);
+    default:
+        return (NULL);
+    }
+}
+
+static void
+fwd_pub_map_init(fwd_pub_map_t *map, int words, uint32_t max_prefixes)
+{
+    uint32_t size = 16;
+
+    while (size < max_prefixes){
+        size <<= 1;
+    }
+    memset(map, 0, sizeof(fwd_pub_map_t));
+    map->buckets = xzalloc(size * sizeof(fwd_pub_entry_t *));
+    map->mask = size - 1;
+    map->words = words;
+    map->plens = xzalloc(sizeof(fwd_pub_plens_t));
+}
+
+/* Publish a new list of prefix lengths when a length is used for the first
+ * time or not used anymore */
+static void
+fwd_pub_map_update_plens(fwd_pub_t *pub, fwd_pub_map_t *map)
+{
+    fwd_pub_plens_t *plens, *old = map->plens;
+    int plen;
+
+    plens = xzalloc(sizeof(fwd_pub_plens_t));
+    for (plen = map->words * 32; plen >= 0; plen--){
+        if (map->plen_count[plen] > 0){
+            plens->plens[plens->num++] = plen;
+        }
+    }
+    __atomic_store_n(&map->plens, plens, __ATOMIC_RELEASE);
+    epoch_retire(pub->epoch, old, free);
+}
+
+/* Unlink the entry pointed by ppe. It is freed when the readers are done */
+static void
+fwd_pub_map_del(fwd_pub_t *pub, fwd_pub_map_t *map, fwd_pub_entry_t **ppe)
+{
+    fwd_pub_entry_t *pe = *ppe;
+
+    __atomic_store_n(ppe, pe->next, __ATOMIC_RELEASE);
+    if (--map->plen_count[pe->dst_plen] == 0){
+        fwd_pub_map_update_plens(pub, map);
+    }
+    pub->count--;
+    epoch_retire(pub->epoch, pe, free);
+}
+
+static void
+fwd_pub_map_add(fwd_pub_t *pub, fwd_pub_map_t *map, fwd_pub_entry_t *pe)
+{
+    fwd_pub_entry_t **bucket;
+
+    bucket = &map->buckets[pcache_hash(pe->dst, map->words, pe->dst_plen) & map->mask];
+    pe->next = *bucket;
+    __atomic_store_n(bucket, pe, __ATOMIC_RELEASE);
+    if (map->plen_count[pe->dst_plen]++ == 0){
+        fwd_pub_map_update_plens(pub, map);
+    }
+    pub->count++;
+}
+
+/* Remove the entries that are not valid anymore. With all, remove all of them */
+static void
+fwd_pub_map_purge(fwd_pub_t *pub, fwd_pub_map_t *map, uint8_t all)
+{
+    fwd_pub_entry_t **ppe;
+    uint32_t i;
+
+    for (i = 0; i <= map->mask; i++){
+        ppe = &map->buckets[i];
+        while (*ppe){
+            if (all || !fwd_gen_deps_current(&(*ppe)->deps)){
+                fwd_pub_map_del(pub, map, ppe);
+                pub->stats.invalidations += !all;
+            }else{
+                ppe = &(*ppe)->next;
+            }
+        }
+    }
+}
+
+/* Initialize a table for up to max_prefixes pairs of prefixes, read by the
+ * threads registered in epoch */
+void
+fwd_pub_init(fwd_pub_t *pub, uint32_t max_prefixes, epoch_t *epoch)
+{
+    if (max_prefixes == 0){
+        max_prefixes = MAX_SIZE;
+    }
+    pub->epoch = epoch;
+    fwd_pub_map_init(&pub->v4, 1, max_prefixes);
+    fwd_pub_map_init(&pub->v6, 4, max_prefixes);
+    pub->count = 0;
+    pub->max_count = max_prefixes;
+    memset(&pub->stats, 0, sizeof(fwd_pub_stats_t));
+}
+
+/* The readers should be offline */
+void
+fwd_pub_uninit(fwd_pub_t *pub)
+{
+    if (!pub->v4.buckets){
+        return;
+    }
+    fwd_pub_flush(pub);
+    free(pub->v4.buckets);
+    free(pub->v6.buckets);
+    free(pub->v4.plens);
+    free(pub->v6.plens);
+    pub->v4.buckets = NULL;
+    pub->v6.buckets = NULL;
+    epoch_reclaim(pub->epoch);
+}
+
+void
+fwd_pub_flush(fwd_pub_t *pub)
+{
+    fwd_pub_map_purge(pub, &pub->v4, TRUE);
+    fwd_pub_map_purge(pub, &pub->v6, TRUE);
+}
+
+/* Publish a copy of the prefix level state of the forwarding info obtained
+ * from the control plane, replacing the one of the same prefixes. fi is not
+ * modified */
+void
+fwd_pub_insert(fwd_pub_t *pub, fwd_info_t *fi)
+{
+    fwd_prefix_t *prefix = fi->prefix;
+    fwd_pub_map_t *map;
+    fwd_pub_entry_t *pe, **ppe;
+    uint32_t addr[PCACHE_ADDR_WORDS];
+
+    if (!prefix){
+        return;
+    }
+    map = fwd_pub_map(pub, lisp_addr_ip_afi(&prefix->dst_pref));
+    if (!map || lisp_addr_ip_afi(&prefix->src_pref) != lisp_addr_ip_afi(&prefix->dst_pref)){
+        return;
+    }
+
+    pe = xzalloc(sizeof(fwd_pub_entry_t));
+    memcpy(&pe->prefix, prefix, sizeof(fwd_prefix_t));
+    pe->deps = fi->deps;
+    pe->encap = fi->encap;
+    pe->dst_plen = lisp_addr_ip_get_plen(&prefix->dst_pref);
+    pe->src_plen = lisp_addr_ip_get_plen(&prefix->src_pref);
+    lisp_addr_copy_to(addr, &prefix->dst_pref);
+    pcache_mask(pe->dst, addr, map->words, pe->dst_plen);
+    lisp_addr_copy_to(addr, &prefix->src_pref);
+    pcache_mask(pe->src, addr, map->words, pe->src_plen);
+
+    if (pub->count >= pub->max_count){
+        fwd_pub_map_purge(pub, &pub->v4, FALSE);
+        fwd_pub_map_purge(pub, &pub->v6, FALSE);
+        if (pub->count >= pub->max_count){
+            fwd_pub_flush(pub);
+            pub->stats.flushes++;
+        }
+    }
+
+    /* The new entry is added before the previous one of the same prefixes is
+     * removed, so readers always find one of them */
+    fwd_pub_map_add(pub, map, pe);
+    ppe = &pe->next;
+    while (*ppe){
+        if ((*ppe)->dst_plen == pe->dst_plen && (*ppe)->src_plen == pe->src_plen
+                && memcmp((*ppe)->dst, pe->dst, map->words * sizeof(uint32_t)) == 0
+                && memcmp((*ppe)->src, pe->src, map->words * sizeof(uint32_t)) == 0){
+            fwd_pub_map_del(pub, map, ppe);
+            break;
+        }
+        ppe = &(*ppe)->next;
+    }
+    pub->stats.inserts++;
+
+    epoch_reclaim(pub->epoch);
+}
+
+/* Copy of the state of an entry, to be inserted in the prefix cache of the
+ * reader */
+static fwd_info_t *
+fwd_pub_entry_fwd_info(fwd_pub_entry_t *pe)
+{
+    fwd_info_t *fi;
+
+    fi = fwd_info_new();
+    fi->prefix = fwd_prefix_new();
+    memcpy(fi->prefix, &pe->prefix, sizeof(fwd_prefix_t));
+    fi->deps = pe->deps;
+    fi->encap = pe->encap;
+
+    return (fi);
+}
+
+/* Get a copy of the prefix level state of the longest destination prefix that
+ * contains the flow. It doesn't take locks: the caller should be a reader of
+ * the epoch domain of the table, or a writer. Returns NULL if there is no
+ * valid entry */
+fwd_info_t *
+fwd_pub_lookup(fwd_pub_t *pub, packet_tuple_t *tpl)
+{
+    fwd_pub_map_t *map;
+    fwd_pub_plens_t *plens;
+    fwd_pub_entry_t *pe;
+    uint32_t dst[PCACHE_ADDR_WORDS], src[PCACHE_ADDR_WORDS];
+    uint32_t dpref[PCACHE_ADDR_WORDS], spref[PCACHE_ADDR_WORDS];
+    int i, plen;
+
+    map = fwd_pub_map(pub, lisp_addr_ip_afi(&tpl->dst_addr));
+    if (!map || lisp_addr_ip_afi(&tpl->src_addr) != lisp_addr_ip_afi(&tpl->dst_addr)){
+        return (NULL);
+    }
+    plens = __atomic_load_n(&map->plens, __ATOMIC_ACQUIRE);
+    if (plens->num == 0){
+        return (NULL);
+    }
+    lisp_addr_copy_to(dst, &tpl->dst_addr);
+    lisp_addr_copy_to(src, &tpl->src_addr);
+
+    for (i = 0; i < plens->num; i++){
+        plen = plens->plens[i];
+        pcache_mask(dpref, dst, map->words, plen);
+        pe = __atomic_load_n(&map->buckets[pcache_hash(dpref, map->words, plen) & map->mask],
+                __ATOMIC_ACQUIRE);
+        for (; pe != NULL; pe = __atomic_load_n(&pe->next, __ATOMIC_ACQUIRE)){
+            if (pe->dst_plen != plen
+                    || memcmp(pe->dst, dpref, map->words * sizeof(uint32_t)) != 0){
+                continue;
+            }
+            pcache_mask(spref, src, map->words, pe->src_plen);
+            if (memcmp(pe->src, spref, map->words * sizeof(uint32_t)) != 0){
+                continue;
+            }
+            if (!fwd_gen_deps_current(&pe->deps)){
+                /* Removed by the next writer that needs the space */
+                return (NULL);
+            }
+            return (fwd_pub_entry_fwd_info(pe));
+        }
+    }
+
+    return (NULL);
+}
+
+uint32_t
+fwd_pub_size(fwd_pub_t *pub)
+{
+    return (pub->count);
+}
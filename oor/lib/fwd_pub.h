@@ -0,0 +1,95 @@
+/*
+ *
+ * Copyright (C) 2011, 2015 Cisco Systems, Inc.
+ * Copyright (C) 2015 CBA research group, Technical University of Catalonia.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef FWD_PUB_H_
+#define FWD_PUB_H_
+
+#include "epoch.h"
+#include "pcache.h"
+#include "../fwd_policies/fwd_policy.h"
+
+/* Published prefix level state. Not modified once it is reachable */
+typedef struct fwd_pub_entry {
+    struct fwd_pub_entry *next;
+    uint32_t dst[PCACHE_ADDR_WORDS];
+    uint32_t src[PCACHE_ADDR_WORDS];
+    uint8_t dst_plen;
+    uint8_t src_plen;
+    fwd_prefix_t prefix;
+    fwd_gen_deps_t deps;
+    oor_encap_t encap;
+} fwd_pub_entry_t;
+
+/* Destination prefix lengths with entries, from the longest one. Replaced
+ * as a whole when they change */
+typedef struct fwd_pub_plens {
+    int num;
+    uint8_t plens[129];
+} fwd_pub_plens_t;
+
+typedef struct fwd_pub_map {
+    fwd_pub_entry_t **buckets;
+    uint32_t mask;
+    int words;
+    /* Only used by the writers */
+    uint32_t plen_count[129];
+    fwd_pub_plens_t *plens;
+} fwd_pub_map_t;
+
+typedef struct fwd_pub_stats {
+    /* Prefixes published */
+    uint64_t inserts;
+    /* Prefixes removed because the state they were obtained from changed */
+    uint64_t invalidations;
+    /* Times the table was emptied because it was full */
+    uint64_t flushes;
+} fwd_pub_stats_t;
+
+/*
+ * Prefix level forwarding state obtained from the control plane, shared by
+ * all the data plane threads. It is the second level of the per thread
+ * prefix caches (see pcache.h): a thread that misses its own cache looks for
+ * the prefixes here before calling the control plane, so the state obtained
+ * by one thread is available to the rest without locking.
+ *
+ * Lookups don't take locks or modify the table. The writers, serialized by
+ * the caller, publish the changes with release stores and retire the removed
+ * entries to the epoch domain of the readers, which frees them when no reader
+ * can be using them. The readers copy the state they find before their next
+ * quiescent state. Entries are validated with the generations of the state
+ * they were obtained from, like the ones of the prefix caches, and stale ones
+ * are removed by the writers.
+ */
+typedef struct fwd_pub {
+    fwd_pub_map_t v4;
+    fwd_pub_map_t v6;
+    uint32_t count;
+    uint32_t max_count;
+    epoch_t *epoch;
+    fwd_pub_stats_t stats;
+} fwd_pub_t;
+
+void fwd_pub_init(fwd_pub_t *pub, uint32_t max_prefixes, epoch_t *epoch);
+void fwd_pub_uninit(fwd_pub_t *pub);
+void fwd_pub_insert(fwd_pub_t *pub, fwd_info_t *fi);
+void fwd_pub_flush(fwd_pub_t *pub);
+fwd_info_t *fwd_pub_lookup(fwd_pub_t *pub, packet_tuple_t *tpl);
+uint32_t fwd_pub_size(fwd_pub_t *pub);
+
+#endif /* FWD_PUB_H_ */
@@ -0,0 +1,911 @@
+/*
+ *
+ * Copyright (C) 2011, 2015 Cisco Systems, Inc.
+ * Copyright (C) 2015 CBA research group, Technical University of Catalonia.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "crc32c.h"
+#include "lpm.h"
+#include "mem_util.h"
+#include "oor_log.h"
+
+#define TBL24_SIZE      (1 << 24)
+#define TBL8_GROUP      256
+#define DIR6_SIZE       (1 << LPM6_DIR_BITS)
+#define MIN_SIZE        16
+
+
+/* Without the instruction, the builtin is a call to a table based function */
+#ifdef __POPCNT__
+#define lpm_popcount(x) __builtin_popcountll(x)
+#else
+static inline uint32_t
+lpm_popcount(uint64_t x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return ((x * 0x0101010101010101ULL) >> 56);
+}
+#endif
+
+static inline void
+lpm_addr_load(lpm_t *lpm, uint32_t *dst, void *addr)
+{
+    uint32_t w[LPM_KEY_WORDS];
+    int i, words = lpm->bits / 32;
+
+    memcpy(w, addr, words * sizeof(uint32_t));
+    for (i = 0; i < LPM_KEY_WORDS; i++){
+        dst[i] = i < words ? ntohl(w[i]) : 0;
+    }
+}
+
+static inline void
+lpm_addr_mask(uint32_t *a, int plen)
+{
+    int i, bits;
+
+    for (i = 0; i < LPM_KEY_WORDS; i++){
+        bits = plen - 32 * i;
+        if (bits <= 0){
+            a[i] = 0;
+        }else if (bits < 32){
+            a[i] &= ~0U << (32 - bits);
+        }
+    }
+}
+
+/* Length of the prefix of an entry, -1 if it has none */
+static inline int
+lpm_depth(lpm_t *lpm, uint32_t id)
+{
+    return (id ? lpm->pfx[id].plen : -1);
+}
+
+/* Check if the first len bits of a and b are equal */
+static inline int
+lpm_addr_match(uint32_t *a, uint32_t *b, int len)
+{
+    int i;
+
+    for (i = 0; len > 0; i++, len -= 32){
+        if ((a[i] ^ b[i]) & (len >= 32 ? ~0U : ~(~0U >> len))){
+            return (FALSE);
+        }
+    }
+    return (TRUE);
+}
+
+/* Number of first bits, up to len, equal in a and b */
+static inline int
+lpm_addr_common(uint32_t *a, uint32_t *b, int len)
+{
+    int i, n;
+
+    for (i = 0; 32 * i < len; i++){
+        if (a[i] != b[i]){
+            n = 32 * i + __builtin_clz(a[i] ^ b[i]);
+            return (n < len ? n : len);
+        }
+    }
+    return (len);
+}
+
+static inline int
+lpm_prefix_match(lpm_prefix_t *p, uint32_t *a)
+{
+    return (lpm_addr_match(p->addr, a, p->plen));
+}
+
+
+/* Prefixes and their hash table */
+
+static inline uint32_t
+lpm_hash(lpm_t *lpm, uint32_t *a, uint8_t plen)
+{
+    return (crc32c(plen, a, LPM_KEY_WORDS * sizeof(uint32_t)) & lpm->buckets_mask);
+}
+
+static uint32_t
+lpm_find(lpm_t *lpm, uint32_t *a, uint8_t plen)
+{
+    uint32_t id;
+
+    for (id = lpm->buckets[lpm_hash(lpm, a, plen)]; id != LPM_NIL; id = lpm->pfx[id].next){
+        if (lpm->pfx[id].plen == plen && memcmp(lpm->pfx[id].addr, a, LPM_KEY_WORDS * sizeof(uint32_t)) == 0){
+            return (id);
+        }
+    }
+    return (0);
+}
+
+static void
+lpm_hash_resize(lpm_t *lpm, uint32_t size)
+{
+    uint32_t id, *bucket;
+
+    free(lpm->buckets);
+    lpm->buckets = xmalloc(size * sizeof(uint32_t));
+    memset(lpm->buckets, 0xff, size * sizeof(uint32_t));
+    lpm->buckets_mask = size - 1;
+    for (id = 1; id < lpm->pfx_used; id++){
+        if (lpm->pfx[id].data){
+            bucket = &lpm->buckets[lpm_hash(lpm, lpm->pfx[id].addr, lpm->pfx[id].plen)];
+            lpm->pfx[id].next = *bucket;
+            *bucket = id;
+        }
+    }
+}
+
+static uint32_t
+lpm_prefix_new(lpm_t *lpm, uint32_t *a, uint8_t plen, void *data)
+{
+    uint32_t id, *bucket;
+
+    if (lpm->pfx_free != LPM_NIL){
+        id = lpm->pfx_free;
+        lpm->pfx_free = lpm->pfx[id].next;
+    }else{
+        if (lpm->pfx_used == lpm->pfx_size){
+            lpm->pfx_size *= 2;
+            lpm->pfx = xrealloc(lpm->pfx, lpm->pfx_size * sizeof(lpm_prefix_t));
+        }
+        id = lpm->pfx_used++;
+    }
+    memcpy(lpm->pfx[id].addr, a, sizeof(lpm->pfx[id].addr));
+    lpm->pfx[id].plen = plen;
+    lpm->pfx[id].data = data;
+
+    if (++lpm->count > lpm->buckets_mask + 1){
+        lpm_hash_resize(lpm, 2 * (lpm->buckets_mask + 1));
+    }else{
+        bucket = &lpm->buckets[lpm_hash(lpm, a, plen)];
+        lpm->pfx[id].next = *bucket;
+        *bucket = id;
+    }
+
+    return (id);
+}
+
+static void
+lpm_prefix_free(lpm_t *lpm, uint32_t id)
+{
+    uint32_t *pid;
+
+    pid = &lpm->buckets[lpm_hash(lpm, lpm->pfx[id].addr, lpm->pfx[id].plen)];
+    while (*pid != id){
+        pid = &lpm->pfx[*pid].next;
+    }
+    *pid = lpm->pfx[id].next;
+
+    lpm->pfx[id].data = NULL;
+    lpm->pfx[id].next = lpm->pfx_free;
+    lpm->pfx_free = id;
+    lpm->count--;
+}
+
+/* Longest prefix shorter than plen that contains a, or 0 */
+static uint32_t
+lpm_parent(lpm_t *lpm, uint32_t *a, int plen)
+{
+    uint32_t m[LPM_KEY_WORDS], id;
+    int len;
+
+    for (len = plen - 1; len >= 0; len--){
+        memcpy(m, a, sizeof(m));
+        lpm_addr_mask(m, len);
+        if ((id = lpm_find(lpm, m, len))){
+            return (id);
+        }
+    }
+    return (0);
+}
+
+/* Entries to update: with insertion (old is LPM_NIL), the ones with a
+ * shorter prefix than the new one. With removal, the ones of the old one */
+static inline int
+lpm_replaces(lpm_t *lpm, uint32_t e, uint32_t old, int plen)
+{
+    if (old != LPM_NIL){
+        return (e == old);
+    }
+    return (lpm_depth(lpm, e) < plen);
+}
+
+
+/* IPv4: DIR-24-8 */
+
+static uint32_t
+lpm4_group_new(lpm4_t *t, uint32_t fill)
+{
+    uint32_t g, i;
+
+    if (t->tbl8_free != LPM_NIL){
+        g = t->tbl8_free;
+        t->tbl8_free = t->tbl8[g * TBL8_GROUP];
+    }else{
+        if (t->tbl8_used == t->tbl8_size){
+            t->tbl8_size = t->tbl8_size ? 2 * t->tbl8_size : MIN_SIZE;
+            t->tbl8 = xrealloc(t->tbl8, t->tbl8_size * TBL8_GROUP * sizeof(uint32_t));
+        }
+        g = t->tbl8_used++;
+    }
+    for (i = 0; i < TBL8_GROUP; i++){
+        t->tbl8[g * TBL8_GROUP + i] = fill;
+    }
+    return (g);
+}
+
+static void
+lpm4_group_free(lpm4_t *t, uint32_t g)
+{
+    t->tbl8[g * TBL8_GROUP] = t->tbl8_free;
+    t->tbl8_free = g;
+}
+
+/* Set id in the entries of the prefix a/plen selected by lpm_replaces */
+static void
+lpm4_update(lpm_t *lpm, uint32_t a, int plen, uint32_t old, uint32_t id)
+{
+    lpm4_t *t = &lpm->v4;
+    uint32_t s, n, j, g, e, *grp, last = LPM_NIL;
+    int replace = FALSE;
+
+    if (plen <= 24){
+        n = 1U << (24 - plen);
+        for (s = a >> 8; n > 0; s++, n--){
+            e = t->tbl24[s];
+            if (e & LPM_EXT){
+                grp = &t->tbl8[(e & ~LPM_EXT) * TBL8_GROUP];
+                for (j = 0; j < TBL8_GROUP; j++){
+                    if (lpm_replaces(lpm, grp[j], old, plen)){
+                        grp[j] = id;
+                    }
+                }
+                continue;
+            }
+            /* Most entries are equal to the previous one */
+            if (e != last){
+                last = e;
+                replace = lpm_replaces(lpm, e, old, plen);
+            }
+            if (replace){
+                t->tbl24[s] = id;
+            }
+        }
+        return;
+    }
+
+    s = a >> 8;
+    e = t->tbl24[s];
+    if (!(e & LPM_EXT)){
+        g = lpm4_group_new(t, e);
+        t->tbl24[s] = g | LPM_EXT;
+    }else{
+        g = e & ~LPM_EXT;
+    }
+    grp = &t->tbl8[g * TBL8_GROUP];
+    n = 1U << (32 - plen);
+    for (j = a & 0xff; n > 0; j++, n--){
+        if (lpm_replaces(lpm, grp[j], old, plen)){
+            grp[j] = id;
+        }
+    }
+    if (old == LPM_NIL){
+        return;
+    }
+    /* The group is not needed when there are no prefixes longer than /24 */
+    for (j = 1; j < TBL8_GROUP && grp[j] == grp[0]; j++);
+    if (j == TBL8_GROUP){
+        t->tbl24[s] = grp[0];
+        lpm4_group_free(t, g);
+    }
+}
+
+
+/* IPv6 and longer keys: first level indexed by the first bits and
+ * compressed subtrees */
+
+static inline uint32_t
+lpm6_bits(uint32_t *a, int off)
+{
+    int w = off >> 5, b = off & 31;
+    uint64_t v = (uint64_t)a[w] << 32;
+
+    if (w < LPM_KEY_WORDS - 1){
+        v |= a[w + 1];
+    }
+    return ((v >> (64 - LPM6_STRIDE - b)) & ((1 << LPM6_STRIDE) - 1));
+}
+
+static uint32_t
+lpm6_sub_nodes_new(lpm6_sub_t *sub, uint32_t num)
+{
+    uint32_t base = sub->nodes_num;
+
+    if (sub->nodes_num + num > sub->nodes_size){
+        sub->nodes_size = sub->nodes_size ? 2 * sub->nodes_size : MIN_SIZE;
+        if (sub->nodes_size < sub->nodes_num + num){
+            sub->nodes_size = sub->nodes_num + num;
+        }
+        sub->nodes = xrealloc(sub->nodes, sub->nodes_size * sizeof(lpm6_node_t));
+    }
+    sub->nodes_num += num;
+    return (base);
+}
+
+static void
+lpm6_sub_leaf_add(lpm6_sub_t *sub, uint32_t id)
+{
+    if (sub->leaves_num == sub->leaves_size){
+        sub->leaves_size = sub->leaves_size ? 2 * sub->leaves_size : MIN_SIZE;
+        sub->leaves = xrealloc(sub->leaves, sub->leaves_size * sizeof(uint32_t));
+    }
+    sub->leaves[sub->leaves_num++] = id;
+}
+
+/* Build the node ni at bit off from the n prefixes of pfx under it. All of
+ * them are longer than off. def is the longest prefix that covers the node */
+static void
+lpm6_node_build(lpm_t *lpm, lpm6_sub_t *sub, uint32_t ni, int off,
+        uint32_t *pfx, uint32_t n, uint32_t def)
+{
+    uint32_t slotdef[1 << LPM6_STRIDE], count[1 << LPM6_STRIDE], start[1 << LPM6_STRIDE];
+    uint32_t *child_pfx = NULL, i, s, span, base0, base1, last = 0, nc = 0;
+    uint64_t vector = 0, leafvec = 0;
+    lpm_prefix_t *p;
+    int end = off + LPM6_STRIDE;
+
+    for (s = 0; s < (1 << LPM6_STRIDE); s++){
+        slotdef[s] = def;
+        count[s] = 0;
+    }
+    /* Prefixes ending in the node cover a range of slots. The rest go to
+     * the child of their slot */
+    for (i = 0; i < n; i++){
+        p = &lpm->pfx[pfx[i]];
+        s = lpm6_bits(p->addr, off);
+        if (p->plen <= end){
+            for (span = 1U << (end - p->plen); span > 0; s++, span--){
+                if (lpm_depth(lpm, slotdef[s]) < p->plen){
+                    slotdef[s] = pfx[i];
+                }
+            }
+        }else{
+            count[s]++;
+            nc++;
+        }
+    }
+    if (nc > 0){
+        child_pfx = xmalloc(nc * sizeof(uint32_t));
+        for (s = 0, i = 0; s < (1 << LPM6_STRIDE); s++){
+            start[s] = i;
+            i += count[s];
+        }
+        for (i = 0; i < n; i++){
+            p = &lpm->pfx[pfx[i]];
+            if (p->plen > end){
+                child_pfx[start[lpm6_bits(p->addr, off)]++] = pfx[i];
+            }
+        }
+    }
+
+    nc = 0;
+    base0 = sub->leaves_num;
+    for (s = 0; s < (1 << LPM6_STRIDE); s++){
+        if (count[s] > 0){
+            vector |= 1ULL << s;
+            nc++;
+        }else if (leafvec == 0 || slotdef[s] != last){
+            leafvec |= 1ULL << s;
+            lpm6_sub_leaf_add(sub, slotdef[s]);
+            last = slotdef[s];
+        }
+    }
+    /* Children are consecutive */
+    base1 = lpm6_sub_nodes_new(sub, nc);
+    sub->nodes[ni].vector = vector;
+    sub->nodes[ni].leafvec = leafvec;
+    sub->nodes[ni].base0 = base0;
+    sub->nodes[ni].base1 = base1;
+
+    for (s = 0, i = 0; s < (1 << LPM6_STRIDE); s++){
+        if (count[s] > 0){
+            /* start[s] was advanced to the end of the prefixes of s */
+            lpm6_node_build(lpm, sub, base1 + i, end, child_pfx + start[s] - count[s],
+                    count[s], slotdef[s]);
+            i++;
+        }
+    }
+    free(child_pfx);
+}
+
+/* The root is at the first bit not common to all the prefixes nor part of
+ * the shortest one */
+static void
+lpm6_sub_root(lpm_t *lpm, lpm6_sub_t *sub)
+{
+    lpm_prefix_t *first = &lpm->pfx[sub->pfx[0]], *p;
+    uint32_t i;
+    int off = first->plen - 1;
+
+    for (i = 1; i < sub->pfx_num && off > LPM6_DIR_BITS; i++){
+        p = &lpm->pfx[sub->pfx[i]];
+        if (p->plen - 1 < off){
+            off = p->plen - 1;
+        }
+        off = lpm_addr_common(first->addr, p->addr, off);
+    }
+    memcpy(sub->root, first->addr, sizeof(sub->root));
+    lpm_addr_mask(sub->root, off);
+    sub->root_off = off;
+}
+
+static void
+lpm6_sub_build(lpm_t *lpm, lpm6_sub_t *sub, uint32_t def)
+{
+    sub->nodes_num = 0;
+    sub->leaves_num = 0;
+    sub->nodes_garbage = 0;
+    sub->leaves_garbage = 0;
+    lpm6_sub_root(lpm, sub);
+    lpm6_sub_nodes_new(sub, 1);
+    lpm6_node_build(lpm, sub, 0, sub->root_off, sub->pfx, sub->pfx_num, def);
+    sub->dirty = FALSE;
+}
+
+/* Count the nodes below the node ni and the leaves of all of them */
+static void
+lpm6_node_count(lpm6_sub_t *sub, uint32_t ni, uint32_t *nodes, uint32_t *leaves)
+{
+    lpm6_node_t *node = &sub->nodes[ni];
+    uint32_t i, nc = lpm_popcount(node->vector);
+
+    *leaves += lpm_popcount(node->leafvec);
+    *nodes += nc;
+    for (i = 0; i < nc; i++){
+        lpm6_node_count(sub, node->base1 + i, nodes, leaves);
+    }
+}
+
+/* Lookup in a subtree not built yet */
+static uint32_t
+lpm6_sub_scan(lpm_t *lpm, lpm6_sub_t *sub, uint32_t *a, uint32_t def)
+{
+    uint32_t i, best = def;
+    lpm_prefix_t *p;
+
+    for (i = 0; i < sub->pfx_num; i++){
+        p = &lpm->pfx[sub->pfx[i]];
+        if (p->plen > lpm_depth(lpm, best) && lpm_prefix_match(p, a)){
+            best = sub->pfx[i];
+        }
+    }
+    return (best);
+}
+
+static uint32_t
+lpm6_sub_new(lpm6_t *t)
+{
+    uint32_t i;
+
+    if (t->subs_free != LPM_NIL){
+        i = t->subs_free;
+        t->subs_free = t->subs[i].next_free;
+    }else{
+        if (t->subs_used == t->subs_size){
+            t->subs_size = t->subs_size ? 2 * t->subs_size : MIN_SIZE;
+            t->subs = xrealloc(t->subs, t->subs_size * sizeof(lpm6_sub_t));
+        }
+        i = t->subs_used++;
+    }
+    memset(&t->subs[i], 0, sizeof(lpm6_sub_t));
+    return (i);
+}
+
+static void
+lpm6_sub_free(lpm6_t *t, uint32_t i)
+{
+    free(t->subs[i].nodes);
+    free(t->subs[i].leaves);
+    free(t->subs[i].pfx);
+    memset(&t->subs[i], 0, sizeof(lpm6_sub_t));
+    t->subs[i].next_free = t->subs_free;
+    t->subs_free = i;
+}
+
+/* The prefixes or the default of the subtree of top changed */
+static void
+lpm6_sub_changed(lpm_t *lpm, uint32_t top)
+{
+    lpm6_sub_t *sub = &lpm->v6.subs[lpm->v6.dir[top] & ~LPM_EXT];
+
+    if (lpm->v6.bulk){
+        sub->dirty = TRUE;
+    }else{
+        lpm6_sub_build(lpm, sub, lpm->v6.dir_def[top]);
+    }
+}
+
+/* The prefix a/plen, longer than LPM6_DIR_BITS, was added to the subtree of
+ * top or removed from it. Only the deepest node that contains all the
+ * addresses of the prefix changes, with the nodes below it: it is rebuilt
+ * with new nodes and leaves at the end of the arrays. The whole subtree is
+ * rebuilt when the ones left behind are half of them */
+static void
+lpm6_sub_update(lpm_t *lpm, uint32_t top, uint32_t *a, int plen)
+{
+    lpm6_sub_t *sub = &lpm->v6.subs[lpm->v6.dir[top] & ~LPM_EXT];
+    lpm6_node_t *node;
+    uint32_t *pfx, ni = 0, n = 0, i, idx, def = lpm->v6.dir_def[top];
+    uint32_t nodes = 0, leaves = 0;
+    lpm_prefix_t *p;
+    int off = sub->root_off;
+
+    /* A new prefix outside the root moves it */
+    if (lpm->v6.bulk || sub->dirty || sub->nodes_num == 0
+            || plen <= off || !lpm_addr_match(sub->root, a, off)
+            || 2 * sub->nodes_garbage > sub->nodes_num
+            || 2 * sub->leaves_garbage > sub->leaves_num){
+        lpm6_sub_changed(lpm, top);
+        return;
+    }
+
+    while (plen > off + LPM6_STRIDE){
+        node = &sub->nodes[ni];
+        idx = lpm6_bits(a, off);
+        if (!(node->vector & (1ULL << idx))){
+            break;
+        }
+        ni = node->base1 + lpm_popcount(node->vector & (((1ULL << idx) << 1) - 1)) - 1;
+        off += LPM6_STRIDE;
+    }
+
+    /* Prefixes under the node and the longest one covering it */
+    pfx = xmalloc(sub->pfx_num * sizeof(uint32_t));
+    for (i = 0; i < sub->pfx_num; i++){
+        p = &lpm->pfx[sub->pfx[i]];
+        if (!lpm_addr_match(p->addr, a, p->plen < off ? p->plen : off)){
+            continue;
+        }
+        if (p->plen > off){
+            pfx[n++] = sub->pfx[i];
+        }else if (p->plen > lpm_depth(lpm, def)){
+            def = sub->pfx[i];
+        }
+    }
+
+    lpm6_node_count(sub, ni, &nodes, &leaves);
+    sub->nodes_garbage += nodes;
+    sub->leaves_garbage += leaves;
+    lpm6_node_build(lpm, sub, ni, off, pfx, n, def);
+    free(pfx);
+}
+
+static void
+lpm6_insert(lpm_t *lpm, uint32_t *a, int plen, uint32_t id)
+{
+    lpm6_t *t = &lpm->v6;
+    uint32_t top = a[0] >> (32 - LPM6_DIR_BITS), s, n;
+    lpm6_sub_t *sub;
+
+    if (plen <= LPM6_DIR_BITS){
+        n = 1U << (LPM6_DIR_BITS - plen);
+        for (s = top; n > 0; s++, n--){
+            if (lpm_depth(lpm, t->dir_def[s]) < plen){
+                t->dir_def[s] = id;
+                if (t->dir[s] & LPM_EXT){
+                    lpm6_sub_changed(lpm, s);
+                }else{
+                    t->dir[s] = id;
+                }
+            }
+        }
+        return;
+    }
+
+    if (!(t->dir[top] & LPM_EXT)){
+        t->dir[top] = lpm6_sub_new(t) | LPM_EXT;
+    }
+    sub = &t->subs[t->dir[top] & ~LPM_EXT];
+    if (sub->pfx_num == sub->pfx_size){
+        sub->pfx_size = sub->pfx_size ? 2 * sub->pfx_size : MIN_SIZE;
+        sub->pfx = xrealloc(sub->pfx, sub->pfx_size * sizeof(uint32_t));
+    }
+    sub->pfx[sub->pfx_num++] = id;
+    lpm6_sub_update(lpm, top, a, plen);
+}
+
+static void
+lpm6_remove(lpm_t *lpm, uint32_t *a, int plen, uint32_t id)
+{
+    lpm6_t *t = &lpm->v6;
+    uint32_t top = a[0] >> (32 - LPM6_DIR_BITS), s, n, i, parent;
+    lpm6_sub_t *sub;
+
+    if (plen <= LPM6_DIR_BITS){
+        parent = lpm_parent(lpm, a, plen);
+        n = 1U << (LPM6_DIR_BITS - plen);
+        for (s = top; n > 0; s++, n--){
+            if (t->dir_def[s] == id){
+                t->dir_def[s] = parent;
+                if (t->dir[s] & LPM_EXT){
+                    lpm6_sub_changed(lpm, s);
+                }else{
+                    t->dir[s] = parent;
+                }
+            }
+        }
+        return;
+    }
+
+    sub = &t->subs[t->dir[top] & ~LPM_EXT];
+    for (i = 0; sub->pfx[i] != id; i++);
+    sub->pfx[i] = sub->pfx[--sub->pfx_num];
+    if (sub->pfx_num == 0){
+        lpm6_sub_free(t, t->dir[top] & ~LPM_EXT);
+        t->dir[top] = t->dir_def[top];
+    }else{
+        lpm6_sub_update(lpm, top, a, plen);
+    }
+}
+
+static void *
+lpm6_lookup(lpm_t *lpm, uint32_t *a)
+{
+    lpm6_t *t = &lpm->v6;
+    uint32_t top = a[0] >> (32 - LPM6_DIR_BITS), e, idx;
+    lpm6_sub_t *sub;
+    lpm6_node_t *node;
+    uint64_t bits;
+    int off;
+
+    e = t->dir[top];
+    if (!(e & LPM_EXT)){
+        return (lpm->pfx[e].data);
+    }
+    sub = &t->subs[e & ~LPM_EXT];
+    if (sub->dirty){
+        return (lpm->pfx[lpm6_sub_scan(lpm, sub, a, t->dir_def[top])].data);
+    }
+    if (!lpm_addr_match(sub->root, a, sub->root_off)){
+        return (lpm->pfx[t->dir_def[top]].data);
+    }
+    node = sub->nodes;
+    for (off = sub->root_off; ; off += LPM6_STRIDE){
+        idx = lpm6_bits(a, off);
+        /* Slots up to idx */
+        bits = ((1ULL << idx) << 1) - 1;
+        if (node->vector & (1ULL << idx)){
+            node = &sub->nodes[node->base1 + lpm_popcount(node->vector & bits) - 1];
+        }else{
+            e = sub->leaves[node->base0 + lpm_popcount(node->leafvec & bits) - 1];
+            return (lpm->pfx[e].data);
+        }
+    }
+}
+
+
+/* Table of keys of bits bits, a multiple of 32: 32 for IPv4, 128 for IPv6 */
+lpm_t *
+lpm_new(int bits)
+{
+    lpm_t *lpm;
+
+    if (bits < 32 || bits > LPM_KEY_WORDS * 32 || bits % 32 != 0){
+        OOR_LOG(LDBG_1, "lpm_new: Keys of %d bits not supported", bits);
+        return (NULL);
+    }
+    lpm = xzalloc(sizeof(lpm_t));
+    lpm->bits = bits;
+    /* Prefix 0 is no prefix */
+    lpm->pfx_size = MIN_SIZE;
+    lpm->pfx = xzalloc(lpm->pfx_size * sizeof(lpm_prefix_t));
+    lpm->pfx_used = 1;
+    lpm->pfx_free = LPM_NIL;
+    lpm_hash_resize(lpm, MIN_SIZE);
+    lpm->v4.tbl8_free = LPM_NIL;
+    lpm->v6.subs_free = LPM_NIL;
+
+    return (lpm);
+}
+
+/* The data of the prefixes is not freed */
+void
+lpm_del(lpm_t *lpm)
+{
+    uint32_t i;
+
+    if (!lpm){
+        return;
+    }
+    free(lpm->v4.tbl24);
+    free(lpm->v4.tbl8);
+    free(lpm->v6.dir);
+    free(lpm->v6.dir_def);
+    for (i = 0; i < lpm->v6.subs_used; i++){
+        free(lpm->v6.subs[i].nodes);
+        free(lpm->v6.subs[i].leaves);
+        free(lpm->v6.subs[i].pfx);
+    }
+    free(lpm->v6.subs);
+    free(lpm->buckets);
+    free(lpm->pfx);
+    free(lpm);
+}
+
+/* Add the prefix addr/plen. addr is in network byte order. Returns ERR_EXIST
+ * if the prefix is already there */
+int
+lpm_insert(lpm_t *lpm, void *addr, uint8_t plen, void *data)
+{
+    uint32_t a[LPM_KEY_WORDS], id;
+
+    if (!data || plen > lpm->bits){
+        return (BAD);
+    }
+    lpm_addr_load(lpm, a, addr);
+    lpm_addr_mask(a, plen);
+    if (lpm_find(lpm, a, plen)){
+        return (ERR_EXIST);
+    }
+    id = lpm_prefix_new(lpm, a, plen, data);
+
+    if (lpm->bits == 32){
+        if (!lpm->v4.tbl24){
+            lpm->v4.tbl24 = xzalloc(TBL24_SIZE * sizeof(uint32_t));
+        }
+        lpm4_update(lpm, a[0], plen, LPM_NIL, id);
+    }else{
+        if (!lpm->v6.dir){
+            lpm->v6.dir = xzalloc(DIR6_SIZE * sizeof(uint32_t));
+            lpm->v6.dir_def = xzalloc(DIR6_SIZE * sizeof(uint32_t));
+        }
+        lpm6_insert(lpm, a, plen, id);
+    }
+
+    return (GOOD);
+}
+
+/* Remove the prefix addr/plen. Returns its data or NULL if it is not there */
+void *
+lpm_remove(lpm_t *lpm, void *addr, uint8_t plen)
+{
+    uint32_t a[LPM_KEY_WORDS], id;
+    void *data;
+
+    lpm_addr_load(lpm, a, addr);
+    lpm_addr_mask(a, plen);
+    id = lpm_find(lpm, a, plen);
+    if (!id){
+        return (NULL);
+    }
+    data = lpm->pfx[id].data;
+
+    /* The addresses of the prefix go to the one containing it */
+    if (lpm->bits == 32){
+        lpm4_update(lpm, a[0], plen, id, lpm_parent(lpm, a, plen));
+    }else{
+        lpm6_remove(lpm, a, plen, id);
+    }
+    lpm_prefix_free(lpm, id);
+
+    return (data);
+}
+
+/* Data of the longest prefix containing the address addr, in network byte
+ * order, or NULL */
+void *
+lpm_lookup(lpm_t *lpm, void *addr)
+{
+    uint32_t a[LPM_KEY_WORDS], w, e;
+
+    if (lpm->bits == 32){
+        if (!lpm->v4.tbl24){
+            return (NULL);
+        }
+        memcpy(&w, addr, sizeof(uint32_t));
+        w = ntohl(w);
+        e = lpm->v4.tbl24[w >> 8];
+        if (e & LPM_EXT){
+            e = lpm->v4.tbl8[(e & ~LPM_EXT) * TBL8_GROUP + (w & 0xff)];
+        }
+        return (lpm->pfx[e].data);
+    }
+
+    if (!lpm->v6.dir){
+        return (NULL);
+    }
+    lpm_addr_load(lpm, a, addr);
+    return (lpm6_lookup(lpm, a));
+}
+
+void *
+lpm_lookup_exact(lpm_t *lpm, void *addr, uint8_t plen)
+{
+    uint32_t a[LPM_KEY_WORDS];
+
+    lpm_addr_load(lpm, a, addr);
+    lpm_addr_mask(a, plen);
+    return (lpm->pfx[lpm_find(lpm, a, plen)].data);
+}
+
+/* Defer the build of the subtrees of the long keys changed until lpm_bulk_end,
+ * to insert or remove many prefixes. Meanwhile, lookups in those subtrees
+ * check all their prefixes */
+void
+lpm_bulk_begin(lpm_t *lpm)
+{
+    lpm->v6.bulk = TRUE;
+}
+
+void
+lpm_bulk_end(lpm_t *lpm)
+{
+    lpm6_t *t = &lpm->v6;
+    lpm6_sub_t *sub;
+    uint32_t s;
+
+    t->bulk = FALSE;
+    if (!t->dir){
+        return;
+    }
+    for (s = 0; s < DIR6_SIZE; s++){
+        if (!(t->dir[s] & LPM_EXT)){
+            continue;
+        }
+        sub = &t->subs[t->dir[s] & ~LPM_EXT];
+        if (sub->dirty){
+            lpm6_sub_build(lpm, sub, t->dir_def[s]);
+        }
+    }
+}
+
+uint32_t
+lpm_count(lpm_t *lpm)
+{
+    return (lpm->count);
+}
+
+/* Memory allocated by the table, in bytes. Only the used parts of the IPv4
+ * table of the first 24 bits take physical memory */
+size_t
+lpm_memory(lpm_t *lpm)
+{
+    size_t mem;
+    uint32_t i;
+
+    mem = sizeof(lpm_t) + lpm->pfx_size * sizeof(lpm_prefix_t)
+            + (lpm->buckets_mask + 1) * sizeof(uint32_t);
+    if (lpm->v4.tbl24){
+        mem += TBL24_SIZE * sizeof(uint32_t);
+    }
+    mem += (size_t)lpm->v4.tbl8_size * TBL8_GROUP * sizeof(uint32_t);
+    if (lpm->v6.dir){
+        mem += 2 * DIR6_SIZE * sizeof(uint32_t);
+    }
+    mem += lpm->v6.subs_size * sizeof(lpm6_sub_t);
+    for (i = 0; i < lpm->v6.subs_used; i++){
+        mem += lpm->v6.subs[i].nodes_size * sizeof(lpm6_node_t)
+                + lpm->v6.subs[i].leaves_size * sizeof(uint32_t)
+                + lpm->v6.subs[i].pfx_size * sizeof(uint32_t);
+    }
+    return (mem);
+}
@@ -0,0 +1,152 @@
+/*
+ *
+ * Copyright (C) 2011, 2015 Cisco Systems, Inc.
+ * Copyright (C) 2015 CBA research group, Technical University of Catalonia.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef LPM_H_
+#define LPM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Entries of the lookup arrays are prefix ids or, with this bit, the index
+ * of a second level (tbl8 group or IPv6 subtree). Prefix 0 is no prefix */
+#define LPM_EXT             0x80000000
+#define LPM_NIL             0xffffffff
+
+/* Longest key: an IID and an IPv6 address */
+#define LPM_KEY_WORDS       5
+/* Bits of the first level of the lookups of keys longer than 32 bits */
+#define LPM6_DIR_BITS       16
+/* Bits of each node of their subtrees */
+#define LPM6_STRIDE         6
+
+typedef struct lpm_prefix {
+    /* Host byte order, masked */
+    uint32_t addr[LPM_KEY_WORDS];
+    void *data;
+    /* Hash chain, or free list */
+    uint32_t next;
+    uint8_t plen;
+} lpm_prefix_t;
+
+/* DIR-24-8: one access to a table indexed by the first 24 bits and, for the
+ * addresses with prefixes longer than /24, another one to a group of 256
+ * entries. Prefixes are expanded to all the entries they cover that don't
+ * belong to a longer prefix */
+typedef struct lpm4 {
+    uint32_t *tbl24;
+    uint32_t *tbl8;
+    uint32_t tbl8_size;
+    uint32_t tbl8_used;
+    uint32_t tbl8_free;
+} lpm4_t;
+
+/* Compressed node of 64 children, as the ones of Poptrie. Slots with the bit
+ * of vector set have a child node, the rest a prefix. Children are
+ * consecutive from base1, and the prefixes from base0 with one element per
+ * run of slots with the same prefix, marked in leafvec */
+typedef struct lpm6_node {
+    uint64_t vector;
+    uint64_t leafvec;
+    uint32_t base0;
+    uint32_t base1;
+} lpm6_node_t;
+
+/* Subtree of the keys with the same first LPM6_DIR_BITS. Its nodes and
+ * prefixes are contiguous arrays built from its prefixes */
+typedef struct lpm6_sub {
+    lpm6_node_t *nodes;
+    uint32_t *leaves;
+    uint32_t nodes_num;
+    uint32_t nodes_size;
+    uint32_t leaves_num;
+    uint32_t leaves_size;
+    /* First bits of all its prefixes, all of them longer. The root node is
+     * at bit root_off: the lookups of keys with other first bits don't go
+     * through the nodes of the bits in common */
+    uint32_t root[LPM_KEY_WORDS];
+    uint8_t root_off;
+    /* Prefixes longer than LPM6_DIR_BITS it contains */
+    uint32_t *pfx;
+    uint32_t pfx_num;
+    uint32_t pfx_size;
+    /* Nodes and leaves of the parts rebuilt, not reachable anymore */
+    uint32_t nodes_garbage;
+    uint32_t leaves_garbage;
+    /* Changed and not built yet. Looked up scanning pfx */
+    uint8_t dirty;
+    uint32_t next_free;
+} lpm6_sub_t;
+
+typedef struct lpm6 {
+    /* Prefix or subtree of each value of the first bits */
+    uint32_t *dir;
+    /* Longest prefix up to LPM6_DIR_BITS of each value of the first bits */
+    uint32_t *dir_def;
+    lpm6_sub_t *subs;
+    uint32_t subs_size;
+    uint32_t subs_used;
+    uint32_t subs_free;
+    /* Subtrees are built at lpm_bulk_end */
+    uint8_t bulk;
+} lpm6_t;
+
+/*
+ * Longest prefix match table of keys of 32 bits (IPv4) up to LPM_KEY_WORDS
+ * words (IPv6, or an IID followed by an address), an alternative to the
+ * patricia tries for the tables looked up often. The lookups don't allocate
+ * memory and access a few entries of contiguous arrays: at most two for
+ * IPv4, with DIR-24-8, and one per 6 bits after the first 16 for the longer
+ * keys, with compressed multibit subtrees.
+ *
+ * IPv4 prefixes are inserted and removed updating only the entries they
+ * cover. With the longer keys, the node of the subtree that contains a
+ * changed prefix is rebuilt from the prefixes under it, or the whole subtree
+ * once for all the changes done between lpm_bulk_begin and lpm_bulk_end.
+ * The prefixes are also kept in a hash table for the exact lookups.
+ *
+ * The table of the first 24 bits of IPv4 takes 64 MB of address space,
+ * reserved when the first prefix is inserted. Only the parts covered by
+ * prefixes use memory.
+ */
+typedef struct lpm {
+    /* Length of the keys */
+    int bits;
+    lpm_prefix_t *pfx;
+    uint32_t pfx_size;
+    uint32_t pfx_used;
+    uint32_t pfx_free;
+    uint32_t count;
+    uint32_t *buckets;
+    uint32_t buckets_mask;
+    lpm4_t v4;
+    lpm6_t v6;
+} lpm_t;
+
+lpm_t *lpm_new(int bits);
+void lpm_del(lpm_t *lpm);
+int lpm_insert(lpm_t *lpm, void *addr, uint8_t plen, void *data);
+void *lpm_remove(lpm_t *lpm, void *addr, uint8_t plen);
+void *lpm_lookup(lpm_t *lpm, void *addr);
+void *lpm_lookup_exact(lpm_t *lpm, void *addr, uint8_t plen);
+void lpm_bulk_begin(lpm_t *lpm);
+void lpm_bulk_end(lpm_t *lpm);
+uint32_t lpm_count(lpm_t *lpm);
+size_t lpm_memory(lpm_t *lpm);
+
+#endif /* LPM_H_ */
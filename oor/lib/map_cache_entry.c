@@ -34,6 +34,7 @@ mcache_entry_new()
 
     mce->active = NOT_ACTIVE;
     mce->timestamp = time(NULL);
+    mce->gen_idx = fwd_gen_new_idx();
 
     return(mce);
 }
@@ -73,10 +74,28 @@ mcache_entry_del(mcache_entry_t *entry)
     if (entry->routing_info != NULL){
         entry->routing_inf_del(entry->routing_info);
     }
+    lisp_addr_del(entry->requester);
 
     free(entry);
 }
 
+/* Heap memory used by the entry, its mapping and its routing info. The
+ * timers are not included */
+size_t
+mcache_entry_mem_size(mcache_entry_t *entry)
+{
+    size_t size;
+
+    size = sizeof(mcache_entry_t) + mapping_mem_size(mcache_entry_mapping(entry));
+    if (entry->routing_info != NULL && entry->routing_inf_size != NULL){
+        size += entry->routing_inf_size(entry->routing_info);
+    }
+    if (entry->requester != NULL){
+        size += lisp_addr_mem_size(entry->requester);
+    }
+    return (size);
+}
+
 void
 map_cache_entry_dump (mcache_entry_t *entry, int log_level)
 {
@@ -110,8 +129,8 @@ map_cache_entry_dump (mcache_entry_t *entry, int log_level)
     } else {
         snprintf(str + strlen(str),sizeof(str) - strlen(str),"TYPE: Dynamic, ");
     }
-    snprintf(str + strlen(str),sizeof(str) - strlen(str),"ACTIVE: %s",
-            entry->active == TRUE ? "Yes" : "No");
+    snprintf(str + strlen(str),sizeof(str) - strlen(str),"ACTIVE: %s, BYTES: %u",
+            entry->active == TRUE ? "Yes" : "No", entry->bytes);
 
     OOR_LOG(log_level, "%s\n%s\n", str, mapping_to_char(mapping));
 }
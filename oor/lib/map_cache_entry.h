@@ -20,6 +20,7 @@
 #ifndef MAP_CACHE_ENTRY_H_
 #define MAP_CACHE_ENTRY_H_
 
+#include "fwd_gen.h"
 #include "timers.h"
 #include "../liblisp/lisp_mapping.h"
 
@@ -40,6 +41,7 @@ typedef enum mce_type {
 #define ACTIVE                          1
 
 typedef void (*routing_info_del_fct)(void *);
+typedef size_t (*routing_info_size_fct)(void *);
 
 typedef struct map_cache_entry_ {
     uint8_t how_learned;
@@ -56,9 +58,31 @@ typedef struct map_cache_entry_ {
     /* Routing info */
     void *                  routing_info;
     routing_info_del_fct    routing_inf_del;
+    routing_info_size_fct   routing_inf_size;
 
     /* EID that requested the mapping. Helps with timers */
     lisp_addr_t *requester;
+
+    /* Generation counter of the flows forwarded with the entry */
+    uint32_t gen_idx;
+
+    /* Refresh before expiration */
+    /* Usage counter of gen_idx when the validity period started */
+    uint32_t uses;
+    /* A Map-Request to refresh the mapping is in flight */
+    uint8_t refreshing;
+    /* The mapping was refreshed before expiring */
+    uint8_t refreshed;
+
+    /* Memory accounting and eviction */
+    /* Bytes accounted in the map cache for the entry */
+    uint32_t bytes;
+    /* Position in the CLOCK of the map cache. Only the dynamic entries */
+    glist_entry_t *clock_it;
+    /* Second chance: added since the hand last passed */
+    uint8_t clock_ref;
+    /* Usage counter of gen_idx when the hand last passed */
+    uint32_t clock_uses;
 } mcache_entry_t;
 
 mcache_entry_t *mcache_entry_new();
@@ -67,6 +91,7 @@ void mcache_entry_init_static(mcache_entry_t *, mapping_t *);
 
 
 void mcache_entry_del(mcache_entry_t *entry);
+size_t mcache_entry_mem_size(mcache_entry_t *entry);
 void map_cache_entry_dump(mcache_entry_t *entry, int log_level);
 
 static inline mapping_t *mcache_entry_mapping(mcache_entry_t*);
@@ -76,7 +101,7 @@ static inline void mcache_entry_set_active(mcache_entry_t *, int);
 static inline uint8_t mcache_has_locators(mcache_entry_t *m);
 static inline void *mcache_entry_routing_info(mcache_entry_t *);
 static inline void mcache_entry_set_routing_info(mcache_entry_t *, void *,
-        routing_info_del_fct);
+        routing_info_del_fct, routing_info_size_fct);
 
 
 static inline mapping_t *
@@ -122,10 +147,12 @@ mcache_entry_routing_info(mcache_entry_t *m)
 }
 
 static inline void
-mcache_entry_set_routing_info(mcache_entry_t *m, void *routing_inf, routing_info_del_fct del_fct)
+mcache_entry_set_routing_info(mcache_entry_t *m, void *routing_inf, routing_info_del_fct del_fct,
+        routing_info_size_fct size_fct)
 {
     m->routing_info = routing_inf;
     m->routing_inf_del = del_fct;
+    m->routing_inf_size = size_fct;
 }
 
 
@@ -68,6 +68,7 @@ map_local_entry_new()
 {
 	map_local_entry_t *mle;
 	mle = xzalloc(sizeof(map_local_entry_t));
+	mle->gen_idx = fwd_gen_new_idx();
 
 	return (mle);
 }
@@ -84,6 +85,7 @@ map_local_entry_new_init(mapping_t *map)
     }
     mle->mapping = map;
     mle->nat_info = nat_info_new();
+    mle->gen_idx = fwd_gen_new_idx();
 
     return (mle);
 }
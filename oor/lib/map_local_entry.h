@@ -20,6 +20,7 @@
 #ifndef MAP_LOCAL_ENTRY_H_
 #define MAP_LOCAL_ENTRY_H_
 
+#include "fwd_gen.h"
 #include "../liblisp/lisp_mapping.h"
 #include "shash.h"
 
@@ -35,6 +36,8 @@ typedef struct map_local_entry_ {
     void *              fwd_info;
     fwd_info_del_fct    fwd_inf_del;
     nat_info_t *        nat_info;
+    /* Generation counter of the flows forwarded with the mapping */
+    uint32_t            gen_idx;
 } map_local_entry_t;
 
 map_local_entry_t *map_local_entry_new();
@@ -42,8 +42,12 @@ patricia_node_t *pt_find_ip_node_exact(patricia_tree_t *pt, ip_addr_t *ipaddr,
 patricia_node_t *pt_find_mc_node(patricia_tree_t *pt, lcaf_addr_t *mcaddr,
         uint8_t exact);
 void pt_remove_node(patricia_tree_t *pt, patricia_node_t *node);
+static patricia_node_t *pt_find_key(patricia_tree_t *pt, int afi, void *addr,
+        int prefixlen, uint8_t exact);
 
 uint8_t pt_test_if_empty(patricia_tree_t *pt);
+static uint8_t pt_has_prefix_inside(patricia_tree_t *pt, ip_addr_t *ipaddr,
+        uint8_t prefixlen);
 prefix_t *pt_make_ip_prefix(ip_addr_t *ipaddr, uint8_t prefixlen);
 
 void mdb_for_each_entry_cb(mdb_t *mdb, void (*callback)(void *, void *),
@@ -76,6 +80,55 @@ get_ip_pt_from_afi(mdb_t *db, uint16_t afi)
 }
 
 
+static lpm_t *
+get_ip_lpm_from_afi(mdb_t *db, uint16_t afi)
+{
+    switch (afi) {
+    case AF_INET:
+        return (db->AF4_lpm);
+    case AF_INET6:
+        return (db->AF6_lpm);
+    default:
+        return (NULL);
+    }
+}
+
+/* Spread consecutive IIDs over the first bits of the keys of the IID tables,
+ * which index its first level. The multiplier is odd: different IIDs get
+ * different keys */
+static inline uint32_t
+mdb_iid_mix(uint32_t iid)
+{
+    return (iid * 0x9e3779b1U);
+}
+
+/* Table of the entries with IID of the AFI when the database has one, or
+ * NULL. key is set to the IID followed by the address addr */
+static lpm_t *
+get_iid_lpm_key(mdb_t *db, uint32_t iid, int afi, void *addr, uint32_t *key)
+{
+    lpm_t *lpm;
+    size_t size;
+
+    switch (afi) {
+    case AF_INET:
+        lpm = db->AF4_iid_lpm;
+        size = sizeof(struct in_addr);
+        break;
+    case AF_INET6:
+        lpm = db->AF6_iid_lpm;
+        size = sizeof(struct in6_addr);
+        break;
+    default:
+        return (NULL);
+    }
+    if (lpm){
+        key[0] = htonl(mdb_iid_mix(iid));
+        memcpy(&key[1], addr, size);
+    }
+    return (lpm);
+}
+
 static patricia_tree_t *
 get_iid_pt_from_lcaf(mdb_t *db, lcaf_addr_t *iidaddr)
 {
@@ -219,6 +272,8 @@ _get_grp_pt_for_mc_addr(patricia_tree_t *strie, lcaf_addr_t *mcaddr,
 static int
 _add_ippref_entry(mdb_t *db, void *entry, ip_prefix_t *ippref)
 {
+    lpm_t *lpm;
+
     if (pt_add_ippref(get_ip_pt_from_afi(db, ip_prefix_afi(ippref)), ippref,
             entry) != GOOD) {
         OOR_LOG(LDBG_3, "_add_ippref_entry: Attempting to insert (%s) in the "
@@ -226,12 +281,33 @@ _add_ippref_entry(mdb_t *db, void *entry, ip_prefix_t *ippref)
                 ip_prefix_to_char(ippref));
         return (BAD);
     }
+    /* As the trie, it keeps the previous entry of the prefix if there is one */
+    lpm = get_ip_lpm_from_afi(db, ip_prefix_afi(ippref));
+    if (lpm){
+        lpm_insert(lpm, ip_addr_get_addr(ip_prefix_addr(ippref)),
+                ip_prefix_get_plen(ippref), entry);
+    }
 
     OOR_LOG(LDBG_3, "_add_ippref_entry: Added map cache data for %s",
             ip_prefix_to_char(ippref));
     return (GOOD);
 }
 
+static void *
+_rm_ippref_entry(mdb_t *db, ip_prefix_t *ippref)
+{
+    lpm_t *lpm;
+    void *data;
+
+    data = pt_remove_ippref(get_ip_pt_from_afi(db, ip_prefix_afi(ippref)), ippref);
+    lpm = get_ip_lpm_from_afi(db, ip_prefix_afi(ippref));
+    if (data && lpm){
+        lpm_remove(lpm, ip_addr_get_addr(ip_prefix_addr(ippref)),
+                ip_prefix_get_plen(ippref));
+    }
+    return (data);
+}
+
 static int
 _db_add_iid(mdb_t *db, uint32_t iid, uint16_t afi){
     patricia_tree_t *pt;
@@ -272,10 +348,11 @@ _db_add_iid(mdb_t *db, uint32_t iid, uint16_t afi){
 static int
 _add_iid_entry(mdb_t *db, void *entry, lcaf_addr_t *iidaddr)
 {
-    uint32_t iid;
+    uint32_t iid, key[LPM_KEY_WORDS];
     lisp_addr_t *ip_pref;
     patricia_tree_t *pt;
     uint16_t afi;
+    lpm_t *lpm;
 
     iid = lcaf_iid_get_iid(iidaddr);
     ip_pref = lcaf_get_ip_pref_addr(iidaddr);
@@ -297,6 +374,10 @@ _add_iid_entry(mdb_t *db, void *entry, lcaf_addr_t *iidaddr)
                 lcaf_addr_to_char(iidaddr));
         return (BAD);
     }
+    lpm = get_iid_lpm_key(db, iid, afi, ip_addr_get_addr(lisp_addr_ip_get_addr(ip_pref)), key);
+    if (lpm){
+        lpm_insert(lpm, key, MDB_IID_BITS + lisp_addr_ip_get_plen(ip_pref), entry);
+    }
 
     OOR_LOG(LDBG_3, "_add_iid_entry: Added map cache data for %s",
             lcaf_addr_to_char(iidaddr));
@@ -306,8 +387,11 @@ _add_iid_entry(mdb_t *db, void *entry, lcaf_addr_t *iidaddr)
 static void *
 _rm_iid_entry(mdb_t *db, lcaf_addr_t *iidaddr)
 {
+    uint32_t key[LPM_KEY_WORDS];
     lisp_addr_t *ip_pref;
     patricia_tree_t *pt;
+    lpm_t *lpm;
+    void *data;
 
     pt = get_iid_pt_from_lcaf(db, iidaddr);
     if (!pt){
@@ -321,7 +405,13 @@ _rm_iid_entry(mdb_t *db, lcaf_addr_t *iidaddr)
         return (NULL);
     }
 
-    return (pt_remove_ippref(pt, lisp_addr_get_ippref(ip_pref)));
+    data = pt_remove_ippref(pt, lisp_addr_get_ippref(ip_pref));
+    lpm = get_iid_lpm_key(db, lcaf_iid_get_iid(iidaddr), lisp_addr_ip_afi(ip_pref),
+            ip_addr_get_addr(lisp_addr_ip_get_addr(ip_pref)), key);
+    if (data && lpm){
+        lpm_remove(lpm, key, MDB_IID_BITS + lisp_addr_ip_get_plen(ip_pref));
+    }
+    return (data);
 }
 
 static patricia_node_t *
@@ -451,7 +541,7 @@ _get_local_db_for_addr(mdb_t *db, lisp_addr_t *addr)
 }
 
 mdb_t *
-mdb_new()
+mdb_new(mdb_lpm_e lpm)
 {
     mdb_t *db = xzalloc(sizeof(mdb_t));
     OOR_LOG(LDBG_3, " Creating mdb...");
@@ -484,6 +574,13 @@ mdb_new()
         return(BAD);
     }
 
+    if (lpm == MDB_LPM_MULTIBIT){
+        db->AF4_lpm = lpm_new(sizeof(struct in_addr) * 8);
+        db->AF6_lpm = lpm_new(sizeof(struct in6_addr) * 8);
+        db->AF4_iid_lpm = lpm_new(MDB_IID_BITS + sizeof(struct in_addr) * 8);
+        db->AF6_iid_lpm = lpm_new(MDB_IID_BITS + sizeof(struct in6_addr) * 8);
+    }
+
     db->n_entries = 0;
 
     return (db);
@@ -526,6 +623,10 @@ mdb_del(mdb_t *db, mdb_del_fct del_fct)
         } PATRICIA_WALK_END;
     }
     Destroy_Patricia(db->AF6_mc_db, NULL);
+    lpm_del(db->AF4_lpm);
+    lpm_del(db->AF6_lpm);
+    lpm_del(db->AF4_iid_lpm);
+    lpm_del(db->AF6_iid_lpm);
     free(db);
 }
 
@@ -574,13 +675,11 @@ mdb_remove_entry(mdb_t *db, lisp_addr_t *laddr)
         taddr = lisp_addr_clone(laddr);
         lisp_addr_ip_to_ippref(taddr);
         ippref = lisp_addr_get_ippref(taddr);
-        ret = pt_remove_ippref(get_ip_pt_from_afi(db, ip_prefix_afi(ippref)), ippref);
+        ret = _rm_ippref_entry(db, ippref);
         lisp_addr_del(taddr);
         break;
     case LM_AFI_IPPREF:
-        ippref = lisp_addr_get_ippref(laddr);
-        ret = pt_remove_ippref(
-                get_ip_pt_from_afi(db, ip_prefix_afi(ippref)), ippref);
+        ret = _rm_ippref_entry(db, lisp_addr_get_ippref(laddr));
         break;
     case LM_AFI_LCAF:
         ret = _del_lcaf_entry(db, lisp_addr_get_lcaf(laddr));
@@ -597,10 +696,55 @@ mdb_remove_entry(mdb_t *db, lisp_addr_t *laddr)
     return (ret);
 }
 
+/* Table of laddr, an IP or IP prefix with or without IID, when the database
+ * has one, or NULL. kaddr is set to its key, built in key with the IID, and
+ * plen to the length of its prefix in the table */
+static lpm_t *
+_get_lpm_for_addr(mdb_t *db, lisp_addr_t *laddr, uint32_t *key, void **kaddr,
+        uint8_t *plen)
+{
+    lcaf_addr_t *lcaf;
+    lisp_addr_t *ip;
+    lpm_t *lpm;
+
+    switch (lisp_addr_lafi(laddr)) {
+    case LM_AFI_IP:
+    case LM_AFI_IPPREF:
+        *kaddr = ip_addr_get_addr(lisp_addr_ip_get_addr(laddr));
+        *plen = lisp_addr_ip_get_plen(laddr);
+        return (get_ip_lpm_from_afi(db, lisp_addr_ip_afi(laddr)));
+    case LM_AFI_LCAF:
+        lcaf = lisp_addr_get_lcaf(laddr);
+        if (lcaf_addr_get_type(lcaf) != LCAF_IID){
+            return (NULL);
+        }
+        ip = iid_type_get_addr(lcaf_addr_get_iid(lcaf));
+        if (lisp_addr_lafi(ip) != LM_AFI_IP && lisp_addr_lafi(ip) != LM_AFI_IPPREF){
+            return (NULL);
+        }
+        lpm = get_iid_lpm_key(db, lcaf_iid_get_iid(lcaf), lisp_addr_ip_afi(ip),
+                ip_addr_get_addr(lisp_addr_ip_get_addr(ip)), key);
+        *kaddr = key;
+        *plen = MDB_IID_BITS + lisp_addr_ip_get_plen(ip);
+        return (lpm);
+    default:
+        return (NULL);
+    }
+}
+
 void *
 mdb_lookup_entry(mdb_t *db, lisp_addr_t *laddr)
 {
     patricia_node_t *node;
+    uint32_t key[LPM_KEY_WORDS];
+    uint8_t plen;
+    void *kaddr;
+    lpm_t *lpm;
+
+    lpm = _get_lpm_for_addr(db, laddr, key, &kaddr, &plen);
+    if (lpm){
+        return (lpm_lookup(lpm, kaddr));
+    }
 
     node = _find_node(db, laddr, NOT_EXACT);
     if (node){
@@ -614,6 +758,16 @@ void *
 mdb_lookup_entry_exact(mdb_t *db, lisp_addr_t *laddr)
 {
     patricia_node_t *node;
+    uint32_t key[LPM_KEY_WORDS];
+    uint8_t plen;
+    void *kaddr;
+    lpm_t *lpm;
+
+    lpm = _get_lpm_for_addr(db, laddr, key, &kaddr, &plen);
+    if (lpm){
+        return (lpm_lookup_exact(lpm, kaddr, plen));
+    }
+
     node = _find_node(db, laddr, EXACT);
     if (node){
         return(node->data);
@@ -622,11 +776,180 @@ mdb_lookup_entry_exact(mdb_t *db, lisp_addr_t *laddr)
     }
 }
 
+/* IP table of the IID. The entries of IID 0 are the ones without IID */
+static patricia_tree_t *
+get_key_pt(mdb_t *db, uint32_t iid, int afi)
+{
+    patricia_tree_t *pt;
+    int_htable *ht;
+
+    if (iid == 0){
+        return (get_ip_pt_from_afi(db, afi));
+    }
+    switch (afi){
+    case AF_INET:
+        ht = db->AF4_iid_db;
+        break;
+    case AF_INET6:
+        ht = db->AF6_iid_db;
+        break;
+    default:
+        OOR_LOG(LDBG_1, "get_key_pt: AFI %d not recognized!", afi);
+        return (NULL);
+    }
+    pt = int_htable_lookup(ht, iid);
+    if (!pt){
+        return (NULL);
+    }
+    return (pt->head->data);
+}
+
+/* Longest prefix match of the address addr, in network byte order, of the
+ * IID iid. Unlike the lookups of lisp_addr_t, it doesn't need to build an
+ * address with the IID nor allocates memory */
+void *
+mdb_lookup_key(mdb_t *db, uint32_t iid, int afi, void *addr)
+{
+    patricia_tree_t *pt;
+    patricia_node_t *node;
+    uint32_t key[LPM_KEY_WORDS];
+    lpm_t *lpm;
+
+    if (iid == 0){
+        if ((lpm = get_ip_lpm_from_afi(db, afi))){
+            return (lpm_lookup(lpm, addr));
+        }
+    }else if ((lpm = get_iid_lpm_key(db, iid, afi, addr, key))){
+        return (lpm_lookup(lpm, key));
+    }
+    pt = get_key_pt(db, iid, afi);
+    if (!pt){
+        return (NULL);
+    }
+    node = pt_find_key(pt, afi, addr, -1, NOT_EXACT);
+    return (node ? node->data : NULL);
+}
+
+void *
+mdb_lookup_key_exact(mdb_t *db, uint32_t iid, int afi, void *addr, uint8_t plen)
+{
+    patricia_tree_t *pt;
+    patricia_node_t *node;
+    uint32_t key[LPM_KEY_WORDS];
+    lpm_t *lpm;
+
+    if (iid == 0){
+        if ((lpm = get_ip_lpm_from_afi(db, afi))){
+            return (lpm_lookup_exact(lpm, addr, plen));
+        }
+    }else if ((lpm = get_iid_lpm_key(db, iid, afi, addr, key))){
+        return (lpm_lookup_exact(lpm, key, MDB_IID_BITS + plen));
+    }
+    pt = get_key_pt(db, iid, afi);
+    if (!pt){
+        return (NULL);
+    }
+    node = pt_find_key(pt, afi, addr, plen, EXACT);
+    return (node ? node->data : NULL);
+}
+
+/* Check if there are entries more specific than the one of the prefix laddr.
+ * Returns TRUE if there isn't an entry for laddr */
+uint8_t
+mdb_has_more_specific(mdb_t *db, lisp_addr_t *laddr)
+{
+    patricia_node_t *node;
+
+    node = _find_node(db, laddr, EXACT);
+    if (!node){
+        return (TRUE);
+    }
+    /* The subtree of a node only contains prefixes covered by it */
+    return (node->l != NULL || node->r != NULL);
+}
+
+/* Length of the shortest prefix containing laddr that doesn't contain any
+ * entry, so that a negative answer for laddr can cover it. laddr shouldn't be
+ * covered by an entry. Returns the length of laddr if there are entries
+ * inside it */
+uint8_t
+mdb_uncovered_plen(mdb_t *db, lisp_addr_t *laddr)
+{
+    patricia_tree_t *pt;
+    lisp_addr_t *addr;
+    ip_addr_t *ip;
+    uint8_t lo = 0, hi, mid;
+
+    switch (lisp_addr_lafi(laddr)) {
+    case LM_AFI_IP:
+    case LM_AFI_IPPREF:
+        addr = laddr;
+        pt = get_ip_pt_from_afi(db, lisp_addr_ip_afi(laddr));
+        break;
+    case LM_AFI_LCAF:
+        if (lisp_addr_is_iid(laddr)){
+            addr = iid_type_get_addr(lcaf_addr_get_iid(lisp_addr_get_lcaf(laddr)));
+            if (lisp_addr_lafi(addr) == LM_AFI_IP || lisp_addr_lafi(addr) == LM_AFI_IPPREF){
+                pt = get_iid_pt_from_lcaf(db, lisp_addr_get_lcaf(laddr));
+                break;
+            }
+        }
+        /* No break */
+    default:
+        return (lisp_addr_get_plen(laddr));
+    }
+
+    hi = lisp_addr_ip_get_plen(addr);
+    ip = lisp_addr_ip_get_addr(addr);
+    if (!pt){
+        /* No entries of the IID */
+        return (0);
+    }
+    if (pt_has_prefix_inside(pt, ip, hi)){
+        return (hi);
+    }
+    /* A prefix without entries inside is followed by longer ones without
+     * entries inside */
+    while (lo < hi){
+        mid = (lo + hi) / 2;
+        if (pt_has_prefix_inside(pt, ip, mid)){
+            lo = mid + 1;
+        }else{
+            hi = mid;
+        }
+    }
+    return (lo);
+}
+
 inline int
 mdb_n_entries(mdb_t *mdb) {
     return(mdb->n_entries);
 }
 
+/* Defer the work of the lookup tables to mdb_bulk_end when adding or removing
+ * many entries */
+void
+mdb_bulk_begin(mdb_t *db)
+{
+    if (db->AF4_lpm){
+        lpm_bulk_begin(db->AF4_lpm);
+        lpm_bulk_begin(db->AF6_lpm);
+        lpm_bulk_begin(db->AF4_iid_lpm);
+        lpm_bulk_begin(db->AF6_iid_lpm);
+    }
+}
+
+void
+mdb_bulk_end(mdb_t *db)
+{
+    if (db->AF4_lpm){
+        lpm_bulk_end(db->AF4_lpm);
+        lpm_bulk_end(db->AF6_lpm);
+        lpm_bulk_end(db->AF4_iid_lpm);
+        lpm_bulk_end(db->AF6_iid_lpm);
+    }
+}
+
 /*
  * Patricia trie wrappers
  */
@@ -823,30 +1146,92 @@ pt_remove_node(patricia_tree_t *pt, patricia_node_t *node)
 }
 
 
-patricia_node_t *
-pt_find_ip_node(patricia_tree_t *pt, ip_addr_t *ipaddr)
+/* First node of the subtree with an entry. Nodes without data, like the 0/0
+ * node added to hold the multicast tries, are not entries */
+static patricia_node_t *
+pt_subtree_entry(patricia_node_t *node)
 {
-    patricia_node_t *node;
-    prefix_t        *prefix;
-    uint8_t         default_plen;
+    patricia_node_t *stack[PATRICIA_MAXBITS + 1];
+    int sp = 0;
 
-    default_plen = (ip_addr_afi(ipaddr) == AF_INET) ? 32: 128;
-    prefix = pt_make_ip_prefix(ipaddr, default_plen);
-    node =  patricia_search_best(pt, prefix);
-    Deref_Prefix(prefix);
+    while (node){
+        if (node->prefix && node->data){
+            return (node);
+        }
+        if (node->l){
+            if (node->r){
+                stack[sp++] = node->r;
+            }
+            node = node->l;
+        }else if (node->r){
+            node = node->r;
+        }else{
+            node = sp > 0 ? stack[--sp] : NULL;
+        }
+    }
+    return (NULL);
+}
 
-    return(node);
+/* Check if the trie has entries inside ipaddr/prefixlen, including it */
+static uint8_t
+pt_has_prefix_inside(patricia_tree_t *pt, ip_addr_t *ipaddr, uint8_t prefixlen)
+{
+    patricia_node_t *node = pt->head;
+    u_char *addr, *pref;
+    int bytes = prefixlen / 8;
+    int bits = prefixlen % 8;
+
+    addr = (u_char *)ip_addr_get_addr(ipaddr);
+    while (node && node->bit < prefixlen){
+        if (BIT_TEST(addr[node->bit >> 3], 0x80 >> (node->bit & 0x07))){
+            node = node->r;
+        }else{
+            node = node->l;
+        }
+    }
+    /* The entries inside would be in the subtree of node, which share their
+     * first node->bit bits */
+    node = pt_subtree_entry(node);
+    if (!node){
+        return (FALSE);
+    }
+    pref = prefix_touchar(node->prefix);
+    if (memcmp(addr, pref, bytes) != 0){
+        return (FALSE);
+    }
+    if (bits && ((addr[bytes] ^ pref[bytes]) & (0xff << (8 - bits)) & 0xff)){
+        return (FALSE);
+    }
+    return (TRUE);
 }
 
-patricia_node_t *pt_find_ip_node_exact(patricia_tree_t *pt, ip_addr_t *ipaddr, uint8_t prefixlen) {
-    patricia_node_t *node;
-    prefix_t        *prefix;
+/* The lookups build the prefix on the stack */
+static patricia_node_t *
+pt_find_key(patricia_tree_t *pt, int afi, void *addr, int prefixlen, uint8_t exact)
+{
+    prefix_t prefix;
 
-    prefix = pt_make_ip_prefix(ipaddr, prefixlen);
-    node = patricia_search_exact(pt, prefix);
-    Deref_Prefix(prefix);
+    if (afi != AF_INET && afi != AF_INET6) {
+        OOR_LOG(LDBG_1, "pt_find_key: AFI %d not recognized!", afi);
+        return(NULL);
+    }
+    New_Prefix2(afi, addr, prefixlen, &prefix);
+    if (exact) {
+        return(patricia_search_exact(pt, &prefix));
+    }
+    return(patricia_search_best(pt, &prefix));
+}
 
-    return(node);
+patricia_node_t *
+pt_find_ip_node(patricia_tree_t *pt, ip_addr_t *ipaddr)
+{
+    return(pt_find_key(pt, ip_addr_afi(ipaddr), ip_addr_get_addr(ipaddr), -1,
+            NOT_EXACT));
+}
+
+patricia_node_t *pt_find_ip_node_exact(patricia_tree_t *pt, ip_addr_t *ipaddr, uint8_t prefixlen) {
+    return(pt_find_key(pt, ip_addr_afi(ipaddr), ip_addr_get_addr(ipaddr),
+            prefixlen, EXACT));
 }
 
 patricia_node_t *pt_find_mc_node(patricia_tree_t *strie, lcaf_addr_t *mcaddr, uint8_t exact) {
@@ -27,6 +27,7 @@
 #define MAPPING_DB_H_
 
 #include "int_table.h"
+#include "lpm.h"
 #include "../elibs/patricia/patricia.h"
 #include "../liblisp/lisp_address.h"
 
@@ -34,6 +35,17 @@
 #define NOT_EXACT 0
 #define EXACT 1
 
+/* Engine of the longest prefix match lookups of the IP entries */
+typedef enum {
+    MDB_LPM_PATRICIA,
+    /* lpm.h tables kept along with the patricia tries. Faster lookups, but
+     * more memory and slower removals, above all of short prefixes */
+    MDB_LPM_MULTIBIT
+} mdb_lpm_e;
+
+/* Length of the IID before the address in the keys of the IID tables */
+#define MDB_IID_BITS 32
+
 /*
  *  Patricia tree based databases
  *  for IP/IP-prefix and multicast addresses
@@ -45,18 +57,32 @@ typedef struct {
     int_htable *AF6_iid_db;
     patricia_tree_t *AF4_mc_db;
     patricia_tree_t *AF6_mc_db;
+    /* Copies of the IP tries for the lookups. NULL with MDB_LPM_PATRICIA */
+    lpm_t *AF4_lpm;
+    lpm_t *AF6_lpm;
+    /* Entries of all the IIDs of AF4_iid_db and AF6_iid_db, with the IID
+     * as the first bits of the keys. Its first level is the directory of
+     * the IIDs */
+    lpm_t *AF4_iid_lpm;
+    lpm_t *AF6_iid_lpm;
     int n_entries;
 } mdb_t;
 
 typedef void (*mdb_del_fct)(void *);
 
-mdb_t *mdb_new();
+mdb_t *mdb_new(mdb_lpm_e lpm);
 void mdb_del(mdb_t *db, mdb_del_fct del_fct);
 int mdb_add_entry(mdb_t *db, lisp_addr_t *addr, void *data);
 void *mdb_remove_entry(mdb_t *db, lisp_addr_t *laddr);
 void *mdb_lookup_entry(mdb_t *db, lisp_addr_t *laddr);
 void *mdb_lookup_entry_exact(mdb_t *db, lisp_addr_t *laddr);
+void *mdb_lookup_key(mdb_t *db, uint32_t iid, int afi, void *addr);
+void *mdb_lookup_key_exact(mdb_t *db, uint32_t iid, int afi, void *addr, uint8_t plen);
+uint8_t mdb_has_more_specific(mdb_t *db, lisp_addr_t *laddr);
+uint8_t mdb_uncovered_plen(mdb_t *db, lisp_addr_t *laddr);
 int mdb_n_entries(mdb_t *);
+void mdb_bulk_begin(mdb_t *db);
+void mdb_bulk_end(mdb_t *db);
 
 patricia_tree_t *_get_local_db_for_lcaf_addr(mdb_t *db, lcaf_addr_t *lcaf);
 patricia_tree_t *_get_local_db_for_addr(mdb_t *db, lisp_addr_t *addr);
@@ -31,12 +31,10 @@
 #include "sockets.h"
 #include "../liblisp/lisp_address.h"
 #include "cksum.h"
+#include "crc32c.h"
 #include "mem_util.h"
 #include "oor_log.h"
 
-/* needed for hashword */
-#include "../elibs/bob/lookup3.c"
-
 
 uint16_t ip_id = 0;
 
@@ -124,7 +122,9 @@ pkt_push_ipv4(lbuf_t *b, struct in_addr *src, struct in_addr *dst, int proto)
     iph->ip_src.s_addr = src->s_addr;
     iph->ip_dst.s_addr = dst->s_addr;
     /* FIXME: ip checksum could be offloaded to NIC*/
-    /* iph->ip_sum = 0; */
+    /* The header is sent as is through packet rings. Raw sockets would
+     * fill the checksum */
+    iph->ip_sum = 0;
     iph->ip_sum = ip_checksum((uint16_t *) iph, sizeof(struct ip));
     return(iph);
 }
@@ -202,8 +202,116 @@ pkt_push_udp_and_ip(lbuf_t *b, uint16_t sp, uint16_t dp, ip_addr_t *sip,
     return(GOOD);
 }
 
+/* Build a template from the outer headers of an encapsulated packet with no
+ * payload, as generated by pkt_push_udp_and_ip */
+int
+pkt_hdr_tmpl_init(pkt_hdr_tmpl_t *tmpl, lbuf_t *hdrs)
+{
+    struct ip *iph;
+    struct ip6_hdr *ip6h;
+    struct udphdr *uh;
+    uint32_t sum;
+
+    memset(tmpl, 0, sizeof(pkt_hdr_tmpl_t));
+    if (lbuf_size(hdrs) > sizeof(tmpl->hdr)) {
+        return (BAD);
+    }
+    memcpy(tmpl->hdr, lbuf_data(hdrs), lbuf_size(hdrs));
+
+    /* Clear the fields that depend on the packet. The sums of the rest are
+     * kept */
+    switch (((struct ip *)tmpl->hdr)->ip_v) {
+    case IPVERSION:
+        iph = (struct ip *)tmpl->hdr;
+        tmpl->ip_len = sizeof(struct ip);
+        iph->ip_tos = 0;
+        iph->ip_len = 0;
+        iph->ip_id = 0;
+        iph->ip_ttl = 0;
+        iph->ip_sum = 0;
+        tmpl->ip_sum = cksum_add(iph, tmpl->ip_len, 0);
+        sum = cksum_add(&iph->ip_src, 2 * sizeof(struct in_addr), 0);
+        break;
+    case IP6VERSION:
+        ip6h = (struct ip6_hdr *)tmpl->hdr;
+        tmpl->ip_len = sizeof(struct ip6_hdr);
+        ip6h->ip6_plen = 0;
+        sum = cksum_add(&ip6h->ip6_src, 2 * sizeof(struct in6_addr), 0);
+        break;
+    default:
+        return (BAD);
+    }
+
+    uh = (struct udphdr *)(tmpl->hdr + tmpl->ip_len);
+    udpsport(uh) = 0;
+    udplen(uh) = 0;
+    udpsum(uh) = 0;
+    sum += htons(IPPROTO_UDP);
+    tmpl->udp_sum = cksum_add(uh, lbuf_size(hdrs) - tmpl->ip_len, sum);
+    tmpl->len = lbuf_size(hdrs);
+
+    return (GOOD);
+}
+
+/* Push the outer headers of the template in front of an IP packet. The TTL
+ * and TOS of the inner packet are copied to the outer header. The UDP source
+ * port is selected per flow */
+void *
+pkt_push_hdr_tmpl(lbuf_t *b, pkt_hdr_tmpl_t *tmpl, uint16_t src_port)
+{
+    struct ip *iph;
+    struct ip6_hdr *ip6h;
+    struct udphdr *uh;
+    uint32_t sum;
+    int ttl = 0, tos = 0, udp_len;
+
+    ip_hdr_ttl_and_tos(lbuf_data(b), &ttl, &tos);
+    /*XXX It seems that there is a bug in uClibc that causes ttl=0 in
+     * OpenWRT. This is a quick workaround */
+    if (ttl == 0) {
+        ttl = 255;
+    }
+
+    /* The payload is the only part of the UDP checksum not in the template.
+     * The UDP length appears both in the pseudo-header and in the header */
+    udp_len = tmpl->len - tmpl->ip_len + lbuf_size(b);
+    sum = cksum_add(lbuf_data(b), lbuf_size(b), tmpl->udp_sum);
+    sum += 2 * htons(udp_len) + htons(src_port);
+
+    memcpy(lbuf_push_uninit(b, tmpl->len), tmpl->hdr, tmpl->len);
+    lbuf_reset_ip(b);
+
+    uh = (struct udphdr *)((uint8_t *)lbuf_data(b) + tmpl->ip_len);
+    udpsport(uh) = htons(src_port);
+    udplen(uh) = htons(udp_len);
+    udpsum(uh) = ~cksum_fold(sum);
+    if (udpsum(uh) == 0) {
+        udpsum(uh) = 0xffff;
+    }
+
+    if (tmpl->ip_len == sizeof(struct ip)) {
+        iph = (struct ip *)lbuf_data(b);
+        iph->ip_tos = tos;
+        iph->ip_len = htons(lbuf_size(b));
+        iph->ip_id = htons(get_IP_ID());
+        iph->ip_ttl = ttl;
+        /* Add the new fields to the sum of the constant ones */
+        sum = tmpl->ip_sum + htons(tos) + iph->ip_len + iph->ip_id
+                + htons(ttl << 8);
+        iph->ip_sum = ~cksum_fold(sum);
+    } else {
+        ip6h = (struct ip6_hdr *)lbuf_data(b);
+        ip6h->ip6_plen = htons(udp_len);
+        ip6h->ip6_hops = ttl;
+        IPV6_SET_TC(ip6h, tos);
+    }
+
+    return (lbuf_data(b));
+}
+
 /* Fill the tuple with the 5 tuples of a packet:
- * (SRC IP, DST IP, PROTOCOL, SRC PORT, DST PORT) */
+ * (SRC IP, DST IP, PROTOCOL, SRC PORT, DST PORT) and calculate its hash.
+ * The iid of the tuple should be already set */
 int
 pkt_parse_5_tuple(lbuf_t *b, packet_tuple_t *tuple)
 {
@@ -251,55 +359,65 @@ pkt_parse_5_tuple(lbuf_t *b, packet_tuple_t *tuple)
         tuple->src_port = 0;
         tuple->dst_port = 0;
     }
+    tuple->hash = pkt_tuple_hash(tuple);
     return (GOOD);
 }
 
 
-/* Calculate the hash of the 5 tuples of a packet */
-uint32_t
-pkt_tuple_hash(packet_tuple_t *tuple)
+/* Pack the tuple in key, an array of at least PKT_TUPLE_KEY6_WORDS words.
+ * Returns the number of words used or 0 if the tuple is not IP */
+int
+pkt_tuple_pack(packet_tuple_t *tuple, uint32_t *key)
 {
-    int hash = 0;
-    int len = 0;
-    int port = tuple->src_port;
-    uint32_t *tuples = NULL;
+    uint32_t ports = tuple->src_port + ((uint32_t)tuple->dst_port << 16);
 
-    port = port + ((int)tuple->dst_port << 16);
     switch (lisp_addr_ip_afi(&tuple->src_addr)){
     case AF_INET:
-        /* 1 integer src_addr
-         * + 1 integer dst_adr
-         * + 1 integer (ports)
-         * + 1 integer protocol
-         * + 1 iid*/
-        len = 5;
-        tuples = xmalloc(len * sizeof(uint32_t));
-        lisp_addr_copy_to(&tuples[0], &tuple->src_addr);
-        lisp_addr_copy_to(&tuples[1], &tuple->dst_addr);
-        tuples[2] = port;
-        tuples[3] = tuple->protocol;
-        tuples[4] = tuple->iid;
-        break;
+        lisp_addr_copy_to(&key[0], &tuple->src_addr);
+        lisp_addr_copy_to(&key[1], &tuple->dst_addr);
+        key[2] = ports;
+        key[3] = tuple->protocol;
+        key[4] = tuple->iid;
+        return (PKT_TUPLE_KEY4_WORDS);
     case AF_INET6:
-        /* 4 integer src_addr
-         * + 4 integer dst_adr
-         * + 1 integer (ports)
-         * + 1 integer protocol
-         * + 1 iid */
-        len = 11;
-        tuples = xmalloc(len * sizeof(uint32_t));
-        lisp_addr_copy_to(&tuples[0], &tuple->src_addr);
-        lisp_addr_copy_to(&tuples[4], &tuple->dst_addr);
-        tuples[8] = port;
-        tuples[9] = tuple->protocol;
-        tuples[10] = tuple->iid;
-        break;
+        lisp_addr_copy_to(&key[0], &tuple->src_addr);
+        lisp_addr_copy_to(&key[4], &tuple->dst_addr);
+        key[8] = ports;
+        key[9] = tuple->protocol;
+        key[10] = tuple->iid;
+        return (PKT_TUPLE_KEY6_WORDS);
+    default:
+        return (0);
+    }
+}
+
+/* Calculate the hash of the 5 tuples and iid of a packet. Returns 0 if the
+ * tuple is not IP */
+uint32_t
+pkt_tuple_hash(packet_tuple_t *tuple)
+{
+    uint32_t key[PKT_TUPLE_KEY6_WORDS];
+    int len;
+
+    len = pkt_tuple_pack(tuple, key);
+    if (len == 0){
+        return (0);
     }
+    return (crc32c(0, key, len * sizeof(uint32_t)));
+}
 
-    /* XXX: why 2013 used as initial value? */
-    hash = hashword(tuples, len, 2013);
-    free(tuples);
-    return (hash);
+/* Select the outer UDP source port of a flow in the range [min, max] using
+ * the hash of its tuple, so that the packets of a flow keep the same port and
+ * different flows are spread over the range */
+uint16_t
+pkt_tuple_src_port(packet_tuple_t *tuple, uint16_t min, uint16_t max)
+{
+    uint32_t range = max - min + 1;
+
+    if (max <= min){
+        return (min);
+    }
+    return (min + tuple->hash % range);
 }
 
 int
@@ -322,6 +440,7 @@ pkt_tuple_clone(packet_tuple_t *tpl)
     lisp_addr_copy(&cpy->src_addr, &tpl->src_addr);
     lisp_addr_copy(&cpy->dst_addr, &tpl->dst_addr);
     cpy->iid = tpl->iid;
+    cpy->hash = tpl->hash;
     return(cpy);
 }
 
@@ -38,6 +38,7 @@
 #define MAX_IP_PKT_LEN          4096
 #define MAX_IP_HDR_LEN          40  /* without options or IPv6 hdr extensions */
 #define UDP_HDR_LEN             8
+#define MAX_ENCAP_HDR_LEN       8   /* LISP or VXLAN-GPE header */
 
 #ifdef BSD
 #define udpsport(x) x->uh_sport
@@ -69,8 +70,31 @@ typedef struct packet_tuple {
     uint16_t                        dst_port;
     uint8_t                         protocol;
     uint32_t                        iid;
+    /* Hash of the tuple, calculated when the packet is parsed */
+    uint32_t                        hash;
 } packet_tuple_t;
 
+/* Number of 32 bit words of the packed IPv4 and IPv6 tuples:
+ * src addr + dst addr + ports + protocol + iid */
+#define PKT_TUPLE_KEY4_WORDS    5
+#define PKT_TUPLE_KEY6_WORDS    11
+
+
+
+/* Outer IP, UDP and encapsulation headers shared by all the packets sent
+ * between two RLOCs. They are built once and copied in front of each packet,
+ * where only the UDP source port, length, ID, TTL, TOS and checksums have to
+ * be updated */
+typedef struct pkt_hdr_tmpl {
+    uint8_t hdr[MAX_IP_HDR_LEN + UDP_HDR_LEN + MAX_ENCAP_HDR_LEN];
+    /* Length of the headers and of the IP header. 0 if not built */
+    uint8_t len;
+    uint8_t ip_len;
+    /* Partial sums of the fields of the IPv4 header and of the UDP pseudo
+     * header, UDP header and encapsulation header that never change */
+    uint32_t ip_sum;
+    uint32_t udp_sum;
+} pkt_hdr_tmpl_t;
 
 
 /*
@@ -102,10 +126,14 @@ void *pkt_push_ip(lbuf_t *, ip_addr_t *, ip_addr_t *, int proto);
 int pkt_push_udp_and_ip(lbuf_t *, uint16_t, uint16_t, ip_addr_t *,
         ip_addr_t *);
 int ip_hdr_set_ttl_and_tos(struct iphdr *, int ttl, int tos);
+int pkt_hdr_tmpl_init(pkt_hdr_tmpl_t *tmpl, lbuf_t *hdrs);
+void *pkt_push_hdr_tmpl(lbuf_t *b, pkt_hdr_tmpl_t *tmpl, uint16_t src_port);
 int ip_hdr_ttl_and_tos(struct iphdr *, int *ttl, int *tos);
 
 int pkt_parse_5_tuple(lbuf_t *b, packet_tuple_t *tuple);
+int pkt_tuple_pack(packet_tuple_t *tuple, uint32_t *key);
 uint32_t pkt_tuple_hash(packet_tuple_t *tuple);
+uint16_t pkt_tuple_src_port(packet_tuple_t *tuple, uint16_t min, uint16_t max);
 int pkt_tuple_cmp(packet_tuple_t *t1, packet_tuple_t *t2);
 packet_tuple_t *pkt_tuple_clone(packet_tuple_t *);
 void pkt_tuple_del(packet_tuple_t *tpl);
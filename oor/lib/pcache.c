@@ -0,0 +1,379 @@
+/*
+ *
+ * Copyright (C) 2011, 2015 Cisco Systems, Inc.
+ * Copyright (C) 2015 CBA research group, Technical University of Catalonia.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "pcache.h"
+#include "mem_util.h"
+#include "oor_log.h"
+#include "sockets.h"
+#include "../fwd_policies/fwd_policy.h"
+#include "../liblisp/liblisp.h"
+
+/* Default maximum number of cached prefixes */
+#define MAX_SIZE 4096
+
+
+static inline pcache_map_t *
+pcache_map(pcache_t *pc, int afi)
+{
+    switch (afi){
+    case AF_INET:
+        return (&pc->v4);
+    case AF_INET6:
+        return (&pc->v6);
+    default:
+        return (NULL);
+    }
+}
+
+static void
+pcache_map_init(pcache_map_t *map, int words, uint32_t max_prefixes)
+{
+    uint32_t size = 16;
+
+    while (size < max_prefixes){
+        size <<= 1;
+    }
+    memset(map, 0, sizeof(pcache_map_t));
+    map->buckets = xzalloc(size * sizeof(pcache_entry_t *));
+    map->mask = size - 1;
+    map->words = words;
+}
+
+/* Update the list of prefix lengths with entries when a length is used for
+ * the first time or not used anymore */
+static void
+pcache_map_update_plens(pcache_map_t *map)
+{
+    int plen;
+
+    map->plens_num = 0;
+    for (plen = map->words * 32; plen >= 0; plen--){
+        if (map->plen_count[plen] > 0){
+            map->plens[map->plens_num++] = plen;
+        }
+    }
+}
+
+static void
+pcache_entry_del(pcache_entry_t *pe)
+{
+    int i, paths_num;
+
+    paths_num = pe->paths ? pe->prefix->src_locs_num * pe->prefix->dst_locs_num : 0;
+    for (i = 0; i < paths_num; i++){
+        if (pe->paths[i]){
+            fwd_info_del(pe->paths[i],(fwd_info_data_del)fwd_entry_del);
+        }
+    }
+    free(pe->paths);
+    fwd_prefix_del(pe->prefix);
+    free(pe);
+}
+
+/* Unlink and delete the entry pointed by ppe */
+static void
+pcache_map_del(pcache_t *pc, pcache_map_t *map, pcache_entry_t **ppe)
+{
+    pcache_entry_t *pe = *ppe;
+
+    *ppe = pe->next;
+    if (--map->plen_count[pe->dst_plen] == 0){
+        pcache_map_update_plens(map);
+    }
+    pc->count--;
+    pcache_entry_del(pe);
+}
+
+static void
+pcache_map_add(pcache_t *pc, pcache_map_t *map, pcache_entry_t *pe)
+{
+    uint32_t pos;
+
+    pos = pcache_hash(pe->dst, map->words, pe->dst_plen) & map->mask;
+    pe->next = map->buckets[pos];
+    map->buckets[pos] = pe;
+    if (map->plen_count[pe->dst_plen]++ == 0){
+        pcache_map_update_plens(map);
+    }
+    pc->count++;
+}
+
+/* Remove the entries that are not valid anymore. With all, remove all of them */
+static void
+pcache_map_purge(pcache_t *pc, pcache_map_t *map, uint8_t all)
+{
+    pcache_entry_t **ppe;
+    uint32_t i;
+
+    for (i = 0; i <= map->mask; i++){
+        ppe = &map->buckets[i];
+        while (*ppe){
+            if (all || !fwd_gen_deps_current(&(*ppe)->deps)){
+                pcache_map_del(pc, map, ppe);
+            }else{
+                ppe = &(*ppe)->next;
+            }
+        }
+    }
+}
+
+/* Initialize a cache for up to max_prefixes pairs of prefixes */
+void
+pcache_init(pcache_t *pc, uint32_t max_prefixes)
+{
+    if (max_prefixes == 0){
+        max_prefixes = MAX_SIZE;
+    }
+    pcache_map_init(&pc->v4, 1, max_prefixes);
+    pcache_map_init(&pc->v6, 4, max_prefixes);
+    pc->count = 0;
+    pc->max_count = max_prefixes;
+    memset(&pc->stats, 0, sizeof(pcache_stats_t));
+}
+
+void
+pcache_uninit(pcache_t *pc)
+{
+    pcache_flush(pc);
+    free(pc->v4.buckets);
+    free(pc->v6.buckets);
+    pc->v4.buckets = NULL;
+    pc->v6.buckets = NULL;
+}
+
+void
+pcache_flush(pcache_t *pc)
+{
+    if (!pc->v4.buckets){
+        return;
+    }
+    pcache_map_purge(pc, &pc->v4, TRUE);
+    pcache_map_purge(pc, &pc->v6, TRUE);
+}
+
+/* Create the forwarding info of each pair of RLOCs of the entry */
+static int
+pcache_entry_init_paths(pcache_entry_t *pe, fwd_info_t *fi,
+        pcache_path_init_fct init_fct, void *arg)
+{
+    fwd_prefix_t *prefix = pe->prefix;
+    fwd_info_t *path;
+    int s, d;
+
+    pe->paths = xzalloc(prefix->src_locs_num * prefix->dst_locs_num
+            * sizeof(fwd_info_t *));
+    if (!pe->paths){
+        return (BAD);
+    }
+    for (s = 0; s < prefix->src_locs_num; s++){
+        for (d = 0; d < prefix->dst_locs_num; d++){
+            if (lisp_addr_ip_afi(&prefix->src_locs[s])
+                    != lisp_addr_ip_afi(&prefix->dst_locs[d])){
+                continue;
+            }
+            path = fwd_info_new();
+            if (!path){
+                return (BAD);
+            }
+            pe->paths[s * prefix->dst_locs_num + d] = path;
+            path->fwd_info = fwd_entry_new_init(&prefix->src_locs[s],
+                    &prefix->dst_locs[d], prefix->iid, NULL);
+            path->encap = fi->encap;
+            path->deps = fi->deps;
+            if (!path->fwd_info || init_fct(arg, path) != GOOD){
+                return (BAD);
+            }
+        }
+    }
+    return (GOOD);
+}
+
+/*
+ * Add the prefix level state of the forwarding info obtained from the control
+ * plane. The cache takes the prefix of fi, the rest of fi remains owned by the
+ * caller. Returns the new entry or NULL if it couldn't be added.
+ */
+pcache_entry_t *
+pcache_insert(pcache_t *pc, fwd_info_t *fi, pcache_path_init_fct init_fct,
+        void *arg)
+{
+    fwd_prefix_t *prefix = fi->prefix;
+    pcache_map_t *map;
+    pcache_entry_t *pe, **ppe;
+    uint32_t addr[PCACHE_ADDR_WORDS];
+
+    fi->prefix = NULL;
+    if (!prefix){
+        return (NULL);
+    }
+    map = pcache_map(pc, lisp_addr_ip_afi(&prefix->dst_pref));
+    if (!map || lisp_addr_ip_afi(&prefix->src_pref) != lisp_addr_ip_afi(&prefix->dst_pref)){
+        fwd_prefix_del(prefix);
+        return (NULL);
+    }
+
+    pe = xzalloc(sizeof(pcache_entry_t));
+    if (!pe){
+        fwd_prefix_del(prefix);
+        return (NULL);
+    }
+    pe->prefix = prefix;
+    pe->deps = fi->deps;
+    pe->dst_plen = lisp_addr_ip_get_plen(&prefix->dst_pref);
+    pe->src_plen = lisp_addr_ip_get_plen(&prefix->src_pref);
+    lisp_addr_copy_to(addr, &prefix->dst_pref);
+    pcache_mask(pe->dst, addr, map->words, pe->dst_plen);
+    lisp_addr_copy_to(addr, &prefix->src_pref);
+    pcache_mask(pe->src, addr, map->words, pe->src_plen);
+    if (pcache_entry_init_paths(pe, fi, init_fct, arg) != GOOD){
+        OOR_LOG(LDBG_2, "pcache_insert: Couldn't create the forwarding info "
+                "of %s -> %s", lisp_addr_to_char(&prefix->src_pref),
+                lisp_addr_to_char(&prefix->dst_pref));
+        pcache_entry_del(pe);
+        return (NULL);
+    }
+
+    /* Replace the previous entry of the same prefixes */
+    ppe = &map->buckets[pcache_hash(pe->dst, map->words, pe->dst_plen) & map->mask];
+    while (*ppe){
+        if ((*ppe)->dst_plen == pe->dst_plen && (*ppe)->src_plen == pe->src_plen
+                && memcmp((*ppe)->dst, pe->dst, map->words * sizeof(uint32_t)) == 0
+                && memcmp((*ppe)->src, pe->src, map->words * sizeof(uint32_t)) == 0){
+            pcache_map_del(pc, map, ppe);
+            break;
+        }
+        ppe = &(*ppe)->next;
+    }
+
+    if (pc->count >= pc->max_count){
+        pcache_map_purge(pc, &pc->v4, FALSE);
+        pcache_map_purge(pc, &pc->v6, FALSE);
+        if (pc->count >= pc->max_count){
+            pcache_flush(pc);
+            pc->stats.flushes++;
+        }
+    }
+    pcache_map_add(pc, map, pe);
+    pc->stats.inserts++;
+
+    return (pe);
+}
+
+/* Select the forwarding info of the flow among the ones of the entry. The
+ * flow should be from the source prefix to the destination prefix */
+fwd_info_t *
+pcache_entry_fwd_info(pcache_entry_t *pe, packet_tuple_t *tpl)
+{
+    fwd_prefix_t *prefix = pe->prefix;
+    uint8_t *dst_vec;
+    int src, dst, dst_vec_len;
+
+    src = prefix->src_vec[tpl->hash % prefix->src_vec_len];
+    if (lisp_addr_ip_afi(&prefix->src_locs[src]) == AF_INET){
+        dst_vec = prefix->dst_v4_vec;
+        dst_vec_len = prefix->dst_v4_vec_len;
+    }else{
+        dst_vec = prefix->dst_v6_vec;
+        dst_vec_len = prefix->dst_v6_vec_len;
+    }
+    if (dst_vec_len == 0){
+        return (NULL);
+    }
+    dst = dst_vec[tpl->hash % dst_vec_len];
+
+    return (pe->paths[src * prefix->dst_locs_num + dst]);
+}
+
+/* Get the forwarding info of a new flow from the entry of the longest
+ * destination prefix that also contains its source address */
+fwd_info_t *
+pcache_lookup(pcache_t *pc, packet_tuple_t *tpl)
+{
+    pcache_map_t *map;
+    pcache_entry_t **ppe;
+    uint32_t dst[PCACHE_ADDR_WORDS], src[PCACHE_ADDR_WORDS];
+    uint32_t dpref[PCACHE_ADDR_WORDS], spref[PCACHE_ADDR_WORDS];
+    fwd_info_t *fi;
+    int i, plen;
+
+    map = pcache_map(pc, lisp_addr_ip_afi(&tpl->dst_addr));
+    if (!map || map->plens_num == 0
+            || lisp_addr_ip_afi(&tpl->src_addr) != lisp_addr_ip_afi(&tpl->dst_addr)){
+        pc->stats.misses++;
+        return (NULL);
+    }
+    lisp_addr_copy_to(dst, &tpl->dst_addr);
+    lisp_addr_copy_to(src, &tpl->src_addr);
+
+    for (i = 0; i < map->plens_num; i++){
+        plen = map->plens[i];
+        pcache_mask(dpref, dst, map->words, plen);
+        ppe = &map->buckets[pcache_hash(dpref, map->words, plen) & map->mask];
+        while (*ppe){
+            /* The source prefix of an entry determines its IID, so the same
+             * destination prefix may have entries of other IIDs */
+            if ((*ppe)->dst_plen != plen
+                    || memcmp((*ppe)->dst, dpref, map->words * sizeof(uint32_t)) != 0){
+                ppe = &(*ppe)->next;
+                continue;
+            }
+            pcache_mask(spref, src, map->words, (*ppe)->src_plen);
+            if (memcmp((*ppe)->src, spref, map->words * sizeof(uint32_t)) != 0){
+                ppe = &(*ppe)->next;
+                continue;
+            }
+            if (!fwd_gen_deps_current(&(*ppe)->deps)){
+                pcache_map_del(pc, map, ppe);
+                pc->stats.invalidations++;
+                pc->stats.misses++;
+                return (NULL);
+            }
+            fi = pcache_entry_fwd_info(*ppe, tpl);
+            if (!fi){
+                /* No compatible RLOCs. Let the control plane decide */
+                break;
+            }
+            pc->stats.hits++;
+            return (fi);
+        }
+        if (*ppe){
+            break;
+        }
+    }
+    pc->stats.misses++;
+
+    return (NULL);
+}
+
+uint32_t
+pcache_size(pcache_t *pc)
+{
+    return (pc->count);
+}
+
+/* Add the counters of other to stats */
+void
+pcache_stats_add(pcache_stats_t *stats, pcache_stats_t *other)
+{
+    stats->hits += other->hits;
+    stats->misses += other->misses;
+    stats->inserts += other->inserts;
+    stats->invalidations += other->invalidations;
+    stats->flushes += other->flushes;
+}
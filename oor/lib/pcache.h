@@ -0,0 +1,132 @@
+/*
+ *
+ * Copyright (C) 2011, 2015 Cisco Systems, Inc.
+ * Copyright (C) 2015 CBA research group, Technical University of Catalonia.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef PCACHE_H_
+#define PCACHE_H_
+
+#include "crc32c.h"
+#include "fwd_gen.h"
+#include "packets.h"
+
+typedef struct fwd_info_ fwd_info_t;
+typedef struct fwd_prefix_ fwd_prefix_t;
+
+/* Max number of 32 bits words of an address */
+#define PCACHE_ADDR_WORDS   4
+
+/* Cached forwarding state of the flows from a local prefix to a map cache
+ * prefix. The prefixes are stored masked, in network byte order */
+typedef struct pcache_entry {
+    struct pcache_entry *next;
+    uint32_t dst[PCACHE_ADDR_WORDS];
+    uint32_t src[PCACHE_ADDR_WORDS];
+    uint8_t dst_plen;
+    uint8_t src_plen;
+    fwd_prefix_t *prefix;
+    fwd_gen_deps_t deps;
+    /* Forwarding info of each pair of source and destination RLOCs, in
+     * position src * dst_locs_num + dst. Shared by all the flows using the
+     * pair. NULL if the AFIs of the RLOCs are different */
+    fwd_info_t **paths;
+} pcache_entry_t;
+
+/* Entries of one AFI, hashed by destination prefix */
+typedef struct pcache_map {
+    pcache_entry_t **buckets;
+    uint32_t mask;
+    int words;
+    /* Number of entries of each destination prefix length, and the lengths
+     * with entries from the longest one */
+    uint32_t plen_count[129];
+    uint8_t plens[129];
+    int plens_num;
+} pcache_map_t;
+
+typedef struct pcache_stats {
+    /* New flows forwarded with a cached entry */
+    uint64_t hits;
+    uint64_t misses;
+    /* Entries added to the cache */
+    uint64_t inserts;
+    /* Entries removed because the state they were obtained from changed */
+    uint64_t invalidations;
+    /* Times the cache was emptied because it was full */
+    uint64_t flushes;
+} pcache_stats_t;
+
+/*
+ * Cache between the flow table and the control plane. The forwarding info of
+ * a new flow is obtained with a longest prefix match of its destination
+ * address, a check of its source address and the selection of the RLOCs with
+ * the hash of the flow, without memory allocations or calls to the control
+ * plane.
+ *
+ * The control plane only provides the state of prefixes without more specific
+ * ones (see fwd_prefix_t), so the longest match among the cached prefixes is
+ * the one of the map cache. Entries are validated with the generations of the
+ * state they were obtained from (see fwd_gen.h). The cache is not thread safe:
+ * each data plane thread has its own one.
+ */
+typedef struct pcache {
+    pcache_map_t v4;
+    pcache_map_t v6;
+    uint32_t count;
+    uint32_t max_count;
+    pcache_stats_t stats;
+} pcache_t;
+
+/* Copy the first plen bits of addr to pref, clearing the rest */
+static inline void
+pcache_mask(uint32_t *pref, uint32_t *addr, int words, int plen)
+{
+    int i, bits;
+
+    for (i = 0; i < words; i++){
+        bits = plen - 32 * i;
+        if (bits >= 32){
+            pref[i] = addr[i];
+        }else if (bits <= 0){
+            pref[i] = 0;
+        }else{
+            pref[i] = addr[i] & htonl(~0U << (32 - bits));
+        }
+    }
+}
+
+static inline uint32_t
+pcache_hash(uint32_t *pref, int words, int plen)
+{
+    return (crc32c(plen, pref, words * sizeof(uint32_t)));
+}
+
+/* Called for the forwarding info of each pair of RLOCs of a new entry, to
+ * complete it with the state of the data plane */
+typedef int (*pcache_path_init_fct)(void *arg, fwd_info_t *fi);
+
+void pcache_init(pcache_t *pc, uint32_t max_prefixes);
+void pcache_uninit(pcache_t *pc);
+void pcache_flush(pcache_t *pc);
+pcache_entry_t *pcache_insert(pcache_t *pc, fwd_info_t *fi,
+        pcache_path_init_fct init_fct, void *arg);
+fwd_info_t *pcache_lookup(pcache_t *pc, packet_tuple_t *tpl);
+fwd_info_t *pcache_entry_fwd_info(pcache_entry_t *pe, packet_tuple_t *tpl);
+uint32_t pcache_size(pcache_t *pc);
+void pcache_stats_add(pcache_stats_t *stats, pcache_stats_t *other);
+
+#endif /* PCACHE_H_ */
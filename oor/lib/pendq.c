@@ -0,0 +1,303 @@
+/*
+ *
+ * Copyright (C) 2011, 2015 Cisco Systems, Inc.
+ * Copyright (C) 2015 CBA research group, Technical University of Catalonia.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <string.h>
+
+#include "pendq.h"
+#include "crc32c.h"
+#include "mem_util.h"
+#include "oor_log.h"
+#include "../liblisp/liblisp.h"
+
+
+/* IP prefix of an EID. IP addresses are taken as host prefixes */
+static ip_addr_t *
+pendq_eid_ip(lisp_addr_t *eid, int *plen)
+{
+    if (lisp_addr_is_iid(eid)){
+        eid = iid_type_get_addr(lcaf_addr_get_addr(lisp_addr_get_lcaf(eid)));
+    }
+    switch (lisp_addr_lafi(eid)){
+    case LM_AFI_IP:
+        *plen = ip_addr_afi_to_default_mask(lisp_addr_ip(eid));
+        return (lisp_addr_ip(eid));
+    case LM_AFI_IPPREF:
+        *plen = ip_prefix_get_plen(lisp_addr_get_ippref(eid));
+        return (ip_prefix_addr(lisp_addr_get_ippref(eid)));
+    default:
+        return (NULL);
+    }
+}
+
+static uint8_t
+pendq_addr_in_pref(ip_addr_t *addr, ip_addr_t *pref, int plen)
+{
+    uint8_t *a, *p;
+    int bytes = plen / 8;
+    int bits = plen % 8;
+
+    if (ip_addr_afi(addr) != ip_addr_afi(pref)){
+        return (FALSE);
+    }
+    a = ip_addr_get_addr(addr);
+    p = ip_addr_get_addr(pref);
+    if (memcmp(a, p, bytes) != 0){
+        return (FALSE);
+    }
+    if (bits && ((a[bytes] ^ p[bytes]) & (0xff << (8 - bits)) & 0xff)){
+        return (FALSE);
+    }
+    return (TRUE);
+}
+
+static pendq_dst_t **
+pendq_bucket(pendq_t *pq, ip_addr_t *addr)
+{
+    return (&pq->buckets[crc32c(0, ip_addr_get_addr(addr),
+            ip_addr_get_size(addr)) % PENDQ_BUCKETS]);
+}
+
+static pendq_dst_t *
+pendq_dst_lookup(pendq_t *pq, ip_addr_t *addr)
+{
+    pendq_dst_t *dst;
+
+    for (dst = *pendq_bucket(pq, addr); dst != NULL; dst = dst->hnext){
+        if (ip_addr_cmp(&dst->addr, addr) == 0){
+            return (dst);
+        }
+    }
+    return (NULL);
+}
+
+/* Remove the destination from the hash table and free it. It must have been
+ * removed from the list of destinations */
+static void
+pendq_dst_del(pendq_t *pq, pendq_dst_t *dst)
+{
+    pendq_dst_t **pdst;
+
+    for (pdst = pendq_bucket(pq, &dst->addr); *pdst != dst; pdst = &(*pdst)->hnext);
+    *pdst = dst->hnext;
+    pq->pkts -= dst->pkts;
+    pq->bytes -= dst->bytes;
+    pendq_pkts_del(dst->head);
+    free(dst);
+}
+
+/* Drop the packets of the destinations whose time expired. Called with the
+ * lock held */
+static void
+pendq_expire(pendq_t *pq, time_t now)
+{
+    pendq_dst_t *dst;
+
+    while (pq->head && pq->head->expires <= now){
+        dst = pq->head;
+        pq->head = dst->next;
+        if (!pq->head){
+            pq->tail = NULL;
+        }
+        OOR_LOG(LDBG_2, "pendq_expire: No mapping for %s in time. %u packets "
+                "dropped", ip_addr_to_char(&dst->addr), dst->pkts);
+        pq->stats.drops_expired += dst->pkts;
+        pendq_dst_del(pq, dst);
+    }
+}
+
+/* Remove the destinations covered by the EID. Their packets are returned in
+ * arrival order if release is TRUE, otherwise they are dropped */
+static pendq_pkt_t *
+pendq_remove(pendq_t *pq, lisp_addr_t *eid, uint8_t release)
+{
+    pendq_dst_t **prev, *dst, *last = NULL, *host = NULL;
+    pendq_pkt_t *head = NULL, *tail = NULL;
+    ip_addr_t *pref;
+    int plen;
+
+    pref = pendq_eid_ip(eid, &plen);
+    if (!pref){
+        return (NULL);
+    }
+
+    pthread_mutex_lock(&pq->lock);
+    pendq_expire(pq, time(NULL));
+    /* A host EID covers at most one destination */
+    if (plen == ip_addr_afi_to_default_mask(pref)){
+        host = pendq_dst_lookup(pq, pref);
+        if (!host){
+            pthread_mutex_unlock(&pq->lock);
+            return (NULL);
+        }
+    }
+    prev = &pq->head;
+    while ((dst = *prev) != NULL){
+        if (host ? dst != host : !pendq_addr_in_pref(&dst->addr, pref, plen)){
+            last = dst;
+            prev = &dst->next;
+            continue;
+        }
+        *prev = dst->next;
+        if (pq->tail == dst){
+            pq->tail = last;
+        }
+        if (release){
+            pq->stats.released += dst->pkts;
+            if (tail){
+                tail->next = dst->head;
+            }else{
+                head = dst->head;
+            }
+            tail = dst->tail;
+            dst->head = NULL;
+        }else{
+            pq->stats.drops_expired += dst->pkts;
+        }
+        pendq_dst_del(pq, dst);
+    }
+    pthread_mutex_unlock(&pq->lock);
+
+    return (head);
+}
+
+void
+pendq_init(pendq_t *pq, uint32_t dst_max_pkts, uint32_t dst_max_bytes,
+        uint32_t max_pkts, uint32_t max_bytes, int timeout)
+{
+    memset(pq, 0, sizeof(pendq_t));
+    pthread_mutex_init(&pq->lock, NULL);
+    pq->dst_max_pkts = dst_max_pkts;
+    pq->dst_max_bytes = dst_max_bytes;
+    pq->max_pkts = max_pkts;
+    pq->max_bytes = max_bytes;
+    pq->timeout = timeout;
+}
+
+void
+pendq_uninit(pendq_t *pq)
+{
+    pendq_dst_t *dst;
+
+    while (pq->head){
+        dst = pq->head;
+        pq->head = dst->next;
+        pendq_dst_del(pq, dst);
+    }
+    pq->tail = NULL;
+    pthread_mutex_destroy(&pq->lock);
+}
+
+/* Keep a copy of a packet to dst until its mapping is obtained. Returns BAD if
+ * the packet doesn't fit in the queue */
+int
+pendq_add(pendq_t *pq, ip_addr_t *addr, lbuf_t *b)
+{
+    pendq_dst_t *dst, **bucket;
+    pendq_pkt_t *pkt;
+    uint32_t size = lbuf_size(b);
+    time_t now = time(NULL);
+
+    /* The copy is done without the lock. It is discarded if the packet
+     * doesn't fit */
+    pkt = xmalloc(sizeof(pendq_pkt_t));
+    pkt->next = NULL;
+    pkt->b = lbuf_new_with_headroom(size, LBUF_STACK_OFFSET);
+    lbuf_put(pkt->b, lbuf_data(b), size);
+    lbuf_reset_ip(pkt->b);
+
+    pthread_mutex_lock(&pq->lock);
+    pendq_expire(pq, now);
+    dst = pendq_dst_lookup(pq, addr);
+    if (pq->pkts >= pq->max_pkts || pq->bytes + size > pq->max_bytes
+            || (dst && dst->pkts >= pq->dst_max_pkts)
+            || (dst ? dst->bytes : 0) + size > pq->dst_max_bytes){
+        pq->stats.drops_full++;
+        pthread_mutex_unlock(&pq->lock);
+        pendq_pkts_del(pkt);
+        return (BAD);
+    }
+
+    if (!dst){
+        dst = xzalloc(sizeof(pendq_dst_t));
+        ip_addr_copy(&dst->addr, addr);
+        dst->expires = now + pq->timeout;
+        if (pq->tail){
+            pq->tail->next = dst;
+        }else{
+            pq->head = dst;
+        }
+        pq->tail = dst;
+        bucket = pendq_bucket(pq, addr);
+        dst->hnext = *bucket;
+        *bucket = dst;
+    }
+    if (dst->tail){
+        dst->tail->next = pkt;
+    }else{
+        dst->head = pkt;
+    }
+    dst->tail = pkt;
+    dst->pkts++;
+    dst->bytes += size;
+    pq->pkts++;
+    pq->bytes += size;
+    pq->stats.queued++;
+    pthread_mutex_unlock(&pq->lock);
+
+    return (GOOD);
+}
+
+/* Remove the packets to the destinations covered by the EID, whose mapping
+ * has been obtained. They should be forwarded and deleted with
+ * pendq_pkts_del */
+pendq_pkt_t *
+pendq_take(pendq_t *pq, lisp_addr_t *eid)
+{
+    return (pendq_remove(pq, eid, TRUE));
+}
+
+/* Drop the packets to the destinations covered by the EID, whose mapping
+ * couldn't be obtained */
+void
+pendq_drop(pendq_t *pq, lisp_addr_t *eid)
+{
+    pendq_remove(pq, eid, FALSE);
+}
+
+void
+pendq_pkts_del(pendq_pkt_t *pkts)
+{
+    pendq_pkt_t *next;
+
+    while (pkts){
+        next = pkts->next;
+        lbuf_del(pkts->b);
+        free(pkts);
+        pkts = next;
+    }
+}
+
+void
+pendq_get_stats(pendq_t *pq, pendq_stats_t *stats, uint32_t *pkts)
+{
+    pthread_mutex_lock(&pq->lock);
+    *stats = pq->stats;
+    *pkts = pq->pkts;
+    pthread_mutex_unlock(&pq->lock);
+}
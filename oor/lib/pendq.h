@@ -0,0 +1,108 @@
+/*
+ *
+ * Copyright (C) 2011, 2015 Cisco Systems, Inc.
+ * Copyright (C) 2015 CBA research group, Technical University of Catalonia.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef PENDQ_H_
+#define PENDQ_H_
+
+#include <pthread.h>
+#include <time.h>
+
+#include "lbuf.h"
+#include "../liblisp/lisp_address.h"
+
+/* Copy of a packet waiting for the mapping of its destination */
+typedef struct pendq_pkt {
+    struct pendq_pkt *next;
+    lbuf_t *b;
+} pendq_pkt_t;
+
+/* Number of buckets of the hash table of destinations */
+#define PENDQ_BUCKETS   1024
+
+/* Packets to one destination address, in arrival order */
+typedef struct pendq_dst {
+    struct pendq_dst *next;
+    /* Next destination in the same bucket */
+    struct pendq_dst *hnext;
+    ip_addr_t addr;
+    /* The packets are dropped if the mapping is not obtained before */
+    time_t expires;
+    pendq_pkt_t *head;
+    pendq_pkt_t *tail;
+    uint32_t pkts;
+    uint32_t bytes;
+} pendq_dst_t;
+
+typedef struct pendq_stats {
+    uint64_t queued;
+    /* Packets handed back to be forwarded once the mapping was obtained */
+    uint64_t released;
+    /* Packets not queued because a limit was reached */
+    uint64_t drops_full;
+    /* Packets dropped because the mapping was not obtained in time */
+    uint64_t drops_expired;
+} pendq_stats_t;
+
+/*
+ * Packets that would be dropped while the Map-Request for their destination
+ * is in flight. They are copied and kept, per destination address, until the
+ * control plane installs the mapping or gives up. The number of packets and
+ * bytes is bounded per destination and for the whole queue, and the
+ * destinations are removed in the order they were added when their time
+ * expires.
+ *
+ * It is shared by all the threads encapsulating packets and protected by its
+ * own lock. The packets are copied before taking it, and the destinations are
+ * found through a hash table of their addresses.
+ */
+typedef struct pendq {
+    pthread_mutex_t lock;
+    /* Destinations in the order they were added, which is also the order in
+     * which they expire */
+    pendq_dst_t *head;
+    pendq_dst_t *tail;
+    pendq_dst_t *buckets[PENDQ_BUCKETS];
+    uint32_t pkts;
+    uint32_t bytes;
+    /* Limits. 0 packets per destination disables the queue */
+    uint32_t dst_max_pkts;
+    uint32_t dst_max_bytes;
+    uint32_t max_pkts;
+    uint32_t max_bytes;
+    /* Time a destination waits for its mapping (s) */
+    int timeout;
+    pendq_stats_t stats;
+} pendq_t;
+
+void pendq_init(pendq_t *pq, uint32_t dst_max_pkts, uint32_t dst_max_bytes,
+        uint32_t max_pkts, uint32_t max_bytes, int timeout);
+void pendq_uninit(pendq_t *pq);
+int pendq_add(pendq_t *pq, ip_addr_t *dst, lbuf_t *b);
+pendq_pkt_t *pendq_take(pendq_t *pq, lisp_addr_t *eid);
+void pendq_drop(pendq_t *pq, lisp_addr_t *eid);
+void pendq_pkts_del(pendq_pkt_t *pkts);
+void pendq_get_stats(pendq_t *pq, pendq_stats_t *stats, uint32_t *pkts);
+
+static inline uint8_t
+pendq_enabled(pendq_t *pq)
+{
+    return (pq->dst_max_pkts > 0);
+}
+
+#endif /* PENDQ_H_ */
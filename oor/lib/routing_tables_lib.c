@@ -19,6 +19,7 @@
 
 #include <errno.h>
 #include <unistd.h>
+#include <linux/neighbour.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 #include <sys/socket.h>
@@ -488,3 +489,171 @@ del_route(int  afi, uint32_t ifindex, lisp_addr_t *dest_pref, lisp_addr_t *src,
     return (result);
 }
 
+/*
+ * Send a request to the kernel through a new netlink socket. Returns the
+ * socket where the answer should be read
+ */
+static int
+netlink_send_query(struct nlmsghdr *nlh)
+{
+    struct timeval tv = {1, 0};
+    int sockfd;
+
+    sockfd = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_ROUTE);
+    if (sockfd < 0) {
+        OOR_LOG(LERR, "netlink_send_query: Failed to open netlink socket: %s",
+                strerror(errno));
+        return (ERR_SOCKET);
+    }
+    /* Don't block the process if the kernel doesn't answer */
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    if (send(sockfd, nlh, nlh->nlmsg_len, 0) < 0) {
+        OOR_LOG(LERR, "netlink_send_query: send netlink command failed %s",
+                strerror(errno));
+        close(sockfd);
+        return (ERR_SOCKET);
+    }
+    return (sockfd);
+}
+
+int
+get_route_to(lisp_addr_t *dst, lisp_addr_t *src, int *oif, lisp_addr_t *gw)
+{
+    struct nlmsghdr *nlh = NULL;
+    struct rtmsg *rtm = NULL;
+    struct rtattr *rta = NULL;
+    char buf[4096];
+    int afi = lisp_addr_ip_afi(dst);
+    int addr_size = ip_sock_afi_to_size(afi);
+    int sockfd, nbytes, rta_len;
+    int result = BAD;
+
+    memset(buf, 0, sizeof(buf));
+    nlh = (struct nlmsghdr *)buf;
+    rtm = NLMSG_DATA(nlh);
+    rta_len = sizeof(struct rtmsg);
+
+    rta = (struct rtattr *)(CO(rtm, sizeof(struct rtmsg)));
+    rta->rta_type = RTA_DST;
+    rta->rta_len = sizeof(struct rtattr) + addr_size;
+    lisp_addr_copy_to(((char *)rta) + sizeof(struct rtattr), dst);
+    rta_len += rta->rta_len;
+    rtm->rtm_dst_len = addr_size * 8;
+
+    /* Source routing rules are taken into account */
+    if (src != NULL && lisp_addr_ip_afi(src) == afi){
+        rta = (struct rtattr *)(CO(rta, rta->rta_len));
+        rta->rta_type = RTA_SRC;
+        rta->rta_len = sizeof(struct rtattr) + addr_size;
+        lisp_addr_copy_to(((char *)rta) + sizeof(struct rtattr), src);
+        rta_len += rta->rta_len;
+        rtm->rtm_src_len = addr_size * 8;
+    }
+
+    nlh->nlmsg_len = NLMSG_LENGTH(rta_len);
+    nlh->nlmsg_flags = NLM_F_REQUEST;
+    nlh->nlmsg_type = RTM_GETROUTE;
+    rtm->rtm_family = afi;
+
+    sockfd = netlink_send_query(nlh);
+    if (sockfd == ERR_SOCKET){
+        return (BAD);
+    }
+    nbytes = recv(sockfd, buf, sizeof(buf), 0);
+    close(sockfd);
+
+    *oif = 0;
+    lisp_addr_set_lafi(gw, LM_AFI_NO_ADDR);
+    for (nlh = (struct nlmsghdr *)buf; nbytes > 0 && NLMSG_OK(nlh, nbytes);
+            nlh = NLMSG_NEXT(nlh, nbytes)) {
+        if (nlh->nlmsg_type != RTM_NEWROUTE){
+            continue;
+        }
+        rtm = NLMSG_DATA(nlh);
+        rta_len = RTM_PAYLOAD(nlh);
+        for (rta = RTM_RTA(rtm); RTA_OK(rta, rta_len); rta = RTA_NEXT(rta, rta_len)){
+            switch (rta->rta_type){
+            case RTA_OIF:
+                memcpy(oif, RTA_DATA(rta), sizeof(int));
+                result = GOOD;
+                break;
+            case RTA_GATEWAY:
+                lisp_addr_ip_init(gw, RTA_DATA(rta), afi);
+                break;
+            }
+        }
+    }
+
+    return (result);
+}
+
+int
+get_neighbour_lladdr(int ifindex, lisp_addr_t *addr, uint8_t *lladdr, int len)
+{
+    struct nlmsghdr *nlh = NULL;
+    struct ndmsg *ndm = NULL;
+    struct rtattr *rta = NULL;
+    char buf[8192];
+    uint8_t ip[sizeof(struct in6_addr)];
+    void *neigh_lladdr;
+    int afi = lisp_addr_ip_afi(addr);
+    int addr_size = ip_sock_afi_to_size(afi);
+    int sockfd, nbytes, rta_len, done = FALSE, found;
+    int result = BAD;
+
+    lisp_addr_copy_to(ip, addr);
+
+    memset(buf, 0, sizeof(buf));
+    nlh = (struct nlmsghdr *)buf;
+    ndm = NLMSG_DATA(nlh);
+    nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct ndmsg));
+    nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    nlh->nlmsg_type = RTM_GETNEIGH;
+    ndm->ndm_family = afi;
+    ndm->ndm_ifindex = ifindex;
+
+    sockfd = netlink_send_query(nlh);
+    if (sockfd == ERR_SOCKET){
+        return (BAD);
+    }
+
+    /* The whole table is dumped. Older kernels don't filter by interface */
+    while (!done && (nbytes = recv(sockfd, buf, sizeof(buf), 0)) > 0){
+        for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, nbytes);
+                nlh = NLMSG_NEXT(nlh, nbytes)) {
+            if (nlh->nlmsg_type == NLMSG_DONE || nlh->nlmsg_type == NLMSG_ERROR){
+                done = TRUE;
+                break;
+            }
+            ndm = NLMSG_DATA(nlh);
+            if (nlh->nlmsg_type != RTM_NEWNEIGH || ndm->ndm_ifindex != ifindex
+                    || result == GOOD){
+                continue;
+            }
+            if (!(ndm->ndm_state & (NUD_REACHABLE | NUD_STALE | NUD_DELAY
+                    | NUD_PROBE | NUD_PERMANENT))){
+                continue;
+            }
+            found = FALSE;
+            neigh_lladdr = NULL;
+            rta_len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(struct ndmsg));
+            for (rta = (struct rtattr *)CO(ndm, NLMSG_ALIGN(sizeof(struct ndmsg)));
+                    RTA_OK(rta, rta_len); rta = RTA_NEXT(rta, rta_len)){
+                if (rta->rta_type == NDA_DST && RTA_PAYLOAD(rta) == addr_size
+                        && memcmp(RTA_DATA(rta), ip, addr_size) == 0){
+                    found = TRUE;
+                }else if (rta->rta_type == NDA_LLADDR && RTA_PAYLOAD(rta) == len){
+                    neigh_lladdr = RTA_DATA(rta);
+                }
+            }
+            if (found && neigh_lladdr){
+                memcpy(lladdr, neigh_lladdr, len);
+                result = GOOD;
+            }
+        }
+    }
+    close(sockfd);
+
+    return (result);
+}
@@ -73,4 +73,24 @@ int add_route(int afi, uint32_t ifindex, lisp_addr_t *dest_pref, lisp_addr_t *sr
 int del_route(int  afi, uint32_t ifindex, lisp_addr_t *dest_pref, lisp_addr_t *src,
         lisp_addr_t *gw, uint32_t metric, uint32_t table);
 
+/*
+ * Ask the kernel for the route used to reach dst from src
+ * src:         Source address. NULL if not relevant
+ * oif:         Output interface
+ * gw:          Gateway. Its afi is LM_AFI_NO_ADDR when dst is directly
+ *              reachable
+ */
+int get_route_to(lisp_addr_t *dst, lisp_addr_t *src, int *oif, lisp_addr_t *gw);
+
+/*
+ * Get the link layer address of a neighbour from the kernel neighbour table.
+ * Only valid entries are considered
+ * ifindex:     Interface of the neighbour
+ * addr:        IP address of the neighbour
+ * lladdr:      Buffer where the link layer address is copied
+ * len:         Length of the link layer address
+ */
+int get_neighbour_lladdr(int ifindex, lisp_addr_t *addr, uint8_t *lladdr,
+        int len);
+
 #endif /* ROUTING_TABLES_LIB_H_ */
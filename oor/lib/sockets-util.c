@@ -20,6 +20,7 @@
 #include <errno.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <linux/filter.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 
@@ -213,6 +214,156 @@ socket_conf_req_ttl_tos(int sock, int afi)
     return (GOOD);
 }
 
+/* Attach to a raw UDP socket a classic BPF filter that only accepts packets
+ * with destination port 'port'. The rest are dropped in the kernel.
+ * IPv4 raw sockets receive the IP header while IPv6 ones start with the
+ * UDP header */
+int
+socket_attach_udp_port_filter(int sock, int afi, uint16_t port)
+{
+    struct sock_filter filter_v4[] = {
+            /* X = IPv4 header length */
+            BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+            /* A = UDP destination port */
+            BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, port, 0, 1),
+            BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+            BPF_STMT(BPF_RET | BPF_K, 0)
+    };
+    struct sock_filter filter_v6[] = {
+            /* A = UDP destination port */
+            BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 2),
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, port, 0, 1),
+            BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+            BPF_STMT(BPF_RET | BPF_K, 0)
+    };
+    struct sock_fprog prog;
+
+    switch (afi) {
+    case AF_INET:
+        prog.len = sizeof(filter_v4) / sizeof(struct sock_filter);
+        prog.filter = filter_v4;
+        break;
+    case AF_INET6:
+        prog.len = sizeof(filter_v6) / sizeof(struct sock_filter);
+        prog.filter = filter_v6;
+        break;
+    default:
+        return (BAD);
+    }
+
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        OOR_LOG(LWRN, "socket_attach_udp_port_filter: setsockopt SO_ATTACH_FILTER: %s",
+                strerror(errno));
+        return (BAD);
+    }
+
+    return (GOOD);
+}
+
+/* Allow several sockets to be bound to the same address and port. Must be
+ * called before binding the socket */
+int
+socket_set_reuseport(int sock)
+{
+    int on = 1;
+
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+        OOR_LOG(LWRN, "socket_set_reuseport: setsockopt SO_REUSEPORT: %s",
+                strerror(errno));
+        return (BAD);
+    }
+
+    return (GOOD);
+}
+
+/* Select the socket of a SO_REUSEPORT group of num sockets that receives a
+ * packet using its UDP source port: socket = source port % num. Sockets are
+ * numbered in the order they were bound. The program is run with the UDP
+ * payload at offset 0, so the UDP header is reached from the network header */
+int
+socket_attach_reuseport_steering(int sock, int afi, int num)
+{
+    struct sock_filter filter_v4[] = {
+        /* X = IPv4 header length */
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, SKF_NET_OFF),
+        BPF_STMT(BPF_ALU | BPF_AND | BPF_K,   0x0f),
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K,   2),
+        BPF_STMT(BPF_MISC| BPF_TAX,           0),
+        /* A = UDP source port */
+        BPF_STMT(BPF_LD  | BPF_H   | BPF_IND, SKF_NET_OFF),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K,   num),
+        BPF_STMT(BPF_RET | BPF_A,             0),
+    };
+    struct sock_filter filter_v6[] = {
+        /* A = UDP source port. Extension headers are not expected */
+        BPF_STMT(BPF_LD  | BPF_H   | BPF_ABS, SKF_NET_OFF + 40),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K,   num),
+        BPF_STMT(BPF_RET | BPF_A,             0),
+    };
+    struct sock_fprog prog;
+
+    switch (afi) {
+    case AF_INET:
+        prog.len = sizeof(filter_v4) / sizeof(struct sock_filter);
+        prog.filter = filter_v4;
+        break;
+    case AF_INET6:
+        prog.len = sizeof(filter_v6) / sizeof(struct sock_filter);
+        prog.filter = filter_v6;
+        break;
+    default:
+        return (BAD);
+    }
+
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog,
+            sizeof(prog)) < 0) {
+        OOR_LOG(LWRN, "socket_attach_reuseport_steering: setsockopt "
+                "SO_ATTACH_REUSEPORT_CBPF: %s", strerror(errno));
+        return (BAD);
+    }
+
+    return (GOOD);
+}
+
+/* Attach a kernel filter that discards all the packets received by the
+ * socket before they are queued */
+int
+socket_attach_drop_filter(int sock)
+{
+    struct sock_filter filter[] = {
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    struct sock_fprog prog;
+
+    prog.len = sizeof(filter) / sizeof(struct sock_filter);
+    prog.filter = filter;
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        OOR_LOG(LERR, "socket_attach_drop_filter: setsockopt SO_ATTACH_FILTER: %s",
+                strerror(errno));
+        return (BAD);
+    }
+
+    return (GOOD);
+}
+
+/* Ask the kernel to coalesce the consecutive datagrams of a flow received by
+ * a UDP socket. The size of the original datagrams is reported with an UDP_GRO
+ * control message */
+int
+socket_enable_udp_gro(int sock)
+{
+    int on = 1;
+
+    if (setsockopt(sock, SOL_UDP, UDP_GRO, &on, sizeof(on)) < 0) {
+        OOR_LOG(LDBG_1, "socket_enable_udp_gro: setsockopt UDP_GRO: %s",
+                strerror(errno));
+        return (BAD);
+    }
+
+    return (GOOD);
+}
+
 
 /*
  * Bind a socket to a specific address and port if specified
@@ -355,6 +506,84 @@ send_datagram_packet (int sock, const void *packet, int packet_length,
     return (GOOD);
 }
 
+/* Send the concatenation of the iov buffers as a train of datagrams of
+ * seg_size bytes (the last one may be smaller). The kernel or the NIC splits
+ * them (UDP_SEGMENT). The TTL and TOS of the outer IP header are provided as
+ * ancillary data */
+int
+send_segmented_datagram(int sock, struct iovec *iov, int iovcnt,
+        uint16_t seg_size, ip_addr_t *dip, int port, uint8_t ttl, uint8_t tos)
+{
+    union {
+        struct cmsghdr cmsg;
+        u_char data[CMSG_SPACE(sizeof(uint16_t)) + 2 * CMSG_SPACE(sizeof(int))];
+    } control;
+    struct sockaddr_in sa4;
+    struct sockaddr_in6 sa6;
+    struct msghdr msg;
+    struct cmsghdr *cmsgptr;
+    int ttl_val = ttl, tos_val = tos;
+    int len = 0, nbytes, i;
 
+    memset(&msg, 0, sizeof(msg));
+    switch (ip_addr_afi(dip)) {
+    case AF_INET:
+        memset(&sa4, 0, sizeof(sa4));
+        sa4.sin_family = AF_INET;
+        sa4.sin_port = htons(port);
+        ip_addr_copy_to(&sa4.sin_addr, dip);
+        msg.msg_name = &sa4;
+        msg.msg_namelen = sizeof(struct sockaddr_in);
+        break;
+    case AF_INET6:
+        memset(&sa6, 0, sizeof(sa6));
+        sa6.sin6_family = AF_INET6;
+        sa6.sin6_port = htons(port);
+        ip_addr_copy_to(&sa6.sin6_addr, dip);
+        msg.msg_name = &sa6;
+        msg.msg_namelen = sizeof(struct sockaddr_in6);
+        break;
+    default:
+        return (BAD);
+    }
 
+    memset(&control, 0, sizeof(control));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+    msg.msg_control = &control;
+    msg.msg_controllen = sizeof(control);
+
+    cmsgptr = CMSG_FIRSTHDR(&msg);
+    cmsgptr->cmsg_level = SOL_UDP;
+    cmsgptr->cmsg_type = UDP_SEGMENT;
+    cmsgptr->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cmsgptr), &seg_size, sizeof(uint16_t));
+
+    cmsgptr = CMSG_NXTHDR(&msg, cmsgptr);
+    cmsgptr->cmsg_level = ip_addr_afi(dip) == AF_INET ? IPPROTO_IP : IPPROTO_IPV6;
+    cmsgptr->cmsg_type = ip_addr_afi(dip) == AF_INET ? IP_TTL : IPV6_HOPLIMIT;
+    cmsgptr->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsgptr), &ttl_val, sizeof(int));
+
+    cmsgptr = CMSG_NXTHDR(&msg, cmsgptr);
+    cmsgptr->cmsg_level = ip_addr_afi(dip) == AF_INET ? IPPROTO_IP : IPPROTO_IPV6;
+    cmsgptr->cmsg_type = ip_addr_afi(dip) == AF_INET ? IP_TOS : IPV6_TCLASS;
+    cmsgptr->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsgptr), &tos_val, sizeof(int));
+
+    for (i = 0; i < iovcnt; i++){
+        len += iov[i].iov_len;
+    }
+    if ((nbytes = sendmsg(sock, &msg, 0)) < 0) {
+        OOR_LOG(LDBG_2, "send_segmented_datagram: send to %s failed -> %s",
+                ip_addr_to_char(dip), strerror(errno));
+        return (BAD);
+    }
+    if (nbytes != len){
+        OOR_LOG(LDBG_2, "send_segmented_datagram: sent %d of %d bytes to %s",
+                nbytes, len, ip_addr_to_char(dip));
+        return (BAD);
+    }
 
+    return (GOOD);
+}
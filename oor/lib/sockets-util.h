@@ -21,8 +21,24 @@
 #ifndef SOCKETS_UTIL_H_
 #define SOCKETS_UTIL_H_
 
+#include <sys/uio.h>
+#include <netinet/udp.h>
 #include "../liblisp/lisp_address.h"
 
+/* UDP segmentation (GSO) and receive coalescing (GRO) socket options. Not
+ * defined by old C libraries */
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT     103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO         104
+#endif
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF    51
+#endif
+/* Max number of segments the kernel accepts in a single UDP_SEGMENT send */
+#define UDP_MAX_SEGMENTS    64
+
 int open_ip_raw_socket(int afi);
 int open_udp_raw_socket(int afi);
 int opent_netlink_socket();
@@ -30,10 +46,17 @@ int opent_netlink_socket();
 int open_udp_datagram_socket(int afi);
 int socket_bindtodevice(int sock, char *device);
 int socket_conf_req_ttl_tos(int sock, int afi);
+int socket_attach_udp_port_filter(int sock, int afi, uint16_t port);
+int socket_attach_drop_filter(int sock);
+int socket_enable_udp_gro(int sock);
+int socket_set_reuseport(int sock);
+int socket_attach_reuseport_steering(int sock, int afi, int num);
 
 int bind_socket(int sock,int afi, lisp_addr_t *src_addr, int src_port);
 int send_raw_packet(int, const void *, int, ip_addr_t *);
 int send_datagram_packet (int sock, const void *packet, int packet_length,
         lisp_addr_t *addr_dest, int port_dest);
+int send_segmented_datagram(int sock, struct iovec *iov, int iovcnt,
+        uint16_t seg_size, ip_addr_t *dip, int port, uint8_t ttl, uint8_t tos);
 
 #endif /* SOCKETS_UTIL_H_ */
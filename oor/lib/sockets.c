@@ -64,6 +64,16 @@ sockmstr_create()
 {
     sockmstr_t *sm;
     sm = xzalloc(sizeof(sockmstr_t));
+    if (sm == NULL){
+        return (NULL);
+    }
+    sm->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (sm->epoll_fd == -1){
+        OOR_LOG(LCRIT, "sockmstr_create: epoll creation failed: %s", strerror(errno));
+        free(sm);
+        return (NULL);
+    }
+    pthread_mutex_init(&sm->lock, NULL);
     return (sm);
 }
 
@@ -98,16 +108,11 @@ sock_list_add(sock_list_t *lst, sock_t *sock)
 
     lst->tail = sock;
     lst->count++;
-    if (sock->fd > lst->maxfd) {
-        lst->maxfd = sock->fd;
-    }
-
 }
 
 static inline void
 sock_list_remove(sock_list_t *lst, struct sock *sock)
 {
-    int fd;
     if (sock->prev == NULL){
         lst->head = sock->next;
         if (sock->next != NULL){
@@ -119,24 +124,10 @@ sock_list_remove(sock_list_t *lst, struct sock *sock)
             sock->next->prev = sock->prev;
         }
     }
-    fd = sock->fd;
     close(sock->fd);
     free(sock);
 
     lst->count--;
-
-    if (fd == lst->maxfd){
-        sock= lst->head;
-        if (sock == NULL){
-            lst->maxfd = 0;
-        }
-        while (sock != NULL){
-            if (sock->fd > lst->maxfd) {
-                lst->maxfd = sock->fd;
-            }
-            sock = sock->next;
-        }
-    }
 }
 
 
@@ -147,6 +138,8 @@ sockmstr_destroy(sockmstr_t *sm)
         return;
     }
     sock_list_remove_all(&sm->read);
+    close(sm->epoll_fd);
+    pthread_mutex_destroy(&sm->lock);
     free(sm);
     OOR_LOG(LDBG_1,"Sockets closed");
 }
@@ -211,11 +204,27 @@ sockmstr_register_read_listener(sockmstr_t *m,int (*func)(struct sock *),
         void *arg, int fd)
 {
     struct sock *sock;
+    struct epoll_event ev;
+
     sock = xzalloc(sizeof(struct sock));
     sock->recv_cb = func;
     sock->type = SOCK_READ;
     sock->arg = arg;
     sock->fd = fd;
+    sock->priority = SOCK_PRIO_NORMAL;
+
+    /* The socket is added once to the epoll set. It remains there until it
+     * is unregistered */
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = sock;
+    if (epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1){
+        OOR_LOG(LERR, "sockmstr_register_read_listener: Couldn't register "
+                "descriptor %d: %s", fd, strerror(errno));
+        free(sock);
+        return (NULL);
+    }
+
     sock_list_add(&m->read, sock);
     return (sock);
 }
@@ -230,54 +239,70 @@ sock_fd(struct sock * sock)
 int
 sockmstr_unregister_read_listenedr(sockmstr_t *m, struct sock *sock)
 {
-   sock_list_remove(&m->read, sock);
-   return (GOOD);
-}
-
-
-static void
-sock_process_fd(struct sock_list *lst, fd_set *fdset)
-{
-    struct sock *sit;
+    int i;
 
-    for (sit = lst->head; sit; sit = sit->next) {
-        if (FD_ISSET(sit->fd, fdset))
-            (*sit->recv_cb)(sit);
+    epoll_ctl(m->epoll_fd, EPOLL_CTL_DEL, sock->fd, NULL);
+    /* The socket could be pending to be processed in this iteration */
+    for (i = 0; i < m->nready; i++){
+        if (m->ready[i] == sock){
+            m->ready[i] = NULL;
+        }
     }
+    sock_list_remove(&m->read, sock);
+    return (GOOD);
 }
 
+/* Wait for ready sockets and call their callbacks, higher priority ones
+ * first. Only ready sockets are visited */
 void
 sockmstr_process_all(sockmstr_t *m)
 {
-    struct timeval tv;
-
-    tv.tv_sec = 0;
-    tv.tv_usec = DEFAULT_SELECT_TIMEOUT;
-
-    while (1) {
-        if (select(m->read.maxfd + 1, &m->readfds, NULL, NULL, &tv) == -1) {
-            if (errno == EINTR) {
-                continue;
-            } else {
-                OOR_LOG(LDBG_2, "sock_process_all: select error: %s",
-                        strerror(errno));
-                return;
-            }
-        } else {
-            break;
+    struct sock *sk;
+    int nev, i, j;
+
+    nev = epoll_wait(m->epoll_fd, m->events, SOCK_MAX_EVENTS,
+            DEFAULT_SELECT_TIMEOUT / 1000);
+    if (nev == -1) {
+        if (errno != EINTR) {
+            OOR_LOG(LDBG_2, "sock_process_all: epoll_wait error: %s",
+                    strerror(errno));
         }
+        return;
     }
 
-    sock_process_fd(&m->read, &m->readfds);
+    /* Insertion sort by priority. Keeps the order of the kernel among
+     * sockets with the same priority */
+    for (i = 0; i < nev; i++){
+        sk = (struct sock *)m->events[i].data.ptr;
+        for (j = i; j > 0 && m->ready[j-1]->priority < sk->priority; j--){
+            m->ready[j] = m->ready[j-1];
+        }
+        m->ready[j] = sk;
+    }
+    m->nready = nev;
+
+    sockmstr_lock(m);
+    for (i = 0; i < m->nready; i++){
+        sk = m->ready[i];
+        /* NULL if unregistered by a previous callback */
+        if (sk != NULL){
+            (*sk->recv_cb)(sk);
+        }
+    }
+    m->nready = 0;
+    sockmstr_unlock(m);
 }
 
-void
-sockmstr_wait_on_all_read(sockmstr_t *m)
+inline void
+sockmstr_lock(sockmstr_t *m)
 {
-    struct sock *sit;
-    for (sit = m->read.head; sit; sit = sit->next) {
-        FD_SET(sit->fd, &m->readfds);
-    }
+    pthread_mutex_lock(&m->lock);
+}
+
+inline void
+sockmstr_unlock(sockmstr_t *m)
+{
+    pthread_mutex_unlock(&m->lock);
 }
 
 int
@@ -341,8 +366,8 @@ open_data_raw_input_socket(int afi, uint16_t port)
     return (sock);
 }
 
-int
-open_data_datagram_input_socket(int afi, int port)
+static int
+open_data_datagram_input_socket_(int afi, int port, uint8_t reuseport)
 {
 
     int sock = ERR_SOCKET;
@@ -350,6 +375,10 @@ open_data_datagram_input_socket(int afi, int port)
     if ((sock = open_udp_datagram_socket(afi)) < 0){
         return(ERR_SOCKET);
     }
+    if (reuseport && socket_set_reuseport(sock) != GOOD){
+        close(sock);
+        return(ERR_SOCKET);
+    }
     if(bind_socket(sock,afi,NULL,port) != GOOD){
         close(sock);
         return(ERR_SOCKET);
@@ -363,6 +392,20 @@ open_data_datagram_input_socket(int afi, int port)
     return (sock);
 }
 
+int
+open_data_datagram_input_socket(int afi, int port)
+{
+    return (open_data_datagram_input_socket_(afi, port, FALSE));
+}
+
+/* Open one of the sockets of a group that share the data port. The kernel
+ * distributes the received packets among them */
+int
+open_data_datagram_input_socket_shared(int afi, int port)
+{
+    return (open_data_datagram_input_socket_(afi, port, TRUE));
+}
+
 
 int
 sock_recv(int sfd, lbuf_t *b)
@@ -449,20 +492,74 @@ sock_ctrl_recv(int sock, struct lbuf *buf, uconn_t *uc)
     return (GOOD);
 }
 
+/* Space for TTL and TOS data */
+union data_control_data {
+    struct cmsghdr cmsg;
+    u_char data[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(int))
+                + CMSG_SPACE(sizeof(int))];
+};
+
+/* Extract the TTL and TOS of a received data packet from the ancillary data
+ * of the message. When the socket coalesces datagrams (UDP_GRO), the size of
+ * the original datagrams is stored in seg_size (0 if not coalesced).
+ * Returns the afi of the packet */
+static int
+sock_data_parse_cmsg(struct msghdr *msg, union sockunion *su, uint8_t *ttl,
+        uint8_t *tos, uint16_t *seg_size)
+{
+    struct cmsghdr *cmsgptr = NULL;
+
+    if (seg_size){
+        *seg_size = 0;
+        for (cmsgptr = CMSG_FIRSTHDR(msg); cmsgptr != NULL; cmsgptr =
+                CMSG_NXTHDR(msg, cmsgptr)) {
+            if (cmsgptr->cmsg_level == SOL_UDP
+                    && cmsgptr->cmsg_type == UDP_GRO) {
+                *seg_size = *((int *) CMSG_DATA(cmsgptr));
+            }
+        }
+    }
+
+    if (su->s4.sin_family == AF_INET) {
+        for (cmsgptr = CMSG_FIRSTHDR(msg); cmsgptr != NULL; cmsgptr =
+                CMSG_NXTHDR(msg, cmsgptr)) {
+
+            if (cmsgptr->cmsg_level == IPPROTO_IP
+                    && cmsgptr->cmsg_type == IP_TTL) {
+                *ttl = *((uint8_t *) CMSG_DATA(cmsgptr));
+            }
+
+            if (cmsgptr->cmsg_level == IPPROTO_IP
+                    && cmsgptr->cmsg_type == IP_TOS) {
+                *tos = *((uint8_t *) CMSG_DATA(cmsgptr));
+            }
+        }
+        return (AF_INET);
+    } else {
+        for (cmsgptr = CMSG_FIRSTHDR(msg); cmsgptr != NULL; cmsgptr =
+                CMSG_NXTHDR(msg, cmsgptr)) {
+
+            if (cmsgptr->cmsg_level == IPPROTO_IPV6
+                    && cmsgptr->cmsg_type == IPV6_HOPLIMIT) {
+                *ttl = *((uint8_t *) CMSG_DATA(cmsgptr));
+            }
+
+            if (cmsgptr->cmsg_level == IPPROTO_IPV6
+                    && cmsgptr->cmsg_type == IPV6_TCLASS) {
+                *tos = *((uint8_t *) CMSG_DATA(cmsgptr));
+            }
+        }
+        return (AF_INET6);
+    }
+}
+
 int
 sock_data_recv(int sock, lbuf_t *b, int *afi, uint8_t *ttl, uint8_t *tos)
 {
-    /* Space for TTL and TOS data */
-    union control_data {
-        struct cmsghdr cmsg;
-        u_char data[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(int))];
-    };
-
     union sockunion su;
     struct msghdr msg;
     struct iovec iov[1];
-    union control_data cmsg;
-    struct cmsghdr *cmsgptr = NULL;
+    union data_control_data cmsg;
     int nbytes = 0;
 
     iov[0].iov_base = lbuf_data(b);
@@ -484,41 +581,152 @@ sock_data_recv(int sock, lbuf_t *b, int *afi, uint8_t *ttl, uint8_t *tos)
 
     lbuf_set_size(b, lbuf_size(b) + nbytes);
 
-    if (su.s4.sin_family == AF_INET) {
-        for (cmsgptr = CMSG_FIRSTHDR(&msg); cmsgptr != NULL; cmsgptr =
-                CMSG_NXTHDR(&msg, cmsgptr)) {
+    *afi = sock_data_parse_cmsg(&msg, &su, ttl, tos, NULL);
 
-            if (cmsgptr->cmsg_level == IPPROTO_IP
-                    && cmsgptr->cmsg_type == IP_TTL) {
-                *ttl = *((uint8_t *) CMSG_DATA(cmsgptr));
-            }
+    return (GOOD);
+}
 
-            if (cmsgptr->cmsg_level == IPPROTO_IP
-                    && cmsgptr->cmsg_type == IP_TOS) {
-                *tos = *((uint8_t *) CMSG_DATA(cmsgptr));
-            }
-        }
-        *afi = AF_INET;
-    } else {
-        for (cmsgptr = CMSG_FIRSTHDR(&msg); cmsgptr != NULL; cmsgptr =
-                CMSG_NXTHDR(&msg, cmsgptr)) {
+/* Read up to vlen data packets already queued in the socket using a single
+ * system call. Packet i is stored in bufs[i] and its afi, ttl and tos in
+ * afi[i], ttl[i] and tos[i]. If seg_size is not NULL, seg_size[i] is the size
+ * of the datagrams coalesced in bufs[i] by UDP_GRO, or 0. The call doesn't
+ * block: it is expected to be used once the socket has been reported as
+ * readable.
+ * Returns the number of packets read or ERR_SOCKET on error */
+int
+sock_data_recv_batch(int sock, lbuf_t **bufs, int *afi, uint8_t *ttl,
+        uint8_t *tos, uint16_t *seg_size, int vlen)
+{
+    struct mmsghdr msgs[SOCK_MAX_BATCH];
+    struct iovec iovs[SOCK_MAX_BATCH];
+    union data_control_data cmsgs[SOCK_MAX_BATCH];
+    union sockunion sus[SOCK_MAX_BATCH];
+    int i, npkts;
+
+    if (vlen > SOCK_MAX_BATCH){
+        vlen = SOCK_MAX_BATCH;
+    }
 
-            if (cmsgptr->cmsg_level == IPPROTO_IPV6
-                    && cmsgptr->cmsg_type == IPV6_HOPLIMIT) {
-                *ttl = *((uint8_t *) CMSG_DATA(cmsgptr));
-            }
+    memset(msgs, 0, vlen * sizeof(struct mmsghdr));
+    for (i = 0; i < vlen; i++){
+        iovs[i].iov_base = lbuf_data(bufs[i]);
+        iovs[i].iov_len = lbuf_tailroom(bufs[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = &cmsgs[i];
+        msgs[i].msg_hdr.msg_controllen = sizeof(union data_control_data);
+        msgs[i].msg_hdr.msg_name = &sus[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(union sockunion);
+    }
 
-            if (cmsgptr->cmsg_level == IPPROTO_IPV6
-                    && cmsgptr->cmsg_type == IPV6_TCLASS) {
-                *tos = *((uint8_t *) CMSG_DATA(cmsgptr));
-            }
+    npkts = recvmmsg(sock, msgs, vlen, MSG_DONTWAIT, NULL);
+    if (npkts == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK){
+            return (0);
         }
-        *afi = AF_INET6;
+        OOR_LOG(LWRN, "sock_data_recv_batch: recvmmsg error: %s", strerror(errno));
+        return (ERR_SOCKET);
+    }
+
+    for (i = 0; i < npkts; i++){
+        lbuf_set_size(bufs[i], lbuf_size(bufs[i]) + msgs[i].msg_len);
+        ttl[i] = 0;
+        tos[i] = 0;
+        afi[i] = sock_data_parse_cmsg(&msgs[i].msg_hdr, &sus[i], &ttl[i], &tos[i],
+                seg_size ? &seg_size[i] : NULL);
     }
 
+    return (npkts);
+}
+
+void
+sock_txq_init(sock_txq_t *q, int fd, int size)
+{
+    q->fd = fd;
+    q->count = 0;
+    q->sent_pkts = 0;
+    q->sent_batches = 0;
+    if (size < 1){
+        size = 1;
+    }else if (size > SOCK_MAX_BATCH){
+        size = SOCK_MAX_BATCH;
+    }
+    q->size = size;
+}
+
+/* Queue a raw packet to be sent to dip. The queue is flushed when it gets full */
+int
+sock_txq_add(sock_txq_t *q, const void *pkt, int plen, ip_addr_t *dip)
+{
+    union sockunion *su = &q->dst[q->count];
+
+    switch (ip_addr_afi(dip)) {
+    case AF_INET:
+        memset(&su->s4, 0, sizeof(struct sockaddr_in));
+        su->s4.sin_family = AF_INET;
+        ip_addr_copy_to(&su->s4.sin_addr, dip);
+        break;
+    case AF_INET6:
+        memset(&su->s6, 0, sizeof(struct sockaddr_in6));
+        su->s6.sin6_family = AF_INET6;
+        ip_addr_copy_to(&su->s6.sin6_addr, dip);
+        break;
+    default:
+        return (BAD);
+    }
+    q->pkts[q->count] = pkt;
+    q->plen[q->count] = plen;
+    q->count++;
+
+    if (q->count == q->size){
+        return (sock_txq_flush(q));
+    }
     return (GOOD);
 }
 
+/* Send all the queued packets using sendmmsg. Packets that can not be sent
+ * are discarded */
+int
+sock_txq_flush(sock_txq_t *q)
+{
+    struct mmsghdr msgs[SOCK_MAX_BATCH];
+    struct iovec iovs[SOCK_MAX_BATCH];
+    int i, nsent, offset = 0, ret = GOOD;
+
+    if (q->count == 0){
+        return (GOOD);
+    }
+
+    memset(msgs, 0, q->count * sizeof(struct mmsghdr));
+    for (i = 0; i < q->count; i++){
+        iovs[i].iov_base = (void *)q->pkts[i];
+        iovs[i].iov_len = q->plen[i];
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &q->dst[i];
+        msgs[i].msg_hdr.msg_namelen = q->dst[i].s4.sin_family == AF_INET ?
+                sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+    }
+
+    while (offset < q->count){
+        nsent = sendmmsg(q->fd, &msgs[offset], q->count - offset, 0);
+        q->sent_batches++;
+        if (nsent == -1){
+            /* The first packet of the remaining ones failed. Skip it */
+            OOR_LOG(LDBG_2, "sock_txq_flush: send packet using descriptor %d "
+                    "failed -> %s", q->fd, strerror(errno));
+            offset++;
+            ret = BAD;
+            continue;
+        }
+        q->sent_pkts += nsent;
+        offset += nsent;
+    }
+    q->count = 0;
+
+    return (ret);
+}
+
 inline int
 uconn_init(uconn_t *uc, int lp, int rp, lisp_addr_t *la,lisp_addr_t *ra)
 {
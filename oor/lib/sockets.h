@@ -20,6 +20,8 @@
 #ifndef SOCKETS_H_
 #define SOCKETS_H_
 
+#include <pthread.h>
+#include <sys/epoll.h>
 #include "../defs.h"
 #include "sockets-util.h"
 #include "packets.h"
@@ -27,11 +29,23 @@
 #include "lbuf.h"
 
 
+/* Max number of packets read or written with a single system call */
+#define SOCK_MAX_BATCH      64
+/* Max number of ready sockets processed per iteration of the event loop */
+#define SOCK_MAX_EVENTS     64
+
 typedef enum {
     SOCK_READ,
     SOCK_WRITE,
 } sock_type_e;
 
+/* Ready sockets are processed in decreasing order of priority, so control,
+ * netlink and timer events are never delayed by data packets */
+typedef enum {
+    SOCK_PRIO_LOW,      /* Data packets */
+    SOCK_PRIO_NORMAL,   /* Control messages, netlink and timers */
+} sock_prio_e;
+
 /*
  * inspired by quagga thread.c
  * It might be a little bit of an overkill for now
@@ -43,7 +57,6 @@ typedef struct sock_list {
     struct sock *head;
     struct sock *tail;
     int count;
-    int maxfd;
 }sock_list_t;
 
 typedef struct sock {
@@ -51,6 +64,7 @@ typedef struct sock {
     int (*recv_cb)(struct sock *);
     void *arg;
     int fd;
+    sock_prio_e priority;
     struct sock *next;
     struct sock *prev;
 }sock_t;
@@ -67,9 +81,15 @@ typedef struct sockmstr {
     sock_list_t read;
 //    struct sock_list *write;
 //    struct sock_list *netlink;
-    fd_set readfds;
-//    fd_set *writefds;
-//    fd_set *netlinkfds;
+    int epoll_fd;
+    struct epoll_event events[SOCK_MAX_EVENTS];
+    /* Sockets ready to be processed in the current iteration, sorted by
+     * priority */
+    struct sock *ready[SOCK_MAX_EVENTS];
+    int nready;
+    /* Held while the callbacks of the sockets are processed. Threads other
+     * than the main one should take it before accessing the control plane */
+    pthread_mutex_t lock;
 } sockmstr_t;
 
 union sockunion {
@@ -77,12 +97,31 @@ union sockunion {
     struct sockaddr_in6 s6;
 };
 
+/* Raw packets pending to be sent through the same socket with a single
+ * system call. Only references to the packets are stored, so they should
+ * not be modified until the queue is flushed */
+typedef struct sock_txq {
+    int fd;
+    int count;
+    int size;
+    const void *pkts[SOCK_MAX_BATCH];
+    int plen[SOCK_MAX_BATCH];
+    union sockunion dst[SOCK_MAX_BATCH];
+    /* Statistics */
+    uint64_t sent_pkts;
+    uint64_t sent_batches;
+} sock_txq_t;
 
 typedef struct fwd_entry {
     lisp_addr_t *srloc;
     lisp_addr_t *drloc;
     int *out_sock;
     uint32_t iid;
+    /* Outer headers of the encapsulated packets. Built by the data plane */
+    pkt_hdr_tmpl_t tmpl;
+    /* Link layer path to the destination RLOC, used by the data planes that
+     * send the packets directly to the interfaces */
+    void *tx_path;
 } fwd_entry_t;
 
 fwd_entry_t *fwd_entry_new_init(lisp_addr_t *srloc, lisp_addr_t *drloc,
@@ -90,6 +129,7 @@ fwd_entry_t *fwd_entry_new_init(lisp_addr_t *srloc, lisp_addr_t *drloc,
 void fwd_entry_del(fwd_entry_t *fwd_entry);
 static inline void fwd_entry_set_srloc(fwd_entry_t *fwd_ent, lisp_addr_t * srloc);
 static inline void fwd_entry_set_drloc(fwd_entry_t *fwd_ent, lisp_addr_t * drloc);
+static inline void sock_set_priority(sock_t *sock, sock_prio_e prio);
 typedef struct iface iface_t;
 
 sockmstr_t *sockmstr_create();
@@ -101,15 +141,22 @@ sock_t *sockmstr_register_read_listener(sockmstr_t *m,
 int sock_fd(struct sock * sock);
 int sockmstr_unregister_read_listenedr(sockmstr_t *m, struct sock *sock);
 void sockmstr_process_all(sockmstr_t *m);
-void sockmstr_wait_on_all_read(sockmstr_t *m);
+void sockmstr_lock(sockmstr_t *m);
+void sockmstr_unlock(sockmstr_t *m);
 
 int open_data_raw_input_socket(int afi, uint16_t port);
 int open_data_datagram_input_socket(int afi, int port);
+int open_data_datagram_input_socket_shared(int afi, int port);
 int open_control_input_socket(int afi);
 
 int sock_recv(int, lbuf_t *);
 int sock_ctrl_recv(int, lbuf_t *, uconn_t *);
 int sock_data_recv(int sock, lbuf_t *b, int *afi, uint8_t *ttl, uint8_t *tos);
+int sock_data_recv_batch(int sock, lbuf_t **bufs, int *afi, uint8_t *ttl,
+        uint8_t *tos, uint16_t *seg_size, int vlen);
+void sock_txq_init(sock_txq_t *q, int fd, int size);
+int sock_txq_add(sock_txq_t *q, const void *pkt, int plen, ip_addr_t *dip);
+int sock_txq_flush(sock_txq_t *q);
 int uconn_init(uconn_t *uc, int lp, int rp, lisp_addr_t *la,
         lisp_addr_t *ra);
 
@@ -125,4 +172,12 @@ fwd_entry_set_drloc(fwd_entry_t *fwd_ent, lisp_addr_t * drloc)
     fwd_ent->drloc = drloc;
 }
 
+static inline void
+sock_set_priority(sock_t *sock, sock_prio_e prio)
+{
+    if (sock){
+        sock->priority = prio;
+    }
+}
+
 #endif /*SOCKETS_H_*/
@@ -25,67 +25,212 @@
 #include "../fwd_policies/fwd_policy.h"
 #include "../liblisp/liblisp.h"
 
-/* Time after which an entry is considered to have timed out and
- * is removed from the table */
-#define TIMEOUT 3
+/* Default time without packets after which an entry can be removed from
+ * the table (s) */
+#define IDLE_TIMEOUT 60
 
-/* Time after which a negative entry is considered to have timed
- * out and is removed from the table */
-#define NEGATIVE_TIMEOUT 0.1
+/* Number of lookups between updates of the coarse clock */
+#define CLOCK_LOOKUPS 64
 
-/* Maximum size of the tuple table */
+/* Default maximum number of flows per AFI */
 #define MAX_SIZE 10000
-#define OLD_ENTRIES 1000
 
-static void ttable_remove_with_khiter(ttable_t *tt, khiter_t k);
+/* Slots checked by the clock hand on each insertion to age the entries */
+#define AGE_STEPS 4
+/* Max slots checked by the clock hand to find an entry to evict. If none
+ * is found, the next entry is evicted */
+#define EVICT_STEPS 32
 
-static double
-time_diff(struct timespec *x , struct timespec *y)
+#define map_slot(_m, _i) \
+    ((ttable_slot_t *)((_m)->slots + (size_t)(_i) * (_m)->slot_size))
+
+
+static inline uint32_t
+time_now_ms()
 {
-    double x_s, y_s, diff;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint32_t)now.tv_sec * 1000 + (uint32_t)(now.tv_nsec / 1000000));
+}
 
-    x_s = (double)x->tv_sec + 1.0e-9*x->tv_nsec;
-    y_s = (double)y->tv_sec + 1.0e-9*y->tv_nsec;
+/* The entry is idle or its forwarding info is not valid anymore */
+static int
+slot_expired(ttable_t *tt, ttable_slot_t *slot)
+{
+    return (tt->now - slot->ts > tt->idle_timeout
+            || !fwd_gen_deps_current(&slot->fi->deps));
+}
 
-    diff = (double)y_s - (double)x_s;
+static void
+ttable_map_init(ttable_map_t *map, int key_words, uint32_t max_flows)
+{
+    uint32_t size = 16;
 
-    return diff;
+    /* Keep the load factor under 2/3 */
+    while (size < max_flows + max_flows / 2){
+        size <<= 1;
+    }
+    map->key_words = key_words;
+    map->slot_size = sizeof(ttable_slot_t) + key_words * sizeof(uint32_t);
+    /* Keep the pointers of the slots aligned */
+    map->slot_size = (map->slot_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    map->slots = xzalloc(size * map->slot_size);
+    map->mask = size - 1;
+    map->count = 0;
+    map->max_count = max_flows;
+    map->hand = 0;
 }
 
-static double
-time_elapsed(struct timespec *time_node)
+/* Remove the slot in position pos moving back the following slots of the
+ * cluster that would not be found anymore */
+static void
+ttable_map_del_pos(ttable_map_t *map, uint32_t pos)
 {
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
-    return(time_diff(time_node, &now));
+    ttable_slot_t *slot, *next;
+    uint32_t i, home;
+
+    slot = map_slot(map, pos);
+    fwd_info_del(slot->fi,(fwd_info_data_del)fwd_entry_del);
+    map->count--;
+
+    i = pos;
+    for (;;){
+        i = (i + 1) & map->mask;
+        next = map_slot(map, i);
+        if (next->fi == NULL){
+            break;
+        }
+        home = next->hash & map->mask;
+        /* The entry can be moved to the hole if its home position is not
+         * between the hole and its current position */
+        if (((i - home) & map->mask) >= ((i - pos) & map->mask)){
+            memcpy(slot, next, map->slot_size);
+            slot = next;
+            pos = i;
+        }
+    }
+    slot->fi = NULL;
 }
 
 static void
-ttable_node_del(ttable_node_t *tn)
+ttable_map_uninit(ttable_map_t *map)
 {
-    pkt_tuple_del(tn->tpl);
-    fwd_info_del(tn->fi,(fwd_info_data_del)fwd_entry_del);
-    free(tn);
+    uint32_t i;
+    ttable_slot_t *slot;
+
+    for (i = 0; i <= map->mask; i++){
+        slot = map_slot(map, i);
+        if (slot->fi != NULL){
+            fwd_info_del(slot->fi,(fwd_info_data_del)fwd_entry_del);
+        }
+    }
+    free(map->slots);
+    map->slots = NULL;
+}
+
+/* Returns the position of the entry with the key or the free position where
+ * it should be inserted */
+static inline uint32_t
+ttable_map_find(ttable_map_t *map, uint32_t *key, uint32_t hash)
+{
+    uint32_t i;
+    ttable_slot_t *slot;
+
+    i = hash & map->mask;
+    for (;;){
+        slot = map_slot(map, i);
+        if (slot->fi == NULL || (slot->hash == hash
+                && memcmp(slot->key, key, map->key_words * sizeof(uint32_t)) == 0)){
+            return (i);
+        }
+        i = (i + 1) & map->mask;
+    }
+}
+
+/* Advance the clock hand up to steps slots. Idle and invalid entries are
+ * removed and the reference of the used ones cleared. With evict, stop
+ * after removing one entry, and if none is removable remove the next one.
+ * Returns TRUE if an entry has been removed */
+static int
+ttable_map_clock(ttable_t *tt, ttable_map_t *map, int steps, uint8_t evict)
+{
+    ttable_slot_t *slot;
+    uint32_t i = map->hand;
+    int removed = FALSE;
+
+    while (steps > 0 || (evict && !removed)){
+        if (map->count == 0){
+            break;
+        }
+        slot = map_slot(map, i);
+        if (slot->fi != NULL){
+            if (slot_expired(tt, slot)){
+                /* The next entry could have been moved to this position */
+                ttable_map_del_pos(map, i);
+                tt->stats.expirations++;
+                removed = TRUE;
+                if (evict){
+                    break;
+                }
+                steps--;
+                continue;
+            }
+            if (evict && (!slot->ref || steps <= 0)){
+                ttable_map_del_pos(map, i);
+                tt->stats.evictions++;
+                removed = TRUE;
+                break;
+            }
+            slot->ref = FALSE;
+        }
+        i = (i + 1) & map->mask;
+        steps--;
+    }
+    map->hand = i;
+    return (removed);
+}
+
+/* Fill the packed key of the tuple. Returns the map of its AFI */
+static inline ttable_map_t *
+ttable_key(ttable_t *tt, packet_tuple_t *tpl, uint32_t *key)
+{
+    switch (pkt_tuple_pack(tpl, key)){
+    case PKT_TUPLE_KEY4_WORDS:
+        return (&tt->v4);
+    case PKT_TUPLE_KEY6_WORDS:
+        return (&tt->v6);
+    default:
+        return (NULL);
+    }
 }
 
 void
 ttable_init(ttable_t *tt)
 {
-    tt->htable =  kh_init(ttable);
-    list_init(&tt->head_list);
+    ttable_init_sized(tt, MAX_SIZE, IDLE_TIMEOUT);
 }
 
+/* Initialize a table for max_flows IPv4 flows and max_flows IPv6 flows,
+ * removing the flows without packets for idle_timeout seconds */
 void
-ttable_uninit(ttable_t *tt)
+ttable_init_sized(ttable_t *tt, uint32_t max_flows, uint32_t idle_timeout)
 {
-    khiter_t k;
-
-    for (k = kh_begin(tt->htable); k != kh_end(tt->htable); ++k){
-        if (kh_exist(tt->htable, k)){
-            ttable_node_del(kh_value(tt->htable,k));
-        }
+    if (max_flows == 0){
+        max_flows = 1;
     }
-    kh_destroy(ttable, tt->htable);
+    ttable_map_init(&tt->v4, PKT_TUPLE_KEY4_WORDS, max_flows);
+    ttable_map_init(&tt->v6, PKT_TUPLE_KEY6_WORDS, max_flows);
+    tt->now = time_now_ms();
+    tt->lookups = 0;
+    tt->idle_timeout = idle_timeout * 1000;
+    memset(&tt->stats, 0, sizeof(ttable_stats_t));
+}
+
+void
+ttable_uninit(ttable_t *tt)
+{
+    ttable_map_uninit(&tt->v4);
+    ttable_map_uninit(&tt->v6);
 }
 
 ttable_t *
@@ -103,118 +248,130 @@ ttable_destroy(ttable_t *tt)
     free(tt);
 }
 
-static int
-tnode_expired(ttable_node_t *tn)
+uint32_t
+ttable_size(ttable_t *tt)
+{
+    return (tt->v4.count + tt->v6.count);
+}
+
+uint32_t
+ttable_capacity(ttable_t *tt)
+{
+    return (tt->v4.max_count + tt->v6.max_count);
+}
+
+/* Add the counters of other to stats */
+void
+ttable_stats_add(ttable_stats_t *stats, ttable_stats_t *other)
 {
-    return(time_elapsed(&tn->ts) > TIMEOUT);
+    stats->inserts += other->inserts;
+    stats->evictions += other->evictions;
+    stats->expirations += other->expirations;
+    stats->invalidations += other->invalidations;
 }
 
+/* The key is copied into the table. The tuple remains owned by the caller.
+ * The tables use the hash calculated when the tuple was parsed */
 void
 ttable_insert(ttable_t *tt, packet_tuple_t *tpl, fwd_info_t *fi)
 {
-    khiter_t k;
-    int ret,i,removed,to_remove;
-    ttable_node_t *node;
-    struct ovs_list *list_elt;
-
-    /* If table is full, lookup and remove expired entries. If it is still
-     * full, remove old entries */
-    if (kh_size(tt->htable) >= MAX_SIZE) {
-        OOR_LOG(LDBG_1,"ttable_insert: Max size of forwarding table reached. Removing expired entries");
-        removed = 0;
-        for (k = kh_begin(tt->htable); k != kh_end(tt->htable); ++k){
-            if (!kh_exist(tt->htable, k)){
-                continue;
-            }
-            if (tnode_expired(kh_value(tt->htable,k))){
-                ttable_remove_with_khiter(tt,k);
-                removed++;
-            }
-        }
-        if (removed <  OLD_ENTRIES){
-            OOR_LOG(LDBG_1,"ttable_insert: Max size of forwarding table reached. Removing older entries");
-            to_remove = OLD_ENTRIES - removed;
-            for (i = 0 ; i < to_remove ; i++){
-                list_elt = list_back(&tt->head_list);
-                node = CONTAINER_OF(list_elt, ttable_node_t, list_elt);
-                ttable_remove(tt, node->tpl);
-            }
+    uint32_t key[PKT_TUPLE_KEY6_WORDS];
+    uint32_t hash, pos;
+    ttable_map_t *map;
+    ttable_slot_t *slot;
+
+    map = ttable_key(tt, tpl, key);
+    if (!map){
+        fwd_info_del(fi,(fwd_info_data_del)fwd_entry_del);
+        return;
+    }
+    hash = tpl->hash;
+    tt->now = time_now_ms();
+
+    pos = ttable_map_find(map, key, hash);
+    slot = map_slot(map, pos);
+    if (slot->fi != NULL){
+        /* Replace the forwarding info of the flow */
+        fwd_info_del(slot->fi,(fwd_info_data_del)fwd_entry_del);
+    }else{
+        /* Age some entries and, if the table is full, evict one */
+        ttable_map_clock(tt, map, AGE_STEPS, FALSE);
+        if (map->count >= map->max_count) {
+            ttable_map_clock(tt, map, EVICT_STEPS, TRUE);
         }
+        /* Removals can move the entries */
+        pos = ttable_map_find(map, key, hash);
+        slot = map_slot(map, pos);
+        memcpy(slot->key, key, map->key_words * sizeof(uint32_t));
+        slot->hash = hash;
+        /* Not referenced until it is used again, so flows of a single
+         * packet are the first evicted */
+        slot->ref = FALSE;
+        map->count++;
+        tt->stats.inserts++;
     }
-
-    node = xzalloc(sizeof(ttable_node_t));
-    node->fi = fi;
-    node->tpl = tpl;
-    clock_gettime(CLOCK_MONOTONIC, &node->ts);
-
-    list_init(&node->list_elt);
-    list_push_front(&tt->head_list, &node->list_elt);
-
-    k = kh_put(ttable,tt->htable,tpl,&ret);
-    kh_value(tt->htable, k) = node;
+    slot->fi = fi;
+    slot->ts = tt->now;
     OOR_LOG(LDBG_3,"ttable_insert: Inserted tupla: %s ", pkt_tuple_to_char(tpl));
 }
 
 void
 ttable_remove(ttable_t *tt, packet_tuple_t *tpl)
 {
-    khiter_t k;
-    ttable_node_t *tn;
+    uint32_t key[PKT_TUPLE_KEY6_WORDS];
+    uint32_t pos;
+    ttable_map_t *map;
 
-    k = kh_get(ttable,tt->htable, tpl);
-    if (k == kh_end(tt->htable)){
+    map = ttable_key(tt, tpl, key);
+    if (!map){
         return;
     }
-    tn = kh_value(tt->htable,k);
-    OOR_LOG(LDBG_3,"ttable_remove: Remove tupla: %s ", pkt_tuple_to_char(tn->tpl));
-    list_remove(&tn->list_elt);
-    ttable_node_del(tn);
-    kh_del(ttable,tt->htable,k);
-}
-
-static void
-ttable_remove_with_khiter(ttable_t *tt, khiter_t k)
-{
-    ttable_node_t *node;
-
-    node = kh_value(tt->htable,k);
-    OOR_LOG(LDBG_3,"ttable_remove_with_khiter: Remove tupla: %s ", pkt_tuple_to_char(node->tpl));
-    list_remove(&node->list_elt);
-    ttable_node_del(node);
-    kh_del(ttable,tt->htable,k);
+    pos = ttable_map_find(map, key, tpl->hash);
+    if (map_slot(map, pos)->fi == NULL){
+        return;
+    }
+    OOR_LOG(LDBG_3,"ttable_remove: Remove tupla: %s ", pkt_tuple_to_char(tpl));
+    ttable_map_del_pos(map, pos);
 }
 
 fwd_info_t *
 ttable_lookup(ttable_t *tt, packet_tuple_t *tpl)
 {
-    ttable_node_t *tn;
-    khiter_t k;
-    double elapsed;
-
-    k = kh_get(ttable,tt->htable, tpl);
-    if (k == kh_end(tt->htable)){
+    uint32_t key[PKT_TUPLE_KEY6_WORDS];
+    uint32_t pos;
+    ttable_map_t *map;
+    ttable_slot_t *slot;
+    uint32_t epoch;
+
+    map = ttable_key(tt, tpl, key);
+    if (!map){
         return (NULL);
     }
-    tn = kh_value(tt->htable,k);
-
-    elapsed = time_elapsed(&tn->ts);
-    if (!tn->fi->temporal){
-        if (elapsed > TIMEOUT){
-            goto expired;
-        }
-    }else{
-        if (elapsed > NEGATIVE_TIMEOUT){
-            goto expired;
-        }
+    if (++tt->lookups % CLOCK_LOOKUPS == 0){
+        tt->now = time_now_ms();
+    }
+    pos = ttable_map_find(map, key, tpl->hash);
+    slot = map_slot(map, pos);
+    if (slot->fi == NULL){
+        return (NULL);
     }
 
-    list_remove(&tn->list_elt);
-    list_push_front(&tt->head_list, &tn->list_elt);
-
-    return (tn->fi);
+    /* The state used to obtain the forwarding info has changed */
+    if (!fwd_gen_deps_current(&slot->fi->deps)){
+        ttable_map_del_pos(map, pos);
+        tt->stats.invalidations++;
+        return(NULL);
+    }
+    slot->ts = tt->now;
+    slot->ref = TRUE;
+    /* Let the control plane know the state is in use. The first packet after
+     * a reading of the usage adds the ones of the incomplete batch */
+    epoch = fwd_gen_use_epoch();
+    if (++slot->fi->pkts == FWD_USE_BATCH || slot->fi->use_epoch != epoch){
+        fwd_gen_deps_use(&slot->fi->deps, slot->fi->pkts);
+        slot->fi->pkts = 0;
+        slot->fi->use_epoch = epoch;
+    }
 
-expired:
-    ttable_remove_with_khiter(tt, k);
-    return(NULL);
+    return (slot->fi);
 }
-
@@ -20,34 +20,80 @@
 #ifndef TTABLE_H_
 #define TTABLE_H_
 
-#include <time.h>
 #include "packets.h"
-#include "../elibs/khash/khash.h"
-#include "../elibs/ovs/list.h"
 
 typedef struct fwd_info_ fwd_info_t;
 
-typedef struct ttable_node {
-    struct ovs_list list_elt;
-    packet_tuple_t *tpl;
+/*
+ * Slot of the flow table. The key packed with pkt_tuple_pack follows the
+ * header. A slot is free when fi is NULL
+ */
+typedef struct ttable_slot {
     fwd_info_t *fi;
-    struct timespec ts;
-} ttable_node_t;
+    uint32_t hash;
+    /* Last time the entry was used in ms, from the coarse clock */
+    uint32_t ts;
+    /* Used since the clock hand last passed */
+    uint8_t ref;
+    uint32_t key[0];
+} ttable_slot_t;
+
+/* Open addressing table with linear probing for the flows of one AFI. The
+ * slots are preallocated and the removals are done with backward shift
+ * so no tombstones are needed */
+typedef struct ttable_map {
+    uint8_t *slots;
+    uint32_t mask;
+    uint32_t count;
+    uint32_t max_count;
+    /* Clock hand used to age and evict entries */
+    uint32_t hand;
+    int key_words;
+    size_t slot_size;
+} ttable_map_t;
 
-KHASH_INIT(ttable, packet_tuple_t *, ttable_node_t *, 1, pkt_tuple_hash, pkt_tuple_cmp)
+typedef struct ttable_stats {
+    /* Flows added to the table */
+    uint64_t inserts;
+    /* Flows removed to make room for new ones */
+    uint64_t evictions;
+    /* Idle flows removed */
+    uint64_t expirations;
+    /* Flows removed because the state used to forward them changed */
+    uint64_t invalidations;
+} ttable_stats_t;
 
+/*
+ * The forwarding info of a flow remains in the table while the state it
+ * depends on doesn't change (see fwd_gen.h). The time is only used to
+ * evict the idle flows, from a coarse clock updated every some lookups.
+ *
+ * Flows are aged and evicted incrementally with a CLOCK algorithm. Each
+ * insertion advances the hand a few slots removing idle and invalid flows
+ * and, when the table is full, until a flow not used since the hand last
+ * passed is found. The work per insertion is bounded.
+ */
 typedef struct ttable {
-    khash_t(ttable) *htable;
-    struct ovs_list head_list; /* To order flows */
+    ttable_map_t v4;
+    ttable_map_t v6;
+    uint32_t now;
+    uint32_t lookups;
+    /* Time without packets after which a flow can be removed (ms) */
+    uint32_t idle_timeout;
+    ttable_stats_t stats;
 } ttable_t;
 
 void ttable_init(ttable_t *tt);
+void ttable_init_sized(ttable_t *tt, uint32_t max_flows, uint32_t idle_timeout);
 void ttable_uninit(ttable_t *tt);
 ttable_t *ttable_create();
 void ttable_destroy(ttable_t *tt);
 void ttable_insert(ttable_t *, packet_tuple_t *tpl, fwd_info_t *fe);
 void ttable_remove(ttable_t *tt, packet_tuple_t *tpl);
 fwd_info_t *ttable_lookup(ttable_t *tt, packet_tuple_t *tpl);
+uint32_t ttable_size(ttable_t *tt);
+uint32_t ttable_capacity(ttable_t *tt);
+void ttable_stats_add(ttable_stats_t *stats, ttable_stats_t *other);
 
 
 #endif /* TTABLE_H_ */
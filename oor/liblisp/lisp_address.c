@@ -202,6 +202,19 @@ lisp_addr_size_to_write(lisp_addr_t *laddr)
     return (0);
 }
 
+/* Heap memory used by an address allocated with lisp_addr_new. The memory
+ * of the LCAFs is approximated by their size in a message */
+size_t
+lisp_addr_mem_size(lisp_addr_t *laddr)
+{
+    size_t size = sizeof(lisp_addr_t);
+
+    if (lisp_addr_is_lcaf(laddr)){
+        size += lisp_addr_size_to_write(laddr);
+    }
+    return (size);
+}
+
 inline uint16_t
 lisp_addr_get_plen(lisp_addr_t *laddr)
 {
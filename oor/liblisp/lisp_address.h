@@ -72,6 +72,7 @@ int lisp_addr_parse(uint8_t *offset, lisp_addr_t *laddr);
 int lisp_addr_cmp(lisp_addr_t *addr1, lisp_addr_t *addr2);
 int lisp_addr_cmp_afi(lisp_addr_t *addr1, lisp_addr_t *addr2);
 uint32_t lisp_addr_size_to_write(lisp_addr_t *laddr);
+size_t lisp_addr_mem_size(lisp_addr_t *laddr);
 char *lisp_addr_to_char(lisp_addr_t *addr);
 
 void lisp_addr_set_lafi(lisp_addr_t *addr, lm_afi_t afi);
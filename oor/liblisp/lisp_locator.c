@@ -26,7 +26,11 @@
 locator_t *
 locator_new()
 {
-    return (xzalloc(sizeof(locator_t)));
+    locator_t *locator;
+
+    locator = xzalloc(sizeof(locator_t));
+    locator->addr = &locator->addr_buf;
+    return (locator);
 }
 
 locator_t *
@@ -39,7 +43,7 @@ locator_new_init(lisp_addr_t* addr,uint8_t state,uint8_t L_bit,uint8_t R_bit,
     if (locator == NULL){
         return (NULL);
     }
-    locator->addr = lisp_addr_clone(addr);
+    lisp_addr_copy(locator->addr, addr);
     locator->state = state;
     locator->L_bit = L_bit;
     locator->R_bit = R_bit;
@@ -81,10 +85,6 @@ int locator_parse(void *ptr, locator_t *loc)
     if (!LOC_REACHABLE(hdr) && LOC_LOCAL(hdr)) {
         status = DOWN;
     }
-    if (!loc->addr) {
-        loc->addr = lisp_addr_new();
-    }
-
     len = lisp_addr_parse(LOC_ADDR(hdr), loc->addr);
     if (len <= 0) {
         return (BAD);
@@ -126,7 +126,11 @@ locator_del(locator_t *locator)
         return;
     }
 
-    lisp_addr_del(locator->addr);
+    if (locator->addr == &locator->addr_buf){
+        lisp_addr_dealloc(locator->addr);
+    }else{
+        lisp_addr_del(locator->addr);
+    }
     free(locator);
     locator = NULL;
 }
@@ -31,7 +31,10 @@
 #define MAX_WEIGHT 255
 
 typedef struct locator {
+    /* Points to addr_buf: the address is allocated with the locator. Only
+     * the data of the LCAF addresses is allocated apart */
     lisp_addr_t *addr;
+    lisp_addr_t addr_buf;
     /* UP , DOWN */
     uint8_t state;
     uint8_t L_bit;
@@ -125,9 +128,6 @@ static inline void locator_set_addr(locator_t *loc, lisp_addr_t *addr)
 
 static inline void locator_clone_addr(locator_t *loc, lisp_addr_t *addr)
 {
-    if (!loc->addr) {
-        loc->addr = lisp_addr_new();
-    }
     lisp_addr_copy(loc->addr, addr);
 }
 
@@ -29,13 +29,9 @@ mapping_new()
 
         return (NULL);
     }
-    mapping->locators_lists = glist_new_complete(
+    glist_init_complete(mapping_locators_lists(mapping),
             (glist_cmp_fct) locator_list_cmp_afi,
             (glist_del_fct) glist_destroy);
-    if (mapping->locators_lists == NULL){
-        free(mapping);
-        return (NULL);
-    }
     return(mapping);
 }
 
@@ -73,7 +69,7 @@ void mapping_del(mapping_t *m)
     }
 
     /* Free the locators list*/
-    glist_destroy(m->locators_lists);
+    glist_remove_all(mapping_locators_lists(m));
 
     /*  MUST free lcaf addr */
     lisp_addr_dealloc(mapping_eid(m));
@@ -101,12 +97,12 @@ mapping_cmp(mapping_t *m1, mapping_t *m2)
     if (m1->locator_count != m2->locator_count) {
         return (1);
     }
-    if (glist_size(m1->locators_lists) != glist_size(m2->locators_lists)){
+    if (glist_size(mapping_locators_lists(m1)) != glist_size(mapping_locators_lists(m2))){
         return (1);
     }
 
-    it_list2 = glist_first(m2->locators_lists);
-    glist_for_each_entry(it_list1,m1->locators_lists){
+    it_list2 = glist_first(mapping_locators_lists(m2));
+    glist_for_each_entry(it_list1,mapping_locators_lists(m1)){
         loct_list1 = (glist_t *)glist_entry_data(it_list1);
         loct_list2 = (glist_t *)glist_entry_data(it_list2);
         if (glist_size(loct_list1) != glist_size(loct_list2)){
@@ -168,6 +164,30 @@ mapping_to_char(mapping_t *m)
     return(buf);
 }
 
+/* Heap memory used by the mapping, its locators and their lists */
+size_t
+mapping_mem_size(mapping_t *m)
+{
+    glist_t *loct_list;
+    glist_entry_t *it_list, *it_loct;
+    locator_t *loct;
+    size_t size;
+
+    /* The EID, the list of locator lists and the addresses of the locators
+     * are part of the mapping and the locators */
+    size = sizeof(mapping_t) + lisp_addr_mem_size(mapping_eid(m)) - sizeof(lisp_addr_t);
+    glist_for_each_entry(it_list, mapping_locators_lists(m)){
+        loct_list = (glist_t *)glist_entry_data(it_list);
+        size += sizeof(glist_entry_t) + sizeof(glist_t);
+        glist_for_each_entry(it_loct, loct_list){
+            loct = (locator_t *)glist_entry_data(it_loct);
+            size += sizeof(glist_entry_t) + sizeof(locator_t)
+                    + lisp_addr_mem_size(locator_addr(loct)) - sizeof(lisp_addr_t);
+        }
+    }
+    return (size);
+}
+
 int
 mapping_add_locator(
 		mapping_t *mapping,
@@ -189,7 +209,7 @@ mapping_add_locator(
 				(glist_del_fct)locator_del);
 		// The locator is added firstly in order the list has an associated afi
 		if ((result = glist_add(loct,loct_list)) == GOOD){
-			result = glist_add(loct_list,mapping->locators_lists);
+			result = glist_add(loct_list,mapping_locators_lists(mapping));
 		}
 
 	}else {
@@ -221,7 +241,7 @@ mapping_add_locator(
 		result = GOOD;
 	} else {
 		if (glist_size(loct_list) == 0){
-			glist_remove_obj_with_ptr(loct_list,mapping->locators_lists);
+			glist_remove_obj_with_ptr(loct_list,mapping_locators_lists(mapping));
 		}
 		result = BAD;
 	}
@@ -253,7 +273,7 @@ mapping_remove_locator(
     }
 
     if (glist_size(loct_list) == 0){
-        glist_remove_obj_with_ptr(loct_list, mapping->locators_lists);
+        glist_remove_obj_with_ptr(loct_list, mapping_locators_lists(mapping));
     }
 
     if (!lisp_addr_is_no_addr(addr)){
@@ -274,7 +294,7 @@ mapping_remove_locator(
 void
 mapping_remove_locators(mapping_t *mapping)
 {
-    glist_remove_all(mapping->locators_lists);
+    glist_remove_all(mapping_locators_lists(mapping));
     mapping->locator_count = 0;
 }
 
@@ -294,12 +314,12 @@ mapping_update_locators(mapping_t *mapping, glist_t *locts_lists)
     }
 
     /* TODO: do a comparison first */
-    glist_remove_all(mapping->locators_lists);
+    glist_remove_all(mapping_locators_lists(mapping));
 
     glist_for_each_entry(it_list,locts_lists){
         loct_list = (glist_t *)glist_entry_data(it_list);
         new_loct_list = locator_list_clone(loct_list);
-        glist_add(new_loct_list,mapping->locators_lists);
+        glist_add(new_loct_list,mapping_locators_lists(mapping));
         locator = (locator_t*)glist_first_data(new_loct_list);
         if (lisp_addr_is_no_addr(locator_addr(locator)) == FALSE){
             loct_ctr = loct_ctr + glist_size(new_loct_list);
@@ -336,7 +356,7 @@ mapping_get_loct_lst_with_afi(
     locator_t *loct = NULL;
     lisp_addr_t *addr = NULL;
 
-    glist_for_each_entry(it, mapping->locators_lists){
+    glist_for_each_entry(it, mapping_locators_lists(mapping)){
         loct_list = (glist_t *)glist_entry_data(it);
         loct = (locator_t *)glist_first_data(loct_list);
         addr = locator_addr(loct);
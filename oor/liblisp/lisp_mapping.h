@@ -36,7 +36,8 @@ typedef struct mapping {
     lisp_addr_t                     eid_prefix;
     uint16_t                        locator_count;
 
-    glist_t                         *locators_lists; //<glist_t *>
+    /* Part of the mapping, not allocated apart */
+    glist_t                         locators_lists; //<glist_t *>
 
     uint32_t                        ttl;
     uint8_t                         action;
@@ -51,6 +52,7 @@ void mapping_del(mapping_t *);
 int mapping_cmp(mapping_t *, mapping_t *);
 mapping_t *mapping_clone(mapping_t *);
 char *mapping_to_char(mapping_t *m);
+size_t mapping_mem_size(mapping_t *m);
 
 int mapping_add_locator(mapping_t *, locator_t *);
 /* This function extract the locator from the list of locators of the mapping */
@@ -96,7 +98,7 @@ static inline void mapping_set_iid(mapping_t *m, uint32_t iid)
 
 static inline glist_t *mapping_locators_lists(mapping_t *m)
 {
-    return (m->locators_lists);
+    return (&m->locators_lists);
 }
 
 static inline uint16_t mapping_locator_count(mapping_t *m)
@@ -142,7 +144,7 @@ static inline void mapping_set_auth(mapping_t *m, uint8_t a)
             glist_entry_t *_it_list_; \
             glist_entry_t *_it_loct_; \
             \
-            glist_for_each_entry(_it_list_,_map->locators_lists){ \
+            glist_for_each_entry(_it_list_,mapping_locators_lists(_map)){ \
                 _loct_list_ = (glist_t *)glist_entry_data(_it_list_); \
                 if (glist_size(_loct_list_) == 0){ \
                     continue; \
@@ -166,7 +168,7 @@ static inline void mapping_set_auth(mapping_t *m, uint8_t a)
             glist_entry_t *_it_loct_; \
             locator_t *_locator_; \
             \
-            glist_for_each_entry(_it_list_,_map->locators_lists){ \
+            glist_for_each_entry(_it_list_,mapping_locators_lists(_map)){ \
                 _loct_list_ = (glist_t *)glist_entry_data(_it_list_); \
                 if (glist_size(_loct_list_) == 0){ \
                     continue; \
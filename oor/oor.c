@@ -496,13 +496,13 @@ main(int argc, char **argv)
     oor_api_init_server(&oor_api_connection);
 
     for (;;) {
-        sockmstr_wait_on_all_read(smaster);
         sockmstr_process_all(smaster);
+        sockmstr_lock(smaster);
         oor_api_loop(&oor_api_connection);
+        sockmstr_unlock(smaster);
     }
 #else
     for (;;) {
-        sockmstr_wait_on_all_read(smaster);
         sockmstr_process_all(smaster);
     }
 #endif
@@ -582,7 +582,6 @@ JNIEXPORT void JNICALL Java_org_openoverlayrouter_noroot_OOR_1JNI_oor_1loop(JNIE
 
     /* EVENT LOOP */
     while (oor_running) {
-        sockmstr_wait_on_all_read(smaster);
         sockmstr_process_all(smaster);
     }
     /* event_loop returned: bad! */
@@ -0,0 +1,278 @@
+/*
+ * Stress test of the prefixes published to the data plane threads
+ * (oor/lib/fwd_pub.c) and of the reclamation of their memory
+ * (oor/lib/epoch.c).
+ *
+ * Several reader threads look up random flows without locking, as the
+ * workers of the data plane do, while the main thread plays the control
+ * plane: it publishes and replaces prefixes of two lengths, invalidates them
+ * bumping their generations and flushes the table. The readers check that
+ * the state they get belongs to a prefix of the flow. Build it with
+ * SANITIZE=address or SANITIZE=thread to detect accesses to freed entries.
+ *
+ * Usage: fwd_pub_stress [threads] [seconds]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "../oor/lib/epoch.h"
+#include "../oor/lib/fwd_pub.h"
+#include "../oor/lib/mem_util.h"
+
+#define DEF_THREADS     4
+#define DEF_SECONDS     5
+/* Destinations 10.X.Y.0/24, covered by 10.X.0.0/16 */
+#define PREF_X          16
+#define PREF_Y          32
+#define FLOWS           4096
+/* Lookups between quiescent states, like a batch of packets */
+#define BATCH           32
+/* Small enough to be purged and flushed while churning */
+#define MAX_PREFIXES    256
+
+/* Needed by the oor objects */
+int daemonize = 0;
+int debug_level = 0;
+
+/* The fwd_policy module is not linked */
+fwd_info_t *
+fwd_info_new()
+{
+    fwd_info_t *fi = xzalloc(sizeof(fwd_info_t));
+    fi->refs = 1;
+    return (fi);
+}
+
+fwd_prefix_t *
+fwd_prefix_new()
+{
+    return (xzalloc(sizeof(fwd_prefix_t)));
+}
+
+typedef struct reader {
+    pthread_t thread;
+    int id;
+    unsigned int seed;
+    packet_tuple_t *flows;
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t errors;
+} reader_t;
+
+static fwd_pub_t pub;
+static epoch_t ep;
+static int running = 1;
+/* Generation counter of each prefix */
+static uint32_t gen_idx[PREF_X][PREF_Y + 1];
+
+/* The IID of the published prefixes identifies them */
+static uint32_t
+pref_id(int plen, int x, int y)
+{
+    return ((plen << 16) | (x << 8) | (plen == 24 ? y : 0));
+}
+
+static void
+check(reader_t *r, packet_tuple_t *tpl, fwd_info_t *fi)
+{
+    uint8_t *dst = (uint8_t *)&lisp_addr_ip(&tpl->dst_addr)->addr.v4;
+    fwd_prefix_t *p = fi->prefix;
+    int plen = p->iid >> 16;
+
+    if ((plen != 16 && plen != 24) || ((p->iid >> 8) & 0xff) != dst[1]
+            || (plen == 24 && (p->iid & 0xff) != dst[2])
+            || lisp_addr_ip_get_plen(&p->dst_pref) != plen
+            || p->dst_locs_num != 1 || fi->deps.num != 1){
+        r->errors++;
+    }
+}
+
+static void *
+reader_run(void *arg)
+{
+    reader_t *r = arg;
+    packet_tuple_t *tpl;
+    fwd_info_t *fi;
+    unsigned int seed = r->seed;
+    int i;
+
+    r->id = epoch_register(&ep);
+    if (r->id < 0){
+        return (NULL);
+    }
+    while (__atomic_load_n(&running, __ATOMIC_RELAXED)){
+        for (i = 0; i < BATCH; i++){
+            tpl = &r->flows[rand_r(&seed) % FLOWS];
+            fi = fwd_pub_lookup(&pub, tpl);
+            r->lookups++;
+            if (fi){
+                r->hits++;
+                check(r, tpl, fi);
+                free(fi->prefix);
+                free(fi);
+            }
+        }
+        epoch_quiescent(&ep, r->id);
+        /* Sometimes, like a worker waiting for packets */
+        if ((r->lookups & 0xffff) == 0){
+            epoch_offline(&ep, r->id);
+            usleep(100);
+            epoch_online(&ep, r->id);
+        }
+    }
+    epoch_unregister(&ep, r->id);
+
+    return (NULL);
+}
+
+static packet_tuple_t *
+flows_new()
+{
+    packet_tuple_t *flows;
+    uint32_t src, dst;
+    int i;
+
+    flows = xzalloc(FLOWS * sizeof(packet_tuple_t));
+    for (i = 0; i < FLOWS; i++){
+        src = htonl(0xc0a80000 | (random() & 0xffff));
+        dst = htonl(0x0a000000 | (random() % PREF_X) << 16
+                | (random() % PREF_Y) << 8 | (random() & 0xff));
+        lisp_addr_ip_init(&flows[i].src_addr, &src, AF_INET);
+        lisp_addr_ip_init(&flows[i].dst_addr, &dst, AF_INET);
+        flows[i].hash = pkt_tuple_hash(&flows[i]);
+    }
+    return (flows);
+}
+
+static void
+flows_del(packet_tuple_t *flows)
+{
+    int i;
+
+    for (i = 0; i < FLOWS; i++){
+        lisp_addr_dealloc(&flows[i].src_addr);
+        lisp_addr_dealloc(&flows[i].dst_addr);
+    }
+    free(flows);
+}
+
+/* Publish the state of 10.x.y.0/24 or of 10.x.0.0/16 if y is PREF_Y */
+static void
+publish(int x, int y)
+{
+    fwd_info_t fi;
+    fwd_prefix_t prefix;
+    uint32_t src = htonl(0xc0a80000), dst = htonl(0x0a000000 | x << 16 | y << 8);
+    uint32_t rloc = htonl(0xac100001);
+    int plen = y == PREF_Y ? 16 : 24;
+
+    if (y == PREF_Y){
+        dst = htonl(0x0a000000 | x << 16);
+    }
+    memset(&fi, 0, sizeof(fi));
+    memset(&prefix, 0, sizeof(prefix));
+    lisp_addr_ip_init(&prefix.src_pref, &src, AF_INET);
+    lisp_addr_ip_to_ippref(&prefix.src_pref);
+    lisp_addr_set_plen(&prefix.src_pref, 16);
+    lisp_addr_ip_init(&prefix.dst_pref, &dst, AF_INET);
+    lisp_addr_ip_to_ippref(&prefix.dst_pref);
+    lisp_addr_set_plen(&prefix.dst_pref, plen);
+    prefix.iid = pref_id(plen, x, y);
+    lisp_addr_ip_init(&prefix.src_locs[0], &rloc, AF_INET);
+    lisp_addr_ip_init(&prefix.dst_locs[0], &rloc, AF_INET);
+    prefix.src_locs_num = 1;
+    prefix.dst_locs_num = 1;
+    prefix.src_vec_len = 1;
+    prefix.dst_v4_vec_len = 1;
+    fi.prefix = &prefix;
+    fwd_gen_deps_add(&fi.deps, gen_idx[x][y]);
+    fwd_pub_insert(&pub, &fi);
+}
+
+int
+main(int argc, char **argv)
+{
+    reader_t *readers;
+    time_t end;
+    uint64_t ops = 0, lookups = 0, hits = 0, errors = 0;
+    int threads = DEF_THREADS, seconds = DEF_SECONDS;
+    int i, x, y;
+
+    if (argc > 1){
+        threads = atoi(argv[1]);
+    }
+    if (argc > 2){
+        seconds = atoi(argv[2]);
+    }
+    if (threads < 1 || threads > EPOCH_MAX_THREADS){
+        fprintf(stderr, "Between 1 and %d threads\n", EPOCH_MAX_THREADS);
+        return (1);
+    }
+    srandom(1);
+
+    epoch_init(&ep);
+    fwd_pub_init(&pub, MAX_PREFIXES, &ep);
+    for (x = 0; x < PREF_X; x++){
+        for (y = 0; y <= PREF_Y; y++){
+            gen_idx[x][y] = fwd_gen_new_idx();
+        }
+    }
+
+    readers = xzalloc(threads * sizeof(reader_t));
+    for (i = 0; i < threads; i++){
+        readers[i].flows = flows_new();
+        readers[i].seed = i + 1;
+        pthread_create(&readers[i].thread, NULL, reader_run, &readers[i]);
+    }
+
+    end = time(NULL) + seconds;
+    while (time(NULL) < end){
+        x = random() % PREF_X;
+        y = random() % (PREF_Y + 1);
+        switch (random() % 16){
+        case 0:
+            fwd_gen_bump(gen_idx[x][y]);
+            break;
+        case 1:
+            if (random() % 64 == 0){
+                fwd_pub_flush(&pub);
+            }
+            break;
+        default:
+            publish(x, y);
+            break;
+        }
+        ops++;
+    }
+
+    __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+    for (i = 0; i < threads; i++){
+        pthread_join(readers[i].thread, NULL);
+        lookups += readers[i].lookups;
+        hits += readers[i].hits;
+        errors += readers[i].errors;
+        flows_del(readers[i].flows);
+    }
+    free(readers);
+
+    printf("%d readers, %d s: %llu lookups (%.1f M/s), %.1f%% found, "
+            "%llu wrong\n", threads, seconds, (unsigned long long)lookups,
+            lookups / 1e6 / seconds, lookups ? 100.0 * hits / lookups : 0,
+            (unsigned long long)errors);
+    printf("Control plane: %llu changes, %llu prefixes published, %llu "
+            "invalidated, %llu flushes, %u retired not freed\n",
+            (unsigned long long)ops, (unsigned long long)pub.stats.inserts,
+            (unsigned long long)pub.stats.invalidations,
+            (unsigned long long)pub.stats.flushes, epoch_pending(&ep));
+
+    fwd_pub_uninit(&pub);
+    epoch_uninit(&ep);
+
+    return (errors != 0);
+}
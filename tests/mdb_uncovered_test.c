@@ -0,0 +1,97 @@
+/*
+ * Test of the length of the negative prefixes of the mappings database
+ * (mdb_uncovered_plen of oor/lib/mapping_db.c), used by the Map Server to
+ * answer the Map-Requests of EIDs without a registered site.
+ *
+ * Checks an empty database, databases whose only node is 0/0, with and
+ * without an entry, and a database with a few prefixes.
+ *
+ * Usage: mdb_uncovered_test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../oor/lib/mapping_db.h"
+
+/* Needed by the oor objects */
+int daemonize = 0;
+int debug_level = 0;
+
+static int errors = 0;
+
+static void
+check(mdb_t *db, char *eid, int expected, char *desc)
+{
+    lisp_addr_t *addr;
+    int plen;
+
+    addr = lisp_addr_new();
+    if (lisp_addr_ip_from_char(eid, addr) != GOOD){
+        printf("%s: wrong address %s\n", desc, eid);
+        errors++;
+        lisp_addr_del(addr);
+        return;
+    }
+    plen = mdb_uncovered_plen(db, addr);
+    if (plen != expected){
+        printf("%s: %s -> /%d, expected /%d\n", desc, eid, plen, expected);
+        errors++;
+    }
+    lisp_addr_del(addr);
+}
+
+static void
+add(mdb_t *db, char *pref, void *data)
+{
+    lisp_addr_t *addr;
+
+    addr = lisp_addr_new();
+    lisp_addr_ippref_from_char(pref, addr);
+    mdb_add_entry(db, addr, data);
+    lisp_addr_del(addr);
+}
+
+int
+main(int argc, char **argv)
+{
+    mdb_t *db;
+    int data = 0;
+
+    db = mdb_new(MDB_LPM_PATRICIA);
+    check(db, "10.1.1.1", 0, "Empty db");
+    check(db, "2001:db8::1", 0, "Empty db");
+    mdb_del(db, NULL);
+
+    /* Same as the 0/0 node holding the multicast tries */
+    db = mdb_new(MDB_LPM_PATRICIA);
+    add(db, "0.0.0.0/0", NULL);
+    add(db, "::/0", NULL);
+    check(db, "10.1.1.1", 0, "0/0 without data");
+    check(db, "2001:db8::1", 0, "0/0 without data");
+    mdb_del(db, NULL);
+
+    /* 0/0 is not inside any longer prefix */
+    db = mdb_new(MDB_LPM_PATRICIA);
+    add(db, "0.0.0.0/0", &data);
+    check(db, "10.1.1.1", 1, "0/0 entry");
+    mdb_del(db, NULL);
+
+    db = mdb_new(MDB_LPM_PATRICIA);
+    add(db, "0.0.0.0/0", NULL);
+    add(db, "10.0.0.0/8", &data);
+    add(db, "10.2.0.0/16", &data);
+    check(db, "192.168.1.1", 1, "Prefixes");
+    check(db, "11.0.0.1", 8, "Prefixes");
+    check(db, "10.1.0.1", 15, "Prefixes");
+    check(db, "10.2.0.1", 17, "Prefixes");
+    mdb_del(db, NULL);
+
+    if (errors){
+        printf("FAILED: %d errors\n", errors);
+        return (1);
+    }
+    printf("OK\n");
+
+    return (0);
+}
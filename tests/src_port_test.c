@@ -0,0 +1,87 @@
+/*
+ * Test of the selection of the outer UDP source port of the encapsulated
+ * flows (pkt_tuple_src_port), used by the normal and the segmented (GSO)
+ * output paths of the tun data plane.
+ *
+ * Checks that the port of a flow is always the same and inside the range,
+ * and that different flows get different ports.
+ *
+ * Usage: src_port_test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "../oor/lib/packets.h"
+
+#define NFLOWS      1000
+#define PORT_MIN    49152
+#define PORT_MAX    65535
+
+/* Needed by the oor objects */
+int daemonize = 0;
+int debug_level = 0;
+
+static void
+flow_init(packet_tuple_t *tpl, int i)
+{
+    uint32_t src, dst;
+
+    src = htonl(0x0a000001);
+    dst = htonl(0xc0a80000 | (i >> 8));
+    memset(tpl, 0, sizeof(packet_tuple_t));
+    lisp_addr_ip_init(&tpl->src_addr, &src, AF_INET);
+    lisp_addr_ip_init(&tpl->dst_addr, &dst, AF_INET);
+    tpl->src_port = 32768 + (i & 0xff);
+    tpl->dst_port = 80;
+    tpl->protocol = IPPROTO_TCP;
+    tpl->iid = 0;
+    tpl->hash = pkt_tuple_hash(tpl);
+}
+
+int
+main(int argc, char **argv)
+{
+    static uint8_t used[PORT_MAX + 1];
+    packet_tuple_t tpl;
+    uint16_t port;
+    int i, nports = 0, errors = 0;
+
+    for (i = 0; i < NFLOWS; i++){
+        flow_init(&tpl, i);
+        port = pkt_tuple_src_port(&tpl, PORT_MIN, PORT_MAX);
+        if (port < PORT_MIN){
+            printf("Flow %d: port %d out of range\n", i, port);
+            errors++;
+        }
+        flow_init(&tpl, i);
+        if (pkt_tuple_src_port(&tpl, PORT_MIN, PORT_MAX) != port){
+            printf("Flow %d: port changed\n", i);
+            errors++;
+        }
+        if (pkt_tuple_src_port(&tpl, PORT_MIN, PORT_MIN) != PORT_MIN){
+            printf("Flow %d: port not fixed with a range of one port\n", i);
+            errors++;
+        }
+        if (!used[port]){
+            used[port] = 1;
+            nports++;
+        }
+    }
+
+    /* Most of the flows must get a different port */
+    if (nports < NFLOWS * 9 / 10){
+        printf("Only %d different ports for %d flows\n", nports, NFLOWS);
+        errors++;
+    }
+
+    if (errors){
+        printf("FAILED: %d errors\n", errors);
+        return (1);
+    }
+    printf("OK: %d flows, %d different ports\n", NFLOWS, nports);
+
+    return (0);
+}
@@ -0,0 +1,235 @@
+/*
+ * Microbenchmark of the lookups in the flow table of the data plane (ttable).
+ *
+ * Compares the open addressing table of oor/lib/ttable.c with the khash
+ * table it replaced, which is kept below. Both tables are filled with the
+ * same random IPv4 flows and looked up in random order.
+ *
+ * Usage: ttable_bench [lookups]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "../oor/lib/ttable.h"
+#include "../oor/lib/mem_util.h"
+#include "../oor/fwd_policies/fwd_policy.h"
+#include "../oor/elibs/khash/khash.h"
+#include "../oor/elibs/ovs/list.h"
+
+#define DEF_LOOKUPS     1000000
+
+/* Needed by the oor objects */
+int daemonize = 0;
+int debug_level = 0;
+
+/* The forwarding info of the benchmark has no data */
+void
+fwd_info_del(fwd_info_t *fi, fwd_info_data_del del_fn)
+{
+    free(fi);
+}
+
+void
+fwd_entry_del(fwd_entry_t *fe)
+{
+}
+
+
+/* Previous ttable: khash of packet_tuple_t * with a LRU list */
+
+typedef struct old_ttable_node {
+    struct ovs_list list_elt;
+    packet_tuple_t *tpl;
+    fwd_info_t *fi;
+    struct timespec ts;
+} old_ttable_node_t;
+
+KHASH_INIT(old_ttable, packet_tuple_t *, old_ttable_node_t *, 1, pkt_tuple_hash, pkt_tuple_cmp)
+
+typedef struct old_ttable {
+    khash_t(old_ttable) *htable;
+    struct ovs_list head_list;
+} old_ttable_t;
+
+static double
+time_elapsed(struct timespec *time_node)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((double)(now.tv_sec - time_node->tv_sec)
+            + 1.0e-9 * (now.tv_nsec - time_node->tv_nsec));
+}
+
+static void
+old_ttable_init(old_ttable_t *tt)
+{
+    tt->htable = kh_init(old_ttable);
+    list_init(&tt->head_list);
+}
+
+static void
+old_ttable_uninit(old_ttable_t *tt)
+{
+    khiter_t k;
+    old_ttable_node_t *tn;
+
+    for (k = kh_begin(tt->htable); k != kh_end(tt->htable); ++k){
+        if (kh_exist(tt->htable, k)){
+            tn = kh_value(tt->htable,k);
+            pkt_tuple_del(tn->tpl);
+            free(tn->fi);
+            free(tn);
+        }
+    }
+    kh_destroy(old_ttable, tt->htable);
+}
+
+static void
+old_ttable_insert(old_ttable_t *tt, packet_tuple_t *tpl, fwd_info_t *fi)
+{
+    khiter_t k;
+    int ret;
+    old_ttable_node_t *node;
+
+    node = xzalloc(sizeof(old_ttable_node_t));
+    node->fi = fi;
+    node->tpl = tpl;
+    clock_gettime(CLOCK_MONOTONIC, &node->ts);
+
+    list_init(&node->list_elt);
+    list_push_front(&tt->head_list, &node->list_elt);
+
+    k = kh_put(old_ttable,tt->htable,tpl,&ret);
+    kh_value(tt->htable, k) = node;
+}
+
+static fwd_info_t *
+old_ttable_lookup(old_ttable_t *tt, packet_tuple_t *tpl)
+{
+    old_ttable_node_t *tn;
+    khiter_t k;
+
+    k = kh_get(old_ttable,tt->htable, tpl);
+    if (k == kh_end(tt->htable)){
+        return (NULL);
+    }
+    tn = kh_value(tt->htable,k);
+    /* Same checks than the previous table, the entries don't expire here */
+    if (time_elapsed(&tn->ts) > 3600){
+        return (NULL);
+    }
+    list_remove(&tn->list_elt);
+    list_push_front(&tt->head_list, &tn->list_elt);
+
+    return (tn->fi);
+}
+
+
+static double
+now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double)ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+static packet_tuple_t *
+flows_new(int nflows)
+{
+    packet_tuple_t *flows;
+    uint32_t src, dst;
+    int i;
+
+    flows = xzalloc(nflows * sizeof(packet_tuple_t));
+    for (i = 0; i < nflows; i++){
+        src = htonl(0x0a000000 | (random() & 0xffffff));
+        dst = htonl(0xc0a80000 | (i & 0xffff));
+        lisp_addr_ip_init(&flows[i].src_addr, &src, AF_INET);
+        lisp_addr_ip_init(&flows[i].dst_addr, &dst, AF_INET);
+        flows[i].src_port = 1024 + (i >> 16);
+        flows[i].dst_port = random() & 0xffff;
+        flows[i].protocol = IPPROTO_UDP;
+        flows[i].iid = 0;
+        flows[i].hash = pkt_tuple_hash(&flows[i]);
+    }
+    return (flows);
+}
+
+static void
+bench(int nflows, int nlookups)
+{
+    packet_tuple_t *flows;
+    uint32_t *order;
+    ttable_t tt;
+    old_ttable_t ott;
+    double start, new_ns, old_ns;
+    int i, hits;
+
+    flows = flows_new(nflows);
+    order = xmalloc(nlookups * sizeof(uint32_t));
+    for (i = 0; i < nlookups; i++){
+        order[i] = random() % nflows;
+    }
+
+    /* Each table is measured just after filling it */
+    old_ttable_init(&ott);
+    for (i = 0; i < nflows; i++){
+        old_ttable_insert(&ott, pkt_tuple_clone(&flows[i]), xzalloc(sizeof(fwd_info_t)));
+    }
+    hits = 0;
+    start = now_ns();
+    for (i = 0; i < nlookups; i++){
+        hits += old_ttable_lookup(&ott, &flows[order[i]]) != NULL;
+    }
+    old_ns = (now_ns() - start) / nlookups;
+    if (hits != nlookups){
+        printf("khash ttable: %d of %d lookups failed\n", nlookups - hits, nlookups);
+    }
+    old_ttable_uninit(&ott);
+
+    ttable_init_sized(&tt, nflows, 60);
+    for (i = 0; i < nflows; i++){
+        ttable_insert(&tt, &flows[i], xzalloc(sizeof(fwd_info_t)));
+    }
+    hits = 0;
+    start = now_ns();
+    for (i = 0; i < nlookups; i++){
+        hits += ttable_lookup(&tt, &flows[order[i]]) != NULL;
+    }
+    new_ns = (now_ns() - start) / nlookups;
+    if (hits != nlookups){
+        printf("ttable: %d of %d lookups failed\n", nlookups - hits, nlookups);
+    }
+    ttable_uninit(&tt);
+
+    printf("%8d flows: ttable %7.1f ns/op   khash ttable %7.1f ns/op\n",
+            nflows, new_ns, old_ns);
+
+    for (i = 0; i < nflows; i++){
+        lisp_addr_dealloc(&flows[i].src_addr);
+        lisp_addr_dealloc(&flows[i].dst_addr);
+    }
+    free(flows);
+    free(order);
+}
+
+int
+main(int argc, char **argv)
+{
+    int nlookups = DEF_LOOKUPS;
+
+    if (argc > 1) {
+        nlookups = atoi(argv[1]);
+    }
+    srandom(1);
+
+    bench(10000, nlookups);
+    bench(100000, nlookups);
+    bench(1000000, nlookups);
+
+    return (0);
+}